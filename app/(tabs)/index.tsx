@@ -1,13 +1,17 @@
-import { useMemo } from 'react';
+import { useCallback, useMemo, useState } from 'react';
 import { ActivityIndicator, Alert, FlatList, Pressable, StyleSheet, View } from 'react-native';
 import MaterialIcons from '@expo/vector-icons/MaterialIcons';
 
+import { useFocusEffect } from '@react-navigation/native';
 import { useRouter } from 'expo-router';
 
 import { ThemedText } from '@/components/themed-text';
 import { ThemedView } from '@/components/themed-view';
 import { Colors } from '@/constants/theme';
 import { useColorScheme } from '@/hooks/use-color-scheme';
+import { gitStatusMany } from '@/src/git/nativeGit';
+import type { GitRepoStatusSummary } from '@/src/git/types';
+import { workspaceRepoPath } from '@/src/workspaces/paths';
 import { useWorkspaces } from '@/src/workspaces/provider';
 import type { Workspace } from '@/src/workspaces/types';
 
@@ -19,6 +23,13 @@ function formatDate(ms: number) {
   }
 }
 
+function formatRepoStatus(s: GitRepoStatusSummary | undefined) {
+  if (!s || s.error) return null;
+  const parts = [s.dirty ? '有改动' : '干净'];
+  if (s.ahead != null && s.behind != null && (s.ahead > 0 || s.behind > 0)) parts.push(`↑${s.ahead} ↓${s.behind}`);
+  return parts.join(' · ');
+}
+
 type WorkspaceListItem =
   | { type: 'section'; id: string; title: string }
   | { type: 'workspace'; id: string; workspace: Workspace; isActive: boolean };
@@ -35,6 +46,30 @@ export default function WorkspacesScreen() {
     remove,
   } = useWorkspaces();
 
+  const [repoStatus, setRepoStatus] = useState<Record<string, GitRepoStatusSummary>>({});
+
+  // One native call for every git workspace; the badges are decoration, so failures stay silent.
+  useFocusEffect(
+    useCallback(() => {
+      let cancelled = false;
+      const withGit = workspaces.filter((w) => w.git);
+      if (withGit.length === 0) return;
+      gitStatusMany({ localRepoDirUris: withGit.map((w) => workspaceRepoPath(w.id)) })
+        .then((all) => {
+          if (cancelled) return;
+          const next: Record<string, GitRepoStatusSummary> = {};
+          all.forEach((s, i) => {
+            next[withGit[i].id] = s;
+          });
+          setRepoStatus(next);
+        })
+        .catch(() => {});
+      return () => {
+        cancelled = true;
+      };
+    }, [workspaces])
+  );
+
   const activeLabel = useMemo(() => {
     const active = workspaces.find((w) => w.id === activeWorkspaceId);
     return active ? active.name : '未选择';
@@ -138,6 +173,7 @@ export default function WorkspacesScreen() {
             const isSingle = isFirst && isLast;
 
             const activeBg = colorScheme === 'dark' ? 'rgba(34,211,238,0.16)' : 'rgba(10,126,164,0.12)';
+            const statusLabel = formatRepoStatus(repoStatus[item.workspace.id]);
 
             return (
               <Pressable
@@ -175,6 +211,7 @@ export default function WorkspacesScreen() {
                   </ThemedText>
                   <ThemedText type="default" style={styles.muted} numberOfLines={1}>
                     {formatDate(item.workspace.createdAt)}
+                    {statusLabel ? ` · ${statusLabel}` : ''}
                   </ThemedText>
                 </View>
 
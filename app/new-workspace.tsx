@@ -22,6 +22,7 @@ import { isMcpServerProbablyRunnable } from '@/src/mcp/runnable';
 import { saveAuth } from '@/src/auth/authStore';
 import type { GitHttpsAuth, WebDavStoredAuth } from '@/src/auth/types';
 import { gitClone } from '@/src/git/nativeGit';
+import type { GitProgressEvent } from '@/src/git/types';
 import { workspaceRepoPath } from '@/src/workspaces/paths';
 import type { Workspace } from '@/src/workspaces/types';
 import { createWorkspace, setActiveWorkspace } from '@/src/workspaces/workspaceManager';
@@ -61,6 +62,21 @@ function Segment({
   );
 }
 
+function formatGitProgress(e: GitProgressEvent): string | null {
+  const pct = e.total ? ` ${Math.floor(((e.current ?? 0) / e.total) * 100)}%` : '';
+  const size = e.bytes ? `（${(e.bytes / 1024 / 1024).toFixed(1)} MB）` : '';
+  switch (e.phase) {
+    case 'receiving':
+      return `正在下载${pct}${size}`;
+    case 'resolving':
+      return `正在处理${pct}${size}`;
+    case 'checkout':
+      return `正在检出文件${pct}`;
+    default:
+      return null;
+  }
+}
+
 export default function NewWorkspaceScreen() {
   const router = useRouter();
   const colorScheme = useColorScheme() ?? 'light';
@@ -89,6 +105,7 @@ export default function NewWorkspaceScreen() {
   const [sourceType, setSourceType] = useState<SourceType>('empty');
   const [loading, setLoading] = useState(false);
   const [error, setError] = useState<string | null>(null);
+  const [cloneProgress, setCloneProgress] = useState<string | null>(null);
 
   const [name, setName] = useState('');
   const [mcpDefaultEnabledServerIds, setMcpDefaultEnabledServerIds] = useState<string[]>([]);
@@ -98,6 +115,7 @@ export default function NewWorkspaceScreen() {
   const [gitBranch, setGitBranch] = useState('');
   const [gitToken, setGitToken] = useState('');
   const [gitAllowInsecure, setGitAllowInsecure] = useState(false);
+  const [gitShallow, setGitShallow] = useState(true);
   const [gitUserName, setGitUserName] = useState('');
   const [gitUserEmail, setGitUserEmail] = useState('');
 
@@ -268,6 +286,11 @@ export default function NewWorkspaceScreen() {
             />
           </View>
 
+          <View style={styles.switchRow}>
+            <ThemedText type="defaultSemiBold">仅克隆最新提交（更快、更省流量）</ThemedText>
+            <Switch value={gitShallow} onValueChange={setGitShallow} />
+          </View>
+
           <View style={styles.switchRow}>
             <ThemedText type="defaultSemiBold">跳过证书校验（不安全）</ThemedText>
             <Switch value={gitAllowInsecure} onValueChange={setGitAllowInsecure} />
@@ -435,6 +458,7 @@ export default function NewWorkspaceScreen() {
       </ThemedView>
 
       {error ? <ThemedText style={[styles.error, { color: Colors[colorScheme].danger }]}>{error}</ThemedText> : null}
+      {loading && cloneProgress ? <ThemedText style={styles.muted}>{cloneProgress}</ThemedText> : null}
 
       <Pressable
         accessibilityRole="button"
@@ -443,6 +467,7 @@ export default function NewWorkspaceScreen() {
         onPress={async () => {
           setLoading(true);
           setError(null);
+          setCloneProgress(null);
           try {
             let webdav: Workspace['webdav'] | undefined;
             let git: Workspace['git'] | undefined;
@@ -495,16 +520,26 @@ export default function NewWorkspaceScreen() {
 
             await setActiveWorkspace(ws.id);
             if (git) {
-              await gitClone({
-                workspaceId: ws.id,
-                remoteUrl: git.remoteUrl,
-                localRepoDirUri: workspaceRepoPath(ws.id),
-                branch: git.defaultBranch,
-                authRef: git.authRef,
-                allowInsecure: git.allowInsecure,
-                userName: git.userName,
-                userEmail: git.userEmail,
-              });
+              await gitClone(
+                {
+                  workspaceId: ws.id,
+                  remoteUrl: git.remoteUrl,
+                  localRepoDirUri: workspaceRepoPath(ws.id),
+                  branch: git.defaultBranch,
+                  authRef: git.authRef,
+                  allowInsecure: git.allowInsecure,
+                  userName: git.userName,
+                  userEmail: git.userEmail,
+                  depth: gitShallow ? 1 : undefined,
+                  singleBranch: gitShallow,
+                },
+                {
+                  onProgress: (e) => {
+                    const text = formatGitProgress(e);
+                    if (text) setCloneProgress(text);
+                  },
+                }
+              );
             }
             await refresh();
             router.replace('/(tabs)/sessions');
@@ -325,7 +325,12 @@ export default function SessionDetailScreen() {
 
         if (firstToken === '/diff') {
           try {
-            const patch = await gitDiff({ localRepoDirUri: workspaceRepoPath(active.id), maxBytes: 200_000 });
+            // Agent refactors move files; pair them instead of printing a full delete plus add.
+            const patch = await gitDiff({
+              localRepoDirUri: workspaceRepoPath(active.id),
+              maxBytes: 200_000,
+              renames: {},
+            });
             const content = patch.trim()
               ? patch.length >= 200_000
                 ? `${patch}\n\n（已截断：输出超过 200KB）`
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Archive handling for the Codex runtime (MCP server installs, runtime binaries). Independent of
+// libgit2 and of the git scheduler; callers run it on their own threads.
+
+struct ArchiveError : public std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+struct TarExtractOptions {
+  std::string archivePath;
+  // Read the archive from this descriptor (a pipe or socket fed from the network) instead of
+  // `archivePath`. Not closed.
+  int fd = -1;
+  std::string destDir;
+  // Lowercase hex SHA-256 of the compressed archive; empty skips the check. The archive is hashed
+  // on a second thread while it is being extracted, so verification adds no wall time. On a
+  // mismatch the call throws after extracting: point `destDir` at a scratch directory. Only
+  // supported with `archivePath`.
+  std::string sha256;
+};
+
+struct TarExtractStats {
+  uint64_t files = 0;
+  uint64_t directories = 0;
+  uint64_t links = 0;
+  uint64_t bytes = 0;
+};
+
+// Extracts a gzip-compressed tar (ustar, GNU long names, pax path/linkpath/size) into `destDir`,
+// creating it if needed. Data is inflated straight into large aligned buffers and written to the
+// destination with write(2), each file preallocated to its final size. Entries that would land
+// outside `destDir` (absolute or `..` paths, paths through symlinks, links pointing out) are
+// skipped. Symlinks whose target contains `..` are made after every other entry and only if the
+// target, resolved through the extracted tree, stays inside. Regular files get 0755 if any execute bit is set in the archive, else 0644.
+// Throws ArchiveError.
+TarExtractStats tar_gz_extract(const TarExtractOptions &opts);
+
+struct TarPackOptions {
+  std::string rootDir;
+  // Files to pack, relative to rootDir (e.g. the changed files of a tree manifest). Empty packs the
+  // whole tree, skipping entries named in `excludeNames` at any depth.
+  std::vector<std::string> paths;
+  std::vector<std::string> excludeNames;
+  // Receives the .tar.gz as it is produced; a pipe or socket is fine, nothing seeks. Not closed.
+  int outFd = -1;
+  int level = 6;
+  // Compression threads (0 = one per core, at most 4).
+  unsigned threads = 0;
+};
+
+struct TarPackStats {
+  uint64_t files = 0;
+  uint64_t directories = 0;
+  uint64_t links = 0;
+  uint64_t bytes = 0;  // file contents before compression
+  uint64_t written = 0;  // compressed bytes
+};
+
+// Streams `rootDir` as a gzip-compressed tar. The tar stream is cut into 1 MiB chunks that are
+// deflated on several threads as independent gzip members and written in order (the pigz layout;
+// any gunzip, and tar_gz_extract(), reads the concatenation as one stream), so memory stays at a
+// few chunks per thread and no temporary archive is written. Regular files, directories and
+// symlinks are stored (names over 100 bytes as GNU long names); file modes are reduced to
+// 0755/0644. Throws ArchiveError.
+TarPackStats tar_gz_pack(const TarPackOptions &opts);
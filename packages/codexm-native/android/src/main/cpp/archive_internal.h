@@ -0,0 +1,55 @@
+#pragma once
+
+// Helpers shared by the archive translation units. Not part of the API in archive.h.
+
+#include "archive.h"
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+// Throws ArchiveError with `what` and strerror(errno).
+[[noreturn]] void fail_errno(const std::string &what);
+
+class Fd {
+ public:
+  Fd() = default;
+  explicit Fd(int fd) : fd_(fd) {}
+  ~Fd() { reset(); }
+  Fd(const Fd &) = delete;
+  Fd &operator=(const Fd &) = delete;
+  Fd(Fd &&o) noexcept : fd_(o.fd_) { o.fd_ = -1; }
+  Fd &operator=(Fd &&o) noexcept {
+    if (this != &o) {
+      reset();
+      fd_ = o.fd_;
+      o.fd_ = -1;
+    }
+    return *this;
+  }
+
+  int get() const { return fd_; }
+  void reset() {
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+  }
+
+ private:
+  int fd_ = -1;
+};
+
+struct FreeDeleter {
+  void operator()(uint8_t *p) const { std::free(p); }
+};
+using AlignedBuffer = std::unique_ptr<uint8_t, FreeDeleter>;
+
+// Page-aligned, so reads and writes from it can take the kernel's fast paths.
+AlignedBuffer aligned_buffer(size_t size);
+
+// Writes all of [p, p + n), retrying short writes and EINTR. On a socket it uses MSG_NOSIGNAL, so
+// a peer that went away is an error rather than a SIGPIPE. `path` names the target in errors.
+void write_all(int fd, const uint8_t *p, size_t n, const std::string &path);
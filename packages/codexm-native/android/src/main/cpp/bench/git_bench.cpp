@@ -0,0 +1,365 @@
+// Host benchmark for the native git layer (no JNI). Builds a synthetic repository, then times the
+// same entry points the app calls and prints one JSON document on stdout (a table goes to stderr):
+//
+//   codexm_git_bench [--files N] [--commits N] [--dirty N] [--untracked N] [--binaries N]
+//                    [--binary-mb N] [--iterations N] [--clone-iterations N] [--ops a,b,...]
+//                    [--workdir DIR] [--keep]
+//
+// Ops: status, status_cold, diff, checkout, clone. Generation is deterministic (fixed seed), so
+// runs with the same parameters are comparable across libgit2 bumps: diff the JSON of two builds.
+
+#include "git_internal.h"
+#include "git_ops.h"
+#include "repo_cache.h"
+
+#include <git2.h>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+struct Params {
+  int files = 5000;
+  int commits = 50;
+  int dirty = 200;
+  int untracked = 100;
+  int binaries = 4;
+  int binaryMb = 8;
+  int iterations = 20;
+  int cloneIterations = 5;
+  std::string ops = "status,status_cold,diff,checkout,clone";
+  std::string workdir;
+  bool keep = false;
+};
+
+struct Result {
+  std::string op;
+  std::vector<double> samplesMs;
+  int64_t peakRssKb = 0;
+};
+
+[[noreturn]] void die(const std::string &msg) {
+  std::fprintf(stderr, "codexm_git_bench: %s\n", msg.c_str());
+  std::exit(1);
+}
+
+void check(int rc, const char *what) {
+  if (rc != 0) die(std::string(what) + ": " + last_error_message(rc));
+}
+
+// xorshift64*: stable across platforms and standard libraries, unlike <random> distributions.
+struct Rng {
+  uint64_t s;
+  explicit Rng(uint64_t seed) : s(seed ? seed : 1) {}
+  uint64_t next() {
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return s * 2685821657736338717ULL;
+  }
+};
+
+void mkdirs(const std::string &path) {
+  for (size_t i = 1; i <= path.size(); i++) {
+    if (i == path.size() || path[i] == '/') mkdir(path.substr(0, i).c_str(), 0755);
+  }
+}
+
+void write_file(const std::string &path, const std::string &data) {
+  const size_t slash = path.rfind('/');
+  if (slash != std::string::npos) mkdirs(path.substr(0, slash));
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(data.data(), static_cast<std::streamsize>(data.size()));
+  if (!out) die("cannot write " + path);
+}
+
+// ~40 lines of source-like text; `generation` changes a few of them.
+std::string text_content(Rng &rng, int file, int generation) {
+  std::ostringstream out;
+  const int lines = 20 + static_cast<int>(rng.next() % 40);
+  for (int l = 0; l < lines; l++) {
+    out << "line " << l << " of file " << file;
+    if (l % 7 == generation % 7) out << " rev " << generation;
+    out << " " << (rng.next() % 100000) << "\n";
+  }
+  return out.str();
+}
+
+std::string binary_content(Rng &rng, size_t bytes) {
+  std::string data(bytes, '\0');
+  for (size_t i = 0; i + 8 <= bytes; i += 8) {
+    const uint64_t v = rng.next();
+    std::memcpy(&data[i], &v, 8);
+  }
+  return data;
+}
+
+std::string rel_path(int file) {
+  char buf[64];
+  std::snprintf(buf, sizeof buf, "src/d%02d/m%03d/f%05d.txt", file % 50, (file / 50) % 20, file);
+  return buf;
+}
+
+void commit_index(git_repository *repo, git_index *index, const char *message) {
+  git_oid tree_id, commit_id, parent_id;
+  check(git_index_write(index), "index write");
+  check(git_index_write_tree(&tree_id, index), "write tree");
+  git_tree *tree = nullptr;
+  check(git_tree_lookup(&tree, repo, &tree_id), "tree lookup");
+
+  git_commit *parent = nullptr;
+  if (git_reference_name_to_id(&parent_id, repo, "HEAD") == 0) check(git_commit_lookup(&parent, repo, &parent_id), "parent");
+  git_signature *sig = nullptr;
+  check(git_signature_new(&sig, "bench", "bench@localhost", 1700000000, 0), "signature");
+  const git_commit *parents[] = {parent};
+  check(git_commit_create(&commit_id, repo, "HEAD", sig, sig, nullptr, message, tree, parent ? 1 : 0, parents), "commit");
+  git_signature_free(sig);
+  if (parent) git_commit_free(parent);
+  git_tree_free(tree);
+}
+
+// Work tree at `dir` with `commits` commits, a "bench-alt" branch halfway back, then dirty,
+// untracked and large binary files on top.
+void generate(const Params &p, const std::string &dir) {
+  Rng rng(0xC0DE);
+  git_repository *repo = nullptr;
+  git_repository_init_options init = GIT_REPOSITORY_INIT_OPTIONS_INIT;
+  init.flags = GIT_REPOSITORY_INIT_MKPATH;
+  init.initial_head = "main";
+  check(git_repository_init_ext(&repo, dir.c_str(), &init), "init");
+  git_index *index = nullptr;
+  check(git_repository_index(&index, repo), "index");
+
+  for (int f = 0; f < p.files; f++) {
+    write_file(dir + "/" + rel_path(f), text_content(rng, f, 0));
+    check(git_index_add_bypath(index, rel_path(f).c_str()), "add");
+  }
+  for (int b = 0; b < p.binaries; b++) {
+    const std::string rel = "assets/blob" + std::to_string(b) + ".bin";
+    write_file(dir + "/" + rel, binary_content(rng, static_cast<size_t>(p.binaryMb) * 1024 * 1024));
+    check(git_index_add_bypath(index, rel.c_str()), "add");
+  }
+  commit_index(repo, index, "initial");
+
+  const int perCommit = std::max(1, p.files / 20);
+  for (int c = 1; c < p.commits; c++) {
+    for (int i = 0; i < perCommit; i++) {
+      const int f = static_cast<int>(rng.next() % static_cast<uint64_t>(p.files));
+      write_file(dir + "/" + rel_path(f), text_content(rng, f, c));
+      check(git_index_add_bypath(index, rel_path(f).c_str()), "add");
+    }
+    commit_index(repo, index, ("commit " + std::to_string(c)).c_str());
+    if (c == p.commits / 2) {
+      git_oid head;
+      git_reference *ref = nullptr;
+      check(git_reference_name_to_id(&head, repo, "HEAD"), "head");
+      check(git_reference_create(&ref, repo, "refs/heads/bench-alt", &head, 1, nullptr), "branch");
+      git_reference_free(ref);
+    }
+  }
+  if (p.commits < 2) {
+    git_oid head;
+    git_reference *ref = nullptr;
+    check(git_reference_name_to_id(&head, repo, "HEAD"), "head");
+    check(git_reference_create(&ref, repo, "refs/heads/bench-alt", &head, 1, nullptr), "branch");
+    git_reference_free(ref);
+  }
+
+  for (int i = 0; i < p.dirty && p.files > 0; i++) {
+    const int f = static_cast<int>((static_cast<int64_t>(i) * 7919) % p.files);
+    write_file(dir + "/" + rel_path(f), text_content(rng, f, 1000 + i));
+  }
+  for (int i = 0; i < p.untracked; i++) {
+    write_file(dir + "/untracked/u" + std::to_string(i % 10) + "/n" + std::to_string(i) + ".txt", text_content(rng, i, 0));
+  }
+
+  git_index_free(index);
+  git_repository_free(repo);
+}
+
+// Linux: writing 5 to clear_refs resets VmHWM, so each op reports its own peak.
+void reset_peak_rss() {
+  std::ofstream f("/proc/self/clear_refs");
+  f << "5";
+}
+
+int64_t peak_rss_kb() {
+  std::ifstream f("/proc/self/status");
+  std::string line;
+  while (std::getline(f, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) return std::strtoll(line.c_str() + 6, nullptr, 10);
+  }
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_maxrss;
+}
+
+void remove_tree(const std::string &path) {
+  const std::string cmd = "rm -rf '" + path + "'";
+  if (std::system(cmd.c_str()) != 0) std::fprintf(stderr, "codexm_git_bench: could not remove %s\n", path.c_str());
+}
+
+Result measure(const std::string &op, int iterations, const std::function<void(int)> &setup,
+               const std::function<void(int)> &body) {
+  Result r;
+  r.op = op;
+  reset_peak_rss();
+  for (int i = 0; i < iterations; i++) {
+    if (setup) setup(i);
+    const auto t0 = std::chrono::steady_clock::now();
+    body(i);
+    const auto t1 = std::chrono::steady_clock::now();
+    r.samplesMs.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+  }
+  r.peakRssKb = peak_rss_kb();
+  return r;
+}
+
+// Nearest-rank percentile.
+double percentile(std::vector<double> v, double q) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  size_t rank = static_cast<size_t>(q * static_cast<double>(v.size()) + 0.999999);
+  rank = std::min(std::max<size_t>(rank, 1), v.size());
+  return v[rank - 1];
+}
+
+bool wants(const Params &p, const std::string &op) {
+  std::stringstream ss(p.ops);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (item == op) return true;
+  }
+  return false;
+}
+
+Params parse_args(int argc, char **argv) {
+  Params p;
+  for (int i = 1; i < argc; i++) {
+    const std::string a = argv[i];
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc) die("missing value for " + a);
+      return argv[++i];
+    };
+    if (a == "--files") p.files = std::atoi(value().c_str());
+    else if (a == "--commits") p.commits = std::atoi(value().c_str());
+    else if (a == "--dirty") p.dirty = std::atoi(value().c_str());
+    else if (a == "--untracked") p.untracked = std::atoi(value().c_str());
+    else if (a == "--binaries") p.binaries = std::atoi(value().c_str());
+    else if (a == "--binary-mb") p.binaryMb = std::atoi(value().c_str());
+    else if (a == "--iterations") p.iterations = std::atoi(value().c_str());
+    else if (a == "--clone-iterations") p.cloneIterations = std::atoi(value().c_str());
+    else if (a == "--ops") p.ops = value();
+    else if (a == "--workdir") p.workdir = value();
+    else if (a == "--keep") p.keep = true;
+    else die("unknown option " + a);
+  }
+  if (p.files < 1 || p.commits < 1 || p.iterations < 1) die("--files, --commits and --iterations must be >= 1");
+  return p;
+}
+
+void print_json(const Params &p, const std::vector<Result> &results, double generateMs) {
+  int major = 0, minor = 0, rev = 0;
+  git_libgit2_version(&major, &minor, &rev);
+  std::printf("{\n  \"schema\": 1,\n  \"libgit2\": \"%d.%d.%d\",\n", major, minor, rev);
+  std::printf("  \"params\": {\"files\": %d, \"commits\": %d, \"dirty\": %d, \"untracked\": %d, "
+              "\"binaries\": %d, \"binaryMb\": %d, \"iterations\": %d, \"cloneIterations\": %d},\n",
+              p.files, p.commits, p.dirty, p.untracked, p.binaries, p.binaryMb, p.iterations, p.cloneIterations);
+  std::printf("  \"generateMs\": %.3f,\n  \"results\": [\n", generateMs);
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    double sum = 0;
+    for (double s : r.samplesMs) sum += s;
+    std::printf("    {\"op\": \"%s\", \"iterations\": %zu, \"p50Ms\": %.3f, \"p99Ms\": %.3f, \"minMs\": %.3f, "
+                "\"maxMs\": %.3f, \"meanMs\": %.3f, \"peakRssKb\": %lld}%s\n",
+                r.op.c_str(), r.samplesMs.size(), percentile(r.samplesMs, 0.5), percentile(r.samplesMs, 0.99),
+                percentile(r.samplesMs, 0), percentile(r.samplesMs, 1), sum / static_cast<double>(r.samplesMs.size()),
+                static_cast<long long>(r.peakRssKb), i + 1 < results.size() ? "," : "");
+  }
+  std::printf("  ]\n}\n");
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  Params p = parse_args(argc, argv);
+  ensure_libgit2();
+
+  std::string root = p.workdir;
+  if (root.empty()) {
+    char tmpl[] = "/tmp/codexm-bench-XXXXXX";
+    if (!mkdtemp(tmpl)) die("mkdtemp failed");
+    root = tmpl;
+  }
+  const std::string src = root + "/src";
+  const std::string co = root + "/checkout";
+
+  const auto g0 = std::chrono::steady_clock::now();
+  generate(p, src);
+  const double generateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - g0).count();
+
+  std::vector<Result> results;
+  try {
+    if (wants(p, "status")) {
+      git_status(src);  // warm the handle cache, as the app does after the first call
+      results.push_back(measure("status", p.iterations, nullptr, [&](int) { git_status(src); }));
+    }
+    if (wants(p, "status_cold")) {
+      results.push_back(measure("status_cold", p.iterations, [&](int) { invalidate_repo(src); },
+                                [&](int) { git_status(src); }));
+    }
+    if (wants(p, "diff")) {
+      git_diff_unified(src, 0);
+      results.push_back(measure("diff", p.iterations, nullptr, [&](int) { git_diff_unified(src, 0); }));
+    }
+    if (wants(p, "checkout") || wants(p, "clone")) {
+      GitCloneOptions opts;
+      opts.remoteUrl = "file://" + src;
+      opts.localPath = co;
+      git_clone_repo(opts);
+    }
+    if (wants(p, "checkout")) {
+      // Alternates between two commits half the history apart; the work tree is clean.
+      results.push_back(measure("checkout", p.iterations, nullptr, [&](int i) {
+        GitCheckoutOptions opts;
+        opts.localPath = co;
+        opts.ref = i % 2 == 0 ? "bench-alt" : "main";
+        git_checkout_ref(opts);
+      }));
+    }
+    if (wants(p, "clone")) {
+      const std::string dest = root + "/clone";
+      results.push_back(measure("clone", p.cloneIterations, [&](int) { remove_tree(dest); }, [&](int) {
+        GitCloneOptions opts;
+        opts.remoteUrl = "file://" + src;
+        opts.localPath = dest;
+        git_clone_repo(opts);
+        git_release_repo(dest);
+      }));
+    }
+  } catch (const GitException &e) {
+    die(e.what());
+  }
+
+  for (const auto &r : results) {
+    std::fprintf(stderr, "%-12s p50 %9.2f ms  p99 %9.2f ms  peak %8lld KiB\n", r.op.c_str(),
+                 percentile(r.samplesMs, 0.5), percentile(r.samplesMs, 0.99), static_cast<long long>(r.peakRssKb));
+  }
+  print_json(p, results, generateMs);
+
+  clear_repo_cache();
+  if (!p.keep) remove_tree(root);
+  return 0;
+}
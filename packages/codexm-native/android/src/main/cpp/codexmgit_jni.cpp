@@ -1,22 +1,271 @@
 #include <jni.h>
 
+#include "archive.h"
 #include "git_ops.h"
+#include "repo_cache.h"
+#include "scheduler.h"
+#include "trace.h"
 
+#include <memory>
 #include <string>
+#include <vector>
 
+namespace {
+// Resolved once in JNI_OnLoad; FindClass/GetMethodID per call showed up in profiles of large trees.
+struct JniCache {
+  jclass runtimeException = nullptr;
+  jmethodID runtimeExceptionInit = nullptr;
+  jclass cancellationException = nullptr;
+  jmethodID diffSinkOnChunk = nullptr;
+  jmethodID searchSinkOnBatch = nullptr;
+  jmethodID progressSinkOnProgress = nullptr;
+  jmethodID gitTaskRun = nullptr;
+  jmethodID gitTaskComplete = nullptr;
+  jmethodID statusManySinkOnComplete = nullptr;
+};
+JniCache g_jni;
+JavaVM *g_vm = nullptr;
+
+jclass global_class(JNIEnv *env, const char *name) {
+  jclass local = env->FindClass(name);
+  if (!local) return nullptr;
+  auto global = static_cast<jclass>(env->NewGlobalRef(local));
+  env->DeleteLocalRef(local);
+  return global;
+}
+}  // namespace
+
+extern "C" JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void * /*reserved*/) {
+  JNIEnv *env = nullptr;
+  if (vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK) return JNI_ERR;
+  g_vm = vm;
+
+  g_jni.runtimeException = global_class(env, "java/lang/RuntimeException");
+  g_jni.cancellationException = global_class(env, "java/util/concurrent/CancellationException");
+  if (!g_jni.runtimeException || !g_jni.cancellationException) return JNI_ERR;
+  g_jni.runtimeExceptionInit = env->GetMethodID(g_jni.runtimeException, "<init>", "(Ljava/lang/String;)V");
+
+  jclass sink = env->FindClass("com/codexm/nativemodules/CodexMGitModule$DiffChunkSink");
+  if (!sink) return JNI_ERR;
+  g_jni.diffSinkOnChunk = env->GetMethodID(sink, "onChunk", "(I[BZ[B)Z");
+  env->DeleteLocalRef(sink);
+
+  jclass search = env->FindClass("com/codexm/nativemodules/CodexMGitModule$SearchSink");
+  if (!search) return JNI_ERR;
+  g_jni.searchSinkOnBatch = env->GetMethodID(search, "onBatch", "([B)Z");
+  env->DeleteLocalRef(search);
+
+  jclass progress = env->FindClass("com/codexm/nativemodules/CodexMGitModule$ProgressSink");
+  if (!progress) return JNI_ERR;
+  g_jni.progressSinkOnProgress = env->GetMethodID(progress, "onProgress", "(Ljava/lang/String;JJJ[B)V");
+  env->DeleteLocalRef(progress);
+
+  jclass task = env->FindClass("com/codexm/nativemodules/CodexMGitModule$GitTask");
+  if (!task) return JNI_ERR;
+  g_jni.gitTaskRun = env->GetMethodID(task, "run", "()Ljava/lang/Object;");
+  g_jni.gitTaskComplete = env->GetMethodID(task, "complete", "(Ljava/lang/Object;Ljava/lang/Throwable;)V");
+  env->DeleteLocalRef(task);
+
+  jclass statusMany = env->FindClass("com/codexm/nativemodules/CodexMGitModule$StatusManySink");
+  if (!statusMany) return JNI_ERR;
+  g_jni.statusManySinkOnComplete = env->GetMethodID(statusMany, "onComplete", "([B)V");
+  env->DeleteLocalRef(statusMany);
+
+  if (!g_jni.runtimeExceptionInit || !g_jni.diffSinkOnChunk || !g_jni.searchSinkOnBatch || !g_jni.progressSinkOnProgress || !g_jni.gitTaskRun ||
+      !g_jni.gitTaskComplete || !g_jni.statusManySinkOnComplete) {
+    return JNI_ERR;
+  }
+
+  return JNI_VERSION_1_6;
+}
+
+// Standard UTF-8, not the modified UTF-8 of GetStringUTFChars (which splits characters outside the
+// BMP into surrogate halves): what Java hands us has to match what strings_to_packed() hands back
+// and decodeStrings() reads. Unpaired surrogates become U+FFFD.
 static std::string jstring_to_string(JNIEnv *env, jstring s) {
   if (!s) return "";
-  const char *chars = env->GetStringUTFChars(s, nullptr);
-  std::string out(chars ? chars : "");
-  if (chars) env->ReleaseStringUTFChars(s, chars);
+  const jsize n = env->GetStringLength(s);
+  std::vector<jchar> units(static_cast<size_t>(n));
+  if (n > 0) env->GetStringRegion(s, 0, n, units.data());
+  std::string out;
+  out.reserve(static_cast<size_t>(n));
+  for (jsize i = 0; i < n; i++) {
+    uint32_t cp = units[i];
+    if (cp >= 0xd800 && cp < 0xdc00 && i + 1 < n && units[i + 1] >= 0xdc00 && units[i + 1] < 0xe000) {
+      cp = 0x10000 + ((cp - 0xd800) << 10) + (units[++i] - 0xdc00);
+    } else if (cp >= 0xd800 && cp < 0xe000) {
+      cp = 0xfffd;
+    }
+    if (cp < 0x80) {
+      out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+      out.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    } else if (cp < 0x10000) {
+      out.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    } else {
+      out.push_back(static_cast<char>(0xf0 | (cp >> 18)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    }
+  }
   return out;
 }
 
 static void throw_java_runtime(JNIEnv *env, const std::string &msg) {
-  jclass exClass = env->FindClass("java/lang/RuntimeException");
-  if (exClass) env->ThrowNew(exClass, msg.c_str());
+  env->ThrowNew(g_jni.runtimeException, msg.c_str());
+}
+
+static void throw_java_cancelled(JNIEnv *env, const std::string &msg) {
+  env->ThrowNew(g_jni.cancellationException, msg.c_str());
+}
+
+// Runs an entry point's body and maps what it throws to a Java exception: a C++ exception unwinding
+// through the JNI frame terminates the process. GitCancelled becomes a CancellationException,
+// anything else a RuntimeException; an exception already pending in Java (thrown by a sink) is
+// left to propagate. Returns a null / zero result after a throw.
+template <typename F>
+static auto guarded(JNIEnv *env, F &&body) -> decltype(body()) {
+  try {
+    return body();
+  } catch (const GitCancelled &e) {
+    if (!env->ExceptionCheck()) throw_java_cancelled(env, e.what());
+  } catch (const std::exception &e) {
+    if (!env->ExceptionCheck()) throw_java_runtime(env, e.what());
+  } catch (...) {
+    if (!env->ExceptionCheck()) throw_java_runtime(env, "Unknown native error");
+  }
+  return decltype(body())();
+}
+
+static jbyteArray bytes_to_jarray(JNIEnv *env, const char *data, size_t size) {
+  jbyteArray arr = env->NewByteArray(static_cast<jsize>(size));
+  if (arr && size > 0) env->SetByteArrayRegion(arr, 0, static_cast<jsize>(size), reinterpret_cast<const jbyte *>(data));
+  return arr;
+}
+
+// Progress is forwarded to the Kotlin sink on the calling thread. It is best-effort: an exception
+// thrown by the sink is cleared so libgit2 keeps running.
+static void fill_hooks(JNIEnv *env, GitOperationHooks &hooks, jstring operationId, jobject sink) {
+  hooks.operationId = jstring_to_string(env, operationId);
+  if (!sink) return;
+  hooks.onProgress = [env, sink](const GitProgress &p) {
+    jstring phase = env->NewStringUTF(p.phase.c_str());
+    jbyteArray message = p.message.empty() ? nullptr : bytes_to_jarray(env, p.message.data(), p.message.size());
+    env->CallVoidMethod(sink, g_jni.progressSinkOnProgress, phase, static_cast<jlong>(p.current),
+                        static_cast<jlong>(p.total), static_cast<jlong>(p.bytes), message);
+    if (env->ExceptionCheck()) env->ExceptionClear();
+    env->DeleteLocalRef(phase);
+    if (message) env->DeleteLocalRef(message);
+  };
 }
 
+// From CodexMGitModule.renameArgsOf(): a threshold of 0 leaves rename detection off.
+static GitRenameOptions rename_options(jint threshold, jint limit, jboolean copies) {
+  GitRenameOptions o;
+  o.enabled = threshold > 0;
+  if (o.enabled) o.threshold = static_cast<uint16_t>(threshold > 100 ? 100 : threshold);
+  if (limit > 0) o.renameLimit = static_cast<uint32_t>(limit);
+  o.copies = copies == JNI_TRUE;
+  return o;
+}
+
+// Decoded by CodexMGitModule.decodeStatus().
+static jbyteArray status_to_packed(JNIEnv *env, const GitStatus &st) {
+  const std::string buf = git_status_packed(st);
+  return bytes_to_jarray(env, buf.data(), buf.size());
+}
+
+static std::vector<std::string> jstring_array_to_vector(JNIEnv *env, jobjectArray arr) {
+  std::vector<std::string> out;
+  if (!arr) return out;
+  const jsize n = env->GetArrayLength(arr);
+  out.reserve(static_cast<size_t>(n));
+  for (jsize i = 0; i < n; i++) {
+    auto js = static_cast<jstring>(env->GetObjectArrayElement(arr, i));
+    out.push_back(jstring_to_string(env, js));
+    if (js) env->DeleteLocalRef(js);
+  }
+  return out;
+}
+
+// Scheduler workers are native threads; they attach to the VM on first use and stay attached (as
+// daemons) for the life of the process.
+static JNIEnv *worker_env() {
+  JNIEnv *env = nullptr;
+  if (g_vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) == JNI_OK) return env;
+  if (g_vm->AttachCurrentThreadAsDaemon(&env, nullptr) != JNI_OK) return nullptr;
+  return env;
+}
+
+namespace {
+// A CodexMGitModule.GitTask queued on the native scheduler. run() executes on a worker thread and
+// its result (or thrown exception) is handed to complete() of this task and of every task that
+// was coalesced into it.
+class JavaGitJob : public GitJob {
+ public:
+  JavaGitJob(JNIEnv *env, jobject task) : task_(env->NewGlobalRef(task)) {}
+
+  ~JavaGitJob() override {
+    JNIEnv *env = worker_env();
+    if (!env) return;
+    if (task_) env->DeleteGlobalRef(task_);
+    if (result_) env->DeleteGlobalRef(result_);
+    if (error_) env->DeleteGlobalRef(error_);
+  }
+
+  void run() override {
+    JNIEnv *env = worker_env();
+    if (!env) return;
+    jobject result = env->CallObjectMethod(task_, g_jni.gitTaskRun);
+    if (env->ExceptionCheck()) {
+      jthrowable error = env->ExceptionOccurred();
+      env->ExceptionClear();
+      error_ = env->NewGlobalRef(error);
+      env->DeleteLocalRef(error);
+    } else if (result) {
+      result_ = env->NewGlobalRef(result);
+    }
+    if (result) env->DeleteLocalRef(result);
+    complete(env, result_, error_);
+  }
+
+  void complete_from(GitJob &primary) override {
+    JNIEnv *env = worker_env();
+    if (!env) return;
+    auto &p = static_cast<JavaGitJob &>(primary);
+    complete(env, p.result_, p.error_);
+  }
+
+  void fail(const char *message) override {
+    JNIEnv *env = worker_env();
+    if (!env || settled_) return;
+    jstring msg = env->NewStringUTF(message);
+    jobject error = msg ? env->NewObject(g_jni.runtimeException, g_jni.runtimeExceptionInit, msg) : nullptr;
+    if (env->ExceptionCheck()) env->ExceptionClear();
+    complete(env, nullptr, error);
+    if (error) env->DeleteLocalRef(error);
+    if (msg) env->DeleteLocalRef(msg);
+  }
+
+ private:
+  void complete(JNIEnv *env, jobject result, jobject error) {
+    settled_ = true;
+    env->CallVoidMethod(task_, g_jni.gitTaskComplete, result, error);
+    // complete() settles a promise; nothing useful can be done with a failure here.
+    if (env->ExceptionCheck()) env->ExceptionClear();
+  }
+
+  jobject task_ = nullptr;
+  jobject result_ = nullptr;
+  jobject error_ = nullptr;
+  bool settled_ = false;
+};
+}  // namespace
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_codexm_nativemodules_CodexMGitModule_nativeClone(JNIEnv *env,
                                                    jobject /*thiz*/,
@@ -27,39 +276,90 @@ Java_com_codexm_nativemodules_CodexMGitModule_nativeClone(JNIEnv *env,
                                                    jstring token,
                                                    jstring userName,
                                                    jstring userEmail,
-                                                   jboolean allowInsecure) {
-  try {
+                                                   jboolean allowInsecure,
+                                                   jint depth,
+                                                   jboolean singleBranch,
+                                                   jobjectArray sparsePaths,
+                                                   jstring operationId,
+                                                   jobject progress) {
+  guarded(env, [&] {
     GitCloneOptions opts;
     opts.remoteUrl = jstring_to_string(env, remoteUrl);
     opts.localPath = jstring_to_string(env, localPath);
+    TraceSpan span("clone", opts.localPath);
     opts.branch = jstring_to_string(env, branch);
     opts.username = jstring_to_string(env, username);
     opts.token = jstring_to_string(env, token);
     opts.userName = jstring_to_string(env, userName);
     opts.userEmail = jstring_to_string(env, userEmail);
     opts.allowInsecure = allowInsecure == JNI_TRUE;
+    opts.depth = depth;
+    opts.singleBranch = singleBranch == JNI_TRUE;
+    opts.sparsePaths = jstring_array_to_vector(env, sparsePaths);
+    fill_hooks(env, opts.hooks, operationId, progress);
     git_clone_repo(opts);
-  } catch (const GitException &e) {
-    throw_java_runtime(env, e.what());
+  });
+}
+
+// For lists holding repository bytes (names, messages, paths), which are not necessarily modified
+// UTF-8 and so can't go through NewStringUTF: u32 count, then per item u32 length + bytes (all LE).
+// Decoded by CodexMGitModule.decodeStrings().
+static jbyteArray strings_to_packed(JNIEnv *env, const std::vector<std::string> &items) {
+  size_t size = 4;
+  for (const auto &s : items) size += 4 + s.size();
+  std::string buf;
+  buf.reserve(size);
+  auto put_u32 = [&buf](uint32_t v) {
+    for (int i = 0; i < 4; i++) buf.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+  };
+  put_u32(static_cast<uint32_t>(items.size()));
+  for (const auto &s : items) {
+    put_u32(static_cast<uint32_t>(s.size()));
+    buf.append(s);
   }
+  return bytes_to_jarray(env, buf.data(), buf.size());
+}
+
+// Packed by strings_to_packed(): prefixes are repository paths.
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeGetSparsePaths(JNIEnv *env,
+                                                            jobject /*thiz*/,
+                                                            jstring localPath) {
+  return guarded(env, [&]() -> jbyteArray {
+    return strings_to_packed(env, git_get_sparse_paths(jstring_to_string(env, localPath)));
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeSetSparsePaths(JNIEnv *env,
+                                                            jobject /*thiz*/,
+                                                            jstring localPath,
+                                                            jobjectArray paths) {
+  guarded(env, [&] {
+    git_set_sparse_paths(jstring_to_string(env, localPath), jstring_array_to_vector(env, paths));
+  });
 }
 
 extern "C" JNIEXPORT void JNICALL
 Java_com_codexm_nativemodules_CodexMGitModule_nativeCheckout(JNIEnv *env,
                                                       jobject /*thiz*/,
                                                       jstring localPath,
-                                                      jstring ref) {
-  try {
+                                                      jstring ref,
+                                                      jstring operationId,
+                                                      jobject progress) {
+  guarded(env, [&] {
     GitCheckoutOptions opts;
     opts.localPath = jstring_to_string(env, localPath);
+    TraceSpan span("checkout", opts.localPath);
     opts.ref = jstring_to_string(env, ref);
+    fill_hooks(env, opts.hooks, operationId, progress);
     git_checkout_ref(opts);
-  } catch (const GitException &e) {
-    throw_java_runtime(env, e.what());
-  }
+  });
 }
 
-extern "C" JNIEXPORT void JNICALL
+// Returns [outcome (GitPullOutcome), head, then path, ancestor, ours, theirs per conflict], packed by
+// strings_to_packed().
+extern "C" JNIEXPORT jbyteArray JNICALL
 Java_com_codexm_nativemodules_CodexMGitModule_nativePull(JNIEnv *env,
                                                   jobject /*thiz*/,
                                                   jstring localPath,
@@ -67,19 +367,63 @@ Java_com_codexm_nativemodules_CodexMGitModule_nativePull(JNIEnv *env,
                                                   jstring branch,
                                                   jstring username,
                                                   jstring token,
-                                                  jboolean allowInsecure) {
-  try {
+                                                  jboolean allowInsecure,
+                                                  jint depth,
+                                                  jboolean unshallow,
+                                                  jint strategy,
+                                                  jstring operationId,
+                                                  jobject progress) {
+  return guarded(env, [&]() -> jbyteArray {
     GitPullOptions opts;
     opts.localPath = jstring_to_string(env, localPath);
+    TraceSpan span("pull", opts.localPath);
     opts.remote = jstring_to_string(env, remote);
     opts.branch = jstring_to_string(env, branch);
     opts.username = jstring_to_string(env, username);
     opts.token = jstring_to_string(env, token);
     opts.allowInsecure = allowInsecure == JNI_TRUE;
-    git_pull_ff_only(opts);
-  } catch (const GitException &e) {
-    throw_java_runtime(env, e.what());
-  }
+    opts.depth = depth;
+    opts.unshallow = unshallow == JNI_TRUE;
+    opts.strategy = strategy == static_cast<jint>(GitPullStrategy::Rebase)  ? GitPullStrategy::Rebase
+                    : strategy == static_cast<jint>(GitPullStrategy::Merge) ? GitPullStrategy::Merge
+                                                                            : GitPullStrategy::FastForwardOnly;
+    fill_hooks(env, opts.hooks, operationId, progress);
+    const GitPullResult res = git_pull(opts);
+    span.phase("marshal");
+    span.count("conflicts", static_cast<int64_t>(res.conflicts.size()));
+
+    std::vector<std::string> flat;
+    flat.reserve(2 + res.conflicts.size() * 4);
+    flat.push_back(std::to_string(static_cast<int>(res.outcome)));
+    flat.push_back(res.head);
+    for (const auto &c : res.conflicts) {
+      flat.push_back(c.path);
+      flat.push_back(c.ancestorOid);
+      flat.push_back(c.oursOid);
+      flat.push_back(c.theirsOid);
+    }
+    return strings_to_packed(env, flat);
+  });
+}
+
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeCommit(JNIEnv *env,
+                                                    jobject /*thiz*/,
+                                                    jstring localPath,
+                                                    jstring message,
+                                                    jobjectArray paths,
+                                                    jboolean stage,
+                                                    jboolean allowEmpty) {
+  return guarded(env, [&]() -> jstring {
+    GitCommitOptions opts;
+    opts.localPath = jstring_to_string(env, localPath);
+    TraceSpan span("commit", opts.localPath);
+    opts.message = jstring_to_string(env, message);
+    opts.paths = jstring_array_to_vector(env, paths);
+    opts.stage = stage == JNI_TRUE;
+    opts.allowEmpty = allowEmpty == JNI_TRUE;
+    return env->NewStringUTF(git_commit_paths(opts).c_str());
+  });
 }
 
 extern "C" JNIEXPORT void JNICALL
@@ -90,90 +434,768 @@ Java_com_codexm_nativemodules_CodexMGitModule_nativePush(JNIEnv *env,
                                                   jstring branch,
                                                   jstring username,
                                                   jstring token,
-                                                  jboolean allowInsecure) {
-  try {
+                                                  jboolean allowInsecure,
+                                                  jstring operationId,
+                                                  jobject progress) {
+  guarded(env, [&] {
     GitPushOptions opts;
     opts.localPath = jstring_to_string(env, localPath);
+    TraceSpan span("push", opts.localPath);
     opts.remote = jstring_to_string(env, remote);
     opts.branch = jstring_to_string(env, branch);
     opts.username = jstring_to_string(env, username);
     opts.token = jstring_to_string(env, token);
     opts.allowInsecure = allowInsecure == JNI_TRUE;
+    fill_hooks(env, opts.hooks, operationId, progress);
     git_push_branch(opts);
-  } catch (const GitException &e) {
-    throw_java_runtime(env, e.what());
-  }
+  });
 }
 
-extern "C" JNIEXPORT jobject JNICALL
+extern "C" JNIEXPORT jbyteArray JNICALL
 Java_com_codexm_nativemodules_CodexMGitModule_nativeStatus(JNIEnv *env,
                                                     jobject /*thiz*/,
-                                                    jstring localPath) {
-  try {
-    const auto st = git_status(jstring_to_string(env, localPath));
-
-    jclass arguments = env->FindClass("com/facebook/react/bridge/Arguments");
-    jmethodID createMap =
-      env->GetStaticMethodID(arguments, "createMap", "()Lcom/facebook/react/bridge/WritableMap;");
-    jmethodID createArray =
-      env->GetStaticMethodID(arguments, "createArray", "()Lcom/facebook/react/bridge/WritableArray;");
-
-    jobject map = env->CallStaticObjectMethod(arguments, createMap);
-    jclass mapClass = env->GetObjectClass(map);
-    jmethodID putArray =
-      env->GetMethodID(mapClass, "putArray", "(Ljava/lang/String;Lcom/facebook/react/bridge/ReadableArray;)V");
-
-    auto buildArray = [&](const std::vector<std::string> &items) -> jobject {
-      jobject arr = env->CallStaticObjectMethod(arguments, createArray);
-      jclass arrClass = env->GetObjectClass(arr);
-      jmethodID pushString = env->GetMethodID(arrClass, "pushString", "(Ljava/lang/String;)V");
-      for (const auto &s : items) {
-        jstring js = env->NewStringUTF(s.c_str());
-        env->CallVoidMethod(arr, pushString, js);
-        env->DeleteLocalRef(js);
-      }
-      env->DeleteLocalRef(arrClass);
-      return arr;
-    };
+                                                    jstring localPath,
+                                                    jint renameThreshold,
+                                                    jint renameLimit,
+                                                    jboolean renameCopies) {
+  return guarded(env, [&]() -> jbyteArray {
+    const std::string path = jstring_to_string(env, localPath);
+    TraceSpan span("status", path);
+    const GitStatus st = git_status(path, rename_options(renameThreshold, renameLimit, renameCopies));
+    span.phase("marshal");
+    return status_to_packed(env, st);
+  });
+}
 
-    jobject staged = buildArray(st.staged);
-    jobject unstaged = buildArray(st.unstaged);
-    jobject untracked = buildArray(st.untracked);
-
-    jstring kStaged = env->NewStringUTF("staged");
-    jstring kUnstaged = env->NewStringUTF("unstaged");
-    jstring kUntracked = env->NewStringUTF("untracked");
-
-    env->CallVoidMethod(map, putArray, kStaged, staged);
-    env->CallVoidMethod(map, putArray, kUnstaged, unstaged);
-    env->CallVoidMethod(map, putArray, kUntracked, untracked);
-
-    env->DeleteLocalRef(kStaged);
-    env->DeleteLocalRef(kUnstaged);
-    env->DeleteLocalRef(kUntracked);
-    env->DeleteLocalRef(staged);
-    env->DeleteLocalRef(unstaged);
-    env->DeleteLocalRef(untracked);
-    env->DeleteLocalRef(mapClass);
-    env->DeleteLocalRef(arguments);
-
-    return map;
-  } catch (const GitException &e) {
-    throw_java_runtime(env, e.what());
-    return nullptr;
-  }
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeStatusIncremental(JNIEnv *env,
+                                                               jobject /*thiz*/,
+                                                               jstring localPath,
+                                                               jobjectArray touchedPaths,
+                                                               jboolean watch) {
+  return guarded(env, [&]() -> jbyteArray {
+    GitIncrementalStatusOptions opts;
+    opts.localPath = jstring_to_string(env, localPath);
+    TraceSpan span("statusIncremental", opts.localPath);
+    opts.touchedPaths = jstring_array_to_vector(env, touchedPaths);
+    opts.watch = watch == JNI_TRUE;
+    const GitStatus st = git_status_incremental(opts);
+    span.phase("marshal");
+    return status_to_packed(env, st);
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeStatusIncrementalReset(JNIEnv *env,
+                                                                    jobject /*thiz*/,
+                                                                    jstring localPath) {
+  guarded(env, [&] {
+    git_status_incremental_reset(jstring_to_string(env, localPath));
+  });
 }
 
 extern "C" JNIEXPORT jstring JNICALL
 Java_com_codexm_nativemodules_CodexMGitModule_nativeDiff(JNIEnv *env,
                                                    jobject /*thiz*/,
                                                    jstring localPath,
-                                                   jint maxBytes) {
-  try {
-    const auto diff = git_diff_unified(jstring_to_string(env, localPath), static_cast<size_t>(maxBytes));
+                                                   jint maxBytes,
+                                                   jint renameThreshold,
+                                                   jint renameLimit,
+                                                   jboolean renameCopies) {
+  return guarded(env, [&]() -> jstring {
+    const std::string path = jstring_to_string(env, localPath);
+    TraceSpan span("diff", path);
+    const auto diff = git_diff_unified(path, static_cast<size_t>(maxBytes),
+                                       rename_options(renameThreshold, renameLimit, renameCopies));
+    span.phase("marshal");
     return env->NewStringUTF(diff.c_str());
-  } catch (const GitException &e) {
-    throw_java_runtime(env, e.what());
-    return nullptr;
+  });
+}
+
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeDiffStructured(JNIEnv *env,
+                                                            jobject /*thiz*/,
+                                                            jstring localPath,
+                                                            jint renameThreshold,
+                                                            jint renameLimit,
+                                                            jboolean renameCopies) {
+  return guarded(env, [&]() -> jbyteArray {
+    const std::string path = jstring_to_string(env, localPath);
+    TraceSpan span("diffStructured", path);
+    const auto buf = git_diff_structured(path, rename_options(renameThreshold, renameLimit, renameCopies));
+    span.phase("marshal");
+    span.count("bytes", static_cast<int64_t>(buf.size()));
+    return bytes_to_jarray(env, buf.data(), buf.size());
+  });
+}
+
+// Patch text is passed as raw bytes: NewStringUTF expects modified UTF-8 and aborts on arbitrary file
+// content, and decoding once on the Kotlin side avoids an extra copy.
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeDiffStream(JNIEnv *env,
+                                                        jobject /*thiz*/,
+                                                        jstring localPath,
+                                                        jint chunkBytes,
+                                                        jint renameThreshold,
+                                                        jint renameLimit,
+                                                        jboolean renameCopies,
+                                                        jobject sink) {
+  guarded(env, [&] {
+    const std::string path = jstring_to_string(env, localPath);
+    TraceSpan span("diffStream", path);
+    int64_t chunks = 0;
+    git_diff_stream(
+      path,
+      chunkBytes > 0 ? static_cast<size_t>(chunkBytes) : 0,
+      [&](const GitDiffChunk &chunk) -> bool {
+        span.count("chunks", ++chunks);
+        jbyteArray path = bytes_to_jarray(env, chunk.path.data(), chunk.path.size());
+        jbyteArray data = bytes_to_jarray(env, chunk.data, chunk.size);
+        const jboolean keepGoing = env->CallBooleanMethod(sink, g_jni.diffSinkOnChunk, static_cast<jint>(chunk.section), path,
+                                                          chunk.fileStart ? JNI_TRUE : JNI_FALSE, data);
+        env->DeleteLocalRef(path);
+        env->DeleteLocalRef(data);
+        // A Java exception from the sink ends the stream; it propagates once we return.
+        return !env->ExceptionCheck() && keepGoing == JNI_TRUE;
+      },
+      rename_options(renameThreshold, renameLimit, renameCopies));
+  });
+}
+
+// A batch of search matches as one byte[]: u32 count, then per match u32 line, u32 column,
+// u32 path length + path bytes, u32 text length + text bytes (all LE). Decoded by
+// CodexMGitModule.decodeSearchBatch().
+static jbyteArray search_batch_to_packed(JNIEnv *env, const std::vector<GitSearchMatch> &batch) {
+  size_t size = 4;
+  for (const auto &m : batch) size += 16 + m.path.size() + m.text.size();
+  std::string buf;
+  buf.reserve(size);
+  auto put_u32 = [&buf](uint32_t v) {
+    for (int i = 0; i < 4; i++) buf.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+  };
+  put_u32(static_cast<uint32_t>(batch.size()));
+  for (const auto &m : batch) {
+    put_u32(m.line);
+    put_u32(m.column);
+    put_u32(static_cast<uint32_t>(m.path.size()));
+    buf.append(m.path);
+    put_u32(static_cast<uint32_t>(m.text.size()));
+    buf.append(m.text);
+  }
+  return bytes_to_jarray(env, buf.data(), buf.size());
+}
+
+// Returns [filesScanned, bytesScanned, matches, truncated]; matches arrive through `sink` first.
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeSearch(JNIEnv *env,
+                                                    jobject /*thiz*/,
+                                                    jstring localPath,
+                                                    jstring pattern,
+                                                    jboolean regex,
+                                                    jboolean ignoreCase,
+                                                    jobjectArray paths,
+                                                    jboolean includeIgnored,
+                                                    jboolean useIndex,
+                                                    jint maxResults,
+                                                    jstring operationId,
+                                                    jobject sink) {
+  return guarded(env, [&]() -> jlongArray {
+    GitSearchOptions opts;
+    opts.localPath = jstring_to_string(env, localPath);
+    TraceSpan span("search", opts.localPath);
+    opts.pattern = jstring_to_string(env, pattern);
+    opts.regex = regex == JNI_TRUE;
+    opts.ignoreCase = ignoreCase == JNI_TRUE;
+    opts.paths = jstring_array_to_vector(env, paths);
+    opts.includeIgnored = includeIgnored == JNI_TRUE;
+    opts.useIndex = useIndex == JNI_TRUE;
+    if (maxResults > 0) opts.maxResults = static_cast<uint64_t>(maxResults);
+    fill_hooks(env, opts.hooks, operationId, nullptr);
+
+    const GitSearchStats stats = git_search(opts, [&](const std::vector<GitSearchMatch> &batch) -> bool {
+      jbyteArray packed = search_batch_to_packed(env, batch);
+      const jboolean keepGoing = env->CallBooleanMethod(sink, g_jni.searchSinkOnBatch, packed);
+      env->DeleteLocalRef(packed);
+      return !env->ExceptionCheck() && keepGoing == JNI_TRUE;
+    });
+    span.phase("marshal");
+    if (env->ExceptionCheck()) return nullptr;
+    const jlong values[] = {
+        static_cast<jlong>(stats.filesScanned),
+        static_cast<jlong>(stats.bytesScanned),
+        static_cast<jlong>(stats.matches),
+        stats.truncated ? 1 : 0,
+    };
+    jlongArray out = env->NewLongArray(4);
+    if (out) env->SetLongArrayRegion(out, 0, 4, values);
+    return out;
+  });
+}
+
+// Returns [files, blobs, segments, bytes, indexedNow].
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeSearchIndexRefresh(JNIEnv *env,
+                                                                jobject /*thiz*/,
+                                                                jstring localPath,
+                                                                jstring operationId,
+                                                                jobject progress) {
+  return guarded(env, [&]() -> jlongArray {
+    GitSearchIndexOptions opts;
+    opts.localPath = jstring_to_string(env, localPath);
+    TraceSpan span("searchIndex", opts.localPath);
+    fill_hooks(env, opts.hooks, operationId, progress);
+    const GitSearchIndexStats s = git_search_index_refresh(opts);
+    const jlong values[] = {
+        static_cast<jlong>(s.files),
+        static_cast<jlong>(s.blobs),
+        static_cast<jlong>(s.segments),
+        static_cast<jlong>(s.bytes),
+        static_cast<jlong>(s.indexedNow),
+    };
+    jlongArray out = env->NewLongArray(5);
+    if (out) env->SetLongArrayRegion(out, 0, 5, values);
+    return out;
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeSearchIndexDrop(JNIEnv *env,
+                                                             jobject /*thiz*/,
+                                                             jstring localPath) {
+  guarded(env, [&] {
+    git_search_index_drop(jstring_to_string(env, localPath));
+  });
+}
+
+// Flat: dir count, deleted count, hashed, fromIndex, fromManifest, then the dirs, the deleted
+// paths, and per file path, oid, size, change ("A"/"M"/"U"). With changedOnly, unchanged files are
+// left out. Packed by strings_to_packed(): names come from the raw workspace walk.
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeTreeManifest(JNIEnv *env,
+                                                          jobject /*thiz*/,
+                                                          jstring localPath,
+                                                          jstring manifestPath,
+                                                          jobjectArray excludeNames,
+                                                          jboolean changedOnly,
+                                                          jstring operationId,
+                                                          jobject progress) {
+  return guarded(env, [&]() -> jbyteArray {
+    GitTreeManifestOptions opts;
+    opts.localPath = jstring_to_string(env, localPath);
+    TraceSpan span("treeManifest", opts.localPath);
+    opts.manifestPath = jstring_to_string(env, manifestPath);
+    opts.excludeNames = jstring_array_to_vector(env, excludeNames);
+    fill_hooks(env, opts.hooks, operationId, progress);
+    const GitTreeManifest m = git_tree_manifest(opts);
+    span.phase("marshal");
+
+    std::vector<std::string> flat;
+    flat.reserve(5 + m.dirs.size() + m.deleted.size() + m.files.size() * 4);
+    flat.push_back(std::to_string(m.dirs.size()));
+    flat.push_back(std::to_string(m.deleted.size()));
+    flat.push_back(std::to_string(m.hashed));
+    flat.push_back(std::to_string(m.fromIndex));
+    flat.push_back(std::to_string(m.fromManifest));
+    flat.insert(flat.end(), m.dirs.begin(), m.dirs.end());
+    flat.insert(flat.end(), m.deleted.begin(), m.deleted.end());
+    for (const auto &f : m.files) {
+      if (changedOnly && f.change == GitManifestChange::Unchanged) continue;
+      flat.push_back(f.path);
+      flat.push_back(f.oid);
+      flat.push_back(std::to_string(f.size));
+      flat.push_back(f.change == GitManifestChange::Added ? "A" : f.change == GitManifestChange::Modified ? "M" : "U");
+    }
+    return strings_to_packed(env, flat);
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeTreeManifestCommit(JNIEnv *env,
+                                                                jobject /*thiz*/,
+                                                                jstring manifestPath) {
+  guarded(env, [&] {
+    git_tree_manifest_commit(jstring_to_string(env, manifestPath));
+  });
+}
+
+// Writes `rootDir` (or just `paths` in it) as .tar.gz to `outFd`, which the caller owns. Returns
+// [files, directories, links, bytes, written].
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativePackTree(JNIEnv *env,
+                                                      jobject /*thiz*/,
+                                                      jstring rootDir,
+                                                      jobjectArray paths,
+                                                      jobjectArray excludeNames,
+                                                      jint outFd) {
+  return guarded(env, [&]() -> jlongArray {
+    TarPackOptions opts;
+    opts.rootDir = jstring_to_string(env, rootDir);
+    TraceSpan span("packTree", opts.rootDir);
+    opts.paths = jstring_array_to_vector(env, paths);
+    opts.excludeNames = jstring_array_to_vector(env, excludeNames);
+    opts.outFd = outFd;
+    const TarPackStats s = tar_gz_pack(opts);
+    trace_count("bytes", static_cast<int64_t>(s.written));
+    const jlong values[] = {
+        static_cast<jlong>(s.files),
+        static_cast<jlong>(s.directories),
+        static_cast<jlong>(s.links),
+        static_cast<jlong>(s.bytes),
+        static_cast<jlong>(s.written),
+    };
+    jlongArray out = env->NewLongArray(5);
+    if (out) env->SetLongArrayRegion(out, 0, 5, values);
+    return out;
+  });
+}
+
+// Extracts a .tar.gz read from `inFd` (owned by the caller) into `destDir`. Returns
+// [files, directories, links, bytes].
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeUnpackTree(JNIEnv *env,
+                                                        jobject /*thiz*/,
+                                                        jint inFd,
+                                                        jstring destDir) {
+  return guarded(env, [&]() -> jlongArray {
+    TarExtractOptions opts;
+    opts.fd = inFd;
+    opts.destDir = jstring_to_string(env, destDir);
+    TraceSpan span("unpackTree", opts.destDir);
+    const TarExtractStats s = tar_gz_extract(opts);
+    const jlong values[] = {
+        static_cast<jlong>(s.files),
+        static_cast<jlong>(s.directories),
+        static_cast<jlong>(s.links),
+        static_cast<jlong>(s.bytes),
+    };
+    jlongArray out = env->NewLongArray(4);
+    if (out) env->SetLongArrayRegion(out, 0, 4, values);
+    return out;
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeReleaseRepo(JNIEnv *env,
+                                                         jobject /*thiz*/,
+                                                         jstring localPath) {
+  guarded(env, [&] {
+    git_release_repo(jstring_to_string(env, localPath));
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeSubmit(JNIEnv *env,
+                                                    jobject /*thiz*/,
+                                                    jstring repoPath,
+                                                    jstring coalesceKey,
+                                                    jint kind,
+                                                    jobject task) {
+  guarded(env, [&] {
+    const auto jobKind = kind == static_cast<jint>(GitJobKind::Network) ? GitJobKind::Network
+                         : kind == static_cast<jint>(GitJobKind::Write) ? GitJobKind::Write
+                                                                        : GitJobKind::Read;
+    schedule_git_job(repo_cache_key(jstring_to_string(env, repoPath)), jstring_to_string(env, coalesceKey), jobKind,
+                     std::unique_ptr<GitJob>(new JavaGitJob(env, task)));
+  });
+}
+
+// Workspace summaries as one byte[]: u32 count, then per repository u8 flags (1 dirty,
+// 2 hasUpstream, 4 error), u32 staged, unstaged, untracked, ahead, behind (all LE), the
+// NUL-terminated branch and the NUL-terminated error. Decoded by CodexMGitModule.decodeStatusMany().
+static std::string status_many_to_packed(const std::vector<GitRepoStatusSummary> &all) {
+  std::string buf;
+  buf.reserve(4 + all.size() * 32);
+  auto put_u32 = [&buf](uint32_t v) {
+    for (int i = 0; i < 4; i++) buf.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+  };
+  put_u32(static_cast<uint32_t>(all.size()));
+  for (const auto &s : all) {
+    buf.push_back(static_cast<char>((s.dirty ? 1 : 0) | (s.hasUpstream ? 2 : 0) | (s.error.empty() ? 0 : 4)));
+    put_u32(s.staged);
+    put_u32(s.unstaged);
+    put_u32(s.untracked);
+    put_u32(s.ahead);
+    put_u32(s.behind);
+    buf.append(s.branch);
+    buf.push_back('\0');
+    buf.append(s.error);
+    buf.push_back('\0');
   }
+  return buf;
+}
+
+// Queues one summary job per path; `sink` is called once, from the worker that finishes last.
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeStatusMany(JNIEnv *env,
+                                                        jobject /*thiz*/,
+                                                        jobjectArray localPaths,
+                                                        jboolean summaryOnly,
+                                                        jobject sink) {
+  guarded(env, [&] {
+    GitStatusManyOptions opts;
+    opts.localPaths = jstring_array_to_vector(env, localPaths);
+    opts.summaryOnly = summaryOnly == JNI_TRUE;
+    jobject target = env->NewGlobalRef(sink);
+    git_status_many(opts, [target](std::vector<GitRepoStatusSummary> &&all) {
+      JNIEnv *wenv = worker_env();
+      if (!wenv) return;
+      const std::string packed = status_many_to_packed(all);
+      jbyteArray bytes = bytes_to_jarray(wenv, packed.data(), packed.size());
+      if (bytes) {
+        wenv->CallVoidMethod(target, g_jni.statusManySinkOnComplete, bytes);
+        // onComplete() settles a promise; nothing useful can be done with a failure here.
+        if (wenv->ExceptionCheck()) wenv->ExceptionClear();
+        wenv->DeleteLocalRef(bytes);
+      }
+      wenv->DeleteGlobalRef(target);
+    });
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeSetRemoteIdleTimeout(JNIEnv *env,
+                                                                 jobject /*thiz*/,
+                                                                 jlong ms) {
+  guarded(env, [&] {
+    git_set_remote_idle_timeout(static_cast<int64_t>(ms));
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeConfigureRuntime(JNIEnv *env,
+                                                              jobject /*thiz*/,
+                                                              jint memoryClass,
+                                                              jboolean trustLocalObjects) {
+  guarded(env, [&] {
+    GitRuntimeConfig config;
+    config.memoryClass = static_cast<GitMemoryClass>(memoryClass);
+    config.trustLocalObjects = trustLocalObjects == JNI_TRUE;
+    git_configure_runtime(config);
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeWarmUp(JNIEnv *env, jobject /*thiz*/) {
+  guarded(env, [&] {
+    git_warm_up();
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeTrimMemory(JNIEnv *env,
+                                                        jobject /*thiz*/,
+                                                        jint level) {
+  guarded(env, [&] {
+    git_trim_memory(static_cast<int>(level));
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativePrefetchTouch(JNIEnv *env,
+                                                           jobject /*thiz*/,
+                                                           jstring localPath,
+                                                           jstring remote,
+                                                           jstring username,
+                                                           jstring token,
+                                                           jboolean allowInsecure) {
+  guarded(env, [&] {
+    GitPrefetchTarget target;
+    target.localPath = jstring_to_string(env, localPath);
+    target.remote = jstring_to_string(env, remote);
+    target.username = jstring_to_string(env, username);
+    target.token = jstring_to_string(env, token);
+    target.allowInsecure = allowInsecure == JNI_TRUE;
+    git_prefetch_touch(target);
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativePrefetchForget(JNIEnv *env,
+                                                            jobject /*thiz*/,
+                                                            jstring localPath) {
+  guarded(env, [&] {
+    git_prefetch_forget(jstring_to_string(env, localPath));
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativePrefetchSetNetwork(JNIEnv *env,
+                                                                jobject /*thiz*/,
+                                                                jboolean online,
+                                                                jboolean metered) {
+  guarded(env, [&] {
+    git_prefetch_set_network(online == JNI_TRUE, metered == JNI_TRUE);
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativePrefetchConfigure(JNIEnv *env,
+                                                               jobject /*thiz*/,
+                                                               jboolean enabled,
+                                                               jlong intervalMs,
+                                                               jlong recentWindowMs) {
+  guarded(env, [&] {
+    GitPrefetchConfig config;
+    config.enabled = enabled == JNI_TRUE;
+    if (intervalMs > 0) config.intervalMs = static_cast<int64_t>(intervalMs);
+    if (recentWindowMs > 0) config.recentWindowMs = static_cast<int64_t>(recentWindowMs);
+    git_prefetch_configure(config);
+  });
+}
+
+// Returns [ran, objectsPacked, packsRemoved, looseRemoved, bytesBefore, bytesAfter, commitGraph].
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeMaintenance(JNIEnv *env,
+                                                         jobject /*thiz*/,
+                                                         jstring localPath,
+                                                         jboolean force,
+                                                         jstring operationId,
+                                                         jobject progress) {
+  return guarded(env, [&]() -> jlongArray {
+    GitMaintenanceOptions opts;
+    opts.localPath = jstring_to_string(env, localPath);
+    TraceSpan span("maintenance", opts.localPath);
+    opts.force = force == JNI_TRUE;
+    fill_hooks(env, opts.hooks, operationId, progress);
+    const GitMaintenanceResult r = git_maintenance(opts);
+    const jlong values[] = {
+        r.ran ? 1 : 0,
+        static_cast<jlong>(r.objectsPacked),
+        static_cast<jlong>(r.packsRemoved),
+        static_cast<jlong>(r.looseRemoved),
+        static_cast<jlong>(r.bytesBefore),
+        static_cast<jlong>(r.bytesAfter),
+        r.commitGraph ? 1 : 0,
+    };
+    jlongArray out = env->NewLongArray(7);
+    if (out) env->SetLongArrayRegion(out, 0, 7, values);
+    return out;
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeMaintenanceRequest(JNIEnv *env,
+                                                                jobject /*thiz*/,
+                                                                jstring localPath) {
+  guarded(env, [&] {
+    git_maintenance_request(jstring_to_string(env, localPath));
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeMaintenanceSetDeviceState(JNIEnv *env,
+                                                                       jobject /*thiz*/,
+                                                                       jboolean charging,
+                                                                       jboolean idle) {
+  guarded(env, [&] {
+    git_maintenance_set_device_state(charging == JNI_TRUE, idle == JNI_TRUE);
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeTraceSetEnabled(JNIEnv *env,
+                                                             jobject /*thiz*/,
+                                                             jboolean enabled) {
+  guarded(env, [&] {
+    git_trace_set_enabled(enabled == JNI_TRUE);
+  });
+}
+
+// JSON lines as UTF-8 bytes (repository paths may contain characters NewStringUTF rejects).
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeTraceDrain(JNIEnv *env, jobject /*thiz*/) {
+  return guarded(env, [&]() -> jbyteArray {
+    const std::string lines = git_trace_drain();
+    return bytes_to_jarray(env, lines.data(), lines.size());
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeCancelOperation(JNIEnv *env,
+                                                             jobject /*thiz*/,
+                                                             jstring operationId) {
+  guarded(env, [&] {
+    git_cancel_operation(jstring_to_string(env, operationId));
+  });
+}
+
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeSnapshot(JNIEnv *env,
+                                                      jobject /*thiz*/,
+                                                      jstring localPath,
+                                                      jstring message) {
+  return guarded(env, [&]() -> jstring {
+    const std::string path = jstring_to_string(env, localPath);
+    TraceSpan span("snapshot", path);
+    const auto oid = git_snapshot_worktree(path, jstring_to_string(env, message));
+    return env->NewStringUTF(oid.c_str());
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeRestoreSnapshot(JNIEnv *env,
+                                                             jobject /*thiz*/,
+                                                             jstring localPath,
+                                                             jstring oid) {
+  guarded(env, [&] {
+    const std::string path = jstring_to_string(env, localPath);
+    TraceSpan span("restoreSnapshot", path);
+    git_restore_snapshot(path, jstring_to_string(env, oid));
+  });
+}
+
+// Flattened as [oid, createdAt, message, oid, createdAt, message, ...] and packed by
+// strings_to_packed(): messages are free text.
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeListSnapshots(JNIEnv *env,
+                                                           jobject /*thiz*/,
+                                                           jstring localPath) {
+  return guarded(env, [&]() -> jbyteArray {
+    std::vector<std::string> flat;
+    for (const auto &s : git_list_snapshots(jstring_to_string(env, localPath))) {
+      flat.push_back(s.oid);
+      flat.push_back(std::to_string(s.createdAt));
+      flat.push_back(s.message);
+    }
+    return strings_to_packed(env, flat);
+  });
+}
+
+// Flat: nextCursor, scanned, then per commit oid, space-separated parents, author name, author
+// email, author time, commit time (Unix seconds) and summary. Packed by strings_to_packed().
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeLogPage(JNIEnv *env,
+                                                     jobject /*thiz*/,
+                                                     jstring localPath,
+                                                     jstring ref,
+                                                     jstring cursor,
+                                                     jobjectArray paths,
+                                                     jint limit,
+                                                     jint maxScan) {
+  return guarded(env, [&]() -> jbyteArray {
+    GitLogOptions opts;
+    opts.localPath = jstring_to_string(env, localPath);
+    TraceSpan span("logPage", opts.localPath);
+    if (ref) opts.ref = jstring_to_string(env, ref);
+    opts.cursor = jstring_to_string(env, cursor);
+    opts.paths = jstring_array_to_vector(env, paths);
+    if (limit > 0) opts.limit = static_cast<size_t>(limit);
+    if (maxScan > 0) opts.maxScan = static_cast<size_t>(maxScan);
+    const GitLogPage page = git_log_page(opts);
+    span.phase("marshal");
+
+    std::vector<std::string> flat;
+    flat.reserve(2 + page.commits.size() * 7);
+    flat.push_back(page.nextCursor);
+    flat.push_back(std::to_string(page.scanned));
+    for (const auto &c : page.commits) {
+      std::string parents;
+      for (const auto &p : c.parents) {
+        if (!parents.empty()) parents.push_back(' ');
+        parents += p;
+      }
+      flat.push_back(c.oid);
+      flat.push_back(parents);
+      flat.push_back(c.authorName);
+      flat.push_back(c.authorEmail);
+      flat.push_back(std::to_string(c.authorTime));
+      flat.push_back(std::to_string(c.commitTime));
+      flat.push_back(c.summary);
+    }
+    return strings_to_packed(env, flat);
+  });
+}
+
+// Flat, per hunk: start line, line count, oid, author name, author email, author time (Unix
+// seconds), summary, original path, original start line, boundary ("1"/"0"). Packed by
+// strings_to_packed().
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeBlame(JNIEnv *env,
+                                                   jobject /*thiz*/,
+                                                   jstring localPath,
+                                                   jstring path,
+                                                   jint startLine,
+                                                   jint endLine,
+                                                   jstring ref) {
+  return guarded(env, [&]() -> jbyteArray {
+    GitBlameOptions opts;
+    opts.localPath = jstring_to_string(env, localPath);
+    TraceSpan span("blame", opts.localPath);
+    opts.path = jstring_to_string(env, path);
+    opts.startLine = startLine > 0 ? static_cast<size_t>(startLine) : 1;
+    opts.endLine = endLine > 0 ? static_cast<size_t>(endLine) : 0;
+    opts.ref = jstring_to_string(env, ref);
+    const std::vector<GitBlameHunk> hunks = git_blame_range(opts);
+    span.phase("marshal");
+
+    std::vector<std::string> flat;
+    flat.reserve(hunks.size() * 10);
+    for (const auto &h : hunks) {
+      flat.push_back(std::to_string(h.startLine));
+      flat.push_back(std::to_string(h.lineCount));
+      flat.push_back(h.oid);
+      flat.push_back(h.authorName);
+      flat.push_back(h.authorEmail);
+      flat.push_back(std::to_string(h.authorTime));
+      flat.push_back(h.summary);
+      flat.push_back(h.origPath);
+      flat.push_back(std::to_string(h.origStartLine));
+      flat.push_back(h.boundary ? "1" : "0");
+    }
+    return strings_to_packed(env, flat);
+  });
+}
+
+// A file window as one byte[] (the content is raw bytes, not necessarily UTF-8): u64 byteOffset,
+// totalBytes, firstLine, lineCount, i64 totalLines, u32 flags (1 binary, 2 truncated), u32 oid
+// length (all LE), the oid, then the data. Decoded by CodexMGitModule.decodeRange().
+extern "C" JNIEXPORT jbyteArray JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeReadRange(JNIEnv *env,
+                                                       jobject /*thiz*/,
+                                                       jstring localPath,
+                                                       jstring spec,
+                                                       jstring path,
+                                                       jboolean lines,
+                                                       jlong start,
+                                                       jlong count,
+                                                       jint maxBytes) {
+  return guarded(env, [&]() -> jbyteArray {
+    GitRangeOptions opts;
+    opts.localPath = jstring_to_string(env, localPath);
+    opts.spec = jstring_to_string(env, spec);
+    opts.path = jstring_to_string(env, path);
+    TraceSpan span(opts.spec.empty() ? "readFileRange" : "readBlobRange", opts.localPath);
+    opts.lines = lines == JNI_TRUE;
+    opts.start = start > 0 ? static_cast<uint64_t>(start) : 0;
+    opts.count = count > 0 ? static_cast<uint64_t>(count) : 0;
+    if (maxBytes > 0) opts.maxBytes = static_cast<size_t>(maxBytes);
+    const GitRangeResult r = opts.spec.empty() ? git_read_file_range(opts) : git_read_blob_range(opts);
+    span.phase("marshal");
+
+    std::string buf;
+    buf.reserve(48 + r.oid.size() + r.data.size());
+    auto put = [&buf](uint64_t v, int bytes) {
+      for (int i = 0; i < bytes; i++) buf.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    };
+    put(r.byteOffset, 8);
+    put(r.totalBytes, 8);
+    put(r.firstLine, 8);
+    put(r.lineCount, 8);
+    put(static_cast<uint64_t>(r.totalLines), 8);
+    put((r.binary ? 1u : 0u) | (r.truncated ? 2u : 0u), 4);
+    put(r.oid.size(), 4);
+    buf.append(r.oid);
+    buf.append(r.data);
+    return bytes_to_jarray(env, buf.data(), buf.size());
+  });
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeDropSnapshot(JNIEnv *env,
+                                                          jobject /*thiz*/,
+                                                          jstring localPath,
+                                                          jstring oid) {
+  guarded(env, [&] {
+    git_drop_snapshot(jstring_to_string(env, localPath), jstring_to_string(env, oid));
+  });
 }
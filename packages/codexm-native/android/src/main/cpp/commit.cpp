@@ -0,0 +1,125 @@
+#include "git_ops.h"
+
+#include "git_internal.h"
+#include "repo_cache.h"
+#include "trace.h"
+
+#include <git2.h>
+
+#include <string>
+#include <vector>
+
+// Commits are built from the on-disk index: it is loaded once, the requested changes are applied
+// to it in memory, and it is written back once before the tree is created. Restricting status to
+// the requested paths (exact pathspec) means only those files and directories are visited, and
+// git_index_write_tree() reuses the index's cached subtrees for everything left untouched.
+
+namespace {
+// Applies INDEX..WORKDIR changes found under `paths` (or everywhere, or the sparse set, when
+// empty) to `index`. Ignored files are never added.
+void stage_changes(git_repository *repo, git_index *index, const std::vector<std::string> &paths) {
+  git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+  opts.show = GIT_STATUS_SHOW_WORKDIR_ONLY;
+  opts.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS;
+
+  const std::vector<std::string> scope = paths.empty() ? read_sparse_paths(repo) : paths;
+  std::vector<const char *> scopeStorage;
+  if (!scope.empty()) {
+    opts.flags |= GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+    opts.pathspec = as_strarray(scope, scopeStorage);
+  }
+
+  git_status_list *status = nullptr;
+  int rc = git_status_list_new(&status, repo, &opts);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  const size_t count = git_status_list_entrycount(status);
+  for (size_t i = 0; i < count; i++) {
+    const git_status_entry *s = git_status_byindex(status, i);
+    if (!s || !s->index_to_workdir) continue;
+    const char *path = s->index_to_workdir->new_file.path;
+    if (!path) continue;
+
+    if (s->status & GIT_STATUS_WT_DELETED) {
+      rc = git_index_remove_bypath(index, path);
+    } else if (s->status & (GIT_STATUS_WT_NEW | GIT_STATUS_WT_MODIFIED | GIT_STATUS_WT_TYPECHANGE)) {
+      // Hashes the file and records its stat data, so the next status doesn't re-read it.
+      rc = git_index_add_bypath(index, path);
+    }
+    if (rc != 0) break;
+  }
+  git_status_list_free(status);
+  if (rc != 0) throw GitException(last_error_message(rc));
+}
+}  // namespace
+
+std::string git_commit_paths(const GitCommitOptions &opts) {
+  if (opts.message.empty()) throw GitException("Commit message is required");
+
+  RepoLease lease = acquire_repo(opts.localPath);
+  git_repository *repo = lease.get();
+  if (git_repository_is_bare(repo)) throw GitException("Commit requires a work tree");
+
+  git_index *index = nullptr;
+  int rc = git_repository_index(&index, repo);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  git_commit *parent = nullptr;
+  git_tree *tree = nullptr;
+  git_signature *sig = nullptr;
+  git_oid commitId{};
+  try {
+    // Pick up changes made by other writers (e.g. a snapshot restore) before staging on top.
+    trace_phase("index");
+    rc = git_index_read(index, 0);
+    if (rc != 0) throw GitException(last_error_message(rc));
+
+    // The tree below is everything in the index: restore what a sparse checkout left out before
+    // staging, so files outside the sparse set are committed as HEAD has them, not as deletions.
+    const std::vector<std::string> sparse = read_sparse_paths(repo);
+    if (!sparse.empty()) sync_sparse_index(repo, index, sparse);
+
+    trace_phase("stage");
+    if (opts.stage) stage_changes(repo, index, opts.paths);
+    if (git_index_has_conflicts(index)) throw GitException("Cannot commit with unresolved conflicts");
+
+    trace_phase("write");
+    rc = git_index_write(index);
+    if (rc != 0) throw GitException(last_error_message(rc));
+
+    git_oid treeId{};
+    rc = git_index_write_tree(&treeId, index);
+    if (rc != 0) throw GitException(last_error_message(rc));
+    rc = git_tree_lookup(&tree, repo, &treeId);
+    if (rc != 0) throw GitException(last_error_message(rc));
+
+    git_oid headId{};
+    if (git_reference_name_to_id(&headId, repo, "HEAD") == 0) {
+      rc = git_commit_lookup(&parent, repo, &headId);
+      if (rc != 0) throw GitException(last_error_message(rc));
+      if (!opts.allowEmpty && git_oid_equal(git_commit_tree_id(parent), &treeId)) {
+        throw GitException("Nothing to commit");
+      }
+    } else if (!opts.allowEmpty && git_index_entrycount(index) == 0) {
+      throw GitException("Nothing to commit");
+    }
+
+    sig = default_signature(repo);
+    const git_commit *parents[] = {parent};
+    rc = git_commit_create(&commitId, repo, "HEAD", sig, sig, nullptr, opts.message.c_str(), tree, parent ? 1 : 0,
+                           parents);
+    if (rc != 0) throw GitException(last_error_message(rc));
+  } catch (...) {
+    if (sig) git_signature_free(sig);
+    if (tree) git_tree_free(tree);
+    if (parent) git_commit_free(parent);
+    git_index_free(index);
+    throw;
+  }
+
+  git_signature_free(sig);
+  git_tree_free(tree);
+  if (parent) git_commit_free(parent);
+  git_index_free(index);
+  return git_oid_tostr_s(&commitId);
+}
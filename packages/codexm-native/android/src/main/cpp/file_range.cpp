@@ -0,0 +1,409 @@
+#include "git_ops.h"
+
+#include "git_internal.h"
+#include "repo_cache.h"
+#include "trace.h"
+
+#include <git2.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Windowed reads of blobs and work-tree files for the file viewer. Only the requested window is
+// copied out: work-tree files are read with pread() (a line index scan aside, only the window is
+// read from storage), blobs are read through libgit2, which inflates them only on the native side.
+// Line windows go through a sparse line index kept per content (blob id, or path plus stat data),
+// so paging deep into a large file doesn't rescan it from the top.
+
+namespace {
+// One checkpoint per this many lines: 8 bytes per 256 lines, ~32 KiB for a million-line log.
+constexpr uint64_t kLineStride = 256;
+// Indexes kept across calls; each is small, so this is about how many files a user pages through.
+constexpr size_t kMaxLineIndexes = 64;
+// Same sniff window as git's buffer_is_binary().
+constexpr size_t kBinarySniffBytes = 8000;
+
+struct LineIndex {
+  uint64_t lines = 0;  // a last line without '\n' counts
+  // Byte offset of line k * kLineStride.
+  std::vector<uint64_t> checkpoints;
+};
+
+struct CachedIndex {
+  std::shared_ptr<const LineIndex> index;
+  uint64_t lastUse = 0;
+};
+
+std::mutex g_indexes_mu;
+std::unordered_map<std::string, CachedIndex> g_indexes;
+uint64_t g_indexes_clock = 0;
+
+std::shared_ptr<const LineIndex> cached_index(const std::string &key) {
+  std::lock_guard<std::mutex> g(g_indexes_mu);
+  auto it = g_indexes.find(key);
+  if (it == g_indexes.end()) return nullptr;
+  it->second.lastUse = ++g_indexes_clock;
+  return it->second.index;
+}
+
+void store_index(const std::string &key, std::shared_ptr<const LineIndex> index) {
+  std::lock_guard<std::mutex> g(g_indexes_mu);
+  if (g_indexes.size() >= kMaxLineIndexes && g_indexes.find(key) == g_indexes.end()) {
+    auto oldest = g_indexes.begin();
+    for (auto it = g_indexes.begin(); it != g_indexes.end(); ++it) {
+      if (it->second.lastUse < oldest->second.lastUse) oldest = it;
+    }
+    g_indexes.erase(oldest);
+  }
+  g_indexes[key] = CachedIndex{std::move(index), ++g_indexes_clock};
+}
+
+std::string sys_error(const std::string &what, const std::string &path) {
+  return what + " " + path + ": " + strerror(errno);
+}
+
+// Bytes to window over: a blob in memory, or a work-tree file read with pread(). A file that
+// shrinks while it is read just ends early (reads come back short), where touching an mmap()ed
+// page past the new end would raise SIGBUS.
+class Content {
+ public:
+  explicit Content(uint64_t size) : size_(size) {}
+  virtual ~Content() = default;
+  uint64_t size() const { return size_; }
+  // Calls `fn(p, n, at)` for consecutive chunks from `from` to the end until it returns false.
+  template <typename Fn>
+  void scan(uint64_t from, Fn fn) const;
+  // Reads [begin, end) into `out`; short if the content ended early.
+  void read(uint64_t begin, uint64_t end, std::string &out) const {
+    out.resize(static_cast<size_t>(end - begin));
+    out.resize(read_at(begin, &out[0], out.size()));
+  }
+
+ protected:
+  // In-memory content, else nullptr.
+  virtual const char *memory() const { return nullptr; }
+  // Copies up to `n` bytes at `off`; returns how many were copied.
+  virtual size_t read_at(uint64_t off, char *dst, size_t n) const = 0;
+
+ private:
+  uint64_t size_;
+};
+
+class MemoryContent : public Content {
+ public:
+  MemoryContent(const char *base, uint64_t size) : Content(size), base_(base) {}
+
+ protected:
+  const char *memory() const override { return base_; }
+  size_t read_at(uint64_t off, char *dst, size_t n) const override {
+    if (off >= size()) return 0;
+    if (n > size() - off) n = static_cast<size_t>(size() - off);
+    memcpy(dst, base_ + off, n);
+    return n;
+  }
+
+ private:
+  const char *base_;
+};
+
+class FileContent : public Content {
+ public:
+  FileContent(int fd, uint64_t size, std::string path) : Content(size), fd_(fd), path_(std::move(path)) {}
+
+ protected:
+  size_t read_at(uint64_t off, char *dst, size_t n) const override {
+    size_t done = 0;
+    while (done < n) {
+      const ssize_t r = pread(fd_, dst + done, n - done, static_cast<off_t>(off + done));
+      if (r < 0 && errno == EINTR) continue;
+      if (r < 0) throw GitException(sys_error("cannot read", path_));
+      if (r == 0) break;
+      done += static_cast<size_t>(r);
+    }
+    return done;
+  }
+
+ private:
+  int fd_;
+  std::string path_;
+};
+
+// Large enough that a scan is a handful of syscalls per MiB.
+constexpr size_t kScanChunk = 256 * 1024;
+
+template <typename Fn>
+void Content::scan(uint64_t from, Fn fn) const {
+  if (from >= size_) return;
+  if (const char *base = memory()) {
+    fn(base + from, static_cast<size_t>(size_ - from), from);
+    return;
+  }
+  std::string buf(kScanChunk, '\0');
+  for (uint64_t at = from; at < size_;) {
+    const size_t want = size_ - at < kScanChunk ? static_cast<size_t>(size_ - at) : kScanChunk;
+    const size_t n = read_at(at, &buf[0], want);
+    if (n == 0 || !fn(buf.data(), n, at)) return;
+    at += n;
+  }
+}
+
+std::shared_ptr<const LineIndex> build_index(const Content &content) {
+  auto idx = std::make_shared<LineIndex>();
+  idx->checkpoints.push_back(0);
+  const uint64_t size = content.size();
+  uint64_t newlines = 0, seen = 0;
+  bool endsWithNewline = false;
+  content.scan(0, [&](const char *p, size_t n, uint64_t at) {
+    const char *end = p + n;
+    for (const char *q = p; q < end;) {
+      const char *nl = static_cast<const char *>(memchr(q, '\n', static_cast<size_t>(end - q)));
+      if (!nl) break;
+      newlines++;
+      const uint64_t next = at + static_cast<uint64_t>(nl - p) + 1;
+      if (newlines % kLineStride == 0 && next < size) idx->checkpoints.push_back(next);
+      q = nl + 1;
+    }
+    seen = at + n;
+    endsWithNewline = p[n - 1] == '\n';
+    return true;
+  });
+  idx->lines = newlines + (seen > 0 && !endsWithNewline ? 1 : 0);
+  trace_count("lines", static_cast<int64_t>(idx->lines));
+  return idx;
+}
+
+std::shared_ptr<const LineIndex> line_index(const std::string &key, const Content &content) {
+  if (!key.empty()) {
+    if (auto idx = cached_index(key)) return idx;
+  }
+  trace_phase("index");
+  auto idx = build_index(content);
+  if (!key.empty()) store_index(key, idx);
+  return idx;
+}
+
+// Start of 0-based `line`, or the end of the content past the last line. A cached index can be
+// off for a file rewritten at the same size within one timestamp tick; running out of newlines
+// then ends the window instead of reading past it.
+uint64_t line_offset(const LineIndex &idx, const Content &content, uint64_t line) {
+  if (line >= idx.lines) return content.size();
+  const uint64_t from = idx.checkpoints[line / kLineStride];
+  uint64_t skip = line % kLineStride;
+  if (skip == 0) return from;
+  uint64_t off = content.size();
+  content.scan(from, [&](const char *p, size_t n, uint64_t at) {
+    const char *end = p + n;
+    for (const char *q = p; q < end;) {
+      const char *nl = static_cast<const char *>(memchr(q, '\n', static_cast<size_t>(end - q)));
+      if (!nl) break;
+      if (--skip == 0) {
+        off = at + static_cast<uint64_t>(nl - p) + 1;
+        return false;
+      }
+      q = nl + 1;
+    }
+    return true;
+  });
+  return off;
+}
+
+uint64_t count_newlines(const char *p, uint64_t n) {
+  uint64_t count = 0;
+  const char *end = p + n;
+  while (p < end) {
+    const void *nl = memchr(p, '\n', static_cast<size_t>(end - p));
+    if (!nl) break;
+    count++;
+    p = static_cast<const char *>(nl) + 1;
+  }
+  return count;
+}
+
+// Cuts the window out of `content`; `indexKey` identifies it for the line index cache.
+GitRangeResult read_window(const GitRangeOptions &opts, const Content &content, const std::string &indexKey) {
+  GitRangeResult out;
+  const uint64_t size = content.size();
+  out.totalBytes = size;
+  const uint64_t maxBytes = opts.maxBytes > 0 ? opts.maxBytes : size;
+
+  uint64_t begin = 0, end = 0, wantLines = 0;
+  if (opts.lines) {
+    auto idx = line_index(indexKey, content);
+    out.totalLines = static_cast<int64_t>(idx->lines);
+    out.firstLine = opts.start < idx->lines ? opts.start : idx->lines;
+    wantLines = idx->lines - out.firstLine;
+    if (opts.count > 0 && opts.count < wantLines) wantLines = opts.count;
+    begin = line_offset(*idx, content, out.firstLine);
+    end = line_offset(*idx, content, out.firstLine + wantLines);
+    if (end < begin) end = begin;
+  } else {
+    if (auto idx = indexKey.empty() ? nullptr : cached_index(indexKey)) {
+      out.totalLines = static_cast<int64_t>(idx->lines);
+    }
+    begin = opts.start < size ? opts.start : size;
+    end = opts.count > 0 && opts.count < size - begin ? begin + opts.count : size;
+  }
+
+  if (end - begin > maxBytes) {
+    out.truncated = true;
+    end = begin + maxBytes;
+  }
+
+  trace_phase("copy");
+  out.byteOffset = begin;
+  content.read(begin, end, out.data);
+  // A truncated line window still ends on a line boundary when at least one whole line fits.
+  if (out.truncated && opts.lines) {
+    const size_t last = out.data.rfind('\n');
+    if (last != std::string::npos) out.data.resize(last + 1);
+  }
+  if (opts.lines) {
+    out.lineCount = out.truncated || out.data.size() < end - begin ? count_newlines(out.data.data(), out.data.size())
+                                                                   : wantLines;
+  }
+  trace_count("bytes", static_cast<int64_t>(out.data.size()));
+  return out;
+}
+
+// Components of a work-tree path ("." and empty ones dropped). Rejects absolute paths and "..".
+bool split_rel(const std::string &path, std::vector<std::string> &parts) {
+  if (path.empty() || path.front() == '/') return false;
+  size_t pos = 0;
+  while (pos <= path.size()) {
+    size_t next = path.find('/', pos);
+    if (next == std::string::npos) next = path.size();
+    const std::string part = path.substr(pos, next - pos);
+    if (part == "..") return false;
+    if (!part.empty() && part != ".") parts.push_back(part);
+    pos = next + 1;
+  }
+  return !parts.empty();
+}
+
+// Opens the directory holding the last of `parts`, component by component with O_NOFOLLOW: a
+// committed symlink (say `evil -> /data/data/<app>`) must not let `evil/x` read outside the tree.
+int open_parent_dir(const std::string &root, const std::vector<std::string> &parts, const std::string &path) {
+  int dir = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir < 0) throw GitException(sys_error("cannot open", root));
+  for (size_t i = 0; i + 1 < parts.size(); i++) {
+    const int next = openat(dir, parts[i].c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    const int err = errno;
+    close(dir);
+    if (next < 0) {
+      errno = err;
+      throw GitException(sys_error("cannot open", path));
+    }
+    dir = next;
+  }
+  return dir;
+}
+}  // namespace
+
+GitRangeResult git_read_blob_range(const GitRangeOptions &opts) {
+  if (opts.spec.empty()) throw GitException("blob spec is required");
+  RepoLease lease = acquire_repo(opts.localPath);
+  git_repository *repo = lease.get();
+
+  trace_phase("lookup");
+  git_object *obj = nullptr;
+  int rc = git_revparse_single(&obj, repo, opts.spec.c_str());
+  if (rc != 0) throw GitException(last_error_message(rc));
+  git_object *peeled = nullptr;
+  rc = git_object_peel(&peeled, obj, GIT_OBJECT_BLOB);
+  git_object_free(obj);
+  if (rc != 0) throw GitException(last_error_message(rc));
+  auto *blob = reinterpret_cast<git_blob *>(peeled);
+
+  try {
+    const auto *base = static_cast<const char *>(git_blob_rawcontent(blob));
+    const auto size = static_cast<uint64_t>(git_blob_rawsize(blob));
+    const git_oid *id = git_blob_id(blob);
+    // Blob ids name the content, so the index is shared by every path and repository holding it.
+    const std::string key = "b" + std::string(reinterpret_cast<const char *>(id->id), sizeof(id->id));
+    GitRangeResult out = read_window(opts, MemoryContent(base, size), key);
+    out.binary = git_blob_is_binary(blob) != 0;
+    char hex[GIT_OID_HEXSZ + 1];
+    git_oid_tostr(hex, sizeof(hex), id);
+    out.oid = hex;
+    git_blob_free(blob);
+    return out;
+  } catch (...) {
+    git_blob_free(blob);
+    throw;
+  }
+}
+
+GitRangeResult git_read_file_range(const GitRangeOptions &opts) {
+  std::vector<std::string> parts;
+  if (!split_rel(opts.path, parts)) throw GitException("invalid work-tree path: " + opts.path);
+  const std::string root = repo_cache_key(opts.localPath);
+  const std::string full = root + "/" + opts.path;
+  const char *leaf = parts.back().c_str();
+
+  const int dir = open_parent_dir(root, parts, opts.path);
+  struct stat st;
+  if (fstatat(dir, leaf, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+    const std::string msg = sys_error("cannot stat", opts.path);
+    close(dir);
+    throw GitException(msg);
+  }
+  // git stores a symlink as a blob holding its target; show the same.
+  if (S_ISLNK(st.st_mode)) {
+    std::string target(static_cast<size_t>(st.st_size > 0 ? st.st_size : PATH_MAX), '\0');
+    const ssize_t n = readlinkat(dir, leaf, &target[0], target.size());
+    const std::string msg = n < 0 ? sys_error("cannot read link", opts.path) : "";
+    close(dir);
+    if (n < 0) throw GitException(msg);
+    target.resize(static_cast<size_t>(n));
+    return read_window(opts, MemoryContent(target.data(), target.size()), "");
+  }
+  if (!S_ISREG(st.st_mode)) {
+    close(dir);
+    throw GitException("not a regular file: " + opts.path);
+  }
+
+  const int fd = openat(dir, leaf, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+  const std::string openError = fd < 0 ? sys_error("cannot open", opts.path) : "";
+  close(dir);
+  if (fd < 0) throw GitException(openError);
+  if (fstat(fd, &st) != 0) {
+    const std::string msg = sys_error("cannot stat", opts.path);
+    close(fd);
+    throw GitException(msg);
+  }
+  const auto size = static_cast<uint64_t>(st.st_size);
+  // Edits change mtime (or size/inode on rewrite-by-rename), which retires the cached index.
+  const int64_t mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+  std::string key = "w" + full;
+  key.push_back('\0');
+  key += std::to_string(mtimeNs) + ":" + std::to_string(size) + ":" + std::to_string(static_cast<uint64_t>(st.st_ino));
+
+  try {
+    const FileContent content(fd, size, opts.path);
+    GitRangeResult out = read_window(opts, content, key);
+    std::string sniff;
+    content.read(0, size < kBinarySniffBytes ? size : kBinarySniffBytes, sniff);
+    out.binary = sniff.find('\0') != std::string::npos;
+    close(fd);
+    return out;
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+}
+
+void clear_line_indexes() {
+  std::lock_guard<std::mutex> g(g_indexes_mu);
+  g_indexes.clear();
+}
@@ -0,0 +1,185 @@
+#include "fs_watch.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+constexpr uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO |
+                                IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+// Past this many distinct pending paths a targeted re-check stops being cheaper than a full walk.
+constexpr size_t kMaxPendingPaths = 8192;
+
+std::string join_rel(const std::string &dir, const char *name) {
+  if (dir.empty()) return name;
+  return dir + "/" + name;
+}
+
+bool is_dir_entry(const std::string &abs, const struct dirent *de) {
+  if (de->d_type == DT_DIR) return true;
+  if (de->d_type != DT_UNKNOWN) return false;
+  struct stat st;
+  return lstat(abs.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+}  // namespace
+
+WorkTreeWatcher::WorkTreeWatcher(std::string root) : root_(std::move(root)) {
+  while (root_.size() > 1 && root_.back() == '/') root_.pop_back();
+
+  inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotifyFd_ < 0 || pipe2(wakeFd_, O_CLOEXEC) != 0) {
+    degraded_ = true;
+    return;
+  }
+  thread_ = std::thread([this]() { run(); });
+}
+
+WorkTreeWatcher::~WorkTreeWatcher() {
+  if (thread_.joinable()) {
+    const char b = 1;
+    (void)!write(wakeFd_[1], &b, 1);
+    thread_.join();
+  }
+  if (inotifyFd_ >= 0) close(inotifyFd_);
+  if (wakeFd_[0] >= 0) close(wakeFd_[0]);
+  if (wakeFd_[1] >= 0) close(wakeFd_[1]);
+}
+
+bool WorkTreeWatcher::usable() const {
+  std::lock_guard<std::mutex> g(mu_);
+  return !degraded_;
+}
+
+void WorkTreeWatcher::watch_tree(const std::string &relDir, const SkipDir &skip) {
+  std::vector<std::string> stack{relDir};
+  while (!stack.empty()) {
+    std::string dir = std::move(stack.back());
+    stack.pop_back();
+
+    {
+      std::lock_guard<std::mutex> g(mu_);
+      if (degraded_) return;
+      add_watch_locked(dir);
+    }
+
+    const std::string abs = dir.empty() ? root_ : root_ + "/" + dir;
+    DIR *d = opendir(abs.c_str());
+    if (!d) continue;
+    while (const struct dirent *de = readdir(d)) {
+      const char *name = de->d_name;
+      if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+      if (dir.empty() && std::string(name) == ".git") continue;
+
+      const std::string child = join_rel(dir, name);
+      if (!is_dir_entry(abs + "/" + name, de)) continue;
+      if (skip && skip(child)) continue;
+      stack.push_back(child);
+    }
+    closedir(d);
+  }
+}
+
+WorkTreeWatcher::Changes WorkTreeWatcher::drain() {
+  Changes out;
+  {
+    std::lock_guard<std::mutex> g(mu_);
+    std::swap(out, pending_);
+    if (degraded_) out.overflow = true;
+  }
+  std::sort(out.paths.begin(), out.paths.end());
+  out.paths.erase(std::unique(out.paths.begin(), out.paths.end()), out.paths.end());
+  return out;
+}
+
+void WorkTreeWatcher::add_watch_locked(const std::string &relDir) {
+  const std::string abs = relDir.empty() ? root_ : root_ + "/" + relDir;
+  const int wd = inotify_add_watch(inotifyFd_, abs.c_str(), kWatchMask);
+  if (wd >= 0) {
+    wdToDir_[wd] = relDir;
+    return;
+  }
+  // ENOSPC: fs.inotify.max_user_watches exhausted. A partially watched tree would silently miss
+  // changes, so give up on the watcher entirely.
+  if (errno == ENOSPC || errno == ENOMEM) {
+    degraded_ = true;
+    pending_.overflow = true;
+  }
+}
+
+void WorkTreeWatcher::record_locked(const std::string &relPath) {
+  if (pending_.overflow) return;
+  if (pending_.paths.size() >= kMaxPendingPaths) {
+    pending_.overflow = true;
+    pending_.paths.clear();
+    pending_.newDirs.clear();
+    return;
+  }
+  pending_.paths.push_back(relPath);
+}
+
+void WorkTreeWatcher::run() {
+  alignas(struct inotify_event) char buf[64 * 1024];
+  struct pollfd fds[2];
+  fds[0].fd = inotifyFd_;
+  fds[0].events = POLLIN;
+  fds[1].fd = wakeFd_[0];
+  fds[1].events = POLLIN;
+
+  while (true) {
+    fds[0].revents = 0;
+    fds[1].revents = 0;
+    const int n = poll(fds, 2, -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    if (fds[1].revents & POLLIN) break;
+    if (!(fds[0].revents & POLLIN)) continue;
+
+    while (true) {
+      const ssize_t len = read(inotifyFd_, buf, sizeof(buf));
+      if (len <= 0) break;
+
+      std::lock_guard<std::mutex> g(mu_);
+      for (ssize_t off = 0; off < len;) {
+        const auto *ev = reinterpret_cast<const struct inotify_event *>(buf + off);
+        off += static_cast<ssize_t>(sizeof(struct inotify_event) + ev->len);
+
+        if (ev->mask & IN_Q_OVERFLOW) {
+          pending_.overflow = true;
+          continue;
+        }
+
+        auto it = wdToDir_.find(ev->wd);
+        if (it == wdToDir_.end()) continue;
+        const std::string dir = it->second;
+
+        if (ev->mask & IN_IGNORED) {
+          wdToDir_.erase(it);
+          continue;
+        }
+        if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+          // The root itself went away; nothing cached about it is trustworthy anymore.
+          if (dir.empty()) pending_.overflow = true;
+          continue;
+        }
+        if (ev->len == 0 || ev->name[0] == '\0') continue;
+        if (dir.empty() && std::string(ev->name) == ".git") continue;
+
+        const std::string rel = join_rel(dir, ev->name);
+        record_locked(rel);
+        if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)) && !pending_.overflow) {
+          pending_.newDirs.push_back(rel);
+        }
+      }
+    }
+  }
+}
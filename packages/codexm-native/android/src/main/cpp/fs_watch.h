@@ -0,0 +1,58 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// inotify-based watcher for a work tree. Collects the relative paths that changed since the last
+// `drain()` so callers can re-check only those instead of walking the whole tree.
+//
+// inotify is not recursive: every directory needs its own watch. Directories created after the
+// initial `watch_tree("")` are reported through `Changes::newDirs` instead of being watched
+// automatically, so the caller can skip ignored trees (e.g. a fresh node_modules) before spending
+// watches on them. `.git` is never watched.
+class WorkTreeWatcher {
+ public:
+  struct Changes {
+    std::vector<std::string> paths;    // files or directories that changed (relative, no leading '/')
+    std::vector<std::string> newDirs;  // directories created since the last drain (not yet watched)
+    bool overflow = false;             // events were lost; the caller must rescan everything
+  };
+
+  // Returns true for relative directory paths that should not be watched.
+  using SkipDir = std::function<bool(const std::string &relDir)>;
+
+  explicit WorkTreeWatcher(std::string root);
+  ~WorkTreeWatcher();
+
+  WorkTreeWatcher(const WorkTreeWatcher &) = delete;
+  WorkTreeWatcher &operator=(const WorkTreeWatcher &) = delete;
+
+  // False if inotify could not be initialized or the watch limit was hit; the watcher then only
+  // reports `overflow` and callers should fall back to full scans.
+  bool usable() const;
+
+  // Adds watches for `relDir` and every directory below it. Safe to call while running.
+  void watch_tree(const std::string &relDir, const SkipDir &skip);
+
+  Changes drain();
+
+ private:
+  void run();
+  void add_watch_locked(const std::string &relDir);
+  void record_locked(const std::string &relPath);
+
+  std::string root_;
+  int inotifyFd_ = -1;
+  int wakeFd_[2] = {-1, -1};
+
+  mutable std::mutex mu_;
+  std::unordered_map<int, std::string> wdToDir_;
+  Changes pending_;
+  bool degraded_ = false;
+
+  std::thread thread_;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+// Helpers shared by the translation units that talk to libgit2 directly. Not part of the JNI-facing
+// API in git_ops.h.
+
+#include "git_ops.h"
+
+#include <git2.h>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+class OperationContext;
+
+// Initializes libgit2 once per process (CA cert lookup, global options).
+void ensure_libgit2();
+
+// Pushes the current GitRuntimeConfig into libgit2. Called once from ensure_libgit2().
+void apply_runtime_options();
+
+// Formats the last libgit2 error, falling back to the numeric return code.
+std::string last_error_message(int fallback_code);
+
+// user.name/user.email from the repository config, else a fixed "codexm" identity.
+git_signature *default_signature(git_repository *repo);
+
+// Path reported for a status entry (new side of HEAD..INDEX, else INDEX..WORKDIR), or nullptr.
+const char *status_entry_path(const git_status_entry *s);
+
+// Buckets one path into staged/unstaged/untracked the way git_status() reports it.
+void classify_status(GitStatus &out, const std::string &path, unsigned int flags);
+
+// Drops in-memory incremental status state (and its watcher) for a work tree.
+void forget_incremental_status(const std::string &localPath);
+
+// Sparse prefixes stored for this repository (empty = whole tree).
+std::vector<std::string> read_sparse_paths(git_repository *repo);
+
+// Sorted, deduplicated prefixes without leading "./" or trailing "/", nested ones dropped.
+std::vector<std::string> normalize_sparse_paths(const std::vector<std::string> &prefixes);
+
+// True if `path` is one of `prefixes` or below one of them (always true for an empty set).
+bool sparse_contains(const std::vector<std::string> &prefixes, const std::string &path);
+
+// Replaces the stored sparse set (`prefixes` already normalized; empty removes it).
+void write_sparse_paths(git_repository *repo, const std::vector<std::string> &prefixes);
+
+// Makes the index match HEAD outside the sparse prefixes: missing or stale entries are reset to
+// HEAD's blob and marked skip-worktree, entries HEAD no longer has are dropped, and the flag is
+// cleared inside the prefixes. A sparse checkout only writes index entries for the paths it
+// touches; without this the next tree written from the index would delete everything else.
+// The first form leaves writing `index` to the caller; the second updates the repository's index.
+void sync_sparse_index(git_repository *repo, git_index *index, const std::vector<std::string> &sparse);
+void sync_sparse_index(git_repository *repo, const std::vector<std::string> &sparse);
+
+// Points a git_strarray at `items`; `storage` must outlive the result.
+git_strarray as_strarray(const std::vector<std::string> &items, std::vector<const char *> &storage);
+
+// Paths that may match `opts.pattern` according to the trigram index, after refreshing it; nullopt
+// if the pattern has no literal the index can use. Caller holds the repository lease.
+std::optional<std::vector<std::string>> search_index_candidates(git_repository *repo, const std::string &localPath,
+                                                                const GitSearchOptions &opts, OperationContext &op);
+
+// Drops the in-memory copy of a work tree's trigram index.
+void forget_search_index(const std::string &localPath);
+
+// Pairs renames/copies in `diff` per `opts` (no-op unless enabled), reusing the work tree's cached
+// similarity signatures. Caller holds the repository lease.
+void find_renames(git_diff *diff, const std::string &localPath, const GitRenameOptions &opts);
+
+// Drops cached similarity signatures for one work tree / for all of them.
+void forget_rename_signatures(const std::string &localPath);
+void clear_rename_signatures();
+
+// Drops the line indexes kept by git_read_blob_range() / git_read_file_range().
+void clear_line_indexes();
@@ -1,11 +1,20 @@
 #include "git_ops.h"
 
+#include "git_internal.h"
+#include "operation.h"
+#include "repo_cache.h"
+#include "trace.h"
+
 #include <git2.h>
 
 #include <sys/stat.h>
 
+#include <cstdint>
 #include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace {
@@ -15,6 +24,7 @@ bool dir_exists(const char *path) {
   struct stat st;
   return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
 }
+}  // namespace
 
 void ensure_libgit2() {
   std::call_once(g_libgit2_once, []() {
@@ -30,14 +40,24 @@ void ensure_libgit2() {
     if (ca_dir) {
       git_libgit2_opts(GIT_OPT_SET_SSL_CERT_LOCATIONS, nullptr, ca_dir);
     }
+
+    apply_runtime_options();
   });
 }
 
+std::string last_error_message(int fallback_code) {
+  const git_error *e = git_error_last();
+  if (e && e->message) return std::string(e->message);
+  return "libgit2 error code " + std::to_string(fallback_code);
+}
+
+namespace {
 struct CredPayload {
   std::string username;
   std::string token;
   bool hasCreds = false;
   bool allowInsecure = false;
+  OperationContext *op = nullptr;
 };
 
 int credentials_cb(git_credential **out,
@@ -46,6 +66,7 @@ int credentials_cb(git_credential **out,
                    unsigned int allowed_types,
                    void *payload) {
   auto *p = reinterpret_cast<CredPayload *>(payload);
+  if (p && p->op && p->op->cancelled()) return GIT_EUSER;
   if (!p || !p->hasCreds) return 0;
   if ((allowed_types & GIT_CREDENTIAL_USERPASS_PLAINTEXT) == 0) return 0;
   return git_credential_userpass_plaintext_new(out, p->username.c_str(), p->token.c_str());
@@ -57,27 +78,160 @@ int cert_check_cb(git_cert * /*cert*/, int valid, const char * /*host*/, void *p
   return valid ? 0 : -1;
 }
 
-std::string last_error_message(int fallback_code) {
+// The transfer callbacks below double as cancellation points: returning GIT_EUSER makes libgit2
+// abort the transfer and return it from the top-level call.
+int transfer_progress_cb(const git_indexer_progress *stats, void *payload) {
+  auto *p = reinterpret_cast<CredPayload *>(payload);
+  if (!p || !p->op) return 0;
+  if (p->op->cancelled()) return GIT_EUSER;
+  if (stats->received_objects < stats->total_objects) {
+    p->op->report("receiving", stats->received_objects, stats->total_objects, stats->received_bytes);
+  } else {
+    p->op->report("resolving", stats->indexed_deltas, stats->total_deltas, stats->received_bytes);
+  }
+  return 0;
+}
+
+int sideband_progress_cb(const char *str, int len, void *payload) {
+  auto *p = reinterpret_cast<CredPayload *>(payload);
+  if (!p || !p->op) return 0;
+  if (p->op->cancelled()) return GIT_EUSER;
+  p->op->remote_message(str, len > 0 ? static_cast<size_t>(len) : 0);
+  return 0;
+}
+
+int pack_progress_cb(int /*stage*/, uint32_t current, uint32_t total, void *payload) {
+  auto *p = reinterpret_cast<CredPayload *>(payload);
+  if (!p || !p->op) return 0;
+  if (p->op->cancelled()) return GIT_EUSER;
+  p->op->report("packing", current, total, 0);
+  return 0;
+}
+
+int push_transfer_progress_cb(unsigned int current, unsigned int total, size_t bytes, void *payload) {
+  auto *p = reinterpret_cast<CredPayload *>(payload);
+  if (!p || !p->op) return 0;
+  if (p->op->cancelled()) return GIT_EUSER;
+  p->op->report("uploading", current, total, bytes);
+  return 0;
+}
+
+void install_remote_callbacks(git_remote_callbacks &callbacks, CredPayload &payload) {
+  callbacks.credentials = credentials_cb;
+  callbacks.certificate_check = cert_check_cb;
+  callbacks.transfer_progress = transfer_progress_cb;
+  callbacks.sideband_progress = sideband_progress_cb;
+  callbacks.pack_progress = pack_progress_cb;
+  callbacks.push_transfer_progress = push_transfer_progress_cb;
+  callbacks.payload = &payload;
+}
+
+void checkout_progress_cb(const char * /*path*/, size_t completed, size_t total, void *payload) {
+  static_cast<OperationContext *>(payload)->report("checkout", completed, total, 0);
+}
+
+// progress_cb cannot abort a checkout; notify_cb runs per file before anything is written and can.
+int checkout_notify_cb(git_checkout_notify_t /*why*/,
+                       const git_diff_file * /*baseline*/,
+                       const git_diff_file * /*target*/,
+                       const git_diff_file * /*workdir*/,
+                       void *payload) {
+  return static_cast<OperationContext *>(payload)->cancelled() ? GIT_EUSER : 0;
+}
+
+// Limits a checkout to the sparse prefixes (no-op for a full checkout). `storage` backs co.paths.
+void apply_sparse_paths(git_checkout_options &co, const std::vector<std::string> &sparse,
+                        std::vector<const char *> &storage) {
+  if (sparse.empty()) return;
+  co.checkout_strategy |= GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH;
+  co.paths = as_strarray(sparse, storage);
+}
+
+void install_checkout_callbacks(git_checkout_options &co, OperationContext &op) {
+  co.progress_cb = checkout_progress_cb;
+  co.progress_payload = &op;
+  co.notify_flags = GIT_CHECKOUT_NOTIFY_UPDATED;
+  co.notify_cb = checkout_notify_cb;
+  co.notify_payload = &op;
+}
+
+// Credentials are part of the session key so switching accounts never reuses a remote set up for
+// another one. Only a hash is kept.
+std::string session_key(const CredPayload &payload) {
+  if (!payload.hasCreds) return "anonymous";
+  return std::to_string(std::hash<std::string>{}(payload.username + '\n' + payload.token));
+}
+
+bool is_transport_error() {
   const git_error *e = git_error_last();
-  if (e && e->message) return std::string(e->message);
-  return "libgit2 error code " + std::to_string(fallback_code);
+  return e && (e->klass == GIT_ERROR_NET || e->klass == GIT_ERROR_SSL || e->klass == GIT_ERROR_HTTP ||
+               e->klass == GIT_ERROR_OS);
+}
+
+// Runs `use` on the repository's cached remote. A reused remote may hold a connection the server
+// has since closed, so a transport-level failure on one is retried once on a fresh remote.
+// Failures drop the remote from the cache and throw.
+template <typename Use>
+void with_remote(RepoLease &lease, const std::string &remoteName, CredPayload &payload, Use use) {
+  const std::string key = session_key(payload);
+  bool reused = false;
+  int rc = use(lease.remote(remoteName, key, &reused));
+  if (rc != 0 && reused && !payload.op->cancelled() && is_transport_error()) {
+    lease.drop_remote(remoteName, key);
+    rc = use(lease.remote(remoteName, key, nullptr));
+  }
+  if (rc != 0) {
+    lease.drop_remote(remoteName, key);
+    payload.op->fail(rc);
+  }
+}
+
+void fetch_remote(RepoLease &lease, const std::string &remoteName, CredPayload &payload, int depth,
+                  bool updateFetchHead = true) {
+  trace_phase("negotiate");
+  with_remote(lease, remoteName, payload, [&](git_remote *remote) {
+    git_fetch_options fetch_opts = GIT_FETCH_OPTIONS_INIT;
+    install_remote_callbacks(fetch_opts.callbacks, payload);
+    fetch_opts.depth = depth;
+    fetch_opts.update_fetchhead = updateFetchHead ? 1 : 0;
+    return git_remote_fetch(remote, nullptr, &fetch_opts, nullptr);
+  });
 }
 
-void fetch_remote(git_repository *repo, const std::string &remoteName, CredPayload &payload) {
+// Asks the server which branch its HEAD points at (one ls-remote round trip).
+std::string remote_default_branch(const std::string &url, CredPayload &payload) {
   git_remote *remote = nullptr;
-  int rc = git_remote_lookup(&remote, repo, remoteName.c_str());
+  int rc = git_remote_create_detached(&remote, url.c_str());
   if (rc != 0) throw GitException(last_error_message(rc));
 
-  git_fetch_options fetch_opts = GIT_FETCH_OPTIONS_INIT;
   git_remote_callbacks callbacks = GIT_REMOTE_CALLBACKS_INIT;
-  callbacks.credentials = credentials_cb;
-  callbacks.certificate_check = cert_check_cb;
-  callbacks.payload = &payload;
-  fetch_opts.callbacks = callbacks;
+  install_remote_callbacks(callbacks, payload);
+  rc = git_remote_connect(remote, GIT_DIRECTION_FETCH, &callbacks, nullptr, nullptr);
+  if (rc != 0) {
+    git_remote_free(remote);
+    payload.op->fail(rc);
+  }
 
-  rc = git_remote_fetch(remote, nullptr, &fetch_opts, nullptr);
+  git_buf buf = GIT_BUF_INIT;
+  rc = git_remote_default_branch(&buf, remote);
+  std::string branch = rc == 0 && buf.ptr ? buf.ptr : "";
+  git_buf_dispose(&buf);
+  git_remote_disconnect(remote);
   git_remote_free(remote);
+  if (rc == GIT_ENOTFOUND) return "";  // Empty remote: nothing to narrow down to.
   if (rc != 0) throw GitException(last_error_message(rc));
+
+  const std::string prefix = "refs/heads/";
+  if (branch.compare(0, prefix.size(), prefix) == 0) branch.erase(0, prefix.size());
+  return branch;
+}
+
+// Creates "origin" with a fetchspec for one branch, so both the clone and later fetches skip the
+// other branches.
+int single_branch_remote_cb(git_remote **out, git_repository *repo, const char *name, const char *url,
+                            void *payload) {
+  const auto *fetchspec = static_cast<const std::string *>(payload);
+  return git_remote_create_with_fetchspec(out, repo, name, url, fetchspec->c_str());
 }
 }  // namespace
 
@@ -87,31 +241,53 @@ void git_clone_repo(const GitCloneOptions &opts) {
   git_repository *repo = nullptr;
 
   git_clone_options clone_opts = GIT_CLONE_OPTIONS_INIT;
-  git_fetch_options fetch_opts = GIT_FETCH_OPTIONS_INIT;
-  git_remote_callbacks callbacks = GIT_REMOTE_CALLBACKS_INIT;
+  OperationContext op(opts.hooks.operationId, opts.hooks.onProgress);
 
   CredPayload payload;
   payload.allowInsecure = opts.allowInsecure;
+  payload.op = &op;
   if (!opts.username.empty() && !opts.token.empty()) {
     payload.username = opts.username;
     payload.token = opts.token;
     payload.hasCreds = true;
   }
 
-  callbacks.credentials = credentials_cb;
-  callbacks.certificate_check = cert_check_cb;
-  callbacks.payload = &payload;
-
-  fetch_opts.callbacks = callbacks;
-  clone_opts.fetch_opts = fetch_opts;
+  install_remote_callbacks(clone_opts.fetch_opts.callbacks, payload);
+  install_checkout_callbacks(clone_opts.checkout_opts, op);
+  const std::vector<std::string> sparse = normalize_sparse_paths(opts.sparsePaths);
+  std::vector<const char *> sparseStorage;
+  apply_sparse_paths(clone_opts.checkout_opts, sparse, sparseStorage);
+  clone_opts.fetch_opts.depth = opts.depth > 0 ? opts.depth : GIT_FETCH_DEPTH_FULL;
+
+  std::string branch = opts.branch;
+  std::string singleBranchSpec;
+  if (opts.singleBranch && branch.empty()) branch = remote_default_branch(opts.remoteUrl, payload);
+  if (opts.singleBranch && !branch.empty()) {
+    singleBranchSpec = "+refs/heads/" + branch + ":refs/remotes/origin/" + branch;
+    clone_opts.remote_cb = single_branch_remote_cb;
+    clone_opts.remote_cb_payload = &singleBranchSpec;
+  }
 
-  if (!opts.branch.empty()) {
-    clone_opts.checkout_branch = opts.branch.c_str();
+  if (!branch.empty()) {
+    clone_opts.checkout_branch = branch.c_str();
   }
 
+  // Whatever was cached for this path belongs to a work tree that is about to be replaced.
+  forget_incremental_status(opts.localPath);
+  invalidate_repo(opts.localPath);
+
+  trace_phase("negotiate");
   int rc = git_clone(&repo, opts.remoteUrl.c_str(), opts.localPath.c_str(), &clone_opts);
-  if (rc != 0) {
-    throw GitException(last_error_message(rc));
+  if (rc != 0) op.fail(rc);
+
+  if (!sparse.empty()) {
+    try {
+      write_sparse_paths(repo, sparse);
+      sync_sparse_index(repo, sparse);
+    } catch (...) {
+      git_repository_free(repo);
+      throw;
+    }
   }
 
   if (repo && (!opts.userName.empty() || !opts.userEmail.empty())) {
@@ -131,48 +307,220 @@ void git_clone_repo(const GitCloneOptions &opts) {
 }
 
 void git_checkout_ref(const GitCheckoutOptions &opts) {
-  ensure_libgit2();
-
-  git_repository *repo = nullptr;
-  int rc = git_repository_open(&repo, opts.localPath.c_str());
-  if (rc != 0) throw GitException(last_error_message(rc));
+  RepoLease lease = acquire_repo(opts.localPath);
+  git_repository *repo = lease.get();
 
   git_object *obj = nullptr;
-  rc = git_revparse_single(&obj, repo, opts.ref.c_str());
-  if (rc != 0) {
-    git_repository_free(repo);
-    throw GitException(last_error_message(rc));
-  }
+  int rc = git_revparse_single(&obj, repo, opts.ref.c_str());
+  if (rc != 0) throw GitException(last_error_message(rc));
 
+  OperationContext op(opts.hooks.operationId, opts.hooks.onProgress);
   git_checkout_options co = GIT_CHECKOUT_OPTIONS_INIT;
   co.checkout_strategy = GIT_CHECKOUT_SAFE | GIT_CHECKOUT_RECREATE_MISSING;
+  install_checkout_callbacks(co, op);
+  const std::vector<std::string> sparse = read_sparse_paths(repo);
+  std::vector<const char *> sparseStorage;
+  apply_sparse_paths(co, sparse, sparseStorage);
   rc = git_checkout_tree(repo, obj, &co);
   if (rc != 0) {
     git_object_free(obj);
-    git_repository_free(repo);
-    throw GitException(last_error_message(rc));
+    op.fail(rc);
   }
 
   rc = git_repository_set_head_detached(repo, git_object_id(obj));
   if (rc != 0) {
     git_object_free(obj);
-    git_repository_free(repo);
     throw GitException(last_error_message(rc));
   }
 
   git_object_free(obj);
-  git_repository_free(repo);
+  if (!sparse.empty()) sync_sparse_index(repo, sparse);
+
+  // Checkout rewrites HEAD and large parts of the work tree; let the next caller start from a fresh
+  // handle instead of inheriting index/attr caches built for the previous tree.
+  lease.invalidate();
 }
 
-void git_pull_ff_only(const GitPullOptions &opts) {
-  ensure_libgit2();
+namespace {
+std::string oid_str(const git_oid *id) {
+  return id ? std::string(git_oid_tostr_s(id)) : std::string();
+}
 
-  git_repository *repo = nullptr;
-  int rc = git_repository_open(&repo, opts.localPath.c_str());
+void collect_conflicts(git_index *index, std::vector<GitConflict> &out) {
+  git_index_conflict_iterator *it = nullptr;
+  int rc = git_index_conflict_iterator_new(&it, index);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  const git_index_entry *ancestor = nullptr, *ours = nullptr, *theirs = nullptr;
+  while ((rc = git_index_conflict_next(&ancestor, &ours, &theirs, it)) == 0) {
+    GitConflict c;
+    const git_index_entry *any = ours ? ours : (theirs ? theirs : ancestor);
+    c.path = any && any->path ? any->path : "";
+    c.ancestorOid = ancestor ? oid_str(&ancestor->id) : "";
+    c.oursOid = ours ? oid_str(&ours->id) : "";
+    c.theirsOid = theirs ? oid_str(&theirs->id) : "";
+    out.push_back(std::move(c));
+  }
+  git_index_conflict_iterator_free(it);
+  if (rc != GIT_ITEROVER) throw GitException(last_error_message(rc));
+}
+
+// Moves `localRefName` to `target` and updates the work tree to match. The checkout runs first,
+// while HEAD still names the old tip, so its baseline is the old tree and only paths that differ
+// between the two commits are written. SAFE (without RECREATE_MISSING) leaves local edits and
+// deletions of untouched paths alone and fails before writing anything if the pull would
+// overwrite local changes. The ref is only moved once the work tree is updated.
+void advance_branch(git_repository *repo, OperationContext &op, const std::string &localRefName, const git_oid &target,
+                    const std::string &reflog) {
+  git_object *target_obj = nullptr;
+  int rc = git_object_lookup(&target_obj, repo, &target, GIT_OBJECT_COMMIT);
   if (rc != 0) throw GitException(last_error_message(rc));
 
+  git_checkout_options co = GIT_CHECKOUT_OPTIONS_INIT;
+  co.checkout_strategy = GIT_CHECKOUT_SAFE;
+  install_checkout_callbacks(co, op);
+  const std::vector<std::string> sparse = read_sparse_paths(repo);
+  std::vector<const char *> sparseStorage;
+  apply_sparse_paths(co, sparse, sparseStorage);
+  rc = git_checkout_tree(repo, target_obj, &co);
+  git_object_free(target_obj);
+  if (rc == GIT_ECONFLICT) throw GitException("Local changes would be overwritten by pull");
+  if (rc != 0) op.fail(rc);
+
+  git_reference *ref = nullptr;
+  rc = git_reference_create(&ref, repo, localRefName.c_str(), &target, 1, reflog.c_str());
+  if (ref) git_reference_free(ref);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  rc = git_repository_set_head(repo, localRefName.c_str());
+  if (rc != 0) throw GitException(last_error_message(rc));
+  if (!sparse.empty()) sync_sparse_index(repo, sparse);
+}
+
+// Three-way merge of the two tips entirely in memory. Returns false with `conflicts` filled if the
+// merge does not resolve cleanly; otherwise writes the merge commit object (no refs) to `out`.
+bool merge_in_memory(git_repository *repo, const git_oid &ours, const git_oid &theirs, const std::string &message,
+                     git_oid &out, std::vector<GitConflict> &conflicts) {
+  git_commit *ourCommit = nullptr, *theirCommit = nullptr;
+  git_index *index = nullptr;
+  git_tree *tree = nullptr;
+  git_signature *sig = nullptr;
+  bool clean = false;
+
+  int rc = git_commit_lookup(&ourCommit, repo, &ours);
+  if (rc == 0) rc = git_commit_lookup(&theirCommit, repo, &theirs);
+  if (rc == 0) {
+    git_merge_options mo = GIT_MERGE_OPTIONS_INIT;
+    rc = git_merge_commits(&index, repo, ourCommit, theirCommit, &mo);
+  }
+  try {
+    if (rc == 0 && git_index_has_conflicts(index)) {
+      collect_conflicts(index, conflicts);
+    } else if (rc == 0) {
+      git_oid treeId{};
+      rc = git_index_write_tree_to(&treeId, index, repo);
+      if (rc == 0) rc = git_tree_lookup(&tree, repo, &treeId);
+      if (rc == 0) {
+        sig = default_signature(repo);
+        const git_commit *parents[] = {ourCommit, theirCommit};
+        rc = git_commit_create(&out, repo, nullptr, sig, sig, nullptr, message.c_str(), tree, 2, parents);
+      }
+      clean = rc == 0;
+    }
+  } catch (...) {
+    if (index) git_index_free(index);
+    git_commit_free(theirCommit);
+    git_commit_free(ourCommit);
+    throw;
+  }
+
+  if (sig) git_signature_free(sig);
+  if (tree) git_tree_free(tree);
+  if (index) git_index_free(index);
+  if (theirCommit) git_commit_free(theirCommit);
+  if (ourCommit) git_commit_free(ourCommit);
+  if (rc != 0) throw GitException(last_error_message(rc));
+  return clean;
+}
+
+// Replays local commits onto `theirs` in memory. Returns false with `conflicts` filled at the first
+// step that does not apply cleanly; otherwise `out` is the rebased tip (commit objects only).
+bool rebase_in_memory(git_repository *repo, const git_oid &ours, const git_oid &theirs, git_oid &out,
+                      std::vector<GitConflict> &conflicts) {
+  git_annotated_commit *branch = nullptr, *upstream = nullptr;
+  git_rebase *rebase = nullptr;
+  git_signature *sig = nullptr;
+  bool clean = false;
+
+  int rc = git_annotated_commit_lookup(&branch, repo, &ours);
+  if (rc == 0) rc = git_annotated_commit_lookup(&upstream, repo, &theirs);
+  if (rc == 0) {
+    git_rebase_options ro = GIT_REBASE_OPTIONS_INIT;
+    ro.inmemory = 1;
+    rc = git_rebase_init(&rebase, repo, branch, upstream, nullptr, &ro);
+  }
+  try {
+    if (rc == 0) sig = default_signature(repo);
+    out = theirs;
+    git_rebase_operation *step = nullptr;
+    while (rc == 0 && (rc = git_rebase_next(&step, rebase)) == 0) {
+      git_index *index = nullptr;
+      rc = git_rebase_inmemory_index(&index, rebase);
+      if (rc != 0) break;
+      const bool conflicted = git_index_has_conflicts(index);
+      if (conflicted) {
+        try {
+          collect_conflicts(index, conflicts);
+        } catch (...) {
+          git_index_free(index);
+          throw;
+        }
+      }
+      git_index_free(index);
+      if (conflicted) {
+        rc = GIT_ECONFLICT;
+        break;
+      }
+
+      git_oid id{};
+      // Keep each commit's author; libgit2 reuses the original message when none is given.
+      rc = git_rebase_commit(&id, rebase, nullptr, sig, nullptr, nullptr);
+      if (rc == GIT_EAPPLIED) rc = 0;  // Already upstream; the step becomes empty and is dropped.
+      else if (rc == 0) out = id;
+    }
+
+    if (rc == GIT_ITEROVER) {
+      rc = git_rebase_finish(rebase, sig);
+      clean = rc == 0;
+    } else if (rc == GIT_ECONFLICT) {
+      git_rebase_abort(rebase);
+      rc = 0;
+    }
+  } catch (...) {
+    if (sig) git_signature_free(sig);
+    if (rebase) git_rebase_free(rebase);
+    git_annotated_commit_free(upstream);
+    git_annotated_commit_free(branch);
+    throw;
+  }
+
+  if (sig) git_signature_free(sig);
+  if (rebase) git_rebase_free(rebase);
+  if (upstream) git_annotated_commit_free(upstream);
+  if (branch) git_annotated_commit_free(branch);
+  if (rc != 0) throw GitException(last_error_message(rc));
+  return clean;
+}
+}  // namespace
+
+GitPullResult git_pull(const GitPullOptions &opts) {
+  RepoLease lease = acquire_repo(opts.localPath);
+  git_repository *repo = lease.get();
+  OperationContext op(opts.hooks.operationId, opts.hooks.onProgress);
+
   CredPayload payload;
   payload.allowInsecure = opts.allowInsecure;
+  payload.op = &op;
   if (!opts.username.empty() && !opts.token.empty()) {
     payload.username = opts.username;
     payload.token = opts.token;
@@ -180,8 +528,10 @@ void git_pull_ff_only(const GitPullOptions &opts) {
   }
 
   const std::string remoteName = opts.remote.empty() ? "origin" : opts.remote;
-  fetch_remote(repo, remoteName, payload);
+  fetch_remote(lease, remoteName, payload,
+               opts.unshallow ? GIT_FETCH_DEPTH_UNSHALLOW : (opts.depth > 0 ? opts.depth : GIT_FETCH_DEPTH_FULL));
 
+  int rc = 0;
   std::string branchName = opts.branch;
   if (branchName.empty()) {
     git_reference *head = nullptr;
@@ -192,107 +542,106 @@ void git_pull_ff_only(const GitPullOptions &opts) {
     }
   }
   if (branchName.empty()) {
-    git_repository_free(repo);
     throw GitException("Unable to determine current branch for pull");
   }
 
+  trace_phase("merge");
   const std::string remoteRefName = "refs/remotes/" + remoteName + "/" + branchName;
-  git_reference *remote_ref = nullptr;
-  rc = git_reference_lookup(&remote_ref, repo, remoteRefName.c_str());
-  if (rc != 0) {
-    git_repository_free(repo);
-    throw GitException(last_error_message(rc));
-  }
+  git_oid theirs{};
+  rc = git_reference_name_to_id(&theirs, repo, remoteRefName.c_str());
+  if (rc != 0) throw GitException(last_error_message(rc));
 
   git_annotated_commit *their_head = nullptr;
-  rc = git_annotated_commit_from_ref(&their_head, repo, remote_ref);
-  const git_oid *target_oid = git_reference_target(remote_ref);
-  git_reference_free(remote_ref);
-  if (rc != 0 || !target_oid) {
-    if (their_head) git_annotated_commit_free(their_head);
-    git_repository_free(repo);
-    throw GitException(last_error_message(rc != 0 ? rc : -1));
-  }
+  rc = git_annotated_commit_lookup(&their_head, repo, &theirs);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  const std::string localRefName = "refs/heads/" + branchName;
+  git_reference *local_ref = nullptr;
+  const bool localExists = git_reference_lookup(&local_ref, repo, localRefName.c_str()) == 0;
 
-  git_merge_analysis_t analysis;
+  git_merge_analysis_t analysis = GIT_MERGE_ANALYSIS_NONE;
   git_merge_preference_t pref;
   const git_annotated_commit *heads[] = {their_head};
-  rc = git_merge_analysis(&analysis, &pref, repo, heads, 1);
-  if (rc != 0) {
-    git_annotated_commit_free(their_head);
-    git_repository_free(repo);
-    throw GitException(last_error_message(rc));
+  rc = localExists ? git_merge_analysis_for_ref(&analysis, &pref, repo, local_ref, heads, 1)
+                   : git_merge_analysis(&analysis, &pref, repo, heads, 1);
+  git_oid ours{};
+  if (localExists) {
+    const git_oid *target = git_reference_target(local_ref);
+    if (target) ours = *target;
+    git_reference_free(local_ref);
   }
+  git_annotated_commit_free(their_head);
+  if (rc != 0) throw GitException(last_error_message(rc));
 
+  GitPullResult result;
   if (analysis & GIT_MERGE_ANALYSIS_UP_TO_DATE) {
-    git_annotated_commit_free(their_head);
-    git_repository_free(repo);
-    return;
+    result.outcome = GitPullOutcome::UpToDate;
+    result.head = oid_str(&ours);
+    return result;
   }
 
-  if (!(analysis & GIT_MERGE_ANALYSIS_FASTFORWARD)) {
-    git_annotated_commit_free(their_head);
-    git_repository_free(repo);
-    throw GitException("Non fast-forward pull not supported in Phase A");
+  const std::string upstream = remoteName + "/" + branchName;
+  if (!localExists || (analysis & (GIT_MERGE_ANALYSIS_FASTFORWARD | GIT_MERGE_ANALYSIS_UNBORN))) {
+    advance_branch(repo, op, localRefName, theirs, "pull: fast-forward");
+    result.outcome = GitPullOutcome::FastForward;
+    result.head = oid_str(&theirs);
+    return result;
   }
 
-  const std::string localRefName = "refs/heads/" + branchName;
-  git_reference *local_ref = nullptr;
-  rc = git_reference_lookup(&local_ref, repo, localRefName.c_str());
-  if (rc != 0) {
-    git_annotated_commit_free(their_head);
-    git_repository_free(repo);
-    throw GitException(last_error_message(rc));
+  git_oid tip{};
+  bool clean = false;
+  switch (opts.strategy) {
+    case GitPullStrategy::FastForwardOnly:
+      throw GitException("Branches have diverged; pull with merge or rebase");
+    case GitPullStrategy::Merge:
+      clean = merge_in_memory(repo, ours, theirs, "Merge " + upstream + " into " + branchName, tip,
+                              result.conflicts);
+      result.outcome = GitPullOutcome::Merged;
+      break;
+    case GitPullStrategy::Rebase:
+      clean = rebase_in_memory(repo, ours, theirs, tip, result.conflicts);
+      result.outcome = GitPullOutcome::Rebased;
+      break;
   }
 
-  git_reference *new_ref = nullptr;
-  rc = git_reference_set_target(&new_ref, local_ref, target_oid, "fast-forward");
-  git_reference_free(local_ref);
-  if (new_ref) git_reference_free(new_ref);
-  if (rc != 0) {
-    git_annotated_commit_free(their_head);
-    git_repository_free(repo);
-    throw GitException(last_error_message(rc));
+  if (!clean) {
+    // Nothing has been written: the work tree, index and refs are exactly as before the pull.
+    result.outcome = GitPullOutcome::Conflicts;
+    result.head = oid_str(&ours);
+    return result;
   }
 
-  git_object *target_obj = nullptr;
-  rc = git_object_lookup(&target_obj, repo, target_oid, GIT_OBJECT_COMMIT);
-  if (rc != 0) {
-    git_annotated_commit_free(their_head);
-    git_repository_free(repo);
-    throw GitException(last_error_message(rc));
-  }
+  advance_branch(repo, op, localRefName, tip,
+                 opts.strategy == GitPullStrategy::Merge ? "pull: merge " + upstream : "pull: rebase onto " + upstream);
+  result.head = oid_str(&tip);
+  return result;
+}
 
-  git_checkout_options co = GIT_CHECKOUT_OPTIONS_INIT;
-  co.checkout_strategy = GIT_CHECKOUT_SAFE | GIT_CHECKOUT_RECREATE_MISSING;
-  rc = git_checkout_tree(repo, target_obj, &co);
-  git_object_free(target_obj);
-  if (rc != 0) {
-    git_annotated_commit_free(their_head);
-    git_repository_free(repo);
-    throw GitException(last_error_message(rc));
-  }
+void git_fetch(const GitFetchOptions &opts) {
+  RepoLease lease = acquire_repo(opts.localPath);
+  OperationContext op(opts.hooks.operationId, opts.hooks.onProgress);
 
-  rc = git_repository_set_head(repo, localRefName.c_str());
-  if (rc != 0) {
-    git_annotated_commit_free(their_head);
-    git_repository_free(repo);
-    throw GitException(last_error_message(rc));
+  CredPayload payload;
+  payload.allowInsecure = opts.allowInsecure;
+  payload.op = &op;
+  if (!opts.username.empty() && !opts.token.empty()) {
+    payload.username = opts.username;
+    payload.token = opts.token;
+    payload.hasCreds = true;
   }
 
-  git_annotated_commit_free(their_head);
-  git_repository_free(repo);
+  // FETCH_HEAD is left alone: it describes the user's last explicit fetch/pull.
+  fetch_remote(lease, opts.remote.empty() ? "origin" : opts.remote, payload, GIT_FETCH_DEPTH_FULL, false);
 }
 
 void git_push_branch(const GitPushOptions &opts) {
-  ensure_libgit2();
-
-  git_repository *repo = nullptr;
-  int rc = git_repository_open(&repo, opts.localPath.c_str());
-  if (rc != 0) throw GitException(last_error_message(rc));
+  RepoLease lease = acquire_repo(opts.localPath);
+  git_repository *repo = lease.get();
+  OperationContext op(opts.hooks.operationId, opts.hooks.onProgress);
 
   CredPayload payload;
   payload.allowInsecure = opts.allowInsecure;
+  payload.op = &op;
   if (!opts.username.empty() && !opts.token.empty()) {
     payload.username = opts.username;
     payload.token = opts.token;
@@ -300,13 +649,7 @@ void git_push_branch(const GitPushOptions &opts) {
   }
 
   const std::string remoteName = opts.remote.empty() ? "origin" : opts.remote;
-  git_remote *remote = nullptr;
-  rc = git_remote_lookup(&remote, repo, remoteName.c_str());
-  if (rc != 0) {
-    git_repository_free(repo);
-    throw GitException(last_error_message(rc));
-  }
-
+  int rc = 0;
   std::string branchName = opts.branch;
   if (branchName.empty()) {
     git_reference *head = nullptr;
@@ -317,8 +660,6 @@ void git_push_branch(const GitPushOptions &opts) {
     }
   }
   if (branchName.empty()) {
-    git_remote_free(remote);
-    git_repository_free(repo);
     throw GitException("Unable to determine current branch for push");
   }
 
@@ -328,69 +669,119 @@ void git_push_branch(const GitPushOptions &opts) {
   refspecs.count = 1;
   refspecs.strings = const_cast<char **>(specs);
 
-  git_push_options push_opts = GIT_PUSH_OPTIONS_INIT;
-  git_remote_callbacks callbacks = GIT_REMOTE_CALLBACKS_INIT;
-  callbacks.credentials = credentials_cb;
-  callbacks.certificate_check = cert_check_cb;
-  callbacks.payload = &payload;
-  push_opts.callbacks = callbacks;
+  trace_phase("negotiate");
+  with_remote(lease, remoteName, payload, [&](git_remote *remote) {
+    git_push_options push_opts = GIT_PUSH_OPTIONS_INIT;
+    install_remote_callbacks(push_opts.callbacks, payload);
+    return git_remote_push(remote, &refspecs, &push_opts);
+  });
+}
 
-  rc = git_remote_push(remote, &refspecs, &push_opts);
-  git_remote_free(remote);
-  git_repository_free(repo);
-  if (rc != 0) throw GitException(last_error_message(rc));
+void git_set_remote_idle_timeout(int64_t ms) {
+  set_remote_idle_timeout_ms(ms);
 }
 
-GitStatus git_status(const std::string &localPath) {
-  ensure_libgit2();
+void git_release_repo(const std::string &localPath) {
+  git_prefetch_forget(localPath);
+  forget_incremental_status(localPath);
+  forget_search_index(localPath);
+  forget_rename_signatures(localPath);
+  invalidate_repo(localPath);
+}
 
-  git_repository *repo = nullptr;
-  int rc = git_repository_open(&repo, localPath.c_str());
+git_signature *default_signature(git_repository *repo) {
+  git_signature *sig = nullptr;
+  if (git_signature_default(&sig, repo) == 0) return sig;
+  const int rc = git_signature_now(&sig, "codexm", "codexm@localhost");
   if (rc != 0) throw GitException(last_error_message(rc));
+  return sig;
+}
+
+const char *status_entry_path(const git_status_entry *s) {
+  if (s->head_to_index && s->head_to_index->new_file.path) return s->head_to_index->new_file.path;
+  if (s->index_to_workdir && s->index_to_workdir->new_file.path) return s->index_to_workdir->new_file.path;
+  return nullptr;
+}
+
+void classify_status(GitStatus &out, const std::string &path, unsigned int flags) {
+  if (flags & (GIT_STATUS_INDEX_NEW | GIT_STATUS_INDEX_MODIFIED | GIT_STATUS_INDEX_DELETED |
+               GIT_STATUS_INDEX_RENAMED | GIT_STATUS_INDEX_TYPECHANGE)) {
+    out.staged.push_back(path);
+  }
+  if (flags & (GIT_STATUS_WT_MODIFIED | GIT_STATUS_WT_DELETED | GIT_STATUS_WT_RENAMED |
+               GIT_STATUS_WT_TYPECHANGE)) {
+    out.unstaged.push_back(path);
+  }
+  if (flags & GIT_STATUS_WT_NEW) {
+    out.untracked.push_back(path);
+  }
+}
+
+static GitStatus status_from_diffs(git_repository *repo, const std::string &localPath,
+                                   const GitRenameOptions &renames);
+
+GitStatus git_status(const std::string &localPath, const GitRenameOptions &renames) {
+  RepoLease lease = acquire_repo(localPath);
+  git_repository *repo = lease.get();
+  // libgit2's status list can't take a rename limit or a metric, so pairing goes through the diffs.
+  if (renames.enabled) return status_from_diffs(repo, localPath, renames);
 
   git_status_options opts = GIT_STATUS_OPTIONS_INIT;
   opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
   opts.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_RENAMES_HEAD_TO_INDEX;
 
-  git_status_list *status = nullptr;
-  rc = git_status_list_new(&status, repo, &opts);
-  if (rc != 0) {
-    git_repository_free(repo);
-    throw GitException(last_error_message(rc));
+  // Files outside a sparse checkout are absent from the work tree on purpose; don't report them.
+  const std::vector<std::string> sparse = read_sparse_paths(repo);
+  std::vector<const char *> sparseStorage;
+  if (!sparse.empty()) {
+    opts.flags |= GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+    opts.pathspec = as_strarray(sparse, sparseStorage);
   }
 
+  trace_phase("walk");
+  git_status_list *status = nullptr;
+  int rc = git_status_list_new(&status, repo, &opts);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  trace_phase("classify");
   GitStatus out;
   const size_t count = git_status_list_entrycount(status);
+  trace_count("rows", static_cast<int64_t>(count));
   for (size_t i = 0; i < count; i++) {
     const git_status_entry *s = git_status_byindex(status, i);
     if (!s) continue;
-
-    const char *path = nullptr;
-    if (s->head_to_index && s->head_to_index->new_file.path) path = s->head_to_index->new_file.path;
-    else if (s->index_to_workdir && s->index_to_workdir->new_file.path) path = s->index_to_workdir->new_file.path;
+    const char *path = status_entry_path(s);
     if (!path) continue;
-
-    const unsigned int st = s->status;
-    const std::string p(path);
-
-    if (st & (GIT_STATUS_INDEX_NEW | GIT_STATUS_INDEX_MODIFIED | GIT_STATUS_INDEX_DELETED |
-              GIT_STATUS_INDEX_RENAMED | GIT_STATUS_INDEX_TYPECHANGE)) {
-      out.staged.push_back(p);
-    }
-    if (st & (GIT_STATUS_WT_MODIFIED | GIT_STATUS_WT_DELETED | GIT_STATUS_WT_RENAMED |
-              GIT_STATUS_WT_TYPECHANGE)) {
-      out.unstaged.push_back(p);
-    }
-    if (st & GIT_STATUS_WT_NEW) {
-      out.untracked.push_back(p);
-    }
+    classify_status(out, path, s->status);
   }
 
   git_status_list_free(status);
-  git_repository_free(repo);
   return out;
 }
 
+std::string git_status_packed(const GitStatus &st) {
+  const std::vector<std::string> *buckets[] = {&st.staged, &st.unstaged, &st.untracked};
+  size_t count = 0, pathBytes = 0;
+  for (const auto *b : buckets) {
+    count += b->size();
+    for (const auto &p : *b) pathBytes += p.size() + 1;
+  }
+
+  std::string buf;
+  buf.resize(4 + count);
+  buf.reserve(4 + count + pathBytes);
+  for (int i = 0; i < 4; i++) buf[i] = static_cast<char>((count >> (8 * i)) & 0xff);
+  size_t at = 4;
+  for (char bucket = 0; bucket < 3; bucket++) {
+    for (const auto &p : *buckets[static_cast<size_t>(bucket)]) {
+      buf[at++] = bucket;
+      buf.append(p);
+      buf.push_back('\0');
+    }
+  }
+  return buf;
+}
+
 struct DiffBuffer {
   std::string out;
   size_t maxBytes = 0;
@@ -448,17 +839,31 @@ static void print_diff(DiffBuffer &buf, git_diff *diff) {
   if (rc != 0) throw GitException(last_error_message(rc));
 }
 
-std::string git_diff_unified(const std::string &localPath, size_t maxBytes) {
-  ensure_libgit2();
+// HEAD..INDEX and INDEX..WORKDIR (including untracked content) for one work tree.
+struct WorktreeDiffs {
+  git_diff *staged = nullptr;
+  git_diff *workdir = nullptr;
+
+  WorktreeDiffs() = default;
+  WorktreeDiffs(const WorktreeDiffs &) = delete;
+  WorktreeDiffs &operator=(const WorktreeDiffs &) = delete;
+  ~WorktreeDiffs() {
+    if (workdir) git_diff_free(workdir);
+    if (staged) git_diff_free(staged);
+  }
+};
 
-  git_repository *repo = nullptr;
-  int rc = git_repository_open(&repo, localPath.c_str());
+static void build_worktree_diffs(git_repository *repo, WorktreeDiffs &out, const std::string &localPath,
+                                 const GitRenameOptions &renames) {
+  trace_phase("index");
+  git_index *index = nullptr;
+  int rc = git_repository_index(&index, repo);
   if (rc != 0) throw GitException(last_error_message(rc));
 
-  git_index *index = nullptr;
-  rc = git_repository_index(&index, repo);
+  // The handle may be cached from an earlier call; pick up index changes made since then.
+  rc = git_index_read(index, 0);
   if (rc != 0) {
-    git_repository_free(repo);
+    git_index_free(index);
     throw GitException(last_error_message(rc));
   }
 
@@ -471,7 +876,6 @@ std::string git_diff_unified(const std::string &localPath, size_t maxBytes) {
     if (rc != 0) {
       git_reference_free(headRef);
       git_index_free(index);
-      git_repository_free(repo);
       throw GitException(last_error_message(rc));
     }
     rc = git_commit_tree(&headTree, reinterpret_cast<git_commit *>(headObj));
@@ -479,55 +883,337 @@ std::string git_diff_unified(const std::string &localPath, size_t maxBytes) {
     git_reference_free(headRef);
     if (rc != 0) {
       git_index_free(index);
-      git_repository_free(repo);
       throw GitException(last_error_message(rc));
     }
   } else if (rc == GIT_ENOTFOUND || rc == GIT_EUNBORNBRANCH) {
     // Repo has no commits yet; treat HEAD tree as empty.
   } else {
     git_index_free(index);
-    git_repository_free(repo);
     throw GitException(last_error_message(rc));
   }
 
-  DiffBuffer buf;
-  buf.maxBytes = maxBytes;
+  trace_phase("walk");
+  const std::vector<std::string> sparse = read_sparse_paths(repo);
+  std::vector<const char *> sparseStorage;
+  const git_strarray sparseSpec = as_strarray(sparse, sparseStorage);
+  const uint32_t sparseFlags = sparse.empty() ? 0 : GIT_DIFF_DISABLE_PATHSPEC_MATCH;
 
-  git_diff *diffStaged = nullptr;
   git_diff_options stagedOpts = GIT_DIFF_OPTIONS_INIT;
-  rc = git_diff_tree_to_index(&diffStaged, repo, headTree, index, &stagedOpts);
+  stagedOpts.flags |= sparseFlags;
+  stagedOpts.pathspec = sparseSpec;
+  rc = git_diff_tree_to_index(&out.staged, repo, headTree, index, &stagedOpts);
   if (rc != 0) {
     if (headTree) git_tree_free(headTree);
     git_index_free(index);
-    git_repository_free(repo);
     throw GitException(last_error_message(rc));
   }
 
-  git_diff *diffWorkdir = nullptr;
   git_diff_options workOpts = GIT_DIFF_OPTIONS_INIT;
   workOpts.flags = GIT_DIFF_INCLUDE_UNTRACKED | GIT_DIFF_RECURSE_UNTRACKED_DIRS |
-                   GIT_DIFF_SHOW_UNTRACKED_CONTENT;
-  rc = git_diff_index_to_workdir(&diffWorkdir, repo, index, &workOpts);
-  if (rc != 0) {
-    git_diff_free(diffStaged);
-    if (headTree) git_tree_free(headTree);
-    git_index_free(index);
-    git_repository_free(repo);
-    throw GitException(last_error_message(rc));
+                   GIT_DIFF_SHOW_UNTRACKED_CONTENT | sparseFlags;
+  workOpts.pathspec = sparseSpec;
+  rc = git_diff_index_to_workdir(&out.workdir, repo, index, &workOpts);
+  if (headTree) git_tree_free(headTree);
+  git_index_free(index);
+  if (rc != 0) throw GitException(last_error_message(rc));
+  trace_count("rows", static_cast<int64_t>((out.staged ? git_diff_num_deltas(out.staged) : 0) +
+                                           git_diff_num_deltas(out.workdir)));
+
+  if (renames.enabled) {
+    trace_phase("renames");
+    find_renames(out.staged, localPath, renames);
+    find_renames(out.workdir, localPath, renames);
   }
+}
+
+// git_status() buckets from the two diffs, rename-paired. Untracked directories come out file by
+// file (the work-tree diff recurses into them so files moved into a new directory can be paired).
+static GitStatus status_from_diffs(git_repository *repo, const std::string &localPath,
+                                   const GitRenameOptions &renames) {
+  WorktreeDiffs diffs;
+  build_worktree_diffs(repo, diffs, localPath, renames);
 
+  trace_phase("classify");
+  GitStatus out;
+  const size_t staged = git_diff_num_deltas(diffs.staged);
+  for (size_t i = 0; i < staged; i++) {
+    const git_diff_delta *d = git_diff_get_delta(diffs.staged, i);
+    if (d->status == GIT_DELTA_CONFLICTED || !d->new_file.path) continue;
+    out.staged.push_back(d->new_file.path);
+  }
+  const size_t workdir = git_diff_num_deltas(diffs.workdir);
+  for (size_t i = 0; i < workdir; i++) {
+    const git_diff_delta *d = git_diff_get_delta(diffs.workdir, i);
+    if (!d->new_file.path) continue;
+    switch (d->status) {
+      case GIT_DELTA_MODIFIED:
+      case GIT_DELTA_DELETED:
+      case GIT_DELTA_RENAMED:
+      case GIT_DELTA_TYPECHANGE:
+        out.unstaged.push_back(d->new_file.path);
+        break;
+      // A copy's target is still a file git doesn't track.
+      case GIT_DELTA_UNTRACKED:
+      case GIT_DELTA_COPIED:
+        out.untracked.push_back(d->new_file.path);
+        break;
+      default:
+        break;
+    }
+  }
+  return out;
+}
+
+std::string git_diff_unified(const std::string &localPath, size_t maxBytes, const GitRenameOptions &renames) {
+  RepoLease lease = acquire_repo(localPath);
+  WorktreeDiffs diffs;
+  build_worktree_diffs(lease.get(), diffs, localPath, renames);
+
+  DiffBuffer buf;
+  buf.maxBytes = maxBytes;
+
+  trace_phase("format");
   append_section_header(buf, "# Staged (HEAD..INDEX)");
-  print_diff(buf, diffStaged);
+  print_diff(buf, diffs.staged);
   buf.out.push_back('\n');
   append_section_header(buf, "# Workdir (INDEX..WORKDIR, include untracked)");
-  print_diff(buf, diffWorkdir);
-
-  git_diff_free(diffWorkdir);
-  git_diff_free(diffStaged);
-  if (headTree) git_tree_free(headTree);
-  git_index_free(index);
-  git_repository_free(repo);
+  print_diff(buf, diffs.workdir);
 
+  trace_count("bytes", static_cast<int64_t>(buf.out.size()));
   if (buf.out.empty()) return "（无变更）\n";
   return buf.out;
 }
+
+namespace {
+constexpr uint32_t kStructuredDiffMagic = 0x31445843;  // "CXD1"
+constexpr size_t kStructuredHeaderBytes = 8 * 4;
+constexpr size_t kStructuredFileBytes = 36;
+constexpr size_t kStructuredHunkBytes = 24;
+
+struct StructuredFile {
+  const git_diff_delta *delta = nullptr;
+  uint8_t section = 0;
+  uint32_t oldPathOff = 0, oldPathLen = 0, newPathOff = 0, newPathLen = 0;
+  uint32_t additions = 0, deletions = 0;
+  uint32_t firstHunk = 0, hunkCount = 0;
+};
+
+struct StructuredHunk {
+  uint32_t oldStart, oldLines, newStart, newLines, headerOff, headerLen;
+};
+
+struct StructuredDiffState {
+  uint8_t section = 0;
+  std::vector<StructuredFile> files;
+  std::vector<StructuredHunk> hunks;
+  std::string strings;
+  std::unordered_map<std::string, uint32_t> pathOffsets;
+
+  uint32_t intern_path(const char *path, uint32_t &len) {
+    const std::string key(path ? path : "");
+    len = static_cast<uint32_t>(key.size());
+    auto it = pathOffsets.find(key);
+    if (it != pathOffsets.end()) return it->second;
+    const auto off = static_cast<uint32_t>(strings.size());
+    strings.append(key);
+    pathOffsets.emplace(key, off);
+    return off;
+  }
+};
+
+int structured_file_cb(const git_diff_delta *delta, float /*progress*/, void *payload) {
+  auto *st = static_cast<StructuredDiffState *>(payload);
+  StructuredFile f;
+  f.delta = delta;
+  f.section = st->section;
+  f.oldPathOff = st->intern_path(delta->old_file.path, f.oldPathLen);
+  f.newPathOff = st->intern_path(delta->new_file.path, f.newPathLen);
+  f.firstHunk = static_cast<uint32_t>(st->hunks.size());
+  st->files.push_back(f);
+  return 0;
+}
+
+int structured_hunk_cb(const git_diff_delta * /*delta*/, const git_diff_hunk *hunk, void *payload) {
+  auto *st = static_cast<StructuredDiffState *>(payload);
+  std::string_view header(hunk->header, hunk->header_len);
+  while (!header.empty() && (header.back() == '\n' || header.back() == '\r')) header.remove_suffix(1);
+
+  StructuredHunk h;
+  h.oldStart = static_cast<uint32_t>(hunk->old_start);
+  h.oldLines = static_cast<uint32_t>(hunk->old_lines);
+  h.newStart = static_cast<uint32_t>(hunk->new_start);
+  h.newLines = static_cast<uint32_t>(hunk->new_lines);
+  h.headerOff = static_cast<uint32_t>(st->strings.size());
+  h.headerLen = static_cast<uint32_t>(header.size());
+  st->strings.append(header.data(), header.size());
+  st->hunks.push_back(h);
+  st->files.back().hunkCount++;
+  return 0;
+}
+
+int structured_line_cb(const git_diff_delta * /*delta*/,
+                       const git_diff_hunk * /*hunk*/,
+                       const git_diff_line *line,
+                       void *payload) {
+  auto *st = static_cast<StructuredDiffState *>(payload);
+  if (line->origin == GIT_DIFF_LINE_ADDITION) st->files.back().additions++;
+  else if (line->origin == GIT_DIFF_LINE_DELETION) st->files.back().deletions++;
+  return 0;
+}
+
+void put_u16(std::string &out, size_t at, uint16_t v) {
+  out[at] = static_cast<char>(v & 0xff);
+  out[at + 1] = static_cast<char>((v >> 8) & 0xff);
+}
+
+void put_u32(std::string &out, size_t at, uint32_t v) {
+  for (int i = 0; i < 4; i++) out[at + i] = static_cast<char>((v >> (8 * i)) & 0xff);
+}
+}  // namespace
+
+std::string git_diff_structured(const std::string &localPath, const GitRenameOptions &renames) {
+  RepoLease lease = acquire_repo(localPath);
+  WorktreeDiffs diffs;
+  build_worktree_diffs(lease.get(), diffs, localPath, renames);
+
+  trace_phase("summarize");
+  StructuredDiffState st;
+  git_diff *sections[] = {diffs.staged, diffs.workdir};
+  for (uint8_t i = 0; i < 2; i++) {
+    st.section = i;
+    // Only counts lines; nothing per line is copied out of libgit2.
+    const int rc = git_diff_foreach(sections[i], structured_file_cb, nullptr, structured_hunk_cb,
+                                    structured_line_cb, &st);
+    if (rc != 0) throw GitException(last_error_message(rc));
+  }
+
+  // Totals match git_diff_get_stats() summed over both sections, except that a path changed in
+  // both the index and the work tree counts as one changed file.
+  uint32_t insertions = 0, deletions = 0;
+  std::unordered_set<uint32_t> changedPaths;
+  for (const auto &f : st.files) {
+    insertions += f.additions;
+    deletions += f.deletions;
+    changedPaths.insert(f.newPathOff);
+  }
+
+  const size_t filesAt = kStructuredHeaderBytes;
+  const size_t hunksAt = filesAt + st.files.size() * kStructuredFileBytes;
+  const size_t stringsAt = hunksAt + st.hunks.size() * kStructuredHunkBytes;
+  std::string out(stringsAt, '\0');
+  out.reserve(stringsAt + st.strings.size());
+
+  put_u32(out, 0, kStructuredDiffMagic);
+  put_u32(out, 4, static_cast<uint32_t>(st.files.size()));
+  put_u32(out, 8, static_cast<uint32_t>(st.hunks.size()));
+  put_u32(out, 12, static_cast<uint32_t>(st.strings.size()));
+  put_u32(out, 16, static_cast<uint32_t>(changedPaths.size()));
+  put_u32(out, 20, insertions);
+  put_u32(out, 24, deletions);
+
+  size_t at = filesAt;
+  for (const auto &f : st.files) {
+    // Binary detection happens while the file is loaded, after the file callback; read it now.
+    const uint16_t flags = (f.delta->flags & GIT_DIFF_FLAG_BINARY) ? 1 : 0;
+    out[at] = static_cast<char>(f.section);
+    out[at + 1] = static_cast<char>(f.delta->status);
+    put_u16(out, at + 2, flags);
+    put_u32(out, at + 4, f.oldPathOff);
+    put_u32(out, at + 8, f.oldPathLen);
+    put_u32(out, at + 12, f.newPathOff);
+    put_u32(out, at + 16, f.newPathLen);
+    put_u32(out, at + 20, f.additions);
+    put_u32(out, at + 24, f.deletions);
+    put_u32(out, at + 28, f.firstHunk);
+    put_u32(out, at + 32, f.hunkCount);
+    at += kStructuredFileBytes;
+  }
+  for (const auto &h : st.hunks) {
+    put_u32(out, at, h.oldStart);
+    put_u32(out, at + 4, h.oldLines);
+    put_u32(out, at + 8, h.newStart);
+    put_u32(out, at + 12, h.newLines);
+    put_u32(out, at + 16, h.headerOff);
+    put_u32(out, at + 20, h.headerLen);
+    at += kStructuredHunkBytes;
+  }
+  out.append(st.strings);
+  return out;
+}
+
+struct DiffStreamState {
+  const GitDiffChunkCallback *cb = nullptr;
+  size_t chunkBytes = 0;
+  GitDiffSection section = GitDiffSection::Staged;
+  const git_diff_delta *delta = nullptr;
+  std::string path;
+  std::string pending;
+  bool pendingStartsFile = false;
+  bool stopped = false;
+};
+
+static bool flush_stream_chunk(DiffStreamState &st) {
+  if (st.pending.empty()) return true;
+  GitDiffChunk chunk;
+  chunk.section = st.section;
+  chunk.path = st.path;
+  chunk.fileStart = st.pendingStartsFile;
+  chunk.data = st.pending.data();
+  chunk.size = st.pending.size();
+  const bool keepGoing = (*st.cb)(chunk);
+  st.pending.clear();
+  st.pendingStartsFile = false;
+  if (!keepGoing) st.stopped = true;
+  return keepGoing;
+}
+
+static int diff_stream_cb(const git_diff_delta *delta,
+                          const git_diff_hunk * /*hunk*/,
+                          const git_diff_line *line,
+                          void *payload) {
+  auto *st = static_cast<DiffStreamState *>(payload);
+  if (!st || !line) return 0;
+
+  if (delta != st->delta) {
+    if (!flush_stream_chunk(*st)) return GIT_EUSER;
+    st->delta = delta;
+    const char *p = delta && delta->new_file.path ? delta->new_file.path
+                                                  : (delta && delta->old_file.path ? delta->old_file.path : "");
+    st->path = p;
+    st->pendingStartsFile = true;
+  } else if (st->chunkBytes > 0 && st->pending.size() >= st->chunkBytes &&
+             (line->origin == GIT_DIFF_LINE_HUNK_HDR || st->pending.size() >= st->chunkBytes * 4)) {
+    // Prefer cutting at hunk boundaries; only split inside a hunk when it is far oversized.
+    if (!flush_stream_chunk(*st)) return GIT_EUSER;
+  }
+
+  if (line->origin == '+' || line->origin == '-' || line->origin == ' ') {
+    st->pending.push_back(line->origin);
+  }
+  st->pending.append(line->content, static_cast<size_t>(line->content_len));
+  return 0;
+}
+
+static void stream_diff(DiffStreamState &st, git_diff *diff, GitDiffSection section) {
+  if (!diff || st.stopped) return;
+  st.section = section;
+  st.delta = nullptr;
+  const int rc = git_diff_print(diff, GIT_DIFF_FORMAT_PATCH, diff_stream_cb, &st);
+  if (rc == GIT_EUSER && st.stopped) return;
+  if (rc != 0) throw GitException(last_error_message(rc));
+  flush_stream_chunk(st);
+}
+
+void git_diff_stream(const std::string &localPath, size_t chunkBytes, const GitDiffChunkCallback &cb,
+                     const GitRenameOptions &renames) {
+  RepoLease lease = acquire_repo(localPath);
+  WorktreeDiffs diffs;
+  build_worktree_diffs(lease.get(), diffs, localPath, renames);
+
+  trace_phase("format");
+  DiffStreamState st;
+  st.cb = &cb;
+  st.chunkBytes = chunkBytes;
+  stream_diff(st, diffs.staged, GitDiffSection::Staged);
+  stream_diff(st, diffs.workdir, GitDiffSection::Workdir);
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -8,6 +11,30 @@ struct GitException : public std::runtime_error {
   explicit GitException(const std::string &msg) : std::runtime_error(msg) {}
 };
 
+// Thrown when an operation stops because git_cancel_operation() was called for it.
+struct GitCancelled : public GitException {
+  GitCancelled() : GitException("Operation cancelled") {}
+};
+
+struct GitProgress {
+  // "receiving" / "resolving" (fetch), "packing" / "uploading" (push), "checkout", "packing" /
+  // "writing" (maintenance), or "remote" for a sideband message from the server (in `message`).
+  std::string phase;
+  uint64_t current = 0;
+  uint64_t total = 0;
+  uint64_t bytes = 0;
+  std::string message;
+};
+
+// Invoked on the calling thread, throttled to a few updates per second.
+using GitProgressCallback = std::function<void(const GitProgress &)>;
+
+// Optional on every long-running call. `operationId` is what git_cancel_operation() takes.
+struct GitOperationHooks {
+  std::string operationId;
+  GitProgressCallback onProgress;
+};
+
 struct GitCloneOptions {
   std::string remoteUrl;
   std::string localPath;
@@ -17,13 +44,24 @@ struct GitCloneOptions {
   bool allowInsecure = false;
   std::string userName;
   std::string userEmail;
+  // Fetch only the last `depth` commits of history (0 = full history).
+  int depth = 0;
+  // Only fetch `branch` (or the remote's default branch) and track just that branch afterwards.
+  bool singleBranch = false;
+  // Sparse checkout: only write these work-tree-relative prefixes (empty = everything). Stored with
+  // the repository and honoured by checkout, pull, status and diff afterwards.
+  std::vector<std::string> sparsePaths;
+  GitOperationHooks hooks;
 };
 
 struct GitCheckoutOptions {
   std::string localPath;
   std::string ref;
+  GitOperationHooks hooks;
 };
 
+enum class GitPullStrategy { FastForwardOnly = 0, Merge = 1, Rebase = 2 };
+
 struct GitPullOptions {
   std::string localPath;
   std::string remote;
@@ -31,6 +69,71 @@ struct GitPullOptions {
   std::string username;
   std::string token;
   bool allowInsecure = false;
+  // For shallow clones: deepen/shorten history to `depth` commits, or fetch all of it with
+  // `unshallow`. 0 keeps the current shallow boundary.
+  int depth = 0;
+  bool unshallow = false;
+  // How diverged branches are reconciled. Merge and Rebase run in memory first; on conflicts
+  // nothing is written and the conflicting paths are returned instead.
+  GitPullStrategy strategy = GitPullStrategy::FastForwardOnly;
+  GitOperationHooks hooks;
+};
+
+// One conflicted path from an in-memory merge or rebase step. Blob ids are empty for a side that
+// does not have the path (added/deleted on one side).
+struct GitConflict {
+  std::string path;
+  std::string ancestorOid;
+  std::string oursOid;
+  std::string theirsOid;
+};
+
+enum class GitPullOutcome { UpToDate = 0, FastForward = 1, Merged = 2, Rebased = 3, Conflicts = 4 };
+
+struct GitPullResult {
+  GitPullOutcome outcome = GitPullOutcome::UpToDate;
+  std::string head;  // branch tip after the pull (unchanged when outcome is Conflicts)
+  std::vector<GitConflict> conflicts;
+};
+
+// Fetch only: updates refs/remotes/<remote>/* (and tags) without touching branches or the work
+// tree. Used by background prefetch.
+struct GitFetchOptions {
+  std::string localPath;
+  std::string remote;
+  std::string username;
+  std::string token;
+  bool allowInsecure = false;
+  GitOperationHooks hooks;
+};
+
+// Recently opened workspaces are fetched in the background so a later pull is mostly local.
+// Prefetch runs one repository at a time on the git scheduler, only on unmetered networks, never
+// while the repository has other work queued or running, and gives way (is cancelled) as soon as
+// a caller-facing operation arrives for that repository.
+struct GitPrefetchTarget {
+  std::string localPath;
+  std::string remote;  // empty = "origin"
+  std::string username;
+  std::string token;
+  bool allowInsecure = false;
+};
+
+struct GitPrefetchConfig {
+  bool enabled = true;
+  int64_t intervalMs = 15 * 60 * 1000;            // minimum time between fetches of one repository
+  int64_t recentWindowMs = 24 * 60 * 60 * 1000;   // targets not touched for this long are dropped
+};
+
+struct GitCommitOptions {
+  std::string localPath;
+  std::string message;
+  // Work-tree paths (files or directories) whose changes are staged before committing; empty
+  // stages every change (within the sparse set). Deleted files are removed from the index.
+  std::vector<std::string> paths;
+  // false commits the index as it is, ignoring `paths`.
+  bool stage = true;
+  bool allowEmpty = false;
 };
 
 struct GitPushOptions {
@@ -40,6 +143,7 @@ struct GitPushOptions {
   std::string username;
   std::string token;
   bool allowInsecure = false;
+  GitOperationHooks hooks;
 };
 
 struct GitStatus {
@@ -48,9 +152,403 @@ struct GitStatus {
   std::vector<std::string> untracked;
 };
 
+struct GitIncrementalStatusOptions {
+  std::string localPath;
+  // Work-tree-relative paths known to have changed since the last call (e.g. files the agent
+  // edited). Directories cover everything below them.
+  std::vector<std::string> touchedPaths;
+  // Watch the work tree with inotify so other changes are picked up too. Without it only
+  // `touchedPaths` are re-checked between full scans.
+  bool watch = true;
+};
+
+struct GitStatusManyOptions {
+  std::vector<std::string> localPaths;
+  // Stop each scan at its first change: `dirty` is exact, each count is then at most 1.
+  bool summaryOnly = true;
+};
+
+// One work tree's entry in git_status_many(). A repository that cannot be opened or scanned
+// carries `error` and leaves everything else at its default.
+struct GitRepoStatusSummary {
+  std::string localPath;
+  std::string error;
+  bool dirty = false;
+  uint32_t staged = 0;
+  uint32_t unstaged = 0;
+  uint32_t untracked = 0;
+  // Short name of the checked-out branch; empty when HEAD is detached or unborn.
+  std::string branch;
+  // Commits on HEAD missing from its upstream and the reverse; only meaningful with `hasUpstream`.
+  bool hasUpstream = false;
+  uint32_t ahead = 0;
+  uint32_t behind = 0;
+};
+
+using GitStatusManyCallback = std::function<void(std::vector<GitRepoStatusSummary> &&)>;
+
+enum class GitDiffSection { Staged = 0, Workdir = 1 };
+
+// One piece of a streamed patch. Chunks never split a line; a file's patch starts with
+// `fileStart == true` (its "diff --git" header) and may continue over several chunks, cut at hunk
+// boundaries. `data` is only valid during the callback.
+struct GitDiffChunk {
+  GitDiffSection section = GitDiffSection::Staged;
+  std::string path;
+  bool fileStart = false;
+  const char *data = nullptr;
+  size_t size = 0;
+};
+
+// Return false to stop the stream early.
+using GitDiffChunkCallback = std::function<bool(const GitDiffChunk &)>;
+
 void git_clone_repo(const GitCloneOptions &opts);
+// Asks the operation started with this id to stop at its next callback (it then throws
+// GitCancelled). Safe to call before the operation starts or after it finished.
+void git_cancel_operation(const std::string &operationId);
+// Remotes (and their keep-alive connections) are reused across fetch/pull/push on the same
+// repository until unused for this long; 0 disables reuse. Default 30 s.
+void git_set_remote_idle_timeout(int64_t ms);
+
+// Memory budget for libgit2's pack windows and object cache, and for how many repository handles
+// stay open. Chosen from the device's RAM by the host.
+enum class GitMemoryClass { Low = 0, Mid = 1, High = 2 };
+
+struct GitRuntimeConfig {
+  GitMemoryClass memoryClass = GitMemoryClass::Mid;
+  // Skips re-hashing every object read from the ODB and the existence checks when creating trees
+  // and commits. Packs fetched from remotes are still verified by the indexer.
+  bool trustLocalObjects = false;
+};
+
+// Applies process-wide libgit2 options; may be called at any time (later mappings and cache
+// inserts see the new limits).
+void git_configure_runtime(const GitRuntimeConfig &config);
+// Reacts to an Android onTrimMemory() level: shrinks the object cache and, under real pressure,
+// closes idle repository handles. Level 0 restores the configured budget.
+void git_trim_memory(int level);
+// Does the one-time process setup (libgit2 and OpenSSL init, CA lookup, worker threads) ahead of
+// the first real operation. Idempotent; meant for a background thread shortly after app start.
+void git_warm_up();
+
+// Registers `target` as opened now (replacing its credentials) and starts prefetching if needed.
+void git_prefetch_touch(const GitPrefetchTarget &target);
+void git_prefetch_forget(const std::string &localPath);
+// Prefetch only runs while online and unmetered. Starts as offline until first reported.
+void git_prefetch_set_network(bool online, bool metered);
+void git_prefetch_configure(const GitPrefetchConfig &config);
 void git_checkout_ref(const GitCheckoutOptions &opts);
-void git_pull_ff_only(const GitPullOptions &opts);
+GitPullResult git_pull(const GitPullOptions &opts);
+void git_fetch(const GitFetchOptions &opts);
+// Stages the requested changes with a single index load/write and commits them on HEAD, author
+// and committer from the repository config. Returns the new commit id. Throws when the tree is
+// unchanged unless `allowEmpty` is set.
+std::string git_commit_paths(const GitCommitOptions &opts);
 void git_push_branch(const GitPushOptions &opts);
-GitStatus git_status(const std::string &localPath);
-std::string git_diff_unified(const std::string &localPath, size_t maxBytes);
+// Opt-in rename/copy pairing (git's -M / -C) for git_status() and the diffs. Inexact matching
+// compares every deleted file (plus, with `copies`, every modified one) against every added or
+// untracked one; past renameLimit² such pairs only identical blobs are paired, like git's
+// diff.renameLimit. Similarity signatures are cached per work tree between calls.
+struct GitRenameOptions {
+  bool enabled = false;
+  bool copies = false;
+  uint16_t threshold = 50;  // similarity percentage needed to pair two files
+  uint32_t renameLimit = 1000;
+};
+
+// With `renames`, a rename in the index or the work tree is reported once, under its new path.
+GitStatus git_status(const std::string &localPath, const GitRenameOptions &renames = {});
+// Same buckets as git_status(), but re-checks only changed paths after the first call. State is
+// kept per work tree in native memory; a full scan runs again when HEAD or the index file changes,
+// or when the watcher loses events. Untracked directories are collapsed to "dir/" like git_status().
+GitStatus git_status_incremental(const GitIncrementalStatusOptions &opts);
+void git_status_incremental_reset(const std::string &localPath);
+// Summarizes one work tree: change counts (see GitStatusManyOptions::summaryOnly), branch and
+// ahead/behind against its upstream. Never throws; failures are reported in `error`.
+GitRepoStatusSummary git_status_summary(const std::string &localPath, bool summaryOnly);
+// Queues git_status_summary() for every path as its own read job on the git scheduler, so the
+// repositories are scanned in parallel, each behind work already queued for it. `done` runs once,
+// on whichever thread finishes last (the caller's for an empty list), with results in input order.
+void git_status_many(const GitStatusManyOptions &opts, GitStatusManyCallback done);
+// A status as one flat buffer, so handing it to Java or JS costs a single copy regardless of how
+// many paths there are: u32 count (LE), `count` bucket bytes (0 staged, 1 unstaged, 2 untracked),
+// then the paths, each NUL-terminated, in the same order.
+std::string git_status_packed(const GitStatus &st);
+std::string git_diff_unified(const std::string &localPath, size_t maxBytes, const GitRenameOptions &renames = {});
+// Same content as git_diff_unified() without section banners or truncation, delivered file by
+// file as it is generated. `chunkBytes` is a soft target for chunk size (0 = one chunk per file).
+void git_diff_stream(const std::string &localPath, size_t chunkBytes, const GitDiffChunkCallback &cb,
+                     const GitRenameOptions &renames = {});
+
+// Per-file summary of the same diff as git_diff_unified(), in one flat little-endian buffer:
+//
+//   header   8 x u32: magic 'CXD1', fileCount, hunkCount, stringBytes, filesChanged (distinct
+//                     paths), insertions, deletions, reserved
+//   files    fileCount x 36 bytes: u8 section (0 staged, 1 workdir), u8 status (git_delta_t),
+//                     u16 flags (bit 0 binary), u32 oldPathOff, u32 oldPathLen, u32 newPathOff,
+//                     u32 newPathLen, u32 additions, u32 deletions, u32 firstHunk, u32 hunkCount
+//   hunks    hunkCount x 24 bytes: u32 oldStart, u32 oldLines, u32 newStart, u32 newLines,
+//                     u32 headerOff, u32 headerLen
+//   strings  stringBytes of UTF-8; offsets above are relative to the start of this table.
+std::string git_diff_structured(const std::string &localPath, const GitRenameOptions &renames = {});
+
+struct GitSnapshotInfo {
+  std::string oid;
+  int64_t createdAt = 0;  // Unix seconds
+  std::string message;
+};
+
+// Records index + work tree (untracked files included, ignored ones not) as an unreferenced commit
+// without touching HEAD, refs or the index, and returns its id. Only changed paths are hashed.
+std::string git_snapshot_worktree(const std::string &localPath, const std::string &message);
+// Puts the work tree and index back to a snapshot, rewriting only files that differ and removing
+// files created since. HEAD is left where it is.
+void git_restore_snapshot(const std::string &localPath, const std::string &snapshotOid);
+// Snapshots recorded for this repository, oldest first (the 50 most recent are kept).
+std::vector<GitSnapshotInfo> git_list_snapshots(const std::string &localPath);
+void git_drop_snapshot(const std::string &localPath, const std::string &snapshotOid);
+
+struct GitLogOptions {
+  std::string localPath;
+  // Where the first page starts (anything git_revparse_single() accepts); ignored with `cursor`.
+  std::string ref = "HEAD";
+  // `nextCursor` of the previous page; empty for the first page.
+  std::string cursor;
+  // Only commits that change something at or below one of these work-tree-relative paths.
+  std::vector<std::string> paths;
+  size_t limit = 50;
+  // Commits walked per page at most, so a rarely touched path can't walk the whole history for one
+  // screen. A short page that still has a cursor only means the caller should ask again.
+  size_t maxScan = 5000;
+};
+
+struct GitLogEntry {
+  std::string oid;
+  std::vector<std::string> parents;
+  std::string authorName;
+  std::string authorEmail;
+  int64_t authorTime = 0;  // Unix seconds
+  int64_t commitTime = 0;  // Unix seconds
+  std::string summary;
+};
+
+struct GitLogPage {
+  std::vector<GitLogEntry> commits;
+  // Opaque; resumes right after the last commit walked. Empty once history is exhausted.
+  std::string nextCursor;
+  size_t scanned = 0;
+};
+
+struct GitBlameOptions {
+  std::string localPath;
+  std::string path;
+  // 1-based and inclusive; endLine 0 means the end of the file.
+  size_t startLine = 1;
+  size_t endLine = 0;
+  // Commit whose version of the file is blamed; empty = HEAD. Work tree edits are not blamed.
+  std::string ref;
+};
+
+struct GitBlameHunk {
+  size_t startLine = 0;  // 1-based, in the blamed version
+  size_t lineCount = 0;
+  std::string oid;
+  std::string authorName;
+  std::string authorEmail;
+  int64_t authorTime = 0;  // Unix seconds
+  std::string summary;
+  // Path and first line in `oid`, which differ from the blamed ones across renames and moves.
+  std::string origPath;
+  size_t origStartLine = 0;
+  // The line predates the oldest commit considered (e.g. a shallow clone's boundary).
+  bool boundary = false;
+};
+
+// One page of history, newest first by commit time. The walk is lazy and reads the commit-graph
+// file when the repository has one (written by git_maintenance()), so the first page of a large
+// history costs about `limit` commits, not the whole history.
+GitLogPage git_log_page(const GitLogOptions &opts);
+// Blame for a window of one file's lines; only the window is attributed.
+std::vector<GitBlameHunk> git_blame_range(const GitBlameOptions &opts);
+
+struct GitRangeOptions {
+  std::string localPath;
+  // git_read_blob_range(): anything git_revparse_single() accepts that peels to a blob, e.g.
+  // "HEAD:src/app.ts", ":src/app.ts" (the staged version) or a blob id.
+  std::string spec;
+  // git_read_file_range(): work-tree-relative path.
+  std::string path;
+  // A byte window [start, start + count), or with `lines` a window of 0-based lines. count 0 reads
+  // to the end, within `maxBytes`.
+  bool lines = false;
+  uint64_t start = 0;
+  uint64_t count = 0;
+  size_t maxBytes = 256 * 1024;
+};
+
+struct GitRangeResult {
+  std::string data;
+  uint64_t byteOffset = 0;  // of `data` within the file
+  uint64_t totalBytes = 0;
+  // Line windows: the 0-based line `data` starts at and how many whole lines it holds.
+  uint64_t firstLine = 0;
+  uint64_t lineCount = 0;
+  // Known once the content's line index exists (always for line windows); -1 otherwise.
+  int64_t totalLines = -1;
+  bool binary = false;
+  // `maxBytes` cut the window short. Line windows then still end on a line, unless not even one
+  // whole line fit.
+  bool truncated = false;
+  std::string oid;  // blob id; empty for work-tree files
+};
+
+// A window of one blob, without handing the rest of it to the caller. Line windows use a sparse
+// line index cached per blob id, so later pages cost about the window, not the file.
+GitRangeResult git_read_blob_range(const GitRangeOptions &opts);
+// Same for a work-tree file, read with pread() (only the window, plus the index scan, is read);
+// the line index is keyed by path and stat data, so an edit rebuilds it. Symlinks read as their
+// target, like their blobs.
+GitRangeResult git_read_file_range(const GitRangeOptions &opts);
+
+struct GitMaintenanceOptions {
+  std::string localPath;
+  // Run even if the repository is below the loose-object/pack thresholds.
+  bool force = false;
+  // Unreachable loose objects and old packs younger than this are kept, in case something is about
+  // to reference them.
+  int64_t pruneGraceSeconds = 24 * 60 * 60;
+  GitOperationHooks hooks;
+};
+
+struct GitMaintenanceResult {
+  bool ran = false;  // false: below thresholds, nothing done
+  size_t objectsPacked = 0;
+  size_t packsRemoved = 0;
+  size_t looseRemoved = 0;
+  int64_t bytesBefore = 0;
+  int64_t bytesAfter = 0;
+  bool commitGraph = false;
+};
+
+// Repacks everything reachable from refs, HEAD, their reflogs, the index and recorded snapshots
+// into one pack, deletes older packs and redundant or unreachable loose objects (respecting the
+// grace period), and writes a commit-graph. Cancellable through hooks.operationId until old data
+// is deleted.
+GitMaintenanceResult git_maintenance(const GitMaintenanceOptions &opts);
+
+// Queues `localPath` for maintenance the next time the device is charging and idle (at most once
+// a day per repository). It runs as background work: one repository at a time, and it gives way
+// to any other operation and stops as soon as the device leaves that state.
+void git_maintenance_request(const std::string &localPath);
+void git_maintenance_set_device_state(bool charging, bool idle);
+
+struct GitSearchOptions {
+  // Work tree to search; if it is not a git repository, nothing is treated as ignored.
+  std::string localPath;
+  std::string pattern;
+  // POSIX extended regex instead of a literal string.
+  bool regex = false;
+  // ASCII case folding for literals; REG_ICASE for regexes.
+  bool ignoreCase = false;
+  // Only search under these work-tree-relative prefixes (empty = whole tree).
+  std::vector<std::string> paths;
+  // Also search files excluded by .gitignore.
+  bool includeIgnored = false;
+  uint64_t maxResults = 2000;
+  // Larger files are skipped.
+  uint64_t maxFileBytes = 8 * 1024 * 1024;
+  // Excerpts are cut to this many bytes (on a UTF-8 boundary).
+  size_t maxLineBytes = 512;
+  size_t batchSize = 100;
+  // Narrow the files to scan with the trigram index (refreshed first, built on first use).
+  // Ignored when includeIgnored is set.
+  bool useIndex = false;
+  GitOperationHooks hooks;
+};
+
+struct GitSearchMatch {
+  std::string path;  // relative to the work tree
+  uint32_t line = 0;
+  uint32_t column = 0;  // 1-based byte offset of the match within the line
+  std::string text;
+};
+
+struct GitSearchStats {
+  uint64_t filesScanned = 0;
+  uint64_t bytesScanned = 0;
+  uint64_t matches = 0;
+  bool truncated = false;  // stopped at maxResults
+};
+
+// Invoked on the calling thread with up to batchSize matches; return false to stop the search.
+using GitSearchBatchCallback = std::function<bool(const std::vector<GitSearchMatch> &)>;
+
+// Searches file contents under the work tree, skipping .git, symlinks, binary files and (unless
+// includeIgnored) ignored paths. Matches are reported at most once per line, in no particular
+// order across files. Cancellable through hooks.operationId.
+GitSearchStats git_search(const GitSearchOptions &opts, const GitSearchBatchCallback &cb);
+
+struct GitSearchIndexOptions {
+  std::string localPath;
+  GitOperationHooks hooks;
+};
+
+struct GitSearchIndexStats {
+  uint64_t files = 0;  // paths covered
+  uint64_t blobs = 0;  // distinct contents in the index
+  uint64_t segments = 0;
+  uint64_t bytes = 0;  // on disk
+  uint64_t indexedNow = 0;  // blobs read by this refresh
+};
+
+// Brings the trigram index in .git/codexm-search/ up to date with the index and work tree, reading
+// only blobs it hasn't seen. Reports "indexing" progress; a cancel keeps what was indexed so far.
+GitSearchIndexStats git_search_index_refresh(const GitSearchIndexOptions &opts);
+// Deletes the trigram index.
+void git_search_index_drop(const std::string &localPath);
+
+struct GitTreeManifestOptions {
+  // Tree to hash; it does not have to be a git repository.
+  std::string localPath;
+  // Manifest of the last sync (see git_tree_manifest_commit); a missing file means a first sync.
+  std::string manifestPath;
+  // Entries with one of these names are skipped at any depth.
+  std::vector<std::string> excludeNames;
+  GitOperationHooks hooks;
+};
+
+enum class GitManifestChange : uint8_t { Unchanged = 0, Added = 1, Modified = 2 };
+
+struct GitTreeManifestFile {
+  std::string path;  // relative to localPath
+  std::string oid;  // git blob id of the content, hex
+  uint64_t size = 0;
+  GitManifestChange change = GitManifestChange::Unchanged;
+};
+
+struct GitTreeManifest {
+  std::vector<GitTreeManifestFile> files;  // sorted by path
+  std::vector<std::string> dirs;  // sorted, parents first
+  std::vector<std::string> deleted;  // in the last manifest, gone now
+  uint64_t hashed = 0;  // files read
+  uint64_t fromIndex = 0;  // hash taken from the git index's stat cache
+  uint64_t fromManifest = 0;  // hash taken from the last manifest's stat cache
+};
+
+// Walks and hashes the tree with one thread per core, comparing against `manifestPath`. A file is
+// only read when neither the git index nor the last manifest has clean stat data for it, so an
+// unchanged tree costs a walk. The result is written to `manifestPath` + ".next" and becomes the
+// baseline only through git_tree_manifest_commit(), after the transfers it drove succeeded.
+// Symlinks are skipped. Reports "hashing" progress; cancellable through hooks.operationId.
+GitTreeManifest git_tree_manifest(const GitTreeManifestOptions &opts);
+void git_tree_manifest_commit(const std::string &manifestPath);
+
+// Current sparse prefixes (empty = full checkout).
+std::vector<std::string> git_get_sparse_paths(const std::string &localPath);
+// Changes the sparse set: writes newly included files from HEAD and deletes unmodified files that
+// fell out of it. An empty list restores a full checkout.
+void git_set_sparse_paths(const std::string &localPath, const std::vector<std::string> &prefixes);
+
+// Drops the cached repository handle for `localPath` (e.g. before the workspace is deleted).
+void git_release_repo(const std::string &localPath);
@@ -0,0 +1,276 @@
+#include "git_ops.h"
+
+#include "git_internal.h"
+#include "repo_cache.h"
+#include "trace.h"
+
+#include <git2.h>
+
+#include <cstring>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// History browsing: paged log and windowed blame.
+//
+// The log walk is libgit2's time-sorted revwalk, which is lazy and takes parents and commit times
+// from the commit-graph file when core.commitGraph is set. A page's cursor is its frontier: the
+// parents of walked commits that were not walked themselves. Pushing them into a fresh revwalk
+// continues exactly where the previous page stopped, without keeping a walk (or anything else)
+// alive between calls.
+
+namespace {
+struct OidHash {
+  size_t operator()(const git_oid &id) const {
+    size_t h = 0;
+    memcpy(&h, id.id, sizeof(h));
+    return h;
+  }
+};
+
+struct OidEq {
+  bool operator()(const git_oid &a, const git_oid &b) const { return git_oid_equal(&a, &b) != 0; }
+};
+
+struct OidLess {
+  bool operator()(const git_oid &a, const git_oid &b) const { return git_oid_cmp(&a, &b) < 0; }
+};
+
+std::string oid_hex(const git_oid *id) {
+  char buf[GIT_OID_HEXSZ + 1];
+  git_oid_tostr(buf, sizeof(buf), id);
+  return buf;
+}
+
+std::string encode_cursor(const std::set<git_oid, OidLess> &frontier) {
+  std::string out;
+  for (const auto &id : frontier) {
+    if (!out.empty()) out.push_back(',');
+    out += oid_hex(&id);
+  }
+  return out;
+}
+
+std::vector<git_oid> decode_cursor(const std::string &cursor) {
+  std::vector<git_oid> out;
+  size_t pos = 0;
+  while (pos < cursor.size()) {
+    size_t end = cursor.find(',', pos);
+    if (end == std::string::npos) end = cursor.size();
+    git_oid id;
+    if (end - pos != GIT_OID_HEXSZ || git_oid_fromstrn(&id, cursor.data() + pos, end - pos) != 0) {
+      throw GitException("invalid log cursor");
+    }
+    out.push_back(id);
+    pos = end + 1;
+  }
+  return out;
+}
+
+git_oid resolve_commit(git_repository *repo, const std::string &spec) {
+  git_object *obj = nullptr;
+  int rc = git_revparse_single(&obj, repo, spec.c_str());
+  if (rc != 0) throw GitException(last_error_message(rc));
+  git_object *commit = nullptr;
+  rc = git_object_peel(&commit, obj, GIT_OBJECT_COMMIT);
+  git_object_free(obj);
+  if (rc != 0) throw GitException(last_error_message(rc));
+  git_oid id = *git_object_id(commit);
+  git_object_free(commit);
+  return id;
+}
+
+bool tree_changes_paths(git_repository *repo, git_tree *from, git_tree *to, const git_diff_options &opts) {
+  git_diff *diff = nullptr;
+  const int rc = git_diff_tree_to_tree(&diff, repo, from, to, &opts);
+  if (rc != 0) throw GitException(last_error_message(rc));
+  const bool changed = git_diff_num_deltas(diff) > 0;
+  git_diff_free(diff);
+  return changed;
+}
+
+// Like git log's default history simplification: a commit is shown unless it leaves the paths as
+// one of its parents had them.
+bool touches_paths(git_repository *repo, git_commit *commit, const git_diff_options &opts) {
+  git_tree *tree = nullptr;
+  int rc = git_commit_tree(&tree, commit);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  bool touched = true;
+  const unsigned int parents = git_commit_parentcount(commit);
+  if (parents == 0) touched = tree_changes_paths(repo, nullptr, tree, opts);
+  for (unsigned int i = 0; i < parents && touched; i++) {
+    git_commit *parent = nullptr;
+    rc = git_commit_parent(&parent, commit, i);
+    if (rc != 0) {
+      git_tree_free(tree);
+      throw GitException(last_error_message(rc));
+    }
+    if (git_oid_equal(git_commit_tree_id(parent), git_commit_tree_id(commit))) {
+      touched = false;
+    } else {
+      git_tree *parentTree = nullptr;
+      rc = git_commit_tree(&parentTree, parent);
+      if (rc == 0) {
+        try {
+          touched = tree_changes_paths(repo, parentTree, tree, opts);
+        } catch (...) {
+          git_tree_free(parentTree);
+          git_commit_free(parent);
+          git_tree_free(tree);
+          throw;
+        }
+        git_tree_free(parentTree);
+      }
+    }
+    git_commit_free(parent);
+    if (rc != 0) {
+      git_tree_free(tree);
+      throw GitException(last_error_message(rc));
+    }
+  }
+  git_tree_free(tree);
+  return touched;
+}
+
+GitLogEntry log_entry(git_commit *commit) {
+  GitLogEntry e;
+  e.oid = oid_hex(git_commit_id(commit));
+  const unsigned int parents = git_commit_parentcount(commit);
+  for (unsigned int i = 0; i < parents; i++) e.parents.push_back(oid_hex(git_commit_parent_id(commit, i)));
+  if (const git_signature *a = git_commit_author(commit)) {
+    if (a->name) e.authorName = a->name;
+    if (a->email) e.authorEmail = a->email;
+    e.authorTime = static_cast<int64_t>(a->when.time);
+  }
+  e.commitTime = static_cast<int64_t>(git_commit_time(commit));
+  if (const char *summary = git_commit_summary(commit)) e.summary = summary;
+  return e;
+}
+
+std::string signature_field(const git_signature *sig, bool email) {
+  if (!sig) return "";
+  const char *v = email ? sig->email : sig->name;
+  return v ? v : "";
+}
+}  // namespace
+
+GitLogPage git_log_page(const GitLogOptions &opts) {
+  RepoLease lease = acquire_repo(opts.localPath);
+  git_repository *repo = lease.get();
+
+  // A fresh repository without commits has an empty history, not an error.
+  const std::string ref = opts.ref.empty() ? "HEAD" : opts.ref;
+  std::vector<git_oid> starts;
+  if (!opts.cursor.empty()) {
+    starts = decode_cursor(opts.cursor);
+  } else if (ref != "HEAD" || git_repository_head_unborn(repo) != 1) {
+    starts.push_back(resolve_commit(repo, ref));
+  }
+
+  GitLogPage page;
+  if (starts.empty()) return page;
+
+  git_revwalk *walk = nullptr;
+  int rc = git_revwalk_new(&walk, repo);
+  if (rc == 0) rc = git_revwalk_sorting(walk, GIT_SORT_TIME);
+  for (size_t i = 0; rc == 0 && i < starts.size(); i++) rc = git_revwalk_push(walk, &starts[i]);
+  if (rc != 0) {
+    if (walk) git_revwalk_free(walk);
+    throw GitException(last_error_message(rc));
+  }
+
+  git_diff_options diffOpts = GIT_DIFF_OPTIONS_INIT;
+  std::vector<const char *> pathStorage;
+  if (!opts.paths.empty()) {
+    diffOpts.flags = GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+    diffOpts.pathspec = as_strarray(opts.paths, pathStorage);
+  }
+
+  trace_phase("walk");
+  const size_t limit = opts.limit == 0 ? 50 : opts.limit;
+  const size_t maxScan = opts.maxScan == 0 ? limit : opts.maxScan;
+  std::unordered_set<git_oid, OidHash, OidEq> walked;
+  std::set<git_oid, OidLess> frontier(starts.begin(), starts.end());
+  git_oid id;
+  try {
+    while (page.commits.size() < limit && page.scanned < maxScan) {
+      rc = git_revwalk_next(&id, walk);
+      if (rc == GIT_ITEROVER) break;
+      if (rc != 0) throw GitException(last_error_message(rc));
+
+      git_commit *commit = nullptr;
+      rc = git_commit_lookup(&commit, repo, &id);
+      if (rc != 0) throw GitException(last_error_message(rc));
+      page.scanned++;
+      walked.insert(id);
+      frontier.erase(id);
+      const unsigned int parents = git_commit_parentcount(commit);
+      for (unsigned int i = 0; i < parents; i++) {
+        const git_oid *p = git_commit_parent_id(commit, i);
+        if (walked.count(*p) == 0) frontier.insert(*p);
+      }
+
+      bool keep = true;
+      try {
+        keep = opts.paths.empty() || touches_paths(repo, commit, diffOpts);
+        if (keep) page.commits.push_back(log_entry(commit));
+      } catch (...) {
+        git_commit_free(commit);
+        throw;
+      }
+      git_commit_free(commit);
+    }
+  } catch (...) {
+    git_revwalk_free(walk);
+    throw;
+  }
+  git_revwalk_free(walk);
+
+  trace_count("commits", static_cast<int64_t>(page.scanned));
+  // An exhausted walk has nothing left on its frontier.
+  if (rc != GIT_ITEROVER) page.nextCursor = encode_cursor(frontier);
+  return page;
+}
+
+std::vector<GitBlameHunk> git_blame_range(const GitBlameOptions &opts) {
+  if (opts.path.empty()) throw GitException("path is required");
+  if (opts.endLine != 0 && opts.endLine < opts.startLine) throw GitException("endLine is before startLine");
+
+  RepoLease lease = acquire_repo(opts.localPath);
+  git_repository *repo = lease.get();
+
+  git_blame_options bo = GIT_BLAME_OPTIONS_INIT;
+  bo.newest_commit = resolve_commit(repo, opts.ref.empty() ? "HEAD" : opts.ref);
+  bo.min_line = opts.startLine == 0 ? 1 : opts.startLine;
+  bo.max_line = opts.endLine;
+
+  trace_phase("blame");
+  git_blame *blame = nullptr;
+  const int rc = git_blame_file(&blame, repo, opts.path.c_str(), &bo);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  std::vector<GitBlameHunk> out;
+  const uint32_t count = git_blame_get_hunk_count(blame);
+  out.reserve(count);
+  for (uint32_t i = 0; i < count; i++) {
+    const git_blame_hunk *h = git_blame_get_hunk_byindex(blame, i);
+    if (!h) continue;
+    GitBlameHunk hunk;
+    hunk.startLine = h->final_start_line_number;
+    hunk.lineCount = h->lines_in_hunk;
+    hunk.oid = oid_hex(&h->final_commit_id);
+    hunk.authorName = signature_field(h->final_signature, false);
+    hunk.authorEmail = signature_field(h->final_signature, true);
+    if (h->final_signature) hunk.authorTime = static_cast<int64_t>(h->final_signature->when.time);
+    if (h->summary) hunk.summary = h->summary;
+    if (h->orig_path) hunk.origPath = h->orig_path;
+    hunk.origStartLine = h->orig_start_line_number;
+    hunk.boundary = h->boundary != 0;
+    out.push_back(std::move(hunk));
+  }
+  git_blame_free(blame);
+  trace_count("hunks", static_cast<int64_t>(out.size()));
+  return out;
+}
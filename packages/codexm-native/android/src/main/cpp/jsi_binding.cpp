@@ -0,0 +1,300 @@
+#include "git_ops.h"
+#include "repo_cache.h"
+#include "scheduler.h"
+#include "trace.h"
+
+#include <ReactCommon/CallInvoker.h>
+#include <ReactCommon/CallInvokerHolder.h>
+#include <fbjni/fbjni.h>
+#include <jni.h>
+#include <jsi/jsi.h>
+
+#include <cctype>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Direct JSI binding for the calls that run after every agent turn (status and diff), installed as
+// `global.__CodexMGitJSI`. JS calls them without the bridge: no ReadableMap, no Kotlin executor
+// hop, no WritableMap/String round trip. Work still goes through the git scheduler, so ordering and
+// coalescing match the bridge methods; results are resolved on the JS thread through the
+// CallInvoker as ArrayBuffers that own the native buffer (no copy into Java or JS strings).
+//
+// Everything else (network calls, progress, streaming) stays on CodexMGitModule.
+
+namespace jsi = facebook::jsi;
+namespace react = facebook::react;
+
+namespace {
+// Owns the bytes an ArrayBuffer handed to JS points at.
+class StringBuffer : public jsi::MutableBuffer {
+ public:
+  explicit StringBuffer(std::shared_ptr<std::string> data) : data_(std::move(data)) {}
+  size_t size() const override { return data_->size(); }
+  uint8_t *data() override { return reinterpret_cast<uint8_t *>(&(*data_)[0]); }
+
+ private:
+  std::shared_ptr<std::string> data_;
+};
+
+// Promise callbacks. Created on the JS thread and only ever touched (and released) there.
+struct Deferred {
+  jsi::Function resolve;
+  jsi::Function reject;
+};
+
+struct Outcome {
+  std::shared_ptr<std::string> bytes;
+  std::string error;
+  bool cancelled = false;
+};
+
+// File URI or plain path -> path, like CodexMGitModule.uriToFilePath().
+std::string uri_to_path(const std::string &uri) {
+  const std::string scheme = "file://";
+  if (uri.compare(0, scheme.size(), scheme) != 0) return uri;
+  const size_t slash = uri.find('/', scheme.size());
+  if (slash == std::string::npos) return uri;
+  std::string out;
+  out.reserve(uri.size() - slash);
+  for (size_t i = slash; i < uri.size(); i++) {
+    const char c = uri[i];
+    if (c == '%' && i + 2 < uri.size() && std::isxdigit(static_cast<unsigned char>(uri[i + 1])) &&
+        std::isxdigit(static_cast<unsigned char>(uri[i + 2]))) {
+      out.push_back(static_cast<char>(std::stoi(uri.substr(i + 1, 2), nullptr, 16)));
+      i += 2;
+    } else {
+      out.push_back(c);
+    }
+  }
+  return out;
+}
+
+// Optional `{ threshold?, limit?, copies? }` argument (GitRenameDetection in src/git/types.ts);
+// absent or not an object leaves rename detection off.
+GitRenameOptions rename_arg(jsi::Runtime &rt, const jsi::Value *args, size_t count, size_t at) {
+  GitRenameOptions o;
+  if (count <= at || !args[at].isObject()) return o;
+  const jsi::Object r = args[at].asObject(rt);
+  o.enabled = true;
+  const jsi::Value threshold = r.getProperty(rt, "threshold");
+  if (threshold.isNumber() && threshold.asNumber() > 0) {
+    o.threshold = static_cast<uint16_t>(threshold.asNumber() > 100 ? 100 : threshold.asNumber());
+  }
+  const jsi::Value limit = r.getProperty(rt, "limit");
+  if (limit.isNumber() && limit.asNumber() > 0) o.renameLimit = static_cast<uint32_t>(limit.asNumber());
+  const jsi::Value copies = r.getProperty(rt, "copies");
+  o.copies = copies.isBool() && copies.getBool();
+  return o;
+}
+
+// Part of the coalescing key: calls with different rename settings produce different results.
+std::string rename_key(const GitRenameOptions &o) {
+  if (!o.enabled) return "";
+  return ":M" + std::to_string(o.threshold) + "/" + std::to_string(o.renameLimit) + (o.copies ? "C" : "");
+}
+
+class JsiGitJob : public GitJob {
+ public:
+  JsiGitJob(std::function<std::string()> work, std::shared_ptr<react::CallInvoker> invoker,
+            std::shared_ptr<Deferred> deferred, const char *errorCode)
+      : work_(std::move(work)), invoker_(std::move(invoker)), deferred_(std::move(deferred)), errorCode_(errorCode) {}
+
+  void run() override {
+    try {
+      outcome_.bytes = std::make_shared<std::string>(work_());
+    } catch (const GitCancelled &e) {
+      outcome_.error = e.what();
+      outcome_.cancelled = true;
+    } catch (const std::exception &e) {
+      outcome_.error = e.what();
+    }
+    settle(outcome_);
+  }
+
+  // Coalesced callers get their own copy: an ArrayBuffer is mutable from JS.
+  void complete_from(GitJob &primary) override {
+    Outcome o = static_cast<JsiGitJob &>(primary).outcome_;
+    if (o.bytes) o.bytes = std::make_shared<std::string>(*o.bytes);
+    settle(o);
+  }
+
+  void fail(const char *message) override {
+    if (!deferred_) return;  // Already settled.
+    Outcome o;
+    o.error = message;
+    settle(o);
+  }
+
+ private:
+  void settle(const Outcome &o) {
+    // The deferred moves into the callback so its jsi::Functions are released on the JS thread.
+    invoker_->invokeAsync([deferred = std::move(deferred_), o, code = errorCode_](jsi::Runtime &rt) {
+      if (o.bytes) {
+        deferred->resolve.call(rt, jsi::ArrayBuffer(rt, std::make_shared<StringBuffer>(o.bytes)));
+        return;
+      }
+      jsi::Object error = rt.global()
+                              .getPropertyAsFunction(rt, "Error")
+                              .callAsConstructor(rt, jsi::String::createFromUtf8(rt, o.error))
+                              .asObject(rt);
+      error.setProperty(rt, "code", jsi::String::createFromAscii(rt, o.cancelled ? "E_GIT_CANCELLED" : code));
+      deferred->reject.call(rt, std::move(error));
+    });
+  }
+
+  std::function<std::string()> work_;
+  std::shared_ptr<react::CallInvoker> invoker_;
+  std::shared_ptr<Deferred> deferred_;
+  const char *errorCode_;
+  Outcome outcome_;
+};
+
+class CodexMGitJsi : public jsi::HostObject {
+ public:
+  explicit CodexMGitJsi(std::shared_ptr<react::CallInvoker> invoker) : invoker_(std::move(invoker)) {}
+
+  jsi::Value get(jsi::Runtime &rt, const jsi::PropNameID &name) override {
+    const std::string n = name.utf8(rt);
+
+    // status(localRepoDirUri, renames?): Promise<ArrayBuffer> in git_status_packed() layout.
+    if (n == "status") {
+      return method(rt, n, 2, [inv = invoker_](jsi::Runtime &rt, const jsi::Value *args, size_t count) {
+        const std::string path = uri_to_path(string_arg(rt, args[0], "localRepoDirUri"));
+        const GitRenameOptions renames = rename_arg(rt, args, count, 1);
+        return schedule(rt, inv, path, "status" + rename_key(renames), "E_GIT_STATUS", [path, renames] {
+          TraceSpan span("status", path);
+          std::string out = git_status_packed(git_status(path, renames));
+          span.phase("marshal");
+          return out;
+        });
+      });
+    }
+
+    // statusIncremental(localRepoDirUri, touchedPaths?: string[], watch?: boolean).
+    if (n == "statusIncremental") {
+      return method(rt, n, 3, [inv = invoker_](jsi::Runtime &rt, const jsi::Value *args, size_t count) {
+        GitIncrementalStatusOptions opts;
+        opts.localPath = uri_to_path(string_arg(rt, args[0], "localRepoDirUri"));
+        if (count > 1 && args[1].isObject()) {
+          jsi::Array touched = args[1].asObject(rt).asArray(rt);
+          for (size_t i = 0; i < touched.size(rt); i++) {
+            opts.touchedPaths.push_back(touched.getValueAtIndex(rt, i).asString(rt).utf8(rt));
+          }
+        }
+        opts.watch = count < 3 || !args[2].isBool() || args[2].getBool();
+        const std::string coalesceKey =
+            opts.touchedPaths.empty() ? std::string(opts.watch ? "statusIncremental:true" : "statusIncremental:false") : "";
+        return schedule(rt, inv, opts.localPath, coalesceKey, "E_GIT_STATUS", [opts] {
+          TraceSpan span("statusIncremental", opts.localPath);
+          std::string out = git_status_packed(git_status_incremental(opts));
+          span.phase("marshal");
+          return out;
+        });
+      });
+    }
+
+    // diff(localRepoDirUri, maxBytes?, renames?): Promise<ArrayBuffer> of UTF-8 patch text.
+    if (n == "diff") {
+      return method(rt, n, 3, [inv = invoker_](jsi::Runtime &rt, const jsi::Value *args, size_t count) {
+        const std::string path = uri_to_path(string_arg(rt, args[0], "localRepoDirUri"));
+        const size_t maxBytes =
+            count > 1 && args[1].isNumber() && args[1].asNumber() > 0 ? static_cast<size_t>(args[1].asNumber()) : 400000;
+        const GitRenameOptions renames = rename_arg(rt, args, count, 2);
+        const std::string key = "diff:" + std::to_string(maxBytes) + rename_key(renames);
+        return schedule(rt, inv, path, key, "E_GIT_DIFF", [path, maxBytes, renames] {
+          TraceSpan span("diff", path);
+          return git_diff_unified(path, maxBytes, renames);
+        });
+      });
+    }
+
+    // diffStructured(localRepoDirUri, renames?): Promise<ArrayBuffer> in git_diff_structured() layout.
+    if (n == "diffStructured") {
+      return method(rt, n, 2, [inv = invoker_](jsi::Runtime &rt, const jsi::Value *args, size_t count) {
+        const std::string path = uri_to_path(string_arg(rt, args[0], "localRepoDirUri"));
+        const GitRenameOptions renames = rename_arg(rt, args, count, 1);
+        return schedule(rt, inv, path, "diffStructured" + rename_key(renames), "E_GIT_DIFF", [path, renames] {
+          TraceSpan span("diffStructured", path);
+          return git_diff_structured(path, renames);
+        });
+      });
+    }
+
+    return jsi::Value::undefined();
+  }
+
+  std::vector<jsi::PropNameID> getPropertyNames(jsi::Runtime &rt) override {
+    std::vector<jsi::PropNameID> names;
+    for (const char *n : {"status", "statusIncremental", "diff", "diffStructured"}) {
+      names.push_back(jsi::PropNameID::forAscii(rt, n));
+    }
+    return names;
+  }
+
+ private:
+  using Body = std::function<jsi::Value(jsi::Runtime &, const jsi::Value *, size_t)>;
+
+  static jsi::Value method(jsi::Runtime &rt, const std::string &name, unsigned int params, Body body) {
+    return jsi::Function::createFromHostFunction(
+        rt, jsi::PropNameID::forUtf8(rt, name), params,
+        [body = std::move(body)](jsi::Runtime &rt, const jsi::Value &, const jsi::Value *args, size_t count) {
+          const jsi::Value undefined;
+          return body(rt, count > 0 ? args : &undefined, count);
+        });
+  }
+
+  static std::string string_arg(jsi::Runtime &rt, const jsi::Value &v, const char *name) {
+    if (!v.isString()) throw jsi::JSError(rt, std::string(name) + " is required");
+    return v.asString(rt).utf8(rt);
+  }
+
+  // Returns a promise settled with `work()`'s bytes once the scheduler has run it. Coalesce keys
+  // are prefixed so JSI jobs never coalesce with bridge jobs (they report results differently).
+  static jsi::Value schedule(jsi::Runtime &rt, const std::shared_ptr<react::CallInvoker> &invoker,
+                             const std::string &localPath, const std::string &coalesceKey, const char *errorCode,
+                             std::function<std::string()> work) {
+    auto executor = jsi::Function::createFromHostFunction(
+        rt, jsi::PropNameID::forAscii(rt, "executor"), 2,
+        [=](jsi::Runtime &rt, const jsi::Value &, const jsi::Value *args, size_t) {
+          auto deferred = std::make_shared<Deferred>(
+              Deferred{args[0].asObject(rt).asFunction(rt), args[1].asObject(rt).asFunction(rt)});
+          schedule_git_job(repo_cache_key(localPath), coalesceKey.empty() ? "" : "jsi:" + coalesceKey, GitJobKind::Read,
+                           std::unique_ptr<GitJob>(new JsiGitJob(work, invoker, std::move(deferred), errorCode)));
+          return jsi::Value::undefined();
+        });
+    return rt.global().getPropertyAsFunction(rt, "Promise").callAsConstructor(rt, executor);
+  }
+
+  std::shared_ptr<react::CallInvoker> invoker_;
+};
+}  // namespace
+
+// Called from CodexMGitModule.installJsi() on the JS thread.
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_codexm_nativemodules_CodexMGitModule_nativeInstallJsi(JNIEnv *env,
+                                                        jobject /*thiz*/,
+                                                        jlong runtimePtr,
+                                                        jobject callInvokerHolder) {
+  auto *runtime = reinterpret_cast<jsi::Runtime *>(runtimePtr);
+  if (!runtime || !callInvokerHolder) return JNI_FALSE;
+  JavaVM *vm = nullptr;
+  if (env->GetJavaVM(&vm) != JNI_OK) return JNI_FALSE;
+
+  bool installed = false;
+  // fbjni is already set up by React Native; this only makes its thread state available here.
+  facebook::jni::initialize(vm, [&] {
+    auto holder = facebook::jni::alias_ref<react::CallInvokerHolder::javaobject>(
+        static_cast<react::CallInvokerHolder::javaobject>(callInvokerHolder));
+    std::shared_ptr<react::CallInvoker> invoker = holder->cthis()->getCallInvoker();
+    if (!invoker) return;
+    jsi::Runtime &rt = *runtime;
+    rt.global().setProperty(rt, "__CodexMGitJSI",
+                            jsi::Object::createFromHostObject(rt, std::make_shared<CodexMGitJsi>(std::move(invoker))));
+    installed = true;
+  });
+  return installed ? JNI_TRUE : JNI_FALSE;
+}
@@ -0,0 +1,208 @@
+#include "jsonl_pipe.h"
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kInitialBuffer = 64 * 1024;
+
+// Where a record keeps its "delta" string: [start, end) of the escaped contents, between the quotes.
+struct DeltaSpan {
+  size_t start = 0;
+  size_t end = 0;
+};
+
+const char *find_bytes(const char *p, size_t n, const char *needle, size_t m) {
+  if (m > n) return nullptr;
+  const char *end = p + n - m + 1;
+  while (p < end) {
+    p = static_cast<const char *>(memchr(p, needle[0], static_cast<size_t>(end - p)));
+    if (!p) return nullptr;
+    if (memcmp(p, needle, m) == 0) return p;
+    p++;
+  }
+  return nullptr;
+}
+
+// End of the JSON string whose contents start at `i` (index of the closing quote), or npos.
+size_t string_end(const char *p, size_t n, size_t i) {
+  while (i < n) {
+    if (p[i] == '\\') {
+      i += 2;
+    } else if (p[i] == '"') {
+      return i;
+    } else {
+      i++;
+    }
+  }
+  return std::string::npos;
+}
+
+// Codex writes compact JSON, so the keys are matched byte for byte. An unescaped `"delta":"` can
+// only be a real key (inside a string its quotes would be escaped); records with more than one are
+// left alone.
+bool find_delta(const char *p, size_t n, DeltaSpan &out) {
+  static const char kMethod[] = "\"method\":\"";
+  static const char kDelta[] = "\"delta\":\"";
+  const size_t methodLen = sizeof(kMethod) - 1;
+  const size_t deltaLen = sizeof(kDelta) - 1;
+
+  const char *m = find_bytes(p, n, kMethod, methodLen);
+  if (!m) return false;
+  const size_t methodStart = static_cast<size_t>(m - p) + methodLen;
+  const size_t methodEnd = string_end(p, n, methodStart);
+  if (methodEnd == std::string::npos || methodEnd - methodStart < 5) return false;
+  const char *tail = p + methodEnd - 5;
+  if (memcmp(tail - 1, "/delta", 6) != 0 && memcmp(tail, "Delta", 5) != 0) return false;
+
+  const char *d = find_bytes(p, n, kDelta, deltaLen);
+  if (!d) return false;
+  const size_t start = static_cast<size_t>(d - p) + deltaLen;
+  const size_t end = string_end(p, n, start);
+  if (end == std::string::npos) return false;
+  if (find_bytes(p + end, n - end, kDelta, deltaLen)) return false;
+  out.start = start;
+  out.end = end;
+  return true;
+}
+
+class Batcher {
+ public:
+  Batcher(const JsonlPipeOptions &opts, const JsonlBatchCallback &cb, JsonlPipeStats &stats)
+      : opts_(opts), cb_(cb), stats_(stats) {}
+
+  bool empty() const { return records_ == 0; }
+  Clock::time_point deadline() const { return first_ + std::chrono::milliseconds(opts_.frameMs); }
+
+  // Returns false once the callback asked to stop.
+  bool add(const char *p, size_t n) {
+    if (n > 0 && p[n - 1] == '\r') n--;
+    if (n == 0) return true;
+
+    DeltaSpan span;
+    const bool isDelta = opts_.coalesceDeltas && find_delta(p, n, span);
+    if (isDelta && lastIsDelta_ && mergeable(p, n, span)) {
+      const size_t at = lastStart_ + lastDelta_.end;
+      batch_.insert(at, p + span.start, span.end - span.start);
+      lastDelta_.end += span.end - span.start;
+      stats_.coalesced++;
+    } else {
+      if (records_ == 0) {
+        first_ = Clock::now();
+      } else {
+        batch_.push_back('\n');
+      }
+      lastStart_ = batch_.size();
+      batch_.append(p, n);
+      records_++;
+      lastIsDelta_ = isDelta;
+      lastDelta_ = span;
+    }
+    return batch_.size() < opts_.maxBatchBytes || flush();
+  }
+
+  bool flush() {
+    if (records_ == 0) return true;
+    stats_.records += records_;
+    stats_.batches++;
+    const bool keepGoing = cb_(batch_, records_);
+    batch_.clear();
+    records_ = 0;
+    lastIsDelta_ = false;
+    return keepGoing;
+  }
+
+ private:
+  // Same bytes before and after the delta string as the last record in the batch.
+  bool mergeable(const char *p, size_t n, const DeltaSpan &span) const {
+    const char *last = batch_.data() + lastStart_;
+    const size_t lastLen = batch_.size() - lastStart_;
+    const size_t suffix = n - span.end;
+    return span.start == lastDelta_.start && suffix == lastLen - lastDelta_.end &&
+           memcmp(p, last, span.start) == 0 && memcmp(p + span.end, last + lastDelta_.end, suffix) == 0;
+  }
+
+  const JsonlPipeOptions &opts_;
+  const JsonlBatchCallback &cb_;
+  JsonlPipeStats &stats_;
+  std::string batch_;
+  size_t records_ = 0;
+  Clock::time_point first_;
+  size_t lastStart_ = 0;
+  bool lastIsDelta_ = false;
+  DeltaSpan lastDelta_;
+};
+}  // namespace
+
+JsonlPipeStats jsonl_pipe_read(const JsonlPipeOptions &opts, const JsonlBatchCallback &cb) {
+  JsonlPipeStats stats;
+  Batcher batcher(opts, cb, stats);
+
+  // Unread bytes live in [begin, end). Complete records are consumed in place; the partial record
+  // at the tail moves to the front only when the space behind it runs out, and the buffer grows
+  // only for a record longer than the whole buffer.
+  std::vector<char> buf(kInitialBuffer);
+  size_t begin = 0;
+  size_t end = 0;
+
+  for (;;) {
+    int timeout = -1;
+    if (!batcher.empty()) {
+      const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(batcher.deadline() - Clock::now());
+      timeout = static_cast<int>(std::max<int64_t>(0, left.count()));
+    }
+    pollfd pfd{opts.fd, POLLIN, 0};
+    const int ready = poll(&pfd, 1, timeout);
+    if (ready < 0) {
+      if (errno == EINTR) continue;
+      throw JsonlPipeError(std::string("poll: ") + std::strerror(errno));
+    }
+    if (ready == 0) {
+      if (!batcher.flush()) return stats;
+      continue;
+    }
+
+    if (end == buf.size()) {
+      if (begin > 0) {
+        memmove(buf.data(), buf.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+      } else {
+        buf.resize(buf.size() * 2);
+      }
+    }
+    const ssize_t n = read(opts.fd, buf.data() + end, buf.size() - end);
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN) continue;
+      throw JsonlPipeError(std::string("read: ") + std::strerror(errno));
+    }
+    if (n == 0) {
+      if (end > begin && !batcher.add(buf.data() + begin, end - begin)) return stats;
+      batcher.flush();
+      return stats;
+    }
+    stats.bytes += static_cast<uint64_t>(n);
+
+    // Only the new bytes can hold a newline; memchr is the vectorized scan here.
+    size_t scan = end;
+    end += static_cast<size_t>(n);
+    while (const void *nl = memchr(buf.data() + scan, '\n', end - scan)) {
+      const size_t at = static_cast<size_t>(static_cast<const char *>(nl) - buf.data());
+      if (!batcher.add(buf.data() + begin, at - begin)) return stats;
+      begin = at + 1;
+      scan = begin;
+    }
+    if (begin == end) begin = end = 0;
+    // With input always pending, poll() never times out; the frame deadline still applies.
+    if (!batcher.empty() && Clock::now() >= batcher.deadline() && !batcher.flush()) return stats;
+  }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+// Framing for the `codex app-server` stdout pipe: newline-delimited JSON records read natively and
+// handed over in batches, so a fast token stream costs one bridge event per frame instead of one
+// per record.
+
+struct JsonlPipeError : public std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+struct JsonlPipeOptions {
+  int fd = -1;
+  // A batch is delivered at most this long after its first record arrived...
+  int frameMs = 16;
+  // ...or as soon as it holds this many bytes.
+  size_t maxBatchBytes = 256 * 1024;
+  // Merge consecutive streaming notifications (methods ending in "/delta" or "Delta") that differ
+  // only in their "delta" string into one record carrying the concatenated text.
+  bool coalesceDeltas = true;
+};
+
+struct JsonlPipeStats {
+  uint64_t bytes = 0;
+  uint64_t records = 0;  // as delivered, after coalescing
+  uint64_t coalesced = 0;  // records merged into the one before them
+  uint64_t batches = 0;
+};
+
+// `batch` is the records joined by '\n' (no trailing newline; blank lines and '\r' dropped).
+// Return false to stop reading.
+using JsonlBatchCallback = std::function<bool(const std::string &batch, size_t records)>;
+
+// Reads `opts.fd` on the calling thread until EOF or until `cb` returns false; a final record
+// without a newline is delivered at EOF. Works with blocking and non-blocking descriptors and
+// does not close `fd`. Throws JsonlPipeError on read errors.
+JsonlPipeStats jsonl_pipe_read(const JsonlPipeOptions &opts, const JsonlBatchCallback &cb);
@@ -0,0 +1,432 @@
+#include "git_ops.h"
+
+#include "git_internal.h"
+#include "operation.h"
+#include "repo_cache.h"
+#include "scheduler.h"
+#include "trace.h"
+
+#include <git2.h>
+#include <git2/sys/commit_graph.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// On-device `git gc`. Everything reachable is packed with git_packbuilder (so deltas are
+// recomputed across all history) into a single new pack; only then are old packs and loose objects
+// removed. Loose objects are checked against a pack-only ODB: anything packed is redundant, and
+// anything else is unreachable and goes once it is older than the grace period. Old packs younger
+// than the grace period are kept whole, since they may hold objects an in-flight writer expects.
+//
+// libgit2 reads commit-graph files for revwalks when core.commitGraph is set, so one is written
+// from the same roots. A multi-pack-index is not written: after consolidation there is one pack.
+
+namespace {
+constexpr size_t kLooseThreshold = 1000;
+constexpr size_t kPackThreshold = 10;
+
+struct Roots {
+  std::vector<git_oid> commits;
+  std::vector<git_oid> others;  // annotated tags and any non-commit objects they point at
+};
+
+void add_root(git_repository *repo, const git_oid &id, Roots &roots) {
+  git_oid cur = id;
+  for (int depth = 0; depth < 16; depth++) {
+    git_object *obj = nullptr;
+    if (git_object_lookup(&obj, repo, &cur, GIT_OBJECT_ANY) != 0) return;  // dangling ref
+    const git_object_t type = git_object_type(obj);
+    if (type == GIT_OBJECT_TAG) {
+      roots.others.push_back(cur);
+      cur = *git_tag_target_id(reinterpret_cast<git_tag *>(obj));
+      git_object_free(obj);
+      continue;
+    }
+    git_object_free(obj);
+    if (type == GIT_OBJECT_COMMIT) roots.commits.push_back(cur);
+    else roots.others.push_back(cur);
+    return;
+  }
+}
+
+// Both sides of every reflog entry: the tips a pull rebase or merge moved away from stay
+// recoverable, as they do under git gc (which keeps them for 90 days; we never expire reflogs).
+void add_reflog_roots(git_repository *repo, const char *name, Roots &roots) {
+  git_reflog *log = nullptr;
+  if (git_reflog_read(&log, repo, name) != 0) return;  // no reflog
+  const size_t n = git_reflog_entrycount(log);
+  for (size_t i = 0; i < n; i++) {
+    const git_reflog_entry *e = git_reflog_entry_byindex(log, i);
+    if (!e) continue;
+    const git_oid *ids[] = {git_reflog_entry_id_old(e), git_reflog_entry_id_new(e)};
+    for (const git_oid *id : ids) {
+      if (id && !git_oid_is_zero(id)) add_root(repo, *id, roots);
+    }
+  }
+  git_reflog_free(log);
+}
+
+Roots collect_roots(git_repository *repo, const std::string &localPath) {
+  Roots roots;
+  git_reference_iterator *it = nullptr;
+  int rc = git_reference_iterator_new(&it, repo);
+  if (rc != 0) throw GitException(last_error_message(rc));
+  git_reference *ref = nullptr;
+  while (git_reference_next(&ref, it) == 0) {
+    const git_oid *target = git_reference_target(ref);  // null for symbolic refs
+    if (target) add_root(repo, *target, roots);
+    add_reflog_roots(repo, git_reference_name(ref), roots);
+    git_reference_free(ref);
+  }
+  git_reference_iterator_free(it);
+
+  git_oid head{};
+  if (git_reference_name_to_id(&head, repo, "HEAD") == 0) add_root(repo, head, roots);
+  add_reflog_roots(repo, "HEAD", roots);
+
+  for (const auto &s : git_list_snapshots(localPath)) {
+    git_oid id{};
+    if (git_oid_fromstr(&id, s.oid.c_str()) == 0) add_root(repo, id, roots);
+  }
+  return roots;
+}
+
+int push_commits(git_revwalk *walk, const Roots &roots) {
+  for (const auto &id : roots.commits) {
+    const int rc = git_revwalk_push(walk, &id);
+    if (rc != 0) return rc;
+  }
+  return 0;
+}
+
+bool is_hex(const char *s, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    const char c = s[i];
+    if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+  }
+  return s[n] == '\0';
+}
+
+template <typename Fn>
+void for_each_entry(const std::string &dir, Fn fn) {
+  DIR *d = opendir(dir.c_str());
+  if (!d) return;
+  while (dirent *e = readdir(d)) {
+    if (e->d_name[0] == '.') continue;
+    fn(std::string(e->d_name));
+  }
+  closedir(d);
+}
+
+int64_t file_size(const std::string &path, time_t *mtime = nullptr) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) return -1;
+  if (mtime) *mtime = st.st_mtime;
+  return static_cast<int64_t>(st.st_size);
+}
+
+// Loose objects (fanout dirs) and packs under `objectsDir`.
+struct Inventory {
+  size_t loose = 0;
+  size_t packs = 0;
+  int64_t bytes = 0;
+};
+
+Inventory take_inventory(const std::string &objectsDir) {
+  Inventory inv;
+  for_each_entry(objectsDir, [&](const std::string &name) {
+    if (name.size() != 2 || !is_hex(name.c_str(), 2)) return;
+    for_each_entry(objectsDir + name, [&](const std::string &obj) {
+      const int64_t size = file_size(objectsDir + name + "/" + obj);
+      if (size < 0) return;
+      inv.loose++;
+      inv.bytes += size;
+    });
+  });
+  for_each_entry(objectsDir + "pack", [&](const std::string &name) {
+    const int64_t size = file_size(objectsDir + "pack/" + name);
+    if (size < 0) return;
+    inv.bytes += size;
+    if (name.size() > 5 && name.compare(name.size() - 5, 5, ".pack") == 0) inv.packs++;
+  });
+  return inv;
+}
+
+int pack_progress_cb(int /*stage*/, uint32_t current, uint32_t total, void *payload) {
+  auto *op = static_cast<OperationContext *>(payload);
+  if (op->cancelled()) return GIT_EUSER;
+  op->report("packing", current, total, 0);
+  return 0;
+}
+
+int write_progress_cb(const git_indexer_progress *stats, void *payload) {
+  auto *op = static_cast<OperationContext *>(payload);
+  if (op->cancelled()) return GIT_EUSER;
+  op->report("writing", stats->indexed_objects, stats->total_objects, stats->received_bytes);
+  return 0;
+}
+
+// Writes one pack with every reachable object. Returns its "pack-<hash>" basename, or "" if there
+// was nothing to pack.
+std::string write_pack(git_repository *repo, const Roots &roots, OperationContext &op, size_t &objects) {
+  git_packbuilder *pb = nullptr;
+  git_revwalk *walk = nullptr;
+  git_index *index = nullptr;
+  int rc = git_packbuilder_new(&pb, repo);
+  // Two threads: enough to hide zlib latency without starving the UI on little cores.
+  if (rc == 0) git_packbuilder_set_threads(pb, 2);
+  if (rc == 0) rc = git_packbuilder_set_callbacks(pb, pack_progress_cb, &op);
+  if (rc == 0) rc = git_revwalk_new(&walk, repo);
+  if (rc == 0) rc = push_commits(walk, roots);
+  if (rc == 0) rc = git_packbuilder_insert_walk(pb, walk);
+  for (size_t i = 0; rc == 0 && i < roots.others.size(); i++) {
+    rc = git_packbuilder_insert_recur(pb, &roots.others[i], nullptr);
+  }
+
+  // Staged blobs are reachable from nothing but the index.
+  if (rc == 0) rc = git_repository_index(&index, repo);
+  if (rc == 0) {
+    git_odb *odb = nullptr;
+    rc = git_repository_odb(&odb, repo);
+    const size_t n = rc == 0 ? git_index_entrycount(index) : 0;
+    for (size_t i = 0; rc == 0 && i < n; i++) {
+      const git_index_entry *e = git_index_get_byindex(index, i);
+      if (!e || e->mode == GIT_FILEMODE_COMMIT || !git_odb_exists(odb, &e->id)) continue;
+      rc = git_packbuilder_insert(pb, &e->id, e->path);
+    }
+    if (odb) git_odb_free(odb);
+  }
+
+  std::string name;
+  if (rc == 0) {
+    objects = git_packbuilder_object_count(pb);
+    if (objects > 0) {
+      rc = git_packbuilder_write(pb, nullptr, 0, write_progress_cb, &op);
+      if (rc == 0) name = std::string("pack-") + git_packbuilder_name(pb);
+    }
+  }
+
+  if (index) git_index_free(index);
+  if (walk) git_revwalk_free(walk);
+  if (pb) git_packbuilder_free(pb);
+  if (rc != 0) op.fail(rc);
+  return name;
+}
+
+size_t remove_old_packs(const std::string &packDir, const std::string &keep, time_t cutoff) {
+  std::vector<std::string> stems;
+  for_each_entry(packDir, [&](const std::string &name) {
+    if (name.size() <= 5 || name.compare(name.size() - 5, 5, ".pack") != 0) return;
+    const std::string stem = name.substr(0, name.size() - 5);
+    if (stem == keep) return;
+    time_t mtime = 0;
+    if (file_size(packDir + name, &mtime) < 0 || mtime > cutoff) return;
+    if (access((packDir + stem + ".keep").c_str(), F_OK) == 0) return;
+    stems.push_back(stem);
+  });
+
+  for (const auto &stem : stems) {
+    // The index goes first so a reader never sees an .idx without its pack.
+    for (const char *ext : {".idx", ".pack", ".rev", ".bitmap", ".mtimes"}) unlink((packDir + stem + ext).c_str());
+  }
+  // Any multi-pack-index now names packs that are gone.
+  if (!stems.empty()) unlink((packDir + "multi-pack-index").c_str());
+  return stems.size();
+}
+
+size_t prune_loose(const std::string &objectsDir, time_t cutoff) {
+  git_odb_backend *backend = nullptr;
+  git_odb *packed = nullptr;
+  if (git_odb_new(&packed) != 0) return 0;
+  if (git_odb_backend_pack(&backend, objectsDir.c_str()) != 0 || git_odb_add_backend(packed, backend, 1) != 0) {
+    git_odb_free(packed);
+    return 0;
+  }
+
+  size_t removed = 0;
+  for_each_entry(objectsDir, [&](const std::string &fan) {
+    if (fan.size() != 2 || !is_hex(fan.c_str(), 2)) return;
+    const std::string dir = objectsDir + fan + "/";
+    for_each_entry(dir, [&](const std::string &rest) {
+      const std::string path = dir + rest;
+      git_oid id{};
+      const bool isObject = is_hex(rest.c_str(), rest.size()) && git_oid_fromstr(&id, (fan + rest).c_str()) == 0;
+      time_t mtime = 0;
+      if (file_size(path, &mtime) < 0) return;
+      // Packed copies make loose ones redundant at any age; everything else must age out first
+      // (this includes temporary files left by interrupted writers).
+      if ((isObject && git_odb_exists(packed, &id)) || mtime <= cutoff) {
+        if (unlink(path.c_str()) == 0) removed++;
+      }
+    });
+    rmdir(dir.c_str());  // only succeeds once empty
+  });
+  git_odb_free(packed);
+  return removed;
+}
+
+bool write_commit_graph(git_repository *repo, const std::string &objectsDir, const Roots &roots) {
+  const std::string infoDir = objectsDir + "info";
+  mkdir(infoDir.c_str(), 0755);
+
+  git_commit_graph_writer *writer = nullptr;
+  git_revwalk *walk = nullptr;
+  int rc = git_commit_graph_writer_new(&writer, infoDir.c_str());
+  if (rc == 0) rc = git_revwalk_new(&walk, repo);
+  if (rc == 0) rc = push_commits(walk, roots);
+  if (rc == 0) rc = git_commit_graph_writer_add_revwalk(writer, walk);
+  if (rc == 0) rc = git_commit_graph_writer_commit(writer, nullptr);
+  if (walk) git_revwalk_free(walk);
+  if (writer) git_commit_graph_writer_free(writer);
+  if (rc != 0) return false;
+
+  git_config *cfg = nullptr;
+  if (git_repository_config(&cfg, repo) == 0) {
+    git_config_set_bool(cfg, "core.commitGraph", 1);
+    git_config_free(cfg);
+  }
+  return true;
+}
+}  // namespace
+
+GitMaintenanceResult git_maintenance(const GitMaintenanceOptions &opts) {
+  RepoLease lease = acquire_repo(opts.localPath);
+  git_repository *repo = lease.get();
+  OperationContext op(opts.hooks.operationId, opts.hooks.onProgress);
+
+  const std::string objectsDir = std::string(git_repository_path(repo)) + "objects/";
+  const Inventory before = take_inventory(objectsDir);
+
+  GitMaintenanceResult result;
+  result.bytesBefore = result.bytesAfter = before.bytes;
+  if (!opts.force && before.loose < kLooseThreshold && before.packs < kPackThreshold) return result;
+  result.ran = true;
+
+  trace_phase("roots");
+  const Roots roots = collect_roots(repo, opts.localPath);
+  const std::string keep = write_pack(repo, roots, op, result.objectsPacked);
+  if (op.cancelled()) op.fail(GIT_EUSER);
+
+  // Past this point nothing is cancelled: the new pack is complete and deletion is quick.
+  trace_phase("prune");
+  const time_t cutoff = time(nullptr) - static_cast<time_t>(opts.pruneGraceSeconds);
+  if (!keep.empty()) result.packsRemoved = remove_old_packs(objectsDir + "pack/", keep, cutoff);
+  result.looseRemoved = prune_loose(objectsDir, cutoff);
+  trace_count("objects", static_cast<int64_t>(result.objectsPacked));
+  trace_count("looseRemoved", static_cast<int64_t>(result.looseRemoved));
+  trace_phase("commitGraph");
+  result.commitGraph = write_commit_graph(repo, objectsDir, roots);
+
+  // The cached handle has the deleted packs open; the next call reopens it.
+  lease.invalidate();
+  result.bytesAfter = take_inventory(objectsDir).bytes;
+  return result;
+}
+
+// --- Idle-time scheduling -------------------------------------------------------------------
+
+namespace {
+using Clock = std::chrono::steady_clock;
+constexpr std::chrono::hours kMinInterval{24};
+
+std::mutex g_mu;
+std::deque<std::string> g_pending;                           // repo keys, FIFO
+std::unordered_map<std::string, Clock::time_point> g_lastRun;  // by repo key
+bool g_charging = false;
+bool g_idle = false;
+std::string g_runningOp;  // operation id of the job in flight, "" if none
+uint64_t g_seq = 0;
+
+void kick_locked();
+
+class MaintenanceJob : public GitJob {
+ public:
+  MaintenanceJob(std::string key, std::string operationId) : key_(std::move(key)), operationId_(std::move(operationId)) {}
+
+  // Dropped from the queue in favour of foreground work: try again later.
+  ~MaintenanceJob() override {
+    if (!ran_) done(false);
+  }
+
+  bool background() const override { return true; }
+  void yield() override { git_cancel_operation(operationId_); }
+
+  void run() override {
+    ran_ = true;
+    GitMaintenanceOptions opts;
+    opts.localPath = key_;
+    opts.hooks.operationId = operationId_;
+    bool finished = true;
+    try {
+      TraceSpan span("maintenance", key_);
+      git_maintenance(opts);
+    } catch (const GitCancelled &) {
+      finished = false;
+    } catch (const std::exception &) {
+      // Failures (git errors, but also bad_alloc or a thread that could not start) count as a run
+      // so a broken repository isn't retried every idle window.
+    }
+    done(finished);
+  }
+
+  void complete_from(GitJob & /*primary*/) override {}
+
+ private:
+  void done(bool finished) {
+    std::lock_guard<std::mutex> g(g_mu);
+    if (g_runningOp == operationId_) g_runningOp.clear();
+    if (finished) g_lastRun[key_] = Clock::now();
+    else g_pending.push_back(key_);
+    kick_locked();
+  }
+
+  const std::string key_;
+  const std::string operationId_;
+  bool ran_ = false;
+};
+
+// Caller holds g_mu. Starts the next pending repository if the device allows it.
+void kick_locked() {
+  if (!g_charging || !g_idle || !g_runningOp.empty()) return;
+  while (!g_pending.empty()) {
+    const std::string key = g_pending.front();
+    g_pending.pop_front();
+    auto last = g_lastRun.find(key);
+    if (last != g_lastRun.end() && Clock::now() - last->second < kMinInterval) continue;
+    g_runningOp = "maintenance:" + std::to_string(++g_seq) + ":" + key;
+    // Queued behind whatever the repository is doing. Submitting a background job never drops
+    // other jobs, so this cannot re-enter g_mu.
+    schedule_git_job(key, "", GitJobKind::Write, std::unique_ptr<GitJob>(new MaintenanceJob(key, g_runningOp)));
+    return;
+  }
+}
+}  // namespace
+
+void git_maintenance_request(const std::string &localPath) {
+  const std::string key = repo_cache_key(localPath);
+  std::lock_guard<std::mutex> g(g_mu);
+  for (const auto &k : g_pending) {
+    if (k == key) return;
+  }
+  g_pending.push_back(key);
+  kick_locked();
+}
+
+void git_maintenance_set_device_state(bool charging, bool idle) {
+  std::lock_guard<std::mutex> g(g_mu);
+  g_charging = charging;
+  g_idle = idle;
+  if ((!charging || !idle) && !g_runningOp.empty()) git_cancel_operation(g_runningOp);
+  kick_locked();
+}
@@ -0,0 +1,89 @@
+#include "operation.h"
+
+#include "git_internal.h"
+#include "trace.h"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+std::mutex g_ops_mu;
+// Cancel requests may arrive before the operation starts running; those leave a pre-set flag here
+// that the operation picks up when it registers.
+std::unordered_map<std::string, std::shared_ptr<std::atomic<bool>>> g_ops;
+
+std::shared_ptr<std::atomic<bool>> flag_for(const std::string &id) {
+  std::lock_guard<std::mutex> g(g_ops_mu);
+  auto &slot = g_ops[id];
+  if (!slot) slot = std::make_shared<std::atomic<bool>>(false);
+  return slot;
+}
+}  // namespace
+
+OperationContext::OperationContext(const std::string &operationId, const GitProgressCallback &onProgress)
+    : id_(operationId), onProgress_(onProgress) {
+  if (!id_.empty()) cancelled_ = flag_for(id_);
+}
+
+OperationContext::~OperationContext() {
+  if (id_.empty()) return;
+  std::lock_guard<std::mutex> g(g_ops_mu);
+  g_ops.erase(id_);
+}
+
+void OperationContext::report(const char *phase, uint64_t current, uint64_t total, uint64_t bytes) {
+  if (TraceSpan *span = TraceSpan::current()) {
+    span->phase(phase);
+    span->count(phase, static_cast<int64_t>(current));
+    if (bytes > 0) span->count("bytes", static_cast<int64_t>(bytes));
+  }
+  if (!onProgress_) return;
+  const auto now = std::chrono::steady_clock::now();
+  const bool phaseChanged = lastPhase_ != phase;
+  const bool done = total > 0 && current >= total;
+  if (!phaseChanged && !done && now - lastEmit_ < kMinInterval) return;
+  lastEmit_ = now;
+  if (phaseChanged) lastPhase_ = phase;
+
+  GitProgress p;
+  p.phase = phase;
+  p.current = current;
+  p.total = total;
+  p.bytes = bytes;
+  onProgress_(p);
+}
+
+void OperationContext::remote_message(const char *data, size_t len) {
+  if (!onProgress_ || len == 0) return;
+  // Servers redraw counters with '\r'; forwarding every redraw would flood the bridge.
+  const auto now = std::chrono::steady_clock::now();
+  if (now - lastEmit_ < kMinInterval) return;
+  lastEmit_ = now;
+
+  GitProgress p;
+  p.phase = "remote";
+  p.message.assign(data, len);
+  while (!p.message.empty() && (p.message.back() == '\n' || p.message.back() == '\r')) p.message.pop_back();
+  onProgress_(p);
+}
+
+void OperationContext::fail(int rc) const {
+  if (cancelled()) throw GitCancelled();
+  throw GitException(last_error_message(rc));
+}
+
+void git_cancel_operation(const std::string &operationId) {
+  if (operationId.empty()) return;
+  std::lock_guard<std::mutex> g(g_ops_mu);
+  // Cancelling an id that already finished (or never starts) leaves an orphan flag; drop orphans
+  // once there are enough of them to matter.
+  if (g_ops.size() >= 64) {
+    for (auto it = g_ops.begin(); it != g_ops.end();) {
+      if (it->second.use_count() == 1) it = g_ops.erase(it);
+      else ++it;
+    }
+  }
+  auto &slot = g_ops[operationId];
+  if (!slot) slot = std::make_shared<std::atomic<bool>>(false);
+  slot->store(true, std::memory_order_relaxed);
+}
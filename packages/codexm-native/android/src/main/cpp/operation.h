@@ -0,0 +1,41 @@
+#pragma once
+
+#include "git_ops.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Progress and cancellation state for one network/checkout call, shared by the libgit2 callbacks
+// of that call. Constructing it registers `operationId` so git_cancel_operation() can reach it from
+// another thread; the destructor unregisters it.
+class OperationContext {
+ public:
+  OperationContext(const std::string &operationId, const GitProgressCallback &onProgress);
+  ~OperationContext();
+  OperationContext(const OperationContext &) = delete;
+  OperationContext &operator=(const OperationContext &) = delete;
+
+  bool cancelled() const { return cancelled_ && cancelled_->load(std::memory_order_relaxed); }
+
+  // Reports progress, at most every kMinInterval unless the phase changed or the phase completed.
+  void report(const char *phase, uint64_t current, uint64_t total, uint64_t bytes);
+
+  // Forwards a sideband line from the remote ("Counting objects: …").
+  void remote_message(const char *data, size_t len);
+
+  // Throws GitCancelled if the call was cancelled, otherwise GitException for `rc`.
+  [[noreturn]] void fail(int rc) const;
+
+ private:
+  static constexpr std::chrono::milliseconds kMinInterval{100};
+
+  std::string id_;
+  const GitProgressCallback &onProgress_;
+  std::shared_ptr<std::atomic<bool>> cancelled_;
+  std::chrono::steady_clock::time_point lastEmit_{};
+  std::string lastPhase_;
+};
@@ -0,0 +1,195 @@
+#include "git_ops.h"
+
+#include "repo_cache.h"
+#include "scheduler.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Background prefetch (see GitPrefetchTarget in git_ops.h). A single thread wakes up every
+// kTick (or when targets/network change), picks the most overdue target whose repository is idle,
+// and queues one background fetch job for it on the git scheduler. Only one prefetch is in flight
+// at a time; failures back off exponentially.
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr std::chrono::seconds kTick{60};
+constexpr std::chrono::hours kMaxBackoff{4};
+
+enum class Outcome { Fetched, Failed, GaveWay };
+
+struct Target {
+  GitPrefetchTarget spec;
+  Clock::time_point touched;
+  Clock::time_point nextDue;
+  int failures = 0;
+};
+
+std::mutex g_mu;
+std::condition_variable g_cv;
+std::unordered_map<std::string, Target> g_targets;  // by repo_cache_key()
+GitPrefetchConfig g_config;
+bool g_online = false;
+bool g_metered = true;
+bool g_inFlight = false;
+bool g_started = false;
+std::atomic<uint64_t> g_runSeq{0};
+
+void finished(const std::string &key, Outcome outcome) {
+  {
+    std::lock_guard<std::mutex> g(g_mu);
+    g_inFlight = false;
+    auto it = g_targets.find(key);
+    if (it != g_targets.end()) {
+      Target &t = it->second;
+      const auto interval = std::chrono::milliseconds(g_config.intervalMs);
+      if (outcome == Outcome::Failed) {
+        t.failures = std::min(t.failures + 1, 8);
+        const auto backoff = std::min<Clock::duration>(interval * (1 << t.failures), kMaxBackoff);
+        t.nextDue = Clock::now() + backoff;
+      } else {
+        // After giving way the caller's own operation has (most likely) just talked to the
+        // remote, so the repository is treated as fresh.
+        if (outcome == Outcome::Fetched) t.failures = 0;
+        t.nextDue = Clock::now() + interval;
+      }
+    }
+  }
+  g_cv.notify_all();
+}
+
+class PrefetchJob : public GitJob {
+ public:
+  PrefetchJob(std::string key, GitPrefetchTarget spec)
+      : key_(std::move(key)),
+        spec_(std::move(spec)),
+        operationId_("prefetch:" + std::to_string(++g_runSeq) + ":" + key_) {}
+
+  // Dropped from the queue before it ran: another operation took the repository.
+  ~PrefetchJob() override {
+    if (!ran_) finished(key_, Outcome::GaveWay);
+  }
+
+  bool background() const override { return true; }
+  void yield() override { git_cancel_operation(operationId_); }
+
+  void run() override {
+    ran_ = true;
+    GitFetchOptions opts;
+    opts.localPath = spec_.localPath;
+    opts.remote = spec_.remote;
+    opts.username = spec_.username;
+    opts.token = spec_.token;
+    opts.allowInsecure = spec_.allowInsecure;
+    opts.hooks.operationId = operationId_;
+
+    Outcome outcome = Outcome::Fetched;
+    try {
+      TraceSpan span("prefetch", opts.localPath);
+      git_fetch(opts);
+    } catch (const GitCancelled &) {
+      outcome = Outcome::GaveWay;
+    } catch (const std::exception &) {
+      outcome = Outcome::Failed;
+    }
+    finished(key_, outcome);
+  }
+
+  void complete_from(GitJob & /*primary*/) override {}
+
+ private:
+  const std::string key_;
+  const GitPrefetchTarget spec_;
+  const std::string operationId_;
+  bool ran_ = false;
+};
+
+void loop() {
+  std::unique_lock<std::mutex> lock(g_mu);
+  while (true) {
+    g_cv.wait_for(lock, kTick);
+    if (!g_config.enabled || !g_online || g_metered || g_inFlight) continue;
+
+    const Clock::time_point now = Clock::now();
+    const auto window = std::chrono::milliseconds(g_config.recentWindowMs);
+    Target *pick = nullptr;
+    std::string pickKey;
+    for (auto it = g_targets.begin(); it != g_targets.end();) {
+      if (now - it->second.touched > window) {
+        it = g_targets.erase(it);
+        continue;
+      }
+      Target &t = it->second;
+      if (t.nextDue <= now && (!pick || t.nextDue < pick->nextDue) && !git_repo_busy(it->first)) {
+        pick = &t;
+        pickKey = it->first;
+      }
+      ++it;
+    }
+    if (!pick) continue;
+
+    g_inFlight = true;
+    GitPrefetchTarget spec = pick->spec;
+    lock.unlock();
+    schedule_git_job(pickKey, "", GitJobKind::Network,
+                     std::unique_ptr<GitJob>(new PrefetchJob(pickKey, std::move(spec))));
+    lock.lock();
+  }
+}
+
+// Caller holds g_mu.
+void start_locked() {
+  if (g_started) return;
+  g_started = true;
+  std::thread(loop).detach();
+}
+}  // namespace
+
+void git_prefetch_touch(const GitPrefetchTarget &target) {
+  const std::string key = repo_cache_key(target.localPath);
+  {
+    std::lock_guard<std::mutex> g(g_mu);
+    auto it = g_targets.find(key);
+    if (it == g_targets.end()) {
+      Target t;
+      t.nextDue = Clock::now();
+      it = g_targets.emplace(key, std::move(t)).first;
+    }
+    it->second.spec = target;
+    it->second.touched = Clock::now();
+    start_locked();
+  }
+  g_cv.notify_all();
+}
+
+void git_prefetch_forget(const std::string &localPath) {
+  std::lock_guard<std::mutex> g(g_mu);
+  g_targets.erase(repo_cache_key(localPath));
+}
+
+void git_prefetch_set_network(bool online, bool metered) {
+  {
+    std::lock_guard<std::mutex> g(g_mu);
+    g_online = online;
+    g_metered = metered;
+  }
+  g_cv.notify_all();
+}
+
+void git_prefetch_configure(const GitPrefetchConfig &config) {
+  {
+    std::lock_guard<std::mutex> g(g_mu);
+    g_config = config;
+    if (g_config.intervalMs < 60 * 1000) g_config.intervalMs = 60 * 1000;
+  }
+  g_cv.notify_all();
+}
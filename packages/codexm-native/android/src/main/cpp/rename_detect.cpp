@@ -0,0 +1,201 @@
+#include "git_ops.h"
+
+#include "git_internal.h"
+#include "repo_cache.h"
+#include "trace.h"
+
+#include <git2.h>
+#include <git2/sys/hashsig.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Rename/copy pairing for diff output. libgit2's default similarity metric rebuilds every
+// candidate's signature on each call, which for an agent turn that moved a directory means
+// re-reading and re-hashing the same blobs after every edit. Signatures are cached per work tree
+// instead: blobs by id (immutable), work-tree files by path and stat data.
+
+namespace {
+// Same whitespace handling as libgit2's default metric, so scores match `git diff -M`.
+constexpr git_hashsig_option_t kHashsigOptions = GIT_HASHSIG_SMART_WHITESPACE;
+// A signature is ~1 KiB; this bounds a work tree's cache to a few MiB.
+constexpr size_t kMaxSignatures = 2048;
+
+using SharedSig = std::shared_ptr<git_hashsig>;
+
+struct CachedSig {
+  SharedSig sig;
+  uint64_t lastUse = 0;
+};
+
+// Only touched while holding the repository lease (calls for one work tree are serialized); the
+// registry mutex only guards the map itself.
+struct SignatureCache {
+  std::unordered_map<std::string, CachedSig> entries;
+  uint64_t clock = 0;
+  int64_t hits = 0;
+  int64_t misses = 0;
+
+  void trim() {
+    if (entries.size() <= kMaxSignatures) return;
+    std::vector<uint64_t> uses;
+    uses.reserve(entries.size());
+    for (const auto &e : entries) uses.push_back(e.second.lastUse);
+    // Keep the most recently used three quarters.
+    const size_t drop = entries.size() - kMaxSignatures * 3 / 4;
+    std::nth_element(uses.begin(), uses.begin() + static_cast<std::ptrdiff_t>(drop - 1), uses.end());
+    const uint64_t cutoff = uses[drop - 1];
+    for (auto it = entries.begin(); it != entries.end();) {
+      it = it->second.lastUse <= cutoff ? entries.erase(it) : std::next(it);
+    }
+  }
+};
+
+std::mutex g_caches_mu;
+std::unordered_map<std::string, std::shared_ptr<SignatureCache>> g_caches;
+
+std::shared_ptr<SignatureCache> cache_for(const std::string &key) {
+  std::lock_guard<std::mutex> g(g_caches_mu);
+  auto &slot = g_caches[key];
+  if (!slot) slot = std::make_shared<SignatureCache>();
+  return slot;
+}
+
+std::string blob_key(const git_diff_file *file) {
+  if (!(file->flags & GIT_DIFF_FLAG_VALID_ID) || git_oid_is_zero(&file->id)) return {};
+  return std::string("b", 1) + std::string(reinterpret_cast<const char *>(file->id.id), sizeof(file->id.id));
+}
+
+// Work-tree files without a computed id are keyed by what would make git re-read them.
+std::string file_key(const git_diff_file *file, const char *fullpath) {
+  std::string key = blob_key(file);
+  if (!key.empty()) return key;
+  struct stat st;
+  if (stat(fullpath, &st) != 0) return {};
+  const int64_t mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+  key = "w";
+  key.append(fullpath);
+  key.push_back('\0');
+  key.append(std::to_string(mtimeNs)).push_back(':');
+  key.append(std::to_string(static_cast<int64_t>(st.st_size))).push_back(':');
+  key.append(std::to_string(static_cast<uint64_t>(st.st_ino)));
+  return key;
+}
+
+// Hands libgit2 its own reference to a shared signature; free_signature drops it.
+int hand_out(void **out, const SharedSig &sig) {
+  *out = new SharedSig(sig);
+  return 0;
+}
+
+template <typename Create>
+int cached_signature(void **out, const std::string &key, SignatureCache &cache, Create create) {
+  *out = nullptr;
+  if (!key.empty()) {
+    auto it = cache.entries.find(key);
+    if (it != cache.entries.end()) {
+      cache.hits++;
+      it->second.lastUse = ++cache.clock;
+      return hand_out(out, it->second.sig);
+    }
+  }
+  cache.misses++;
+  git_hashsig *raw = nullptr;
+  // Failures (e.g. GIT_EBUFS for files too small to score) go back to libgit2 unchanged, which
+  // then treats the file as having no signature, exactly as with its default metric.
+  const int rc = create(&raw);
+  if (rc < 0) return rc;
+  SharedSig sig(raw, git_hashsig_free);
+  if (!key.empty()) cache.entries[key] = CachedSig{sig, ++cache.clock};
+  return hand_out(out, sig);
+}
+
+int file_signature_cb(void **out, const git_diff_file *file, const char *fullpath, void *payload) {
+  auto *cache = static_cast<SignatureCache *>(payload);
+  return cached_signature(out, file_key(file, fullpath), *cache, [fullpath](git_hashsig **sig) {
+    return git_hashsig_create_fromfile(sig, fullpath, kHashsigOptions);
+  });
+}
+
+int buffer_signature_cb(void **out, const git_diff_file *file, const char *buf, size_t buflen, void *payload) {
+  auto *cache = static_cast<SignatureCache *>(payload);
+  return cached_signature(out, blob_key(file), *cache, [buf, buflen](git_hashsig **sig) {
+    return git_hashsig_create(sig, buf, buflen, kHashsigOptions);
+  });
+}
+
+void free_signature_cb(void *sig, void * /*payload*/) {
+  delete static_cast<SharedSig *>(sig);
+}
+
+int similarity_cb(int *score, void *siga, void *sigb, void * /*payload*/) {
+  const int s = git_hashsig_compare(static_cast<SharedSig *>(siga)->get(), static_cast<SharedSig *>(sigb)->get());
+  if (s < 0) return s;
+  *score = s;
+  return 0;
+}
+}  // namespace
+
+void find_renames(git_diff *diff, const std::string &localPath, const GitRenameOptions &opts) {
+  if (!diff || !opts.enabled) return;
+
+  // Candidate pairs are what inexact matching costs: every source against every target.
+  size_t sources = 0, targets = 0;
+  const size_t deltas = git_diff_num_deltas(diff);
+  for (size_t i = 0; i < deltas; i++) {
+    switch (git_diff_get_delta(diff, i)->status) {
+      case GIT_DELTA_DELETED: sources++; break;
+      case GIT_DELTA_MODIFIED: if (opts.copies) sources++; break;
+      case GIT_DELTA_ADDED:
+      case GIT_DELTA_UNTRACKED: targets++; break;
+      default: break;
+    }
+  }
+  if (sources == 0 || targets == 0) return;
+
+  git_diff_find_options find = GIT_DIFF_FIND_OPTIONS_INIT;
+  find.flags = GIT_DIFF_FIND_RENAMES | GIT_DIFF_FIND_FOR_UNTRACKED;
+  if (opts.copies) find.flags |= GIT_DIFF_FIND_COPIES;
+  find.rename_threshold = opts.threshold;
+  find.copy_threshold = opts.threshold;
+  find.rename_limit = opts.renameLimit;
+  // Past renameLimit² pairs only identical blobs are paired (git's diff.renameLimit behaviour);
+  // that needs ids only, no content.
+  const uint64_t limit = opts.renameLimit;
+  const bool exactOnly = static_cast<uint64_t>(sources) * targets > limit * limit;
+  if (exactOnly) find.flags |= GIT_DIFF_FIND_EXACT_MATCH_ONLY;
+  trace_count("renameCandidates", static_cast<int64_t>(sources * targets));
+
+  std::shared_ptr<SignatureCache> cache = cache_for(repo_cache_key(localPath));
+  git_diff_similarity_metric metric;
+  metric.file_signature = file_signature_cb;
+  metric.buffer_signature = buffer_signature_cb;
+  metric.free_signature = free_signature_cb;
+  metric.similarity = similarity_cb;
+  metric.payload = cache.get();
+  find.metric = &metric;
+
+  const int64_t hits = cache->hits, misses = cache->misses;
+  const int rc = git_diff_find_similar(diff, &find);
+  cache->trim();
+  if (rc != 0) throw GitException(last_error_message(rc));
+  trace_count("signatureHits", cache->hits - hits);
+  trace_count("signatureMisses", cache->misses - misses);
+}
+
+void forget_rename_signatures(const std::string &localPath) {
+  std::lock_guard<std::mutex> g(g_caches_mu);
+  g_caches.erase(repo_cache_key(localPath));
+}
+
+void clear_rename_signatures() {
+  std::lock_guard<std::mutex> g(g_caches_mu);
+  g_caches.clear();
+}
@@ -0,0 +1,299 @@
+#include "repo_cache.h"
+
+#include "git_internal.h"
+#include "git_ops.h"
+#include "trace.h"
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+std::atomic<int64_t> g_remote_idle_ms{30000};
+
+struct CachedRemote {
+  git_remote *remote = nullptr;
+  Clock::time_point lastUsed;
+};
+}  // namespace
+
+struct RepoCacheEntry {
+  std::string key;
+  std::recursive_mutex mu;
+  git_repository *repo = nullptr;
+  // Outstanding leases (including ones still waiting for `mu`). Taken under g_cache_mu, so
+  // eviction never drops an entry somebody is about to lock; released without it.
+  std::atomic<int> leases{0};
+  // Set when the handle was invalidated while leased. The entry (and its mutex) stays in the cache;
+  // the next lease holder reopens it, and the last lease out drops it.
+  std::atomic<bool> stale{false};
+
+  // Keyed by remote name + session key; guarded by `mu`. Freed before `repo`.
+  std::unordered_map<std::string, CachedRemote> remotes;
+
+  // Identity of the git dir at open time. If the workspace is deleted and re-cloned behind our
+  // back (JS owns the directory), the inode changes and the handle is reopened.
+  dev_t gitDirDev = 0;
+  ino_t gitDirIno = 0;
+
+  void free_remotes() {
+    for (auto &kv : remotes) git_remote_free(kv.second.remote);
+    remotes.clear();
+  }
+
+  ~RepoCacheEntry() {
+    free_remotes();
+    if (repo) git_repository_free(repo);
+  }
+};
+
+namespace {
+using EntryPtr = std::shared_ptr<RepoCacheEntry>;
+
+std::mutex g_cache_mu;
+std::list<EntryPtr> g_lru;  // front = most recently used
+std::unordered_map<std::string, std::list<EntryPtr>::iterator> g_index;
+size_t g_capacity = 8;
+
+// Caller holds g_cache_mu. Leased entries stay: dropping one would let the next acquire_repo()
+// open a second handle with its own mutex, and two threads would work on one repository at once.
+// The list may stay over capacity until they are released.
+void evict_over_capacity_locked() {
+  auto it = g_lru.end();
+  while (g_lru.size() > g_capacity && it != g_lru.begin()) {
+    --it;
+    if ((*it)->leases.load() > 0) continue;
+    g_index.erase((*it)->key);
+    it = g_lru.erase(it);
+  }
+}
+
+// Caller holds g_cache_mu. Leases are only taken under g_cache_mu, so an entry seen unleased here
+// can be dropped; a leased one must keep its mutex in the cache (see evict_over_capacity_locked)
+// and is marked stale instead.
+void invalidate_locked(const std::string &key, const RepoCacheEntry *onlyIf) {
+  auto it = g_index.find(key);
+  if (it == g_index.end()) return;
+  RepoCacheEntry &entry = **it->second;
+  if (onlyIf && &entry != onlyIf) return;
+  if (entry.leases.load() > 0) {
+    entry.stale.store(true);
+    return;
+  }
+  g_lru.erase(it->second);
+  g_index.erase(it);
+}
+
+// Caller holds entry->mu.
+bool handle_is_current(const RepoCacheEntry &entry) {
+  if (!entry.repo || entry.stale.load()) return false;
+  struct stat st;
+  if (stat(git_repository_path(entry.repo), &st) != 0) return false;
+  return st.st_dev == entry.gitDirDev && st.st_ino == entry.gitDirIno;
+}
+
+// Caller holds entry->mu.
+void reopen(RepoCacheEntry &entry) {
+  entry.free_remotes();
+  if (entry.repo) {
+    git_repository_free(entry.repo);
+    entry.repo = nullptr;
+  }
+
+  entry.stale.store(false);
+  git_repository *repo = nullptr;
+  const int rc = git_repository_open(&repo, entry.key.c_str());
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  struct stat st;
+  if (stat(git_repository_path(repo), &st) == 0) {
+    entry.gitDirDev = st.st_dev;
+    entry.gitDirIno = st.st_ino;
+  }
+  entry.repo = repo;
+}
+// Caller holds entry.mu.
+void expire_remotes(RepoCacheEntry &entry, Clock::time_point now) {
+  const auto idle = std::chrono::milliseconds(g_remote_idle_ms.load());
+  for (auto it = entry.remotes.begin(); it != entry.remotes.end();) {
+    if (now - it->second.lastUsed >= idle) {
+      git_remote_free(it->second.remote);
+      it = entry.remotes.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// Caller holds entry.mu.
+std::string configured_url(git_repository *repo, const std::string &name) {
+  git_config *cfg = nullptr;
+  if (git_repository_config_snapshot(&cfg, repo) != 0) return "";
+  const char *url = nullptr;
+  std::string out;
+  if (git_config_get_string(&url, cfg, ("remote." + name + ".url").c_str()) == 0 && url) out = url;
+  git_config_free(cfg);
+  return out;
+}
+
+// Frees idle remotes of entries nobody is using, at most once per idle period. Entries that are
+// busy are skipped; their own next remote() call expires them.
+void sweep_idle_remotes() {
+  static std::atomic<int64_t> lastSweep{0};
+  const int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+  int64_t last = lastSweep.load();
+  if (now - last < g_remote_idle_ms.load() || !lastSweep.compare_exchange_strong(last, now)) return;
+
+  std::vector<EntryPtr> entries;
+  {
+    std::lock_guard<std::mutex> g(g_cache_mu);
+    entries.assign(g_lru.begin(), g_lru.end());
+  }
+  for (auto &e : entries) {
+    std::unique_lock<std::recursive_mutex> lock(e->mu, std::try_to_lock);
+    if (lock.owns_lock()) expire_remotes(*e, Clock::now());
+  }
+}
+}  // namespace
+
+std::string repo_cache_key(const std::string &localPath) {
+  std::string key = localPath;
+  while (key.size() > 1 && key.back() == '/') key.pop_back();
+  return key;
+}
+
+RepoLease::RepoLease(std::shared_ptr<RepoCacheEntry> entry,
+                     std::unique_lock<std::recursive_mutex> lock,
+                     git_repository *repo)
+    : entry_(std::move(entry)), lock_(std::move(lock)), repo_(repo) {}
+
+RepoLease::~RepoLease() {
+  if (!entry_) return;
+  if (lock_.owns_lock()) lock_.unlock();
+  if (entry_->leases.fetch_sub(1) == 1 && entry_->stale.load()) {
+    std::lock_guard<std::mutex> g(g_cache_mu);
+    invalidate_locked(entry_->key, entry_.get());
+  }
+}
+
+git_remote *RepoLease::remote(const std::string &name, const std::string &sessionKey, bool *reused) {
+  const Clock::time_point now = Clock::now();
+  expire_remotes(*entry_, now);
+
+  const std::string key = name + '\n' + sessionKey;
+  auto it = entry_->remotes.find(key);
+  if (it != entry_->remotes.end()) {
+    const char *url = git_remote_url(it->second.remote);
+    if (url && configured_url(repo_, name) == url) {
+      it->second.lastUsed = now;
+      if (reused) *reused = true;
+      return it->second.remote;
+    }
+    git_remote_free(it->second.remote);
+    entry_->remotes.erase(it);
+  }
+
+  git_remote *remote = nullptr;
+  const int rc = git_remote_lookup(&remote, repo_, name.c_str());
+  if (rc != 0) throw GitException(last_error_message(rc));
+  entry_->remotes[key] = CachedRemote{remote, now};
+  if (reused) *reused = false;
+  return remote;
+}
+
+void RepoLease::drop_remote(const std::string &name, const std::string &sessionKey) {
+  auto it = entry_->remotes.find(name + '\n' + sessionKey);
+  if (it == entry_->remotes.end()) return;
+  git_remote_free(it->second.remote);
+  entry_->remotes.erase(it);
+}
+
+void RepoLease::invalidate() {
+  if (!entry_) return;
+  std::lock_guard<std::mutex> g(g_cache_mu);
+  invalidate_locked(entry_->key, entry_.get());
+}
+
+RepoLease acquire_repo(const std::string &localPath) {
+  trace_phase("open");
+  ensure_libgit2();
+  sweep_idle_remotes();
+
+  const std::string key = repo_cache_key(localPath);
+  EntryPtr entry;
+  {
+    std::lock_guard<std::mutex> g(g_cache_mu);
+    auto it = g_index.find(key);
+    if (it != g_index.end()) {
+      g_lru.splice(g_lru.begin(), g_lru, it->second);
+      entry = *it->second;
+      entry->leases.fetch_add(1);
+    } else {
+      entry = std::make_shared<RepoCacheEntry>();
+      entry->key = key;
+      entry->leases.fetch_add(1);
+      g_lru.push_front(entry);
+      g_index[key] = g_lru.begin();
+      evict_over_capacity_locked();
+    }
+  }
+
+  // Open outside g_cache_mu so a cold open of one repo never blocks callers on other repos.
+  std::unique_lock<std::recursive_mutex> lock(entry->mu);
+  if (!handle_is_current(*entry)) {
+    try {
+      reopen(*entry);
+    } catch (...) {
+      lock.unlock();
+      entry->leases.fetch_sub(1);
+      std::lock_guard<std::mutex> g(g_cache_mu);
+      invalidate_locked(key, entry.get());
+      throw;
+    }
+  }
+
+  git_repository *repo = entry->repo;
+  return RepoLease(std::move(entry), std::move(lock), repo);
+}
+
+void invalidate_repo(const std::string &localPath) {
+  std::lock_guard<std::mutex> g(g_cache_mu);
+  invalidate_locked(repo_cache_key(localPath), nullptr);
+}
+
+void clear_repo_cache() {
+  std::list<EntryPtr> dropped;
+  {
+    std::lock_guard<std::mutex> g(g_cache_mu);
+    for (auto it = g_lru.begin(); it != g_lru.end();) {
+      if ((*it)->leases.load() > 0) {
+        (*it)->stale.store(true);
+        ++it;
+        continue;
+      }
+      g_index.erase((*it)->key);
+      auto next = std::next(it);
+      dropped.splice(dropped.end(), g_lru, it);
+      it = next;
+    }
+  }
+  // Freed here, outside the cache lock.
+}
+
+void set_remote_idle_timeout_ms(int64_t ms) {
+  g_remote_idle_ms.store(ms < 0 ? 0 : ms);
+}
+
+void set_repo_cache_capacity(size_t capacity) {
+  std::lock_guard<std::mutex> g(g_cache_mu);
+  g_capacity = capacity == 0 ? 1 : capacity;
+  evict_over_capacity_locked();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <git2.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Process-wide cache of opened `git_repository` handles keyed by work-tree path.
+//
+// Opening a repository re-reads config, refdb and ODB backends and re-maps pack indexes, which is
+// the dominant cost of a status/diff on large repos. Handles are kept open across calls, evicted in
+// LRU order, and handed out through `RepoLease`.
+//
+// libgit2 objects are not safe for concurrent use, so a lease holds the entry's mutex for its whole
+// lifetime: calls on the same repository are serialized, calls on different repositories run in
+// parallel. The mutex is recursive so a thread that already holds a lease may acquire the same
+// repository again (e.g. a composite operation calling another entry point).
+//
+// Entries also keep `git_remote` objects alive between network calls. A remote owns its transport,
+// and libgit2's HTTP transport keeps its client (and the TLS connection, while the server allows
+// keep-alive) across disconnect/connect, so a pull followed by a push, or back-to-back background
+// fetches, skip the TCP and TLS handshakes. Each call still connects afresh, so ref advertisements
+// are never stale. Remotes unused for the idle timeout are freed.
+
+struct RepoCacheEntry;
+
+class RepoLease {
+ public:
+  RepoLease(std::shared_ptr<RepoCacheEntry> entry, std::unique_lock<std::recursive_mutex> lock,
+            git_repository *repo);
+  ~RepoLease();
+  RepoLease(RepoLease &&) noexcept = default;
+  RepoLease &operator=(RepoLease &&) = delete;
+  RepoLease(const RepoLease &) = delete;
+  RepoLease &operator=(const RepoLease &) = delete;
+
+  git_repository *get() const { return repo_; }
+
+  // Remote `name` kept open with this handle for calls with the same `sessionKey` (identifies the
+  // credentials). Looked up again if the configured URL changed. `reused` tells whether it has
+  // served an earlier call. The remote stays owned by the cache; don't free it.
+  git_remote *remote(const std::string &name, const std::string &sessionKey, bool *reused);
+
+  // Frees the cached remote, e.g. after a transport error.
+  void drop_remote(const std::string &name, const std::string &sessionKey);
+
+  // Marks the handle stale: the next lease reopens it, and the entry leaves the cache once the last
+  // lease on it is released. The mutex stays shared meanwhile, so calls stay serialized.
+  void invalidate();
+
+ private:
+  // The destructor releases the lock, then the lease count; the entry reference goes last.
+  std::shared_ptr<RepoCacheEntry> entry_;
+  std::unique_lock<std::recursive_mutex> lock_;
+  git_repository *repo_ = nullptr;
+};
+
+// Canonical cache key for a work-tree path (trailing slashes stripped). Other per-repo registries
+// use the same key so that "repo/" and "repo" refer to the same state.
+std::string repo_cache_key(const std::string &localPath);
+
+// Returns a locked handle for `localPath`, opening it on first use. Throws GitException on failure.
+RepoLease acquire_repo(const std::string &localPath);
+
+// Drops the cached handle for `localPath` (no-op if not cached). A leased handle is only marked
+// stale, as with RepoLease::invalidate().
+void invalidate_repo(const std::string &localPath);
+
+// Drops every cached handle that is not leased; leased ones are marked stale.
+void clear_repo_cache();
+
+// How long an unused remote (and its connection) is kept; 0 disables reuse.
+void set_remote_idle_timeout_ms(int64_t ms);
+
+// Maximum number of idle handles kept open. Handles in use are never closed by eviction.
+void set_repo_cache_capacity(size_t capacity);
@@ -0,0 +1,111 @@
+#include "git_ops.h"
+
+#include "git_internal.h"
+#include "repo_cache.h"
+#include "scheduler.h"
+#include "trace.h"
+
+#include <git2.h>
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <mutex>
+
+// libgit2's defaults assume a desktop: on 64-bit it maps pack files in 1 GiB windows up to 8 GiB in
+// total and keeps up to 256 MiB of parsed objects per repository cache. Mapped pack pages that were
+// touched count against the app on Android, and a couple of large repositories open at once is
+// enough to get the process killed on a 3-4 GiB phone. The budgets below keep windows small
+// (more, shorter mappings, each still large enough for sequential pack reads) and cap the cache.
+
+namespace {
+constexpr size_t kMiB = 1024 * 1024;
+
+struct MemoryBudget {
+  size_t windowSize;
+  size_t mappedLimit;
+  size_t fileLimit;  // pack files kept open
+  ssize_t cacheBytes;
+  size_t repoHandles;
+};
+
+constexpr MemoryBudget kBudgets[] = {
+    /* Low */ {16 * kMiB, 128 * kMiB, 64, 16 * kMiB, 3},
+    /* Mid */ {32 * kMiB, 512 * kMiB, 128, 64 * kMiB, 6},
+    /* High */ {64 * kMiB, 2048 * kMiB, 256, 128 * kMiB, 8},
+};
+
+std::mutex g_mu;
+GitRuntimeConfig g_config;
+int g_trimLevel = 0;
+
+// Android ComponentCallbacks2 levels.
+constexpr int kTrimRunningLow = 10;
+constexpr int kTrimUiHidden = 20;
+constexpr int kTrimBackground = 40;
+
+// RUNNING_LOW/RUNNING_CRITICAL while in the foreground, BACKGROUND and above once cached: the
+// system is about to kill something. UI_HIDDEN alone only means the user left the app.
+bool under_pressure(int level) {
+  return (level >= kTrimRunningLow && level < kTrimUiHidden) || level >= kTrimBackground;
+}
+
+const MemoryBudget &budget_for(GitMemoryClass c) {
+  const int i = static_cast<int>(c);
+  return kBudgets[i < 0 ? 0 : i > 2 ? 2 : i];
+}
+
+// Caller holds g_mu.
+void apply_locked() {
+  const MemoryBudget &b = budget_for(g_config.memoryClass);
+  ssize_t cacheBytes = b.cacheBytes;
+  if (under_pressure(g_trimLevel)) cacheBytes = budget_for(GitMemoryClass::Low).cacheBytes / 2;
+  else if (g_trimLevel > 0) cacheBytes = budget_for(GitMemoryClass::Low).cacheBytes;
+
+  git_libgit2_opts(GIT_OPT_SET_MWINDOW_SIZE, b.windowSize);
+  git_libgit2_opts(GIT_OPT_SET_MWINDOW_MAPPED_LIMIT, b.mappedLimit);
+  git_libgit2_opts(GIT_OPT_SET_MWINDOW_FILE_LIMIT, b.fileLimit);
+  git_libgit2_opts(GIT_OPT_SET_CACHE_MAX_SIZE, cacheBytes);
+
+  const int strict = g_config.trustLocalObjects ? 0 : 1;
+  git_libgit2_opts(GIT_OPT_ENABLE_STRICT_HASH_VERIFICATION, strict);
+  git_libgit2_opts(GIT_OPT_ENABLE_STRICT_OBJECT_CREATION, strict);
+
+  set_repo_cache_capacity(b.repoHandles);
+}
+}  // namespace
+
+void apply_runtime_options() {
+  std::lock_guard<std::mutex> g(g_mu);
+  apply_locked();
+}
+
+void git_configure_runtime(const GitRuntimeConfig &config) {
+  ensure_libgit2();
+  std::lock_guard<std::mutex> g(g_mu);
+  g_config = config;
+  apply_locked();
+}
+
+void git_trim_memory(int level) {
+  ensure_libgit2();
+  {
+    std::lock_guard<std::mutex> g(g_mu);
+    g_trimLevel = level;
+    apply_locked();
+  }
+  // Closing a handle frees its object cache and unmaps its pack windows. Handles in use stay open.
+  if (under_pressure(level)) {
+    clear_repo_cache();
+    clear_rename_signatures();
+    clear_line_indexes();
+  }
+}
+
+void git_warm_up() {
+  TraceSpan span("warmUp", "");
+  ensure_libgit2();
+  span.phase("workers");
+  git_worker_count();
+}
+
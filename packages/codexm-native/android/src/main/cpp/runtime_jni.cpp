@@ -0,0 +1,119 @@
+#include <jni.h>
+
+#include "archive.h"
+#include "jsonl_pipe.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+// JNI entry points of CodexRuntimeManagerModule. They share libcodexm_git with the git module
+// (JNI_OnLoad lives in codexmgit_jni.cpp) but not its scheduler: the runtime module calls these on
+// its own I/O threads.
+
+namespace {
+std::string jstring_to_string(JNIEnv *env, jstring s) {
+  if (!s) return "";
+  const char *chars = env->GetStringUTFChars(s, nullptr);
+  std::string out = chars ? chars : "";
+  if (chars) env->ReleaseStringUTFChars(s, chars);
+  return out;
+}
+
+void throw_java_runtime(JNIEnv *env, const std::string &msg) {
+  jclass cls = env->FindClass("java/lang/RuntimeException");
+  if (cls) env->ThrowNew(cls, msg.c_str());
+}
+}  // namespace
+
+// Returns [files, directories, links, bytes].
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_codexm_nativemodules_CodexRuntimeManagerModule_nativeExtractTarGz(JNIEnv *env,
+                                                                    jobject /*thiz*/,
+                                                                    jstring archivePath,
+                                                                    jstring destDir,
+                                                                    jstring sha256) {
+  try {
+    TarExtractOptions opts;
+    opts.archivePath = jstring_to_string(env, archivePath);
+    opts.destDir = jstring_to_string(env, destDir);
+    opts.sha256 = jstring_to_string(env, sha256);
+    const TarExtractStats s = tar_gz_extract(opts);
+    const jlong values[] = {
+        static_cast<jlong>(s.files),
+        static_cast<jlong>(s.directories),
+        static_cast<jlong>(s.links),
+        static_cast<jlong>(s.bytes),
+    };
+    jlongArray out = env->NewLongArray(4);
+    if (out) env->SetLongArrayRegion(out, 0, 4, values);
+    return out;
+  } catch (const std::exception &e) {
+    throw_java_runtime(env, e.what());
+    return nullptr;
+  }
+}
+
+// Opens the read end of the app-server stdout FIFO. Non-blocking so the open does not wait for
+// the writer; jsonl_pipe_read polls before every read.
+extern "C" JNIEXPORT jint JNICALL
+Java_com_codexm_nativemodules_CodexRuntimeManagerModule_nativeOpenFifo(JNIEnv *env,
+                                                                jobject /*thiz*/,
+                                                                jstring path) {
+  const std::string p = jstring_to_string(env, path);
+  const int fd = open(p.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) throw_java_runtime(env, "open " + p + ": " + std::strerror(errno));
+  return fd;
+}
+
+// Blocks until EOF or until sink.onBatch(byte[], int) returns false, then closes `fd`. Batches are
+// passed as UTF-8 bytes: NewStringUTF would mangle characters outside the BMP. Returns
+// [bytes, records, coalesced, batches].
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_codexm_nativemodules_CodexRuntimeManagerModule_nativeReadJsonl(JNIEnv *env,
+                                                                 jobject /*thiz*/,
+                                                                 jint fd,
+                                                                 jint frameMs,
+                                                                 jobject sink) {
+  jclass sinkClass = env->GetObjectClass(sink);
+  jmethodID onBatch = env->GetMethodID(sinkClass, "onBatch", "([BI)Z");
+  env->DeleteLocalRef(sinkClass);
+  if (!onBatch) {
+    close(fd);
+    return nullptr;
+  }
+
+  try {
+    JsonlPipeOptions opts;
+    opts.fd = fd;
+    if (frameMs > 0) opts.frameMs = frameMs;
+    const JsonlPipeStats s = jsonl_pipe_read(opts, [&](const std::string &batch, size_t records) {
+      jbyteArray bytes = env->NewByteArray(static_cast<jsize>(batch.size()));
+      if (!bytes) return false;
+      env->SetByteArrayRegion(bytes, 0, static_cast<jsize>(batch.size()),
+                              reinterpret_cast<const jbyte *>(batch.data()));
+      const jboolean more = env->CallBooleanMethod(sink, onBatch, bytes, static_cast<jint>(records));
+      env->DeleteLocalRef(bytes);
+      if (env->ExceptionCheck()) return false;
+      return more == JNI_TRUE;
+    });
+    close(fd);
+    if (env->ExceptionCheck()) return nullptr;
+    const jlong values[] = {
+        static_cast<jlong>(s.bytes),
+        static_cast<jlong>(s.records),
+        static_cast<jlong>(s.coalesced),
+        static_cast<jlong>(s.batches),
+    };
+    jlongArray out = env->NewLongArray(4);
+    if (out) env->SetLongArrayRegion(out, 0, 4, values);
+    return out;
+  } catch (const std::exception &e) {
+    close(fd);
+    throw_java_runtime(env, e.what());
+    return nullptr;
+  }
+}
@@ -0,0 +1,214 @@
+#include "scheduler.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+struct Pending {
+  std::unique_ptr<GitJob> job;
+  std::vector<std::unique_ptr<GitJob>> followers;
+  std::string coalesceKey;
+  GitJobKind kind = GitJobKind::Read;
+};
+
+struct RepoQueue {
+  std::deque<Pending> pending;
+  bool running = false;
+  GitJob *current = nullptr;  // set while running
+};
+
+long cpu_max_freq(int cpu) {
+  char path[96];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+  FILE *f = fopen(path, "r");
+  if (!f) return 0;
+  long khz = 0;
+  if (fscanf(f, "%ld", &khz) != 1) khz = 0;
+  fclose(f);
+  return khz;
+}
+
+// Cores within 75% of the fastest one's max clock (prime + big clusters on big.LITTLE), clamped
+// to [2, 4]: git work is mostly I/O and zlib, and little cores only add contention.
+size_t pick_worker_count() {
+  const long cpus = sysconf(_SC_NPROCESSORS_CONF);
+  std::vector<long> freqs;
+  for (int i = 0; i < cpus; i++) freqs.push_back(cpu_max_freq(i));
+  const long top = freqs.empty() ? 0 : *std::max_element(freqs.begin(), freqs.end());
+
+  size_t fast = 0;
+  if (top > 0) {
+    for (long f : freqs) {
+      if (f * 4 >= top * 3) fast++;
+    }
+  } else {
+    fast = std::max<size_t>(1, std::thread::hardware_concurrency() / 2);
+  }
+  return std::min<size_t>(4, std::max<size_t>(2, fast));
+}
+
+class Scheduler {
+ public:
+  Scheduler() : workers_(pick_worker_count()) {
+    for (size_t i = 0; i < workers_; i++) std::thread([this]() { loop(); }).detach();
+  }
+
+  size_t workers() const { return workers_; }
+
+  bool busy(const std::string &repoKey) {
+    std::lock_guard<std::mutex> g(mu_);
+    return repos_.count(repoKey) != 0;
+  }
+
+  void submit(const std::string &repoKey, const std::string &coalesceKey, GitJobKind kind,
+              std::unique_ptr<GitJob> job) {
+    std::vector<Pending> dropped;  // destroyed after unlocking
+    {
+      std::lock_guard<std::mutex> g(mu_);
+      RepoQueue &q = repos_[repoKey];
+
+      if (!job->background()) {
+        if (q.running && q.current->background()) q.current->yield();
+        for (auto it = q.pending.begin(); it != q.pending.end();) {
+          if (it->job->background()) {
+            dropped.push_back(std::move(*it));
+            it = q.pending.erase(it);
+          } else {
+            ++it;
+          }
+        }
+      }
+
+      if (kind == GitJobKind::Read && !coalesceKey.empty()) {
+        for (auto it = q.pending.rbegin(); it != q.pending.rend(); ++it) {
+          if (it->kind != GitJobKind::Read) break;
+          if (it->coalesceKey == coalesceKey) {
+            it->followers.push_back(std::move(job));
+            return;
+          }
+        }
+      }
+
+      Pending p;
+      p.job = std::move(job);
+      p.coalesceKey = coalesceKey;
+      p.kind = kind;
+      q.pending.push_back(std::move(p));
+      // The queue may already be in ready_ if only dropped jobs were pending.
+      if (!q.running && q.pending.size() == 1 &&
+          std::find(ready_.begin(), ready_.end(), repoKey) == ready_.end()) {
+        ready_.push_back(repoKey);
+      }
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  // Caller holds mu_. Pops the first ready repository whose next job may start now.
+  bool take_ready_locked(std::string &repoKey) {
+    for (auto it = ready_.begin(); it != ready_.end(); ++it) {
+      const RepoQueue &q = repos_[*it];
+      if (q.pending.front().kind == GitJobKind::Network && runningNetwork_ + 1 >= workers_) continue;
+      repoKey = std::move(*it);
+      ready_.erase(it);
+      return true;
+    }
+    return false;
+  }
+
+  void loop() {
+    while (true) {
+      std::string repoKey;
+      Pending p;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [&]() { return take_ready_locked(repoKey); });
+        RepoQueue &q = repos_[repoKey];
+        p = std::move(q.pending.front());
+        q.pending.pop_front();
+        q.running = true;
+        q.current = p.job.get();
+        if (p.kind == GitJobKind::Network) runningNetwork_++;
+      }
+
+      // Jobs report their own failures; anything that still escapes (bad_alloc, system_error from
+      // a thread a job starts) must not reach this detached thread's top frame, which would
+      // terminate the process, nor skip the bookkeeping below, which would wedge the queue. It is
+      // handed to fail() instead, and followers of a failed job fail with the same message.
+      std::string failure;
+      bool failed = false;
+      try {
+        p.job->run();
+      } catch (const std::exception &e) {
+        failed = true;
+        failure = e.what();
+      } catch (...) {
+        failed = true;
+        failure = "Unknown native error";
+      }
+      if (failed) p.job->fail(failure.c_str());
+      for (auto &f : p.followers) {
+        if (failed) {
+          f->fail(failure.c_str());
+          continue;
+        }
+        try {
+          f->complete_from(*p.job);
+        } catch (const std::exception &e) {
+          f->fail(e.what());
+        } catch (...) {
+          f->fail("Unknown native error");
+        }
+      }
+
+      {
+        std::lock_guard<std::mutex> g(mu_);
+        if (p.kind == GitJobKind::Network) runningNetwork_--;
+        RepoQueue &q = repos_[repoKey];
+        q.running = false;
+        q.current = nullptr;
+        if (q.pending.empty()) repos_.erase(repoKey);
+        else ready_.push_back(repoKey);
+      }
+      // Finishing a network job may unblock one that was waiting on the network limit.
+      cv_.notify_all();
+    }
+  }
+
+  const size_t workers_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::unordered_map<std::string, RepoQueue> repos_;
+  std::deque<std::string> ready_;  // repositories with queued work and nothing running
+  size_t runningNetwork_ = 0;
+};
+
+Scheduler &scheduler() {
+  static Scheduler *s = new Scheduler();  // Workers are detached; never destroyed.
+  return *s;
+}
+}  // namespace
+
+void schedule_git_job(const std::string &repoKey, const std::string &coalesceKey, GitJobKind kind,
+                      std::unique_ptr<GitJob> job) {
+  scheduler().submit(repoKey, coalesceKey, kind, std::move(job));
+}
+
+bool git_repo_busy(const std::string &repoKey) {
+  return scheduler().busy(repoKey);
+}
+
+size_t git_worker_count() {
+  return scheduler().workers();
+}
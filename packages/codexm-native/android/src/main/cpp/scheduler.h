@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// Native scheduler for git work.
+//
+// A small fixed pool of workers (sized to the device's fast cores) runs jobs from per-repository
+// FIFO queues. At most one job per repository runs at a time, so jobs never contend on the
+// repository lease or on index.lock, and unrelated repositories proceed in parallel. Network jobs
+// may occupy all but one worker, so local reads stay responsive during long clones.
+//
+// Queued read-only jobs with the same coalesce key on the same repository collapse: the job runs
+// once and every caller gets its result. Coalescing never reaches across a queued write, so a
+// caller never observes a state older than the writes queued before its request.
+
+enum class GitJobKind { Read = 0, Write = 1, Network = 2 };
+
+class GitJob {
+ public:
+  virtual ~GitJob() = default;
+
+  // Runs the work and reports it to this job's caller.
+  virtual void run() = 0;
+
+  // Reports the result of `primary` (which ran instead of this job) to this job's caller.
+  virtual void complete_from(GitJob &primary) = 0;
+
+  // Called instead of (or after a partial) run() / complete_from() when it threw, so the caller is
+  // rejected rather than left waiting. Must settle at most once overall and must not throw.
+  virtual void fail(const char * /*message*/) {}
+
+  // Background jobs give way to caller-facing work on the same repository: while queued they are
+  // dropped (destroyed without running) when another job arrives, and while running they get
+  // yield(), which must only signal (e.g. cancel the operation) and return.
+  virtual bool background() const { return false; }
+  virtual void yield() {}
+};
+
+// Queues `job` behind earlier jobs for `repoKey` (use repo_cache_key()). `coalesceKey` is only
+// honoured for GitJobKind::Read; pass "" to never coalesce.
+void schedule_git_job(const std::string &repoKey, const std::string &coalesceKey, GitJobKind kind,
+                      std::unique_ptr<GitJob> job);
+
+// True while `repoKey` has a job queued or running.
+bool git_repo_busy(const std::string &repoKey);
+
+// Number of worker threads (fixed for the process lifetime).
+size_t git_worker_count();
@@ -0,0 +1,478 @@
+#include "git_ops.h"
+
+#include "git_internal.h"
+#include "operation.h"
+#include "repo_cache.h"
+#include "trace.h"
+
+#include <git2.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <regex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// In-process content search, so sessions don't depend on exec'ing a bundled `rg`.
+//
+// The calling thread walks the tree and does every ignore check: libgit2 objects must not be used
+// from several threads at once, and the walk is cheap next to reading files. The repository lease
+// is held only for the walk. Worker threads take
+// relative paths off a queue, mmap each file and scan it. Matches are handed back to the calling
+// thread, which delivers them in batches (the callback typically calls into JNI, so it has to run
+// on that thread).
+//
+// Literal search looks for the rarest byte of the pattern with memchr() (vectorized in bionic and
+// glibc) and verifies candidates with memcmp; that is the same prefilter ripgrep uses for literals.
+// Regexes are POSIX extended, matched with REG_STARTEND over the whole mapping, so there is one
+// regexec() call per matching line rather than per line. Like rg, files with a NUL byte in their
+// first 8 KiB are treated as binary and skipped, and only the first match of each line is reported.
+
+namespace {
+constexpr size_t kBinaryProbeBytes = 8192;
+
+// Rough byte frequency in source text, most common first. Bytes not listed count as rare.
+constexpr char kCommonBytes[] =
+    " etaoinsrlcdpumhfgbyvwkxjqz_.,;:()=\"'/-*{}<>[]\n\t0123456789ETAOINSRLCDPUMHFGBYVWKXJQZ";
+
+int byte_rank(unsigned char c) {
+  const char *p = static_cast<const char *>(std::memchr(kCommonBytes, c, sizeof kCommonBytes - 1));
+  return p ? static_cast<int>(sizeof kCommonBytes - (p - kCommonBytes)) : 0;  // lower = rarer
+}
+
+char ascii_lower(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+char ascii_upper(char c) {
+  return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+class Matcher {
+ public:
+  explicit Matcher(const GitSearchOptions &opts) : regex_(opts.regex), ignoreCase_(opts.ignoreCase) {
+    if (regex_) {
+      int flags = REG_EXTENDED | REG_NEWLINE;
+      if (ignoreCase_) flags |= REG_ICASE;
+      const int rc = regcomp(&re_, opts.pattern.c_str(), flags);
+      if (rc != 0) {
+        char buf[256];
+        regerror(rc, &re_, buf, sizeof buf);
+        throw GitException(std::string("Invalid search pattern: ") + buf);
+      }
+      compiled_ = true;
+      return;
+    }
+
+    needle_ = opts.pattern;
+    if (ignoreCase_) std::transform(needle_.begin(), needle_.end(), needle_.begin(), ascii_lower);
+    // A letter has to be found in either case, which costs a second memchr stream; prefer a
+    // non-letter unless it is much more common.
+    int best = 1 << 30;
+    for (size_t i = 0; i < needle_.size(); i++) {
+      const char c = needle_[i];
+      const bool letter = ascii_lower(c) != ascii_upper(c);
+      const int score = byte_rank(static_cast<unsigned char>(c)) * 2 + (ignoreCase_ && letter ? 40 : 0);
+      if (score < best) {
+        best = score;
+        rareAt_ = i;
+      }
+    }
+    rareLo_ = ignoreCase_ ? ascii_lower(needle_[rareAt_]) : needle_[rareAt_];
+    rareHi_ = ignoreCase_ ? ascii_upper(needle_[rareAt_]) : rareLo_;
+  }
+
+  ~Matcher() {
+    if (compiled_) regfree(&re_);
+  }
+
+  Matcher(const Matcher &) = delete;
+  Matcher &operator=(const Matcher &) = delete;
+
+  // First match starting at or after `from` (a line start) in [begin, end).
+  const char *find(const char *begin, const char *end, const char *from) const {
+    return regex_ ? find_regex(begin, end, from) : find_literal(end, from);
+  }
+
+ private:
+  const char *find_regex(const char *begin, const char *end, const char *from) const {
+    regmatch_t m[1];
+    m[0].rm_so = static_cast<regoff_t>(from - begin);
+    m[0].rm_eo = static_cast<regoff_t>(end - begin);
+    if (regexec(&re_, begin, 1, m, REG_STARTEND) != 0) return nullptr;
+    return begin + m[0].rm_so;
+  }
+
+  const char *find_literal(const char *end, const char *from) const {
+    const size_t n = needle_.size();
+    const char *p = from + rareAt_;
+    while (p < end) {
+      const char *hit = find_rare(p, end);
+      if (!hit) return nullptr;
+      const char *start = hit - rareAt_;
+      if (start + n <= end && equals(start)) return start;
+      p = hit + 1;
+    }
+    return nullptr;
+  }
+
+  const char *find_rare(const char *p, const char *end) const {
+    const auto len = static_cast<size_t>(end - p);
+    const char *a = static_cast<const char *>(std::memchr(p, rareLo_, len));
+    if (rareHi_ == rareLo_) return a;
+    const char *b = static_cast<const char *>(std::memchr(p, rareHi_, a ? static_cast<size_t>(a - p) : len));
+    return b ? b : a;
+  }
+
+  bool equals(const char *at) const {
+    if (!ignoreCase_) return std::memcmp(at, needle_.data(), needle_.size()) == 0;
+    for (size_t i = 0; i < needle_.size(); i++) {
+      if (ascii_lower(at[i]) != needle_[i]) return false;
+    }
+    return true;
+  }
+
+  bool regex_ = false;
+  bool ignoreCase_ = false;
+  bool compiled_ = false;
+  regex_t re_{};
+  std::string needle_;
+  size_t rareAt_ = 0;
+  char rareLo_ = 0, rareHi_ = 0;
+};
+
+class MappedFile {
+ public:
+  MappedFile(const std::string &path, size_t maxBytes) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+        static_cast<uint64_t>(st.st_size) <= maxBytes) {
+      size_ = static_cast<size_t>(st.st_size);
+      void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        data_ = static_cast<const char *>(p);
+        madvise(p, size_, MADV_SEQUENTIAL);
+      }
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (data_) munmap(const_cast<char *>(data_), size_);
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Cuts at `max` bytes without splitting a UTF-8 sequence.
+std::string excerpt(const char *begin, const char *end, size_t max) {
+  if (end > begin && end[-1] == '\r') end--;
+  size_t len = static_cast<size_t>(end - begin);
+  if (len > max) {
+    len = max;
+    while (len > 0 && (static_cast<unsigned char>(begin[len]) & 0xC0) == 0x80) len--;
+  }
+  return std::string(begin, len);
+}
+
+struct SearchState {
+  const GitSearchOptions *opts = nullptr;
+  std::string root;  // work tree with trailing '/'
+
+  std::mutex mu;
+  std::condition_variable workCv;     // workers: queue non-empty or walk done
+  std::condition_variable resultsCv;  // caller: results ready or a worker finished
+  std::deque<std::string> queue;
+  bool walkDone = false;
+  int workersRunning = 0;
+  std::vector<GitSearchMatch> results;
+  std::string workerError;  // first exception a worker hit; rethrown by the caller
+
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> matches{0};
+  std::atomic<uint64_t> filesScanned{0};
+  std::atomic<uint64_t> bytesScanned{0};
+  std::atomic<bool> truncated{false};
+};
+
+// Appends matches of one file; returns false once the result limit is hit.
+bool scan_file(SearchState &st, const Matcher &matcher, const std::string &rel, std::vector<GitSearchMatch> &out) {
+  MappedFile file(st.root + rel, st.opts->maxFileBytes);
+  const char *begin = file.data();
+  if (!begin) return true;
+  const char *end = begin + file.size();
+  if (std::memchr(begin, 0, std::min(file.size(), kBinaryProbeBytes))) return true;
+  st.filesScanned.fetch_add(1, std::memory_order_relaxed);
+  st.bytesScanned.fetch_add(file.size(), std::memory_order_relaxed);
+
+  uint32_t line = 1;
+  const char *counted = begin;  // newlines before this point are included in `line`
+  const char *from = begin;
+  while (from < end && !st.stop.load(std::memory_order_relaxed)) {
+    const char *hit = matcher.find(begin, end, from);
+    if (!hit) break;
+    const char *lineStart = hit;
+    while (lineStart > from && lineStart[-1] != '\n') lineStart--;
+    line += static_cast<uint32_t>(std::count(counted, lineStart, '\n'));
+    counted = lineStart;
+    const char *lineEnd = static_cast<const char *>(std::memchr(hit, '\n', static_cast<size_t>(end - hit)));
+    if (!lineEnd) lineEnd = end;
+
+    if (st.matches.fetch_add(1, std::memory_order_relaxed) >= st.opts->maxResults) {
+      st.truncated.store(true, std::memory_order_relaxed);
+      st.stop.store(true, std::memory_order_relaxed);
+      return false;
+    }
+    GitSearchMatch m;
+    m.path = rel;
+    m.line = line;
+    m.column = static_cast<uint32_t>(hit - lineStart) + 1;
+    m.text = excerpt(lineStart, lineEnd, st.opts->maxLineBytes);
+    out.push_back(std::move(m));
+    if (lineEnd == end) break;
+    from = lineEnd + 1;
+  }
+  return true;
+}
+
+// Stops and joins the workers however git_search() returns: a std::thread destroyed while still
+// joinable calls std::terminate(), so a throw from the walk or from delivery must not skip this.
+class WorkerJoin {
+ public:
+  WorkerJoin(SearchState &st, std::vector<std::thread> &threads) : st_(st), threads_(threads) {}
+  ~WorkerJoin() {
+    {
+      std::lock_guard<std::mutex> g(st_.mu);
+      st_.stop.store(true);
+      st_.walkDone = true;
+    }
+    st_.workCv.notify_all();
+    for (auto &t : threads_) {
+      if (t.joinable()) t.join();
+    }
+  }
+
+ private:
+  SearchState &st_;
+  std::vector<std::thread> &threads_;
+};
+
+void worker_main(SearchState &st) {
+  std::unique_ptr<Matcher> matcher;
+  try {
+    matcher.reset(new Matcher(*st.opts));
+  } catch (const std::exception &) {
+    // Already validated on the calling thread; a failure here can only be resource exhaustion.
+    st.stop.store(true);
+  }
+
+  std::vector<GitSearchMatch> found;
+  std::unique_lock<std::mutex> lock(st.mu);
+  while (matcher) {
+    st.workCv.wait(lock, [&] { return !st.queue.empty() || st.walkDone || st.stop.load(); });
+    if (st.stop.load() || st.queue.empty()) break;
+    const std::string rel = std::move(st.queue.front());
+    st.queue.pop_front();
+    lock.unlock();
+
+    found.clear();
+    // An exception escaping a thread's top frame terminates the process; hand it to the caller.
+    std::string error;
+    try {
+      scan_file(st, *matcher, rel, found);
+    } catch (const std::exception &e) {
+      error = e.what();
+      st.stop.store(true);
+    }
+
+    lock.lock();
+    if (!error.empty() && st.workerError.empty()) st.workerError = std::move(error);
+    if (!found.empty()) {
+      for (auto &m : found) st.results.push_back(std::move(m));
+      if (st.results.size() >= st.opts->batchSize) st.resultsCv.notify_one();
+    }
+  }
+  st.workersRunning--;
+  st.resultsCv.notify_one();
+}
+}  // namespace
+
+GitSearchStats git_search(const GitSearchOptions &opts, const GitSearchBatchCallback &cb) {
+  if (opts.pattern.empty()) throw GitException("Search pattern is empty");
+  OperationContext op(opts.hooks.operationId, opts.hooks.onProgress);
+
+  // Workspaces that are not git repositories are searched without ignore rules.
+  std::optional<RepoLease> lease;
+  try {
+    lease.emplace(acquire_repo(opts.localPath));
+  } catch (const GitException &) {
+  }
+  git_repository *repo = lease ? lease->get() : nullptr;
+  const char *wd = repo ? git_repository_workdir(repo) : nullptr;
+
+  SearchState st;
+  st.opts = &opts;
+  st.root = wd ? std::string(wd) : opts.localPath;
+  if (st.root.empty() || st.root.back() != '/') st.root += '/';
+
+  Matcher validate(opts);  // throws on a bad regex before any thread starts
+
+  // With the index only its candidates are scanned; there is nothing to walk. Refreshing it may
+  // throw, so it happens before the workers start too.
+  std::optional<std::vector<std::string>> candidates;
+  if (opts.useIndex && repo && !opts.includeIgnored) candidates = search_index_candidates(repo, opts.localPath, opts, op);
+  trace_phase("walk");
+
+  const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+  const int workers = static_cast<int>(std::min(4u, hw));
+  std::vector<std::thread> threads;
+  WorkerJoin join(st, threads);
+  st.workersRunning = workers;
+  for (int i = 0; i < workers; i++) threads.emplace_back(worker_main, std::ref(st));
+
+  std::vector<GitSearchMatch> batch;
+  bool callerStopped = false;
+  // Delivers queued results; called with `lock` held, releases it around the callback.
+  auto deliver = [&](std::unique_lock<std::mutex> &lock, bool all) {
+    while (!callerStopped && (st.results.size() >= opts.batchSize || (all && !st.results.empty()))) {
+      const size_t n = std::min(st.results.size(), opts.batchSize);
+      batch.assign(std::make_move_iterator(st.results.begin()), std::make_move_iterator(st.results.begin() + n));
+      st.results.erase(st.results.begin(), st.results.begin() + n);
+      lock.unlock();
+      if (!cb(batch)) {
+        callerStopped = true;
+        st.stop.store(true);
+      }
+      lock.lock();
+    }
+  };
+
+  auto is_ignored = [&](const std::string &rel, bool dir) {
+    if (!repo || opts.includeIgnored) return false;
+    int ignored = 0;
+    const std::string path = dir ? rel + "/" : rel;
+    return git_ignore_path_is_ignored(&ignored, repo, path.c_str()) == 0 && ignored;
+  };
+
+  const std::vector<std::string> prefixes = normalize_sparse_paths(opts.paths);
+  std::vector<std::string> stack;
+
+  if (candidates) {
+    std::lock_guard<std::mutex> g(st.mu);
+    for (auto &path : *candidates) {
+      if (sparse_contains(prefixes, path)) st.queue.push_back(std::move(path));
+    }
+    st.workCv.notify_all();
+  } else {
+    if (prefixes.empty()) stack.push_back("");
+    for (const auto &p : prefixes) stack.push_back(p);
+  }
+
+  while (!stack.empty() && !st.stop.load()) {
+    if (op.cancelled()) {
+      st.stop.store(true);
+      break;
+    }
+    const std::string dirRel = std::move(stack.back());
+    stack.pop_back();
+
+    // A prefix may name a single file.
+    struct stat dst;
+    if (!dirRel.empty() && lstat((st.root + dirRel).c_str(), &dst) == 0 && S_ISREG(dst.st_mode)) {
+      if (!is_ignored(dirRel, false)) {
+        std::lock_guard<std::mutex> g(st.mu);
+        st.queue.push_back(dirRel);
+        st.workCv.notify_one();
+      }
+      continue;
+    }
+
+    DIR *d = opendir((st.root + dirRel).c_str());
+    if (!d) continue;
+    std::vector<std::string> files;
+    while (dirent *e = readdir(d)) {
+      const char *name = e->d_name;
+      if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+      if (std::strcmp(name, ".git") == 0) continue;
+      const std::string rel = dirRel.empty() ? std::string(name) : dirRel + "/" + name;
+
+      unsigned char type = e->d_type;
+      if (type == DT_UNKNOWN) {
+        struct stat est;
+        if (lstat((st.root + rel).c_str(), &est) != 0) continue;
+        type = S_ISDIR(est.st_mode) ? DT_DIR : S_ISREG(est.st_mode) ? DT_REG : DT_LNK;
+      }
+      // Symlinks are not followed (rg's default), so a link can't make the walk escape the tree.
+      if (type == DT_DIR) {
+        if (!is_ignored(rel, true)) stack.push_back(rel);
+      } else if (type == DT_REG) {
+        if (!is_ignored(rel, false)) files.push_back(rel);
+      }
+    }
+    closedir(d);
+
+    std::unique_lock<std::mutex> lock(st.mu);
+    if (!files.empty()) {
+      for (auto &f : files) st.queue.push_back(std::move(f));
+      st.workCv.notify_all();
+    }
+    deliver(lock, false);
+  }
+
+  // Reading file contents doesn't need the handle; let other calls on this repository proceed.
+  lease.reset();
+  repo = nullptr;
+
+  trace_phase("scan");
+  {
+    std::unique_lock<std::mutex> lock(st.mu);
+    st.walkDone = true;
+    st.workCv.notify_all();
+    while (st.workersRunning > 0) {
+      st.resultsCv.wait_for(lock, std::chrono::milliseconds(50));
+      if (op.cancelled()) {
+        st.stop.store(true);
+        st.workCv.notify_all();
+      }
+      deliver(lock, false);
+    }
+    deliver(lock, true);
+  }
+  for (auto &t : threads) t.join();
+  if (!st.workerError.empty()) throw GitException(st.workerError);
+
+  GitSearchStats stats;
+  stats.filesScanned = st.filesScanned.load();
+  stats.bytesScanned = st.bytesScanned.load();
+  stats.matches = std::min<uint64_t>(st.matches.load(), opts.maxResults);
+  stats.truncated = st.truncated.load();
+  trace_count("files", static_cast<int64_t>(stats.filesScanned));
+  trace_count("bytes", static_cast<int64_t>(stats.bytesScanned));
+  trace_count("rows", static_cast<int64_t>(stats.matches));
+  if (op.cancelled()) op.fail(GIT_EUSER);
+  return stats;
+}
@@ -0,0 +1,861 @@
+#include "git_internal.h"
+#include "git_ops.h"
+#include "operation.h"
+#include "repo_cache.h"
+#include "trace.h"
+
+#include <git2.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+// Trigram index for git_search(), stored in .git/codexm-search/.
+//
+// Documents are blobs, keyed by OID, so content that is unchanged keeps its postings across
+// checkouts, renames and branch switches; only the path -> OID manifest is rewritten. The current
+// manifest is the index entries, overridden by what git_diff_index_to_workdir() reports as modified
+// or untracked (the diff trusts the index stat cache, so a refresh of an untouched tree is a walk and
+// no reads).  Blobs not yet indexed are read from the ODB, or from the work tree for local edits.
+//
+// Postings live in immutable segments: u32 trigram keys (ASCII-folded, so one index serves both
+// case modes) with delta-varint lists of segment-local document numbers. New blobs go into new
+// segments of bounded size; small or mostly-dead segments are merged, which drops documents no
+// path refers to any more. Segments are mmapped and searched by binary search, so a query costs a
+// few lookups per segment plus the list intersections.
+//
+// Queries give a superset of the files that can match; git_search() still scans the candidates.
+// Patterns without a three-byte literal (e.g. top-level alternation) aren't narrowed.
+
+namespace {
+constexpr const char *kIndexDir = "codexm-search/";
+constexpr const char *kManifestFile = "manifest";
+constexpr const char *kManifestMagic = "codexm-search-manifest";
+constexpr uint32_t kSegmentMagic = 0x47545843;  // "CXTG"
+constexpr uint32_t kVersion = 1;
+
+// (trigram, doc) pairs held in memory while a segment is built: 32 MiB.
+constexpr size_t kSegmentPostings = 4u << 20;
+// Same limits as git_search(): larger and binary files are never scanned, so they get no postings.
+constexpr uint64_t kMaxIndexedBytes = 8 * 1024 * 1024;
+constexpr size_t kBinaryProbeBytes = 8192;
+
+using RawOid = std::array<unsigned char, 20>;
+
+struct RawOidHash {
+  size_t operator()(const RawOid &o) const {
+    size_t h;
+    std::memcpy(&h, o.data(), sizeof h);
+    return h;
+  }
+};
+
+RawOid raw_of(const git_oid &oid) {
+  RawOid r;
+  std::memcpy(r.data(), oid.id, r.size());
+  return r;
+}
+
+struct ManifestEntry {
+  std::string path;
+  RawOid oid;
+  bool operator==(const ManifestEntry &o) const { return path == o.path && oid == o.oid; }
+};
+
+void put_u32(std::string &buf, uint32_t v) {
+  for (int i = 0; i < 4; i++) buf.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void put_u64(std::string &buf, uint64_t v) {
+  for (int i = 0; i < 8; i++) buf.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+uint32_t get_u32(const unsigned char *p) {
+  return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 |
+         static_cast<uint32_t>(p[3]) << 24;
+}
+
+uint64_t get_u64(const unsigned char *p) {
+  return static_cast<uint64_t>(get_u32(p)) | static_cast<uint64_t>(get_u32(p + 4)) << 32;
+}
+
+unsigned char fold(unsigned char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c - 'A' + 'a') : c;
+}
+
+// Distinct trigrams of a text, ASCII-folded; windows spanning a newline are left out because
+// matches never cross lines.
+class TrigramSet {
+ public:
+  TrigramSet() : seen_((1u << 24) / 64, 0) {}
+
+  const std::vector<uint32_t> &extract(const unsigned char *data, size_t size) {
+    for (uint32_t t : out_) seen_[t >> 6] = 0;
+    out_.clear();
+    uint32_t t = 0;
+    size_t run = 0;  // bytes since the last newline
+    for (size_t i = 0; i < size; i++) {
+      const unsigned char c = data[i];
+      if (c == '\n') {
+        run = 0;
+        continue;
+      }
+      t = ((t << 8) | fold(c)) & 0xffffff;
+      if (++run < 3) continue;
+      uint64_t &word = seen_[t >> 6];
+      const uint64_t bit = uint64_t{1} << (t & 63);
+      if (word & bit) continue;
+      word |= bit;
+      out_.push_back(t);
+    }
+    return out_;
+  }
+
+ private:
+  std::vector<uint64_t> seen_;  // 2 MiB bitmap over all trigrams, cleared through out_
+  std::vector<uint32_t> out_;
+};
+
+// Segment file, little-endian:
+//   u32 magic, u32 version, u32 docCount, u32 trigramCount, u64 postingCount
+//   docCount x 20-byte blob OID
+//   trigramCount x {u32 trigram, u32 count, u64 offset}, sorted by trigram
+//   posting lists: `count` varints each, deltas of increasing document numbers
+class Segment {
+ public:
+  static constexpr size_t kHeaderBytes = 24;
+  static constexpr size_t kEntryBytes = 16;
+
+  Segment(std::string name, const std::string &path) : name_(std::move(name)) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw GitException("Unable to open search index segment " + path);
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(kHeaderBytes)) {
+      size_ = static_cast<size_t>(st.st_size);
+      void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) data_ = static_cast<const unsigned char *>(p);
+    }
+    close(fd);
+    if (data_ && get_u32(data_) == kSegmentMagic && get_u32(data_ + 4) == kVersion) {
+      docCount_ = get_u32(data_ + 8);
+      trigramCount_ = get_u32(data_ + 12);
+      postings_ = get_u64(data_ + 16);
+      const uint64_t tables = kHeaderBytes + uint64_t{docCount_} * 20 + uint64_t{trigramCount_} * kEntryBytes;
+      if (tables <= size_) {
+        docs_ = data_ + kHeaderBytes;
+        table_ = docs_ + static_cast<size_t>(docCount_) * 20;
+        lists_ = table_ + static_cast<size_t>(trigramCount_) * kEntryBytes;
+        return;
+      }
+    }
+    if (data_) munmap(const_cast<unsigned char *>(data_), size_);
+    data_ = nullptr;
+    throw GitException("Search index segment " + path + " is unreadable");
+  }
+
+  ~Segment() {
+    if (data_) munmap(const_cast<unsigned char *>(data_), size_);
+  }
+
+  Segment(const Segment &) = delete;
+  Segment &operator=(const Segment &) = delete;
+
+  const std::string &name() const { return name_; }
+  uint32_t doc_count() const { return docCount_; }
+  uint32_t trigram_count() const { return trigramCount_; }
+  uint64_t postings() const { return postings_; }
+  uint64_t bytes() const { return size_; }
+
+  RawOid doc(uint32_t i) const {
+    RawOid r;
+    std::memcpy(r.data(), docs_ + static_cast<size_t>(i) * 20, r.size());
+    return r;
+  }
+
+  uint32_t trigram_at(uint32_t i) const { return get_u32(table_ + static_cast<size_t>(i) * kEntryBytes); }
+
+  // Index of `trigram` in the table, or -1.
+  int64_t find(uint32_t trigram) const {
+    uint32_t lo = 0, hi = trigramCount_;
+    while (lo < hi) {
+      const uint32_t mid = lo + (hi - lo) / 2;
+      const uint32_t t = trigram_at(mid);
+      if (t == trigram) return mid;
+      if (t < trigram) lo = mid + 1;
+      else hi = mid;
+    }
+    return -1;
+  }
+
+  uint32_t list_size(uint32_t entry) const { return get_u32(table_ + static_cast<size_t>(entry) * kEntryBytes + 4); }
+
+  void decode(uint32_t entry, std::vector<uint32_t> &out) const {
+    const unsigned char *e = table_ + static_cast<size_t>(entry) * kEntryBytes;
+    const uint32_t count = get_u32(e + 4);
+    const unsigned char *p = lists_ + get_u64(e + 8);
+    const unsigned char *end = data_ + size_;
+    out.clear();
+    out.reserve(count);
+    uint32_t doc = 0;
+    for (uint32_t i = 0; i < count && p < end; i++) {
+      uint32_t delta = 0;
+      for (int shift = 0; p < end; shift += 7) {
+        const unsigned char b = *p++;
+        delta |= static_cast<uint32_t>(b & 0x7f) << shift;
+        if (!(b & 0x80)) break;
+      }
+      doc += delta;
+      out.push_back(doc);
+    }
+  }
+
+ private:
+  std::string name_;
+  const unsigned char *data_ = nullptr;
+  size_t size_ = 0;
+  uint32_t docCount_ = 0;
+  uint32_t trigramCount_ = 0;
+  uint64_t postings_ = 0;
+  const unsigned char *docs_ = nullptr;
+  const unsigned char *table_ = nullptr;
+  const unsigned char *lists_ = nullptr;
+};
+
+class SegmentBuilder {
+ public:
+  bool empty() const { return docs_.empty(); }
+  bool full() const { return pairs_.size() >= kSegmentPostings; }
+
+  void add(const RawOid &oid, const std::vector<uint32_t> &trigrams) {
+    const auto doc = static_cast<uint32_t>(docs_.size());
+    docs_.push_back(oid);
+    for (uint32_t t : trigrams) pairs_.push_back(static_cast<uint64_t>(t) << 32 | doc);
+  }
+
+  void write(const std::string &path) {
+    std::sort(pairs_.begin(), pairs_.end());
+
+    std::string table, lists;
+    uint32_t trigrams = 0;
+    for (size_t i = 0; i < pairs_.size();) {
+      const auto t = static_cast<uint32_t>(pairs_[i] >> 32);
+      const size_t start = i;
+      const uint64_t offset = lists.size();
+      uint32_t prev = 0;
+      for (; i < pairs_.size() && static_cast<uint32_t>(pairs_[i] >> 32) == t; i++) {
+        const auto doc = static_cast<uint32_t>(pairs_[i]);
+        uint32_t delta = doc - prev;
+        prev = doc;
+        while (delta >= 0x80) {
+          lists.push_back(static_cast<char>((delta & 0x7f) | 0x80));
+          delta >>= 7;
+        }
+        lists.push_back(static_cast<char>(delta));
+      }
+      put_u32(table, t);
+      put_u32(table, static_cast<uint32_t>(i - start));
+      put_u64(table, offset);
+      trigrams++;
+    }
+
+    std::string header;
+    put_u32(header, kSegmentMagic);
+    put_u32(header, kVersion);
+    put_u32(header, static_cast<uint32_t>(docs_.size()));
+    put_u32(header, trigrams);
+    put_u64(header, pairs_.size());
+
+    const std::string tmp = path + ".tmp";
+    {
+      std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+      out.write(header.data(), static_cast<std::streamsize>(header.size()));
+      for (const auto &d : docs_) out.write(reinterpret_cast<const char *>(d.data()), d.size());
+      out.write(table.data(), static_cast<std::streamsize>(table.size()));
+      out.write(lists.data(), static_cast<std::streamsize>(lists.size()));
+      if (!out) throw GitException("Unable to write " + tmp);
+    }
+    if (rename(tmp.c_str(), path.c_str()) != 0) throw GitException("Unable to write " + path);
+    docs_.clear();
+    pairs_.clear();
+  }
+
+ private:
+  std::vector<RawOid> docs_;
+  std::vector<uint64_t> pairs_;  // trigram << 32 | doc
+};
+
+struct IndexState {
+  std::string dir;
+  bool stored = false;  // a manifest exists on disk
+  uint32_t nextSegment = 0;
+  std::vector<ManifestEntry> files;  // sorted by path
+  std::vector<std::unique_ptr<Segment>> segments;
+  std::unordered_set<RawOid, RawOidHash> indexed;  // every document in `segments`
+};
+
+std::string index_dir(git_repository *repo) {
+  return std::string(git_repository_path(repo)) + kIndexDir;
+}
+
+void load_manifest(IndexState &state) {
+  std::ifstream in(state.dir + kManifestFile, std::ios::binary);
+  if (!in) return;
+  std::string header;
+  std::getline(in, header);
+  std::istringstream hs(header);
+  std::string magic;
+  uint32_t version = 0;
+  size_t segments = 0;
+  hs >> magic >> version >> state.nextSegment >> segments;
+  if (magic != kManifestMagic || version != kVersion) return;  // rebuilt from scratch
+  std::vector<std::unique_ptr<Segment>> loaded;
+  for (size_t i = 0; i < segments; i++) {
+    std::string name;
+    hs >> name;
+    loaded.emplace_back(new Segment(name, state.dir + name));
+  }
+
+  // Records: 20-byte OID, then the NUL-terminated path.
+  std::vector<ManifestEntry> files;
+  ManifestEntry e;
+  while (in.read(reinterpret_cast<char *>(e.oid.data()), e.oid.size()) && std::getline(in, e.path, '\0')) {
+    files.push_back(e);
+  }
+
+  state.stored = true;
+  state.segments = std::move(loaded);
+  state.files = std::move(files);
+  for (const auto &s : state.segments) {
+    for (uint32_t i = 0; i < s->doc_count(); i++) state.indexed.insert(s->doc(i));
+  }
+}
+
+void write_manifest(const IndexState &state) {
+  const std::string path = state.dir + kManifestFile;
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out << kManifestMagic << ' ' << kVersion << ' ' << state.nextSegment << ' ' << state.segments.size();
+    for (const auto &s : state.segments) out << ' ' << s->name();
+    out << '\n';
+    for (const auto &e : state.files) {
+      out.write(reinterpret_cast<const char *>(e.oid.data()), e.oid.size());
+      out.write(e.path.c_str(), static_cast<std::streamsize>(e.path.size() + 1));
+    }
+    if (!out) throw GitException("Unable to write " + tmp);
+  }
+  if (rename(tmp.c_str(), path.c_str()) != 0) throw GitException("Unable to write " + path);
+}
+
+// Segment files in the directory that the manifest doesn't list (left by an interrupted refresh
+// or made obsolete by a merge).
+void remove_unlisted_segments(const IndexState &state) {
+  DIR *d = opendir(state.dir.c_str());
+  if (!d) return;
+  std::unordered_set<std::string> keep;
+  for (const auto &s : state.segments) keep.insert(s->name());
+  while (dirent *e = readdir(d)) {
+    const std::string name = e->d_name;
+    if (name.compare(0, 4, "seg-") == 0 && !keep.count(name)) unlink((state.dir + name).c_str());
+  }
+  closedir(d);
+}
+
+// Symlinks and submodules are skipped, as git_search() skips them.
+bool is_blob_mode(uint32_t mode) {
+  return mode == GIT_FILEMODE_BLOB || mode == GIT_FILEMODE_BLOB_EXECUTABLE;
+}
+
+// Blob currently at each path: index entries (stage 0, regular files) overridden by work-tree
+// changes. `fromWorkdir` gets the paths whose content only exists in the work tree.
+std::vector<ManifestEntry> current_manifest(git_repository *repo,
+                                            std::unordered_map<RawOid, std::string, RawOidHash> &fromWorkdir) {
+  git_index *index = nullptr;
+  int rc = git_repository_index(&index, repo);
+  if (rc != 0) throw GitException(last_error_message(rc));
+  rc = git_index_read(index, 0);
+  if (rc != 0) {
+    git_index_free(index);
+    throw GitException(last_error_message(rc));
+  }
+
+  std::unordered_map<std::string, size_t> byPath;
+  std::vector<ManifestEntry> files;
+  const size_t n = git_index_entrycount(index);
+  files.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    const git_index_entry *e = git_index_get_byindex(index, i);
+    if (!is_blob_mode(e->mode) || GIT_INDEX_ENTRY_STAGE(e) != 0) continue;
+    byPath[e->path] = files.size();
+    files.push_back(ManifestEntry{e->path, raw_of(e->id)});
+  }
+
+  git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+  opts.flags = GIT_DIFF_INCLUDE_UNTRACKED | GIT_DIFF_RECURSE_UNTRACKED_DIRS | GIT_DIFF_INCLUDE_TYPECHANGE;
+  git_diff *diff = nullptr;
+  rc = git_diff_index_to_workdir(&diff, repo, index, &opts);
+  git_index_free(index);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  const std::string workdir = git_repository_workdir(repo) ? git_repository_workdir(repo) : "";
+  std::unordered_set<std::string> gone;
+  const size_t deltas = git_diff_num_deltas(diff);
+  for (size_t i = 0; i < deltas; i++) {
+    const git_diff_delta *d = git_diff_get_delta(diff, i);
+    const std::string path = d->new_file.path;
+    const bool regular = is_blob_mode(d->new_file.mode);
+    if (d->status == GIT_DELTA_DELETED || (d->status == GIT_DELTA_TYPECHANGE && !regular)) {
+      gone.insert(path);
+      continue;
+    }
+    if (d->status != GIT_DELTA_MODIFIED && d->status != GIT_DELTA_UNTRACKED && d->status != GIT_DELTA_TYPECHANGE) {
+      continue;
+    }
+    if (!regular) continue;
+
+    git_oid oid = d->new_file.id;
+    if (!(d->new_file.flags & GIT_DIFF_FLAG_VALID_ID) &&
+        git_odb_hashfile(&oid, (workdir + path).c_str(), GIT_OBJECT_BLOB) != 0) {
+      continue;  // unreadable or vanished since the diff
+    }
+    const RawOid raw = raw_of(oid);
+    fromWorkdir.emplace(raw, path);
+    auto it = byPath.find(path);
+    if (it != byPath.end()) {
+      files[it->second].oid = raw;
+    } else {
+      byPath[path] = files.size();
+      files.push_back(ManifestEntry{path, raw});
+    }
+  }
+  git_diff_free(diff);
+
+  if (!gone.empty()) {
+    files.erase(std::remove_if(files.begin(), files.end(), [&](const ManifestEntry &e) { return gone.count(e.path) != 0; }),
+                files.end());
+  }
+  std::sort(files.begin(), files.end(), [](const ManifestEntry &a, const ManifestEntry &b) { return a.path < b.path; });
+  return files;
+}
+
+bool is_indexable(const unsigned char *data, size_t size) {
+  return size <= kMaxIndexedBytes && !std::memchr(data, 0, std::min(size, kBinaryProbeBytes));
+}
+
+struct Refresh {
+  git_repository *repo = nullptr;
+  OperationContext *op = nullptr;
+  std::string workdir;
+  TrigramSet trigrams;
+  SegmentBuilder builder;
+  std::vector<std::unique_ptr<Segment>> added;
+  uint32_t indexedNow = 0;
+};
+
+void flush_segment(IndexState &state, Refresh &r) {
+  if (r.builder.empty()) return;
+  char name[32];
+  std::snprintf(name, sizeof name, "seg-%08u", state.nextSegment++);
+  r.builder.write(state.dir + name);
+  r.added.emplace_back(new Segment(name, state.dir + name));
+}
+
+void index_blob(Refresh &r, const RawOid &oid, const std::string *workdirPath) {
+  static const std::vector<uint32_t> kNone;
+  if (workdirPath) {
+    std::ifstream in(r.workdir + *workdirPath, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const auto *p = reinterpret_cast<const unsigned char *>(content.data());
+    r.builder.add(oid, is_indexable(p, content.size()) ? r.trigrams.extract(p, content.size()) : kNone);
+    return;
+  }
+
+  git_oid id;
+  std::memcpy(id.id, oid.data(), oid.size());
+  git_blob *blob = nullptr;
+  if (git_blob_lookup(&blob, r.repo, &id) != 0) return;  // missing object: retried next refresh
+  const auto *p = static_cast<const unsigned char *>(git_blob_rawcontent(blob));
+  const auto size = static_cast<size_t>(git_blob_rawsize(blob));
+  r.builder.add(oid, is_indexable(p, size) ? r.trigrams.extract(p, size) : kNone);
+  git_blob_free(blob);
+}
+
+// Rewrites runs of adjacent segments that are small or mostly dead into one, dropping documents
+// no path refers to. Works from the stored postings; no blob is read again.
+void compact(IndexState &state, const std::unordered_set<RawOid, RawOidHash> &live) {
+  auto live_docs = [&](const Segment &s) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < s.doc_count(); i++) n += live.count(s.doc(i)) ? 1 : 0;
+    return n;
+  };
+
+  std::vector<std::unique_ptr<Segment>> out;
+  std::vector<std::unique_ptr<Segment>> &in = state.segments;
+  for (size_t i = 0; i < in.size();) {
+    // Collect a run whose live postings fit one segment.
+    size_t j = i;
+    uint64_t budget = 0;
+    bool worthIt = false;
+    while (j < in.size()) {
+      const Segment &s = *in[j];
+      const uint32_t alive = live_docs(s);
+      const uint64_t estimate = s.doc_count() ? s.postings() * alive / s.doc_count() : 0;
+      const bool small = s.postings() < kSegmentPostings / 4;
+      const bool dead = alive * 2 < s.doc_count();
+      if (!small && !dead) break;
+      if (budget + estimate > kSegmentPostings && j > i) break;
+      budget += estimate;
+      worthIt = worthIt || dead || j > i;
+      j++;
+    }
+    if (j == i || !worthIt) {
+      out.push_back(std::move(in[i]));
+      i++;
+      continue;
+    }
+
+    SegmentBuilder merged;
+    std::unordered_map<RawOid, uint32_t, RawOidHash> numbering;
+    std::vector<uint32_t> list;
+    std::vector<std::vector<uint32_t>> perDoc;
+    for (size_t k = i; k < j; k++) {
+      const Segment &s = *in[k];
+      std::vector<int64_t> remap(s.doc_count(), -1);
+      for (uint32_t d = 0; d < s.doc_count(); d++) {
+        const RawOid oid = s.doc(d);
+        if (!live.count(oid) || numbering.count(oid)) continue;
+        remap[d] = static_cast<int64_t>(numbering.size());
+        numbering.emplace(oid, static_cast<uint32_t>(numbering.size()));
+      }
+      perDoc.resize(numbering.size());
+      for (uint32_t t = 0; t < s.trigram_count(); t++) {
+        s.decode(t, list);
+        const uint32_t trigram = s.trigram_at(t);
+        for (uint32_t d : list) {
+          if (d < remap.size() && remap[d] >= 0) perDoc[static_cast<size_t>(remap[d])].push_back(trigram);
+        }
+      }
+    }
+    std::vector<RawOid> order(numbering.size());
+    for (const auto &kv : numbering) order[kv.second] = kv.first;
+    for (size_t d = 0; d < order.size(); d++) {
+      merged.add(order[d], perDoc[d]);
+      std::vector<uint32_t>().swap(perDoc[d]);
+    }
+    for (size_t k = i; k < j; k++) {
+      for (uint32_t d = 0; d < in[k]->doc_count(); d++) state.indexed.erase(in[k]->doc(d));
+    }
+    for (const auto &oid : order) state.indexed.insert(oid);
+    if (!merged.empty()) {
+      char name[32];
+      std::snprintf(name, sizeof name, "seg-%08u", state.nextSegment++);
+      merged.write(state.dir + name);
+      out.emplace_back(new Segment(name, state.dir + name));
+    }
+    i = j;
+  }
+  state.segments = std::move(out);
+}
+
+// Brings `state` up to date with the work tree. Returns the number of blobs read.
+uint32_t refresh(git_repository *repo, IndexState &state, OperationContext *op) {
+  trace_phase("refresh");
+  std::unordered_map<RawOid, std::string, RawOidHash> fromWorkdir;
+  std::vector<ManifestEntry> files = current_manifest(repo, fromWorkdir);
+  if (state.stored && files == state.files) return 0;
+
+  std::vector<std::pair<RawOid, const std::string *>> missing;
+  std::unordered_set<RawOid, RawOidHash> live;
+  live.reserve(files.size());
+  for (const auto &e : files) {
+    if (!live.insert(e.oid).second || state.indexed.count(e.oid)) continue;
+    auto wd = fromWorkdir.find(e.oid);
+    missing.emplace_back(e.oid, wd != fromWorkdir.end() ? &wd->second : nullptr);
+  }
+
+  if (mkdir(state.dir.c_str(), 0755) != 0 && errno != EEXIST) throw GitException("Unable to create " + state.dir);
+
+  Refresh r;
+  r.repo = repo;
+  r.op = op;
+  r.workdir = git_repository_workdir(repo) ? git_repository_workdir(repo) : "";
+  trace_phase("index");
+  for (size_t i = 0; i < missing.size(); i++) {
+    if (op && op->cancelled()) break;
+    index_blob(r, missing[i].first, missing[i].second);
+    if (r.builder.full()) flush_segment(state, r);
+    if (op) op->report("indexing", i + 1, missing.size(), 0);
+  }
+  flush_segment(state, r);
+  for (auto &s : r.added) {
+    for (uint32_t d = 0; d < s->doc_count(); d++) state.indexed.insert(s->doc(d));
+    state.segments.push_back(std::move(s));
+  }
+  trace_count("indexed", static_cast<int64_t>(missing.size()));
+
+  // Whatever was indexed before a cancel is kept; the manifest only lists what is searchable.
+  const bool complete = !(op && op->cancelled());
+  if (complete) {
+    trace_phase("compact");
+    compact(state, live);
+    state.files = std::move(files);
+  } else {
+    std::vector<ManifestEntry> covered;
+    for (const auto &e : files) {
+      if (state.indexed.count(e.oid)) covered.push_back(e);
+    }
+    state.files = std::move(covered);
+  }
+  write_manifest(state);
+  state.stored = true;
+  remove_unlisted_segments(state);
+  if (!complete) op->fail(GIT_EUSER);
+  return static_cast<uint32_t>(missing.size());
+}
+
+// Trigrams every match must contain (folded), from the literal runs that the pattern requires.
+// Empty if nothing can be required.
+std::vector<uint32_t> required_trigrams(const std::string &pattern, bool regex) {
+  std::vector<std::string> runs;
+  if (!regex) {
+    runs.push_back(pattern);
+  } else {
+    std::string cur;
+    auto end_run = [&] {
+      if (cur.size() >= 3) runs.push_back(cur);
+      cur.clear();
+    };
+    const size_t n = pattern.size();
+    size_t i = 0;
+    while (i < n) {
+      const char c = pattern[i];
+      char lit = 0;
+      size_t next = i + 1;
+      if (c == '\\') {
+        if (i + 1 < n && !std::isalnum(static_cast<unsigned char>(pattern[i + 1]))) {
+          lit = pattern[i + 1];
+          next = i + 2;
+        } else {
+          end_run();
+          i += 2;
+          continue;
+        }
+      } else if (c == '[') {
+        end_run();
+        size_t j = i + 1;
+        if (j < n && pattern[j] == '^') j++;
+        if (j < n && pattern[j] == ']') j++;
+        while (j < n && pattern[j] != ']') {
+          // [:class:], [=equiv=] and [.coll.] have their own closing bracket.
+          if (pattern[j] == '[' && j + 1 < n && std::strchr(":=.", pattern[j + 1])) {
+            const char close[] = {pattern[j + 1], ']', '\0'};
+            const size_t end = pattern.find(close, j + 2);
+            if (end != std::string::npos) {
+              j = end + 2;
+              continue;
+            }
+          }
+          j++;
+        }
+        i = j + 1;
+        continue;
+      } else if (c == '(') {
+        // Groups are skipped whole: their content may be optional or alternated.
+        end_run();
+        int depth = 0;
+        size_t j = i;
+        for (; j < n; j++) {
+          if (pattern[j] == '\\') {
+            j++;
+          } else if (pattern[j] == '(') {
+            depth++;
+          } else if (pattern[j] == ')' && --depth == 0) {
+            break;
+          }
+        }
+        i = j + 1;
+        continue;
+      } else if (c == '|') {
+        return {};
+      } else if (c == '{') {
+        // A {m,n} bound: its digits are not text. Whatever it repeats has already been dropped.
+        end_run();
+        const size_t close = pattern.find('}', i + 1);
+        i = close == std::string::npos ? n : close + 1;
+        continue;
+      } else if (std::strchr(".^$)*?+", c)) {
+        end_run();
+        i++;
+        continue;
+      } else {
+        lit = c;
+      }
+
+      if (next < n && (pattern[next] == '*' || pattern[next] == '?' || pattern[next] == '{')) {
+        end_run();
+        i = next;
+        continue;
+      }
+      cur.push_back(lit);
+      if (next < n && pattern[next] == '+') {
+        end_run();
+        next++;
+      }
+      i = next;
+    }
+    end_run();
+  }
+
+  TrigramSet set;
+  std::vector<uint32_t> out;
+  for (const auto &run : runs) {
+    const auto &t = set.extract(reinterpret_cast<const unsigned char *>(run.data()), run.size());
+    out.insert(out.end(), t.begin(), t.end());
+  }
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+  return out;
+}
+
+// Documents of `seg` that contain every trigram.
+void segment_candidates(const Segment &seg, const std::vector<uint32_t> &trigrams,
+                        std::unordered_set<RawOid, RawOidHash> &out) {
+  std::vector<uint32_t> entries;
+  for (uint32_t t : trigrams) {
+    const int64_t e = seg.find(t);
+    if (e < 0) return;
+    entries.push_back(static_cast<uint32_t>(e));
+  }
+  std::sort(entries.begin(), entries.end(),
+            [&](uint32_t a, uint32_t b) { return seg.list_size(a) < seg.list_size(b); });
+
+  std::vector<uint32_t> docs, list, next;
+  seg.decode(entries[0], docs);
+  for (size_t i = 1; i < entries.size() && !docs.empty(); i++) {
+    seg.decode(entries[i], list);
+    next.clear();
+    std::set_intersection(docs.begin(), docs.end(), list.begin(), list.end(), std::back_inserter(next));
+    docs.swap(next);
+  }
+  for (uint32_t d : docs) {
+    if (d < seg.doc_count()) out.insert(seg.doc(d));
+  }
+}
+
+// One repository's loaded index is kept between calls (normally the active workspace).
+std::mutex g_index_mu;
+std::string g_index_key;
+std::unique_ptr<IndexState> g_index;
+
+std::unique_ptr<IndexState> take_state(git_repository *repo, const std::string &key) {
+  {
+    std::lock_guard<std::mutex> g(g_index_mu);
+    if (g_index && g_index_key == key) return std::move(g_index);
+  }
+  std::unique_ptr<IndexState> state(new IndexState());
+  state->dir = index_dir(repo);
+  try {
+    load_manifest(*state);
+  } catch (const GitException &) {
+    // Damaged index: start over.
+    state.reset(new IndexState());
+    state->dir = index_dir(repo);
+  }
+  return state;
+}
+
+void put_state(const std::string &key, std::unique_ptr<IndexState> state) {
+  std::lock_guard<std::mutex> g(g_index_mu);
+  g_index_key = key;
+  g_index = std::move(state);
+}
+
+void forget_state(const std::string &key) {
+  std::unique_ptr<IndexState> dropped;
+  std::lock_guard<std::mutex> g(g_index_mu);
+  if (g_index_key == key) dropped = std::move(g_index);
+}
+
+GitSearchIndexStats stats_of(const IndexState &state, uint32_t indexedNow) {
+  GitSearchIndexStats s;
+  s.files = state.files.size();
+  s.blobs = state.indexed.size();
+  s.segments = state.segments.size();
+  for (const auto &seg : state.segments) s.bytes += seg->bytes();
+  s.indexedNow = indexedNow;
+  return s;
+}
+}  // namespace
+
+std::optional<std::vector<std::string>> search_index_candidates(git_repository *repo, const std::string &localPath,
+                                                                const GitSearchOptions &opts, OperationContext &op) {
+  const std::vector<uint32_t> trigrams = required_trigrams(opts.pattern, opts.regex);
+  if (trigrams.empty()) return std::nullopt;
+
+  const std::string key = repo_cache_key(localPath);
+  std::unique_ptr<IndexState> state = take_state(repo, key);
+  try {
+    refresh(repo, *state, &op);
+  } catch (...) {
+    forget_state(key);
+    throw;
+  }
+
+  trace_phase("query");
+  std::unordered_set<RawOid, RawOidHash> hits;
+  for (const auto &seg : state->segments) segment_candidates(*seg, trigrams, hits);
+  std::vector<std::string> paths;
+  for (const auto &e : state->files) {
+    if (hits.count(e.oid)) paths.push_back(e.path);
+  }
+  trace_count("candidates", static_cast<int64_t>(paths.size()));
+  put_state(key, std::move(state));
+  return paths;
+}
+
+void forget_search_index(const std::string &localPath) {
+  forget_state(repo_cache_key(localPath));
+}
+
+GitSearchIndexStats git_search_index_refresh(const GitSearchIndexOptions &opts) {
+  OperationContext op(opts.hooks.operationId, opts.hooks.onProgress);
+  RepoLease lease = acquire_repo(opts.localPath);
+  const std::string key = repo_cache_key(opts.localPath);
+  std::unique_ptr<IndexState> state = take_state(lease.get(), key);
+  uint32_t indexed = 0;
+  try {
+    indexed = refresh(lease.get(), *state, &op);
+  } catch (...) {
+    forget_state(key);
+    throw;
+  }
+  const GitSearchIndexStats stats = stats_of(*state, indexed);
+  put_state(key, std::move(state));
+  return stats;
+}
+
+void git_search_index_drop(const std::string &localPath) {
+  RepoLease lease = acquire_repo(localPath);
+  forget_state(repo_cache_key(localPath));
+  IndexState state;
+  state.dir = index_dir(lease.get());
+  remove_unlisted_segments(state);
+  unlink((state.dir + kManifestFile).c_str());
+  rmdir(state.dir.c_str());
+}
@@ -0,0 +1,314 @@
+#include "git_ops.h"
+
+#include "git_internal.h"
+#include "repo_cache.h"
+
+#include <git2.h>
+
+#include <sys/stat.h>
+
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// A snapshot is an unreferenced commit shaped like `git stash create -u`:
+//
+//   tree      = index + work-tree changes (untracked files included, ignored files not)
+//   parents   = HEAD (when born), then a commit whose tree is the index at snapshot time
+//
+// Only paths reported by status are hashed; everything else is reused from the index's cached
+// tree, so the cost follows the size of the change rather than the size of the repository.
+// Snapshot ids are recorded in .git/codexm-snapshots so they can be listed and kept alive.
+
+namespace {
+constexpr const char *kSnapshotLog = "codexm-snapshots";
+constexpr size_t kMaxSnapshots = 50;
+
+std::string snapshot_log_path(git_repository *repo) {
+  return std::string(git_repository_path(repo)) + kSnapshotLog;
+}
+
+std::vector<GitSnapshotInfo> read_snapshot_log(git_repository *repo) {
+  std::vector<GitSnapshotInfo> out;
+  std::ifstream in(snapshot_log_path(repo));
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream ls(line);
+    GitSnapshotInfo info;
+    if (!(ls >> info.oid >> info.createdAt)) continue;
+    std::getline(ls >> std::ws, info.message);
+    out.push_back(std::move(info));
+  }
+  return out;
+}
+
+void write_snapshot_log(git_repository *repo, const std::vector<GitSnapshotInfo> &entries) {
+  const std::string path = snapshot_log_path(repo);
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    for (const auto &e : entries) {
+      std::string message = e.message;
+      for (auto &c : message) {
+        if (c == '\n' || c == '\r') c = ' ';
+      }
+      out << e.oid << ' ' << e.createdAt << ' ' << message << '\n';
+    }
+    if (!out) throw GitException("Unable to write " + tmp);
+  }
+  if (rename(tmp.c_str(), path.c_str()) != 0) throw GitException("Unable to write " + path);
+}
+
+unsigned int worktree_mode(const std::string &absPath) {
+  struct stat st;
+  if (lstat(absPath.c_str(), &st) != 0) return 0;
+  if (S_ISLNK(st.st_mode)) return GIT_FILEMODE_LINK;
+  if (!S_ISREG(st.st_mode)) return 0;  // Nested repositories and other oddities are left out.
+  return (st.st_mode & S_IXUSR) ? GIT_FILEMODE_BLOB_EXECUTABLE : GIT_FILEMODE_BLOB;
+}
+
+// Applies INDEX..WORKDIR changes onto `mem` (a copy of the index).
+void apply_worktree_changes(git_repository *repo, git_index *mem) {
+  const char *wd = git_repository_workdir(repo);
+  if (!wd) throw GitException("Snapshots require a work tree");
+  const std::string workdir(wd);
+
+  git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+  opts.show = GIT_STATUS_SHOW_WORKDIR_ONLY;
+  opts.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS;
+  const std::vector<std::string> sparse = read_sparse_paths(repo);
+  std::vector<const char *> sparseStorage;
+  if (!sparse.empty()) {
+    opts.flags |= GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+    opts.pathspec = as_strarray(sparse, sparseStorage);
+  }
+
+  git_status_list *status = nullptr;
+  int rc = git_status_list_new(&status, repo, &opts);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  const size_t count = git_status_list_entrycount(status);
+  for (size_t i = 0; i < count; i++) {
+    const git_status_entry *s = git_status_byindex(status, i);
+    if (!s || !s->index_to_workdir) continue;
+    const char *path = s->index_to_workdir->new_file.path;
+    if (!path) continue;
+
+    if (s->status & GIT_STATUS_WT_DELETED) {
+      rc = git_index_remove(mem, path, 0);
+      if (rc != 0 && rc != GIT_ENOTFOUND) break;
+      rc = 0;
+      continue;
+    }
+    if (!(s->status & (GIT_STATUS_WT_NEW | GIT_STATUS_WT_MODIFIED | GIT_STATUS_WT_TYPECHANGE))) continue;
+
+    const unsigned int mode = worktree_mode(workdir + path);
+    if (mode == 0) continue;
+
+    git_index_entry entry{};
+    entry.path = path;
+    entry.mode = mode;
+    rc = git_blob_create_from_workdir(&entry.id, repo, path);
+    if (rc != 0) break;
+    rc = git_index_add(mem, &entry);
+    if (rc != 0) break;
+  }
+  git_status_list_free(status);
+  if (rc != 0) throw GitException(last_error_message(rc));
+}
+
+git_index *index_from_tree(git_tree *tree) {
+  git_index *mem = nullptr;
+  int rc = git_index_new(&mem);
+  if (rc != 0) throw GitException(last_error_message(rc));
+  rc = git_index_read_tree(mem, tree);
+  if (rc != 0) {
+    git_index_free(mem);
+    throw GitException(last_error_message(rc));
+  }
+  return mem;
+}
+}  // namespace
+
+std::string git_snapshot_worktree(const std::string &localPath, const std::string &message) {
+  RepoLease lease = acquire_repo(localPath);
+  git_repository *repo = lease.get();
+
+  git_index *index = nullptr;
+  int rc = git_repository_index(&index, repo);
+  if (rc != 0) throw GitException(last_error_message(rc));
+  rc = git_index_read(index, 0);
+  if (rc == 0 && git_index_has_conflicts(index)) {
+    git_index_free(index);
+    throw GitException("Cannot snapshot while the index has unresolved conflicts");
+  }
+  git_oid indexTreeId{};
+  if (rc == 0) rc = git_index_write_tree(&indexTreeId, index);
+  git_index_free(index);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  git_tree *indexTree = nullptr;
+  rc = git_tree_lookup(&indexTree, repo, &indexTreeId);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  // Work tree on top of a private copy of the index; the repository's index is not modified.
+  git_index *mem = nullptr;
+  git_oid workTreeId{};
+  try {
+    mem = index_from_tree(indexTree);
+    apply_worktree_changes(repo, mem);
+  } catch (...) {
+    if (mem) git_index_free(mem);
+    git_tree_free(indexTree);
+    throw;
+  }
+  rc = git_index_write_tree_to(&workTreeId, mem, repo);
+  git_index_free(mem);
+  if (rc != 0) {
+    git_tree_free(indexTree);
+    throw GitException(last_error_message(rc));
+  }
+
+  git_commit *head = nullptr;
+  git_oid headId{};
+  if (git_reference_name_to_id(&headId, repo, "HEAD") == 0) {
+    rc = git_commit_lookup(&head, repo, &headId);
+    if (rc != 0) {
+      git_tree_free(indexTree);
+      throw GitException(last_error_message(rc));
+    }
+  }
+
+  git_signature *sig = nullptr;
+  git_tree *workTree = nullptr;
+  git_commit *indexCommit = nullptr;
+  git_oid indexCommitId{}, snapshotId{};
+  const std::string label = message.empty() ? "codexm snapshot" : message;
+  try {
+    sig = default_signature(repo);
+
+    const git_commit *indexParents[] = {head};
+    rc = git_commit_create(&indexCommitId, repo, nullptr, sig, sig, nullptr, ("index on " + label).c_str(),
+                           indexTree, head ? 1 : 0, indexParents);
+    if (rc == 0) rc = git_commit_lookup(&indexCommit, repo, &indexCommitId);
+    if (rc == 0) rc = git_tree_lookup(&workTree, repo, &workTreeId);
+    if (rc == 0) {
+      const git_commit *parents[] = {head, indexCommit};
+      const git_commit **first = head ? parents : parents + 1;
+      rc = git_commit_create(&snapshotId, repo, nullptr, sig, sig, nullptr, label.c_str(), workTree,
+                             head ? 2 : 1, first);
+    }
+  } catch (...) {
+    if (head) git_commit_free(head);
+    git_tree_free(indexTree);
+    throw;
+  }
+  if (workTree) git_tree_free(workTree);
+  if (indexCommit) git_commit_free(indexCommit);
+  if (head) git_commit_free(head);
+  git_signature_free(sig);
+  git_tree_free(indexTree);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  GitSnapshotInfo info;
+  info.oid = git_oid_tostr_s(&snapshotId);
+  info.createdAt = static_cast<int64_t>(time(nullptr));
+  info.message = message;
+
+  std::vector<GitSnapshotInfo> log = read_snapshot_log(repo);
+  log.push_back(info);
+  if (log.size() > kMaxSnapshots) log.erase(log.begin(), log.end() - kMaxSnapshots);
+  write_snapshot_log(repo, log);
+  return info.oid;
+}
+
+void git_restore_snapshot(const std::string &localPath, const std::string &snapshotOid) {
+  RepoLease lease = acquire_repo(localPath);
+  git_repository *repo = lease.get();
+
+  git_oid id{};
+  int rc = git_oid_fromstr(&id, snapshotOid.c_str());
+  if (rc != 0) throw GitException("Invalid snapshot id: " + snapshotOid);
+
+  git_commit *snapshot = nullptr;
+  rc = git_commit_lookup(&snapshot, repo, &id);
+  if (rc != 0) throw GitException(last_error_message(rc));
+  const unsigned int parents = git_commit_parentcount(snapshot);
+  if (parents == 0) {
+    git_commit_free(snapshot);
+    throw GitException("Not a snapshot: " + snapshotOid);
+  }
+
+  git_tree *workTree = nullptr;
+  git_commit *indexCommit = nullptr;
+  git_tree *indexTree = nullptr;
+  rc = git_commit_tree(&workTree, snapshot);
+  if (rc == 0) rc = git_commit_parent(&indexCommit, snapshot, parents - 1);
+  if (rc == 0) rc = git_commit_tree(&indexTree, indexCommit);
+  if (indexCommit) git_commit_free(indexCommit);
+  git_commit_free(snapshot);
+  if (rc != 0) {
+    if (workTree) git_tree_free(workTree);
+    throw GitException(last_error_message(rc));
+  }
+
+  git_index *mem = nullptr;
+  try {
+    mem = index_from_tree(indexTree);
+  } catch (...) {
+    git_tree_free(workTree);
+    git_tree_free(indexTree);
+    throw;
+  }
+  git_tree_free(indexTree);
+
+  git_index *index = nullptr;
+  rc = git_repository_index(&index, repo);
+  if (rc == 0) rc = git_index_read(index, 0);
+  if (rc != 0) {
+    if (index) git_index_free(index);
+    git_index_free(mem);
+    git_tree_free(workTree);
+    throw GitException(last_error_message(rc));
+  }
+
+  // FORCE rewrites only files whose content differs from the target. With the current index as the
+  // baseline, files added since the snapshot are removed whether or not they were staged;
+  // REMOVE_UNTRACKED covers the unstaged ones (ignored files are left alone).
+  const std::vector<std::string> sparse = read_sparse_paths(repo);
+  std::vector<const char *> sparseStorage;
+  git_checkout_options co = GIT_CHECKOUT_OPTIONS_INIT;
+  co.checkout_strategy = GIT_CHECKOUT_FORCE | GIT_CHECKOUT_REMOVE_UNTRACKED | GIT_CHECKOUT_DONT_UPDATE_INDEX;
+  co.baseline_index = index;
+  if (!sparse.empty()) {
+    co.checkout_strategy |= GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH;
+    co.paths = as_strarray(sparse, sparseStorage);
+  }
+  rc = git_checkout_tree(repo, reinterpret_cast<git_object *>(workTree), &co);
+  git_tree_free(workTree);
+
+  // read_index (rather than read_tree) keeps cached stat data for unchanged entries, so the next
+  // status does not have to rehash the whole tree.
+  if (rc == 0) rc = git_index_read_index(index, mem);
+  if (rc == 0) rc = git_index_write(index);
+  git_index_free(index);
+  git_index_free(mem);
+  if (rc != 0) throw GitException(last_error_message(rc));
+}
+
+std::vector<GitSnapshotInfo> git_list_snapshots(const std::string &localPath) {
+  RepoLease lease = acquire_repo(localPath);
+  return read_snapshot_log(lease.get());
+}
+
+void git_drop_snapshot(const std::string &localPath, const std::string &snapshotOid) {
+  RepoLease lease = acquire_repo(localPath);
+  std::vector<GitSnapshotInfo> log = read_snapshot_log(lease.get());
+  std::vector<GitSnapshotInfo> kept;
+  for (auto &e : log) {
+    if (e.oid != snapshotOid) kept.push_back(std::move(e));
+  }
+  if (kept.size() != log.size()) write_snapshot_log(lease.get(), kept);
+}
@@ -0,0 +1,261 @@
+#include "git_ops.h"
+
+#include "git_internal.h"
+#include "repo_cache.h"
+
+#include <git2.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+// One prefix per line, next to the index. Not a core.sparseCheckout file: libgit2 does not read
+// those, and stock git would try to apply it with different (pattern) semantics.
+constexpr const char *kSparseFile = "codexm-sparse";
+
+std::string sparse_file_path(git_repository *repo) {
+  return std::string(git_repository_path(repo)) + kSparseFile;
+}
+
+std::string normalize_prefix(std::string p) {
+  while (p.compare(0, 2, "./") == 0) p.erase(0, 2);
+  while (!p.empty() && p.front() == '/') p.erase(0, 1);
+  while (!p.empty() && p.back() == '/') p.pop_back();
+  return p;
+}
+
+}  // namespace
+
+void write_sparse_paths(git_repository *repo, const std::vector<std::string> &prefixes) {
+  const std::string path = sparse_file_path(repo);
+  if (prefixes.empty()) {
+    if (unlink(path.c_str()) != 0 && errno != ENOENT) throw GitException("Unable to remove " + path);
+    return;
+  }
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    for (const auto &p : prefixes) out << p << '\n';
+    if (!out) throw GitException("Unable to write " + tmp);
+  }
+  if (rename(tmp.c_str(), path.c_str()) != 0) throw GitException("Unable to write " + path);
+}
+
+namespace {
+void remove_empty_parents(const std::string &workdir, std::string rel) {
+  for (size_t slash = rel.rfind('/'); slash != std::string::npos; slash = rel.rfind('/')) {
+    rel.erase(slash);
+    if (rmdir((workdir + rel).c_str()) != 0) break;  // Not empty (or already gone): stop climbing.
+  }
+}
+
+// Deletes work-tree copies of tracked files that fall outside `keep`, leaving anything with local
+// changes in place. Their index entries are left to sync_sparse_index().
+void prune_outside(git_repository *repo, const std::vector<std::string> &keep) {
+  const char *wd = git_repository_workdir(repo);
+  if (!wd) return;
+  const std::string workdir(wd);
+
+  std::set<std::string> dirty;
+  {
+    git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+    opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+    git_status_list *status = nullptr;
+    const int rc = git_status_list_new(&status, repo, &opts);
+    if (rc != 0) throw GitException(last_error_message(rc));
+    const size_t count = git_status_list_entrycount(status);
+    for (size_t i = 0; i < count; i++) {
+      const git_status_entry *s = git_status_byindex(status, i);
+      const char *path = s ? status_entry_path(s) : nullptr;
+      // Missing files are already in the desired state; everything else is a local change.
+      if (path && (s->status & ~GIT_STATUS_WT_DELETED) != 0) dirty.insert(path);
+    }
+    git_status_list_free(status);
+  }
+
+  git_index *index = nullptr;
+  const int rc = git_repository_index(&index, repo);
+  if (rc != 0) throw GitException(last_error_message(rc));
+  const size_t n = git_index_entrycount(index);
+  for (size_t i = 0; i < n; i++) {
+    const git_index_entry *e = git_index_get_byindex(index, i);
+    if (!e || sparse_contains(keep, e->path) || dirty.count(e->path)) continue;
+    const std::string abs = workdir + e->path;
+    if (unlink(abs.c_str()) == 0) remove_empty_parents(workdir, e->path);
+  }
+  git_index_free(index);
+}
+}  // namespace
+
+std::vector<std::string> normalize_sparse_paths(const std::vector<std::string> &prefixes) {
+  std::vector<std::string> out;
+  for (const auto &p : prefixes) {
+    std::string n = normalize_prefix(p);
+    if (!n.empty()) out.push_back(std::move(n));
+  }
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+
+  // "a" already covers "a/b".
+  std::vector<std::string> minimal;
+  for (const auto &p : out) {
+    if (!minimal.empty() && sparse_contains({minimal.back()}, p)) continue;
+    minimal.push_back(p);
+  }
+  return minimal;
+}
+
+std::vector<std::string> read_sparse_paths(git_repository *repo) {
+  std::vector<std::string> out;
+  std::ifstream in(sparse_file_path(repo));
+  std::string line;
+  while (std::getline(in, line)) {
+    line = normalize_prefix(line);
+    if (!line.empty()) out.push_back(line);
+  }
+  return out;
+}
+
+bool sparse_contains(const std::vector<std::string> &prefixes, const std::string &path) {
+  if (prefixes.empty()) return true;
+  for (const auto &p : prefixes) {
+    if (path.compare(0, p.size(), p) != 0) continue;
+    if (path.size() == p.size() || path[p.size()] == '/') return true;
+  }
+  return false;
+}
+
+git_strarray as_strarray(const std::vector<std::string> &items, std::vector<const char *> &storage) {
+  storage.clear();
+  storage.reserve(items.size());
+  for (const auto &s : items) storage.push_back(s.c_str());
+  git_strarray arr;
+  arr.strings = const_cast<char **>(storage.data());
+  arr.count = storage.size();
+  return arr;
+}
+
+namespace {
+struct OutsideWalk {
+  const std::vector<std::string> *sparse;
+  git_index *index;
+  std::set<std::string> paths;
+  int rc = 0;
+};
+
+int outside_entry_cb(const char *root, const git_tree_entry *entry, void *payload) {
+  auto *walk = static_cast<OutsideWalk *>(payload);
+  const std::string path = std::string(root) + git_tree_entry_name(entry);
+  // Subtrees wholly inside the sparse set are the work tree's business.
+  if (sparse_contains(*walk->sparse, path)) return git_tree_entry_type(entry) == GIT_OBJECT_TREE ? 1 : 0;
+  if (git_tree_entry_type(entry) == GIT_OBJECT_TREE) return 0;
+
+  walk->paths.insert(path);
+  const git_oid *id = git_tree_entry_id(entry);
+  const git_filemode_t mode = git_tree_entry_filemode(entry);
+  const git_index_entry *cur = git_index_get_bypath(walk->index, path.c_str(), 0);
+  if (cur && cur->mode == static_cast<uint32_t>(mode) && git_oid_equal(&cur->id, id) &&
+      (cur->flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE)) {
+    return 0;
+  }
+  git_index_entry e{};
+  e.path = path.c_str();
+  e.mode = mode;
+  e.id = *id;
+  e.flags_extended = GIT_INDEX_ENTRY_SKIP_WORKTREE;
+  walk->rc = git_index_add(walk->index, &e);
+  return walk->rc < 0 ? walk->rc : 0;
+}
+}  // namespace
+
+void sync_sparse_index(git_repository *repo, git_index *index, const std::vector<std::string> &sparse) {
+  int rc = 0;
+  // In scope, entries belong to whatever was staged or checked out; only the flag is ours to clear.
+  for (size_t i = git_index_entrycount(index); i > 0; i--) {
+    const git_index_entry *e = git_index_get_byindex(index, i - 1);
+    if (!e || !(e->flags_extended & GIT_INDEX_ENTRY_SKIP_WORKTREE) || !sparse_contains(sparse, e->path)) continue;
+    const std::string path = e->path;
+    git_index_entry copy = *e;
+    copy.path = path.c_str();
+    copy.flags_extended &= static_cast<uint16_t>(~GIT_INDEX_ENTRY_SKIP_WORKTREE);
+    rc = git_index_add(index, &copy);
+    if (rc != 0) throw GitException(last_error_message(rc));
+  }
+  if (sparse.empty()) return;
+
+  git_object *head = nullptr;
+  rc = git_revparse_single(&head, repo, "HEAD^{tree}");
+  if (rc == GIT_ENOTFOUND || rc == GIT_EUNBORNBRANCH) return;
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  OutsideWalk walk{&sparse, index, {}};
+  rc = git_tree_walk(reinterpret_cast<git_tree *>(head), GIT_TREEWALK_PRE, outside_entry_cb, &walk);
+  git_object_free(head);
+  if (rc != 0) throw GitException(last_error_message(walk.rc < 0 ? walk.rc : rc));
+
+  // Out-of-scope entries HEAD no longer has (e.g. left behind by a sparse checkout of another commit).
+  for (size_t i = git_index_entrycount(index); i > 0; i--) {
+    const git_index_entry *e = git_index_get_byindex(index, i - 1);
+    if (!e || sparse_contains(sparse, e->path) || walk.paths.count(e->path)) continue;
+    const std::string path = e->path;
+    rc = git_index_remove(index, path.c_str(), git_index_entry_stage(e));
+    if (rc != 0) throw GitException(last_error_message(rc));
+  }
+}
+
+void sync_sparse_index(git_repository *repo, const std::vector<std::string> &sparse) {
+  git_index *index = nullptr;
+  int rc = git_repository_index(&index, repo);
+  if (rc != 0) throw GitException(last_error_message(rc));
+  try {
+    sync_sparse_index(repo, index, sparse);
+  } catch (...) {
+    git_index_free(index);
+    throw;
+  }
+  rc = git_index_write(index);
+  git_index_free(index);
+  if (rc != 0) throw GitException(last_error_message(rc));
+}
+
+std::vector<std::string> git_get_sparse_paths(const std::string &localPath) {
+  RepoLease lease = acquire_repo(localPath);
+  return read_sparse_paths(lease.get());
+}
+
+void git_set_sparse_paths(const std::string &localPath, const std::vector<std::string> &prefixes) {
+  RepoLease lease = acquire_repo(localPath);
+  git_repository *repo = lease.get();
+  const std::vector<std::string> next = normalize_sparse_paths(prefixes);
+
+  // Write what is newly in scope first, so a failure never leaves fewer files than before.
+  git_object *head = nullptr;
+  int rc = git_revparse_single(&head, repo, "HEAD^{tree}");
+  if (rc == 0) {
+    std::vector<const char *> storage;
+    git_checkout_options co = GIT_CHECKOUT_OPTIONS_INIT;
+    co.checkout_strategy = GIT_CHECKOUT_SAFE | GIT_CHECKOUT_RECREATE_MISSING;
+    if (!next.empty()) {
+      co.checkout_strategy |= GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH;
+      co.paths = as_strarray(next, storage);
+    }
+    rc = git_checkout_tree(repo, head, &co);
+    git_object_free(head);
+    if (rc != 0) throw GitException(last_error_message(rc));
+  } else if (rc != GIT_ENOTFOUND && rc != GIT_EUNBORNBRANCH) {
+    throw GitException(last_error_message(rc));
+  }
+
+  if (!next.empty()) prune_outside(repo, next);
+  sync_sparse_index(repo, next);
+  write_sparse_paths(repo, next);
+
+  forget_incremental_status(localPath);
+}
@@ -0,0 +1,274 @@
+#include "git_ops.h"
+
+#include "fs_watch.h"
+#include "git_internal.h"
+#include "repo_cache.h"
+#include "trace.h"
+
+#include <git2.h>
+
+#include <sys/stat.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+struct PathStamp {
+  bool exists = false;
+  int64_t mtimeNs = 0;
+  int64_t size = 0;
+  uint64_t ino = 0;
+  uint32_t mode = 0;
+
+  bool operator==(const PathStamp &o) const {
+    return exists == o.exists && mtimeNs == o.mtimeNs && size == o.size && ino == o.ino && mode == o.mode;
+  }
+};
+
+PathStamp stamp_of(const std::string &absPath) {
+  PathStamp out;
+  struct stat st;
+  if (lstat(absPath.c_str(), &st) != 0) return out;
+  out.exists = true;
+  out.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+  out.size = static_cast<int64_t>(st.st_size);
+  out.ino = static_cast<uint64_t>(st.st_ino);
+  out.mode = static_cast<uint32_t>(st.st_mode);
+  return out;
+}
+
+// Everything below is only touched while holding the repository lease, so calls for one work tree
+// are already serialized; the registry mutex only guards the map itself.
+struct IncrementalState {
+  std::unique_ptr<WorkTreeWatcher> watcher;
+
+  bool baselineValid = false;
+  bool headValid = false;
+  git_oid head{};
+  PathStamp indexStamp;
+
+  // Per-file status flags from the last walk. Untracked directories are expanded to files here and
+  // collapsed again when building `output`, so a single new file can be patched in or out.
+  std::map<std::string, unsigned int> entries;
+  // lstat() data of paths at the time they were last re-checked; used to drop no-op notifications.
+  std::unordered_map<std::string, PathStamp> stamps;
+
+  GitStatus output;
+  bool outputStale = true;
+};
+
+std::mutex g_states_mu;
+std::unordered_map<std::string, std::shared_ptr<IncrementalState>> g_states;
+
+std::shared_ptr<IncrementalState> state_for(const std::string &key) {
+  std::lock_guard<std::mutex> g(g_states_mu);
+  auto &slot = g_states[key];
+  if (!slot) slot = std::make_shared<IncrementalState>();
+  return slot;
+}
+
+std::string normalize_rel(const std::string &workdir, std::string p) {
+  if (!workdir.empty() && p.compare(0, workdir.size(), workdir) == 0) p.erase(0, workdir.size());
+  while (p.compare(0, 2, "./") == 0) p.erase(0, 2);
+  while (!p.empty() && p.front() == '/') p.erase(0, 1);
+  while (!p.empty() && p.back() == '/') p.pop_back();
+  return p;
+}
+
+bool is_ignored_dir(git_repository *repo, const std::string &relDir) {
+  int ignored = 0;
+  const std::string asDir = relDir + "/";
+  return git_ignore_path_is_ignored(&ignored, repo, asDir.c_str()) == 0 && ignored;
+}
+
+void erase_subtree(std::map<std::string, unsigned int> &entries, const std::string &path) {
+  entries.erase(path);
+  const std::string prefix = path + "/";
+  auto it = entries.lower_bound(prefix);
+  while (it != entries.end() && it->first.compare(0, prefix.size(), prefix) == 0) it = entries.erase(it);
+}
+
+void run_status(git_repository *repo, const std::vector<std::string> *paths,
+                std::map<std::string, unsigned int> &entries) {
+  git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+  opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+  opts.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_RECURSE_UNTRACKED_DIRS |
+               GIT_STATUS_OPT_RENAMES_HEAD_TO_INDEX;
+
+  std::vector<const char *> specs;
+  if (paths) {
+    // Exact paths (no fnmatch) let libgit2 hand them to its iterators as a path list, so only the
+    // listed files and directories are visited instead of the whole tree.
+    opts.flags |= GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+    specs.reserve(paths->size());
+    for (const auto &p : *paths) specs.push_back(p.c_str());
+    opts.pathspec.strings = const_cast<char **>(specs.data());
+    opts.pathspec.count = specs.size();
+  }
+
+  trace_phase("walk");
+  git_status_list *status = nullptr;
+  const int rc = git_status_list_new(&status, repo, &opts);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  const size_t count = git_status_list_entrycount(status);
+  trace_count("rows", static_cast<int64_t>(count));
+  for (size_t i = 0; i < count; i++) {
+    const git_status_entry *s = git_status_byindex(status, i);
+    if (!s) continue;
+    const char *path = status_entry_path(s);
+    if (!path || s->status == GIT_STATUS_CURRENT) continue;
+    entries[path] = s->status;
+  }
+  git_status_list_free(status);
+}
+
+void rebuild_output(git_repository *repo, IncrementalState &st) {
+  git_index *index = nullptr;
+  const int rc = git_repository_index(&index, repo);
+  if (rc != 0) throw GitException(last_error_message(rc));
+
+  // A wholly untracked directory is reported once as "dir/" (topmost directory with no index
+  // entries below it), matching git_status() without RECURSE_UNTRACKED_DIRS.
+  std::unordered_map<std::string, bool> dirHasTracked;
+  auto has_tracked = [&](const std::string &prefix) {
+    auto it = dirHasTracked.find(prefix);
+    if (it != dirHasTracked.end()) return it->second;
+    size_t pos = 0;
+    const bool tracked = git_index_find_prefix(&pos, index, prefix.c_str()) == 0;
+    dirHasTracked.emplace(prefix, tracked);
+    return tracked;
+  };
+
+  GitStatus out;
+  std::set<std::string> emittedDirs;
+  for (const auto &kv : st.entries) {
+    const std::string &path = kv.first;
+    const unsigned int flags = kv.second;
+    if (!(flags & GIT_STATUS_WT_NEW)) {
+      classify_status(out, path, flags);
+      continue;
+    }
+
+    std::string reported = path;
+    for (size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+      const std::string prefix = path.substr(0, slash + 1);
+      if (!has_tracked(prefix)) {
+        reported = prefix;
+        break;
+      }
+    }
+    if (reported.back() == '/' && !emittedDirs.insert(reported).second) continue;
+    classify_status(out, reported, flags);
+  }
+
+  git_index_free(index);
+  st.output = std::move(out);
+  st.outputStale = false;
+}
+}  // namespace
+
+GitStatus git_status_incremental(const GitIncrementalStatusOptions &opts) {
+  RepoLease lease = acquire_repo(opts.localPath);
+  git_repository *repo = lease.get();
+
+  const std::string key = repo_cache_key(opts.localPath);
+  const std::shared_ptr<IncrementalState> state = state_for(key);
+  IncrementalState &st = *state;
+
+  const char *wd = git_repository_workdir(repo);
+  if (!wd) throw GitException("Incremental status requires a work tree");
+  const std::string workdir(wd);
+
+  auto skip_ignored = [repo](const std::string &relDir) { return is_ignored_dir(repo, relDir); };
+
+  if (opts.watch && !st.watcher) {
+    // Watches must be in place before the baseline walk, or edits racing it would be lost.
+    st.watcher.reset(new WorkTreeWatcher(workdir));
+    st.watcher->watch_tree("", skip_ignored);
+    st.baselineValid = false;
+  } else if (!opts.watch && st.watcher) {
+    st.watcher.reset();
+  }
+
+  WorkTreeWatcher::Changes changes;
+  if (st.watcher) {
+    changes = st.watcher->drain();
+    for (const auto &dir : changes.newDirs) {
+      if (!skip_ignored(dir)) st.watcher->watch_tree(dir, skip_ignored);
+    }
+  }
+
+  git_oid head{};
+  const bool headValid = git_reference_name_to_id(&head, repo, "HEAD") == 0;
+  const PathStamp indexStamp = stamp_of(std::string(git_repository_path(repo)) + "index");
+
+  const bool needFull = !st.baselineValid || changes.overflow || headValid != st.headValid ||
+                        (headValid && !git_oid_equal(&head, &st.head)) || !(indexStamp == st.indexStamp);
+
+  // Paths outside a sparse checkout are never reported (see git_status()).
+  const std::vector<std::string> sparse = read_sparse_paths(repo);
+
+  if (needFull) {
+    st.entries.clear();
+    st.stamps.clear();
+    run_status(repo, sparse.empty() ? nullptr : &sparse, st.entries);
+    st.baselineValid = true;
+    st.outputStale = true;
+  } else {
+    std::set<std::string> candidates;
+    for (const auto &p : changes.paths) candidates.insert(normalize_rel(workdir, p));
+    for (const auto &p : opts.touchedPaths) candidates.insert(normalize_rel(workdir, p));
+    candidates.erase("");
+
+    std::vector<std::string> dirty;
+    for (const auto &rel : candidates) {
+      if (rel == ".git" || rel.compare(0, 5, ".git/") == 0) continue;
+      if (!sparse_contains(sparse, rel)) continue;
+      const PathStamp now = stamp_of(workdir + rel);
+      const bool isDir = now.exists && S_ISDIR(now.mode);
+      auto it = st.stamps.find(rel);
+      // Directory mtimes don't reflect edits deeper down, so only files can be short-circuited.
+      if (!isDir && it != st.stamps.end() && it->second == now) continue;
+      if (isDir) st.stamps.erase(rel);
+      else st.stamps[rel] = now;
+      dirty.push_back(rel);
+    }
+
+    if (!dirty.empty()) {
+      for (const auto &rel : dirty) erase_subtree(st.entries, rel);
+      run_status(repo, &dirty, st.entries);
+      st.outputStale = true;
+    }
+  }
+
+  st.head = head;
+  st.headValid = headValid;
+  st.indexStamp = indexStamp;
+
+  trace_count("full", needFull ? 1 : 0);
+  trace_phase("classify");
+  if (st.outputStale) rebuild_output(repo, st);
+  return st.output;
+}
+
+void git_status_incremental_reset(const std::string &localPath) {
+  forget_incremental_status(localPath);
+}
+
+void forget_incremental_status(const std::string &localPath) {
+  std::shared_ptr<IncrementalState> dropped;
+  {
+    std::lock_guard<std::mutex> g(g_states_mu);
+    auto it = g_states.find(repo_cache_key(localPath));
+    if (it == g_states.end()) return;
+    dropped = std::move(it->second);
+    g_states.erase(it);
+  }
+  // The watcher thread is joined here, outside the registry lock.
+}
@@ -0,0 +1,189 @@
+#include "git_ops.h"
+
+#include "git_internal.h"
+#include "repo_cache.h"
+#include "scheduler.h"
+#include "trace.h"
+
+#include <git2.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Status for the workspace list: one small summary per repository instead of full path lists, so
+// the list can show a dirty badge and ahead/behind for every workspace without a bridge call each.
+
+namespace {
+// Returned by the status callback to end the walk; libgit2 passes it back from the foreach.
+constexpr int kStopScan = 1;
+
+struct CountPayload {
+  GitRepoStatusSummary *out;
+  bool stopAtFirst;
+};
+
+int count_entry(const char * /*path*/, unsigned int flags, void *payload) {
+  auto *p = static_cast<CountPayload *>(payload);
+  bool changed = false;
+  if (flags & (GIT_STATUS_INDEX_NEW | GIT_STATUS_INDEX_MODIFIED | GIT_STATUS_INDEX_DELETED |
+               GIT_STATUS_INDEX_RENAMED | GIT_STATUS_INDEX_TYPECHANGE)) {
+    p->out->staged++;
+    changed = true;
+  }
+  if (flags & (GIT_STATUS_WT_MODIFIED | GIT_STATUS_WT_DELETED | GIT_STATUS_WT_RENAMED |
+               GIT_STATUS_WT_TYPECHANGE)) {
+    p->out->unstaged++;
+    changed = true;
+  }
+  if (flags & GIT_STATUS_WT_NEW) {
+    p->out->untracked++;
+    changed = true;
+  }
+  if (!changed) return 0;
+  p->out->dirty = true;
+  return p->stopAtFirst ? kStopScan : 0;
+}
+
+void count_changes(git_repository *repo, bool summaryOnly, GitRepoStatusSummary &out) {
+  git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+  opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+  opts.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED;
+  // Full counts match git_status(); an early stop has no use for rename pairing.
+  if (!summaryOnly) opts.flags |= GIT_STATUS_OPT_RENAMES_HEAD_TO_INDEX;
+
+  const std::vector<std::string> sparse = read_sparse_paths(repo);
+  std::vector<const char *> sparseStorage;
+  if (!sparse.empty()) {
+    opts.flags |= GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+    opts.pathspec = as_strarray(sparse, sparseStorage);
+  }
+
+  CountPayload payload{&out, summaryOnly};
+  const int rc = git_status_foreach_ext(repo, &opts, count_entry, &payload);
+  if (rc != 0 && rc != kStopScan) throw GitException(last_error_message(rc));
+}
+
+// Branch and ahead/behind are decoration: a detached HEAD, a branch without upstream or an
+// upstream whose commits are missing locally just leave them unset.
+void read_tracking(git_repository *repo, GitRepoStatusSummary &out) {
+  if (git_repository_head_unborn(repo) == 1) return;
+  git_reference *head = nullptr;
+  if (git_repository_head(&head, repo) != 0) return;
+  if (git_reference_is_branch(head) == 1) {
+    const char *name = git_reference_shorthand(head);
+    if (name) out.branch = name;
+
+    git_reference *upstream = nullptr;
+    const git_oid *local = git_reference_target(head);
+    if (local && git_branch_upstream(&upstream, head) == 0) {
+      const git_oid *remote = git_reference_target(upstream);
+      size_t ahead = 0, behind = 0;
+      if (remote && git_graph_ahead_behind(&ahead, &behind, repo, local, remote) == 0) {
+        out.hasUpstream = true;
+        out.ahead = static_cast<uint32_t>(ahead);
+        out.behind = static_cast<uint32_t>(behind);
+      }
+      git_reference_free(upstream);
+    }
+  }
+  git_reference_free(head);
+}
+
+struct StatusManyBatch {
+  std::mutex mu;
+  std::vector<GitRepoStatusSummary> results;
+  size_t pending = 0;
+  GitStatusManyCallback done;
+
+  void settle(size_t index, GitRepoStatusSummary result) {
+    {
+      std::lock_guard<std::mutex> g(mu);
+      results[index] = std::move(result);
+      if (--pending != 0) return;
+    }
+    // Last one in; no other job touches the batch any more.
+    done(std::move(results));
+  }
+};
+
+class StatusSummaryJob : public GitJob {
+ public:
+  StatusSummaryJob(std::shared_ptr<StatusManyBatch> batch, size_t index, std::string localPath, bool summaryOnly)
+      : batch_(std::move(batch)), index_(index), localPath_(std::move(localPath)), summaryOnly_(summaryOnly) {}
+
+  void run() override {
+    result_ = git_status_summary(localPath_, summaryOnly_);
+    settle(result_);
+  }
+
+  // The same repository listed twice (or asked for by two batches at once) is scanned once.
+  void complete_from(GitJob &primary) override {
+    GitRepoStatusSummary r = static_cast<StatusSummaryJob &>(primary).result_;
+    r.localPath = localPath_;
+    settle(std::move(r));
+  }
+
+  void fail(const char *message) override {
+    if (settled_) return;
+    GitRepoStatusSummary r;
+    r.localPath = localPath_;
+    r.error = message;
+    settle(std::move(r));
+  }
+
+ private:
+  void settle(GitRepoStatusSummary r) {
+    settled_ = true;
+    batch_->settle(index_, std::move(r));
+  }
+
+  std::shared_ptr<StatusManyBatch> batch_;
+  const size_t index_;
+  const std::string localPath_;
+  const bool summaryOnly_;
+  GitRepoStatusSummary result_;
+  bool settled_ = false;
+};
+}  // namespace
+
+GitRepoStatusSummary git_status_summary(const std::string &localPath, bool summaryOnly) {
+  GitRepoStatusSummary out;
+  out.localPath = localPath;
+  try {
+    TraceSpan span("statusSummary", localPath);
+    RepoLease lease = acquire_repo(localPath);
+    git_repository *repo = lease.get();
+    span.phase("walk");
+    count_changes(repo, summaryOnly, out);
+    span.phase("tracking");
+    read_tracking(repo, out);
+  } catch (const std::exception &e) {
+    GitRepoStatusSummary failed;
+    failed.localPath = localPath;
+    failed.error = e.what();
+    return failed;
+  }
+  return out;
+}
+
+void git_status_many(const GitStatusManyOptions &opts, GitStatusManyCallback done) {
+  if (opts.localPaths.empty()) {
+    done({});
+    return;
+  }
+
+  auto batch = std::make_shared<StatusManyBatch>();
+  batch->results.resize(opts.localPaths.size());
+  batch->pending = opts.localPaths.size();
+  batch->done = std::move(done);
+
+  const std::string coalesceKey = opts.summaryOnly ? "statusSummary:1" : "statusSummary:0";
+  for (size_t i = 0; i < opts.localPaths.size(); i++) {
+    const std::string &path = opts.localPaths[i];
+    schedule_git_job(repo_cache_key(path), coalesceKey, GitJobKind::Read,
+                     std::unique_ptr<GitJob>(new StatusSummaryJob(batch, i, path, opts.summaryOnly)));
+  }
+}
@@ -0,0 +1,632 @@
+#include "archive.h"
+#include "archive_internal.h"
+
+#include <openssl/evp.h>
+#include <zlib.h>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+constexpr size_t kInBytes = 256 * 1024;
+// Inflate output; file data is written from here directly, so this is also the write size.
+constexpr size_t kOutBytes = 1 << 20;
+constexpr size_t kBlock = 512;
+// GNU long names and pax headers beyond this are treated as corrupt rather than buffered.
+constexpr uint64_t kMaxMetaBytes = 1 << 20;
+
+void make_dirs(const std::string &path) {
+  for (size_t i = 1; i <= path.size(); i++) {
+    if (i < path.size() && path[i] != '/') continue;
+    const std::string cur = path.substr(0, i);
+    if (mkdir(cur.c_str(), 0755) != 0 && errno != EEXIST) fail_errno("mkdir " + cur);
+  }
+}
+
+// SHA-256 of a whole file, computed on its own thread with its own descriptor so it runs
+// alongside extraction (the pages it reads are the ones the extractor just pulled in).
+class ParallelSha256 {
+ public:
+  explicit ParallelSha256(const std::string &path) : thread_([this, path] { run(path); }) {}
+  ~ParallelSha256() {
+    stop_.store(true);
+    if (thread_.joinable()) thread_.join();
+  }
+  ParallelSha256(const ParallelSha256 &) = delete;
+  ParallelSha256 &operator=(const ParallelSha256 &) = delete;
+
+  // Lowercase hex digest; waits for the hashing thread.
+  std::string finish() {
+    thread_.join();
+    if (!error_.empty()) throw ArchiveError(error_);
+    return hex_;
+  }
+
+ private:
+  void run(const std::string &path) {
+    Fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd.get() < 0) {
+      error_ = "open " + path + ": " + std::strerror(errno);
+      return;
+    }
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (!ctx || EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) != 1) {
+      EVP_MD_CTX_free(ctx);
+      error_ = "sha256 unavailable";
+      return;
+    }
+    AlignedBuffer buf = aligned_buffer(kOutBytes);
+    while (!stop_.load(std::memory_order_relaxed)) {
+      const ssize_t n = read(fd.get(), buf.get(), kOutBytes);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) {
+        error_ = "read " + path + ": " + std::strerror(errno);
+        break;
+      }
+      if (n == 0) break;
+      EVP_DigestUpdate(ctx, buf.get(), static_cast<size_t>(n));
+    }
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    EVP_DigestFinal_ex(ctx, md, &len);
+    EVP_MD_CTX_free(ctx);
+    static const char kHex[] = "0123456789abcdef";
+    for (unsigned int i = 0; i < len; i++) {
+      hex_.push_back(kHex[md[i] >> 4]);
+      hex_.push_back(kHex[md[i] & 0xf]);
+    }
+  }
+
+  std::atomic<bool> stop_{false};
+  std::string hex_;
+  std::string error_;
+  std::thread thread_;  // Last, so it starts after the members it uses exist.
+};
+
+// Archive path -> components below the root; false if it would leave the root.
+bool split_entry_path(const std::string &raw, std::vector<std::string> &out) {
+  out.clear();
+  size_t pos = 0;
+  while (pos <= raw.size()) {
+    size_t end = raw.find_first_of("/\\", pos);
+    if (end == std::string::npos) end = raw.size();
+    const std::string part = raw.substr(pos, end - pos);
+    if (part == "..") return false;
+    if (!part.empty() && part != ".") out.push_back(part);
+    pos = end + 1;
+  }
+  return true;
+}
+
+// True if a relative symlink `target` placed in directory `dir` stays below the root, read
+// lexically. That is enough for targets without "..": every symlink they may cross was checked the
+// same way. Targets with ".." are checked again against the finished tree (resolves_inside()).
+bool link_stays_inside(const std::vector<std::string> &dir, const std::string &target) {
+  if (target.empty() || target[0] == '/') return false;
+  size_t depth = dir.size();
+  size_t pos = 0;
+  while (pos <= target.size()) {
+    size_t end = target.find('/', pos);
+    if (end == std::string::npos) end = target.size();
+    const std::string part = target.substr(pos, end - pos);
+    if (part == "..") {
+      if (depth == 0) return false;
+      depth--;
+    } else if (!part.empty() && part != ".") {
+      depth++;
+    }
+    pos = end + 1;
+  }
+  return true;
+}
+
+std::string join_path(const std::vector<std::string> &parts, size_t n) {
+  std::string out;
+  for (size_t i = 0; i < n; i++) {
+    if (i) out.push_back('/');
+    out += parts[i];
+  }
+  return out;
+}
+
+// Directories below the destination, opened component by component with O_NOFOLLOW so no entry
+// can be written through a symlink, whatever the archive (or an earlier entry) put there.
+class DestTree {
+ public:
+  explicit DestTree(const std::string &root) : root_(open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) {
+    if (root_.get() < 0) fail_errno("open " + root);
+  }
+
+  // Descriptor of the directory made of the first `n` components (created as needed), or -1 if
+  // one of them exists but is not a directory. Valid until the next call.
+  int dir(const std::vector<std::string> &parts, size_t n) {
+    if (n == 0) return root_.get();
+    std::string key = join_path(parts, n);
+    if (cached_.get() >= 0 && key == cachedKey_) return cached_.get();
+
+    Fd cur;
+    int base = root_.get();
+    for (size_t i = 0; i < n; i++) {
+      const char *name = parts[i].c_str();
+      if (mkdirat(base, name, 0755) != 0 && errno != EEXIST) fail_errno("mkdir " + join_path(parts, i + 1));
+      Fd next(openat(base, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+      if (next.get() < 0) return -1;
+      cur = std::move(next);
+      base = cur.get();
+    }
+    cached_ = std::move(cur);
+    cachedKey_ = std::move(key);
+    return cached_.get();
+  }
+
+  // True if the first `n` components exist and each is a directory, not a symlink. Creates nothing.
+  bool is_real_dir(const std::vector<std::string> &parts, size_t n) const {
+    Fd cur;
+    int base = root_.get();
+    for (size_t i = 0; i < n; i++) {
+      Fd next(openat(base, parts[i].c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+      if (next.get() < 0) return false;
+      cur = std::move(next);
+      base = cur.get();
+    }
+    return true;
+  }
+
+ private:
+  Fd root_;
+  Fd cached_;
+  std::string cachedKey_;
+};
+
+std::string tar_field(const uint8_t *p, size_t len) {
+  size_t n = 0;
+  while (n < len && p[n] != 0) n++;
+  return std::string(reinterpret_cast<const char *>(p), n);
+}
+
+// Octal, or GNU base-256 when the high bit of the first byte is set.
+uint64_t tar_number(const uint8_t *p, size_t len) {
+  uint64_t v = 0;
+  if (p[0] & 0x80) {
+    v = p[0] & 0x7f;
+    for (size_t i = 1; i < len; i++) v = (v << 8) | p[i];
+    return v;
+  }
+  size_t i = 0;
+  while (i < len && p[i] == ' ') i++;
+  for (; i < len && p[i] >= '0' && p[i] <= '7'; i++) v = v * 8 + static_cast<uint64_t>(p[i] - '0');
+  return v;
+}
+
+bool checksum_ok(const uint8_t *h) {
+  const uint64_t stored = tar_number(h + 148, 8);
+  uint64_t unsignedSum = 0;
+  int64_t signedSum = 0;
+  for (size_t i = 0; i < kBlock; i++) {
+    const uint8_t b = i >= 148 && i < 156 ? ' ' : h[i];
+    unsignedSum += b;
+    signedSum += static_cast<int8_t>(b);
+  }
+  return stored == unsignedSum || static_cast<int64_t>(stored) == signedSum;
+}
+
+class TarExtractor {
+ public:
+  TarExtractor(DestTree &tree, TarExtractStats &stats) : tree_(tree), stats_(stats) {}
+
+  // Consumes inflated bytes; returns false once the end-of-archive block has been read.
+  bool feed(const uint8_t *p, size_t n) {
+    while (n > 0 && !done_) {
+      size_t take = 0;
+      switch (state_) {
+        case State::Header:
+          take = std::min(kBlock - headerFill_, n);
+          memcpy(header_ + headerFill_, p, take);
+          headerFill_ += take;
+          if (headerFill_ == kBlock) {
+            headerFill_ = 0;
+            on_header();
+          }
+          break;
+        case State::Data:
+          take = static_cast<size_t>(std::min<uint64_t>(remaining_, n));
+          write_all(file_.get(), p, take, path_);
+          stats_.bytes += take;
+          remaining_ -= take;
+          if (remaining_ == 0) {
+            file_.reset();
+            stats_.files++;
+            skip_padding();
+          }
+          break;
+        case State::Meta:
+          take = static_cast<size_t>(std::min<uint64_t>(remaining_, n));
+          meta_.append(reinterpret_cast<const char *>(p), take);
+          remaining_ -= take;
+          if (remaining_ == 0) {
+            apply_meta();
+            skip_padding();
+          }
+          break;
+        case State::Skip:
+          take = static_cast<size_t>(std::min<uint64_t>(remaining_, n));
+          remaining_ -= take;
+          if (remaining_ == 0) state_ = State::Header;
+          break;
+      }
+      p += take;
+      n -= take;
+    }
+    return !done_;
+  }
+
+  // The archive stream ended; fine between entries (some writers omit the end blocks). Creates the
+  // symlinks that were held back until the tree is complete.
+  void finish() {
+    const bool complete = done_ || (state_ == State::Header && headerFill_ == 0) ||
+                          (state_ == State::Skip && remaining_ == 0);
+    if (!complete) {
+      throw ArchiveError(state_ == State::Header ? "invalid tar header: truncated" : "invalid tar entry: truncated");
+    }
+    make_pending_links();
+  }
+
+ private:
+  enum class State { Header, Data, Meta, Skip };
+
+  void skip(uint64_t bytes) {
+    remaining_ = bytes;
+    state_ = bytes ? State::Skip : State::Header;
+  }
+
+  void skip_padding() { skip(padding_); }
+
+  void on_header() {
+    if (std::all_of(header_, header_ + kBlock, [](uint8_t b) { return b == 0; })) {
+      done_ = true;
+      return;
+    }
+    if (!checksum_ok(header_)) throw ArchiveError("invalid tar header: checksum");
+
+    const char type = static_cast<char>(header_[156]);
+    const bool extension = type == 'L' || type == 'K' || type == 'x';
+    const uint64_t size = hasNextSize_ && !extension ? nextSize_ : tar_number(header_ + 124, 12);
+    padding_ = (kBlock - size % kBlock) % kBlock;
+
+    // Extension headers describe the entry that follows them.
+    if (extension) {
+      if (size > kMaxMetaBytes) throw ArchiveError("invalid tar header: oversized extension");
+      metaType_ = type;
+      meta_.clear();
+      remaining_ = size;
+      state_ = size ? State::Meta : State::Header;
+      if (!size) apply_meta();
+      return;
+    }
+
+    std::string name = nextPath_;
+    if (name.empty()) {
+      name = tar_field(header_, 100);
+      // POSIX ustar splits long names into prefix + name; GNU tar uses those bytes for other things.
+      const std::string prefix = memcmp(header_ + 257, "ustar\0", 6) == 0 ? tar_field(header_ + 345, 155) : "";
+      if (!prefix.empty()) name = prefix + "/" + name;
+    }
+    const std::string link = !nextLink_.empty() ? nextLink_ : tar_field(header_ + 157, 100);
+    const uint64_t mode = tar_number(header_ + 100, 8);
+    nextPath_.clear();
+    nextLink_.clear();
+    hasNextSize_ = false;
+
+    std::vector<std::string> parts;
+    const bool inside = split_entry_path(name, parts);
+    const bool isDir = type == '5' || (!name.empty() && (name.back() == '/' || name.back() == '\\'));
+    if (!inside || parts.empty()) {
+      skip(size + padding_);
+      return;
+    }
+    path_ = join_path(parts, parts.size());
+    // A later entry for the same path wins, as it would have had the link been made right away.
+    pendingLinks_.erase(path_);
+
+    if (isDir) {
+      if (tree_.dir(parts, parts.size()) >= 0) stats_.directories++;
+      skip(size + padding_);
+    } else if (type == '0' || type == '\0' || type == '7') {
+      begin_file(parts, mode, size);
+    } else if (type == '2') {
+      make_symlink(parts, link);
+      skip(size + padding_);
+    } else if (type == '1') {
+      make_hardlink(parts, link);
+      skip(size + padding_);
+    } else {
+      // Devices, FIFOs, sparse files and unknown types have no place in a runtime install.
+      skip(size + padding_);
+    }
+  }
+
+  void begin_file(const std::vector<std::string> &parts, uint64_t mode, uint64_t size) {
+    const int dir = tree_.dir(parts, parts.size() - 1);
+    if (dir < 0) {
+      skip(size + padding_);
+      return;
+    }
+    const char *leaf = parts.back().c_str();
+    const mode_t perm = (mode & 0111) ? 0755 : 0644;
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC;
+    Fd fd(openat(dir, leaf, flags, perm));
+    if (fd.get() < 0 && (errno == ELOOP || errno == EISDIR)) {
+      // Replace a symlink or directory left by an earlier entry (or an earlier install).
+      unlinkat(dir, leaf, errno == EISDIR ? AT_REMOVEDIR : 0);
+      fd = Fd(openat(dir, leaf, flags, perm));
+    }
+    if (fd.get() < 0) fail_errno("create " + path_);
+    fchmod(fd.get(), perm);
+    // Best effort: one extent instead of growing the file chunk by chunk.
+    if (size > 0) (void)fallocate(fd.get(), 0, 0, static_cast<off_t>(size));
+
+    if (size == 0) {
+      stats_.files++;
+      skip_padding();
+      return;
+    }
+    file_ = std::move(fd);
+    remaining_ = size;
+    state_ = State::Data;
+  }
+
+  // Links with ".." are made once every entry is written: whether ".." climbs out depends on what
+  // the components before it turn out to be (`s -> .` then `e -> s/..` passes the lexical check
+  // but resolves to the parent of the root).
+  void make_symlink(const std::vector<std::string> &parts, const std::string &target) {
+    const std::vector<std::string> parent(parts.begin(), parts.end() - 1);
+    if (!link_stays_inside(parent, target)) return;
+    std::vector<std::string> scratch;
+    if (!split_entry_path(target, scratch)) {
+      pendingLinks_[path_] = PendingLink{parts, target};
+      return;
+    }
+    create_symlink(parts, target, path_);
+  }
+
+  void create_symlink(const std::vector<std::string> &parts, const std::string &target, const std::string &path) {
+    const int dir = tree_.dir(parts, parts.size() - 1);
+    if (dir < 0) return;
+    const char *leaf = parts.back().c_str();
+    if (symlinkat(target.c_str(), dir, leaf) != 0) {
+      if (errno != EEXIST) fail_errno("symlink " + path);
+      // A directory entry below the link's path was written in the meantime; it stays.
+      if (unlinkat(dir, leaf, 0) != 0 && errno == EISDIR) return;
+      if (symlinkat(target.c_str(), dir, leaf) != 0) fail_errno("symlink " + path);
+    }
+    stats_.links++;
+  }
+
+  // True if a link in `dir` to `target` stays below the root in the finished tree: each component
+  // a ".." later climbs back out of must be a real directory, so ".." means its parent.
+  bool resolves_inside(std::vector<std::string> dir, const std::string &target) const {
+    std::vector<std::string> comps;
+    size_t pos = 0;
+    while (pos <= target.size()) {
+      size_t end = target.find('/', pos);
+      if (end == std::string::npos) end = target.size();
+      comps.push_back(target.substr(pos, end - pos));
+      pos = end + 1;
+    }
+    size_t lastUp = 0;
+    for (size_t i = 0; i < comps.size(); i++) {
+      if (comps[i] == "..") lastUp = i;
+    }
+    for (size_t i = 0; i < comps.size(); i++) {
+      const std::string &c = comps[i];
+      if (c.empty() || c == ".") continue;
+      if (c == "..") {
+        if (dir.empty()) return false;
+        dir.pop_back();
+        continue;
+      }
+      dir.push_back(c);
+      if (i < lastUp && !tree_.is_real_dir(dir, dir.size())) return false;
+    }
+    return true;
+  }
+
+  void make_pending_links() {
+    for (const auto &e : pendingLinks_) {
+      const std::vector<std::string> parent(e.second.parts.begin(), e.second.parts.end() - 1);
+      if (resolves_inside(parent, e.second.target)) create_symlink(e.second.parts, e.second.target, e.first);
+    }
+    pendingLinks_.clear();
+  }
+
+  void make_hardlink(const std::vector<std::string> &parts, const std::string &target) {
+    std::vector<std::string> targetParts;
+    if (!split_entry_path(target, targetParts) || targetParts.empty()) return;
+    // A hard link to a held-back symlink is another copy of that symlink.
+    auto pending = pendingLinks_.find(join_path(targetParts, targetParts.size()));
+    if (pending != pendingLinks_.end()) {
+      const std::string linkTarget = pending->second.target;
+      make_symlink(parts, linkTarget);
+      return;
+    }
+    const int srcDir = tree_.dir(targetParts, targetParts.size() - 1);
+    if (srcDir < 0) return;
+    // dir() reuses its descriptor, so keep our own copy of the source directory.
+    Fd src(fcntl(srcDir, F_DUPFD_CLOEXEC, 0));
+    if (src.get() < 0) fail_errno("link " + path_);
+    const int dir = tree_.dir(parts, parts.size() - 1);
+    if (dir < 0) return;
+    const char *from = targetParts.back().c_str();
+    const char *leaf = parts.back().c_str();
+    if (linkat(src.get(), from, dir, leaf, 0) != 0) {
+      if (errno != EEXIST || unlinkat(dir, leaf, 0) != 0 || linkat(src.get(), from, dir, leaf, 0) != 0) {
+        fail_errno("link " + path_);
+      }
+    }
+    stats_.links++;
+  }
+
+  void apply_meta() {
+    if (metaType_ == 'L' || metaType_ == 'K') {
+      const std::string value = meta_.substr(0, meta_.find('\0'));
+      (metaType_ == 'L' ? nextPath_ : nextLink_) = value;
+      return;
+    }
+    // pax records: "<len> <key>=<value>\n", where <len> counts the whole record.
+    size_t pos = 0;
+    while (pos < meta_.size()) {
+      size_t len = 0;
+      size_t i = pos;
+      while (i < meta_.size() && std::isdigit(static_cast<unsigned char>(meta_[i]))) len = len * 10 + (meta_[i++] - '0');
+      if (i >= meta_.size() || meta_[i] != ' ' || len == 0 || pos + len > meta_.size()) break;
+      const std::string record = meta_.substr(i + 1, pos + len - (i + 1) - 1);
+      const size_t eq = record.find('=');
+      if (eq != std::string::npos) {
+        const std::string key = record.substr(0, eq);
+        const std::string value = record.substr(eq + 1);
+        if (key == "path") {
+          nextPath_ = value;
+        } else if (key == "linkpath") {
+          nextLink_ = value;
+        } else if (key == "size") {
+          nextSize_ = std::strtoull(value.c_str(), nullptr, 10);
+          hasNextSize_ = true;
+        }
+      }
+      pos += len;
+    }
+  }
+
+  struct PendingLink {
+    std::vector<std::string> parts;
+    std::string target;
+  };
+
+  DestTree &tree_;
+  TarExtractStats &stats_;
+  State state_ = State::Header;
+  uint8_t header_[kBlock];
+  size_t headerFill_ = 0;
+  uint64_t remaining_ = 0;
+  uint64_t padding_ = 0;
+  bool done_ = false;
+
+  Fd file_;
+  std::string path_;
+
+  char metaType_ = 0;
+  std::string meta_;
+  std::string nextPath_;
+  std::string nextLink_;
+  bool hasNextSize_ = false;
+  uint64_t nextSize_ = 0;
+  // By path; made in finish().
+  std::map<std::string, PendingLink> pendingLinks_;
+};
+}  // namespace
+
+void fail_errno(const std::string &what) {
+  throw ArchiveError(what + ": " + std::strerror(errno));
+}
+
+AlignedBuffer aligned_buffer(size_t size) {
+  void *p = nullptr;
+  if (posix_memalign(&p, 4096, size) != 0) throw ArchiveError("out of memory");
+  return AlignedBuffer(static_cast<uint8_t *>(p));
+}
+
+void write_all(int fd, const uint8_t *p, size_t n, const std::string &path) {
+  bool socket = true;
+  while (n > 0) {
+    ssize_t w = socket ? send(fd, p, n, MSG_NOSIGNAL) : write(fd, p, n);
+    if (w < 0 && errno == ENOTSOCK) {
+      socket = false;
+      continue;
+    }
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      fail_errno("write " + path);
+    }
+    p += w;
+    n -= static_cast<size_t>(w);
+  }
+}
+
+TarExtractStats tar_gz_extract(const TarExtractOptions &opts) {
+  Fd owned;
+  int in = opts.fd;
+  const std::string source = in >= 0 ? std::string("archive stream") : opts.archivePath;
+  if (in < 0) {
+    owned = Fd(open(opts.archivePath.c_str(), O_RDONLY | O_CLOEXEC));
+    if (owned.get() < 0) fail_errno("open " + opts.archivePath);
+    in = owned.get();
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+  } else if (!opts.sha256.empty()) {
+    throw ArchiveError("sha256 can only be checked for an archive file");
+  }
+
+  make_dirs(opts.destDir);
+  DestTree tree(opts.destDir);
+
+  std::unique_ptr<ParallelSha256> hasher;
+  if (!opts.sha256.empty()) hasher.reset(new ParallelSha256(opts.archivePath));
+
+  TarExtractStats stats;
+  TarExtractor tar(tree, stats);
+  AlignedBuffer inBuf = aligned_buffer(kInBytes);
+  AlignedBuffer outBuf = aligned_buffer(kOutBytes);
+
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  // 15 + 32: any window size, gzip or zlib header detected automatically.
+  if (inflateInit2(&zs, 15 + 32) != Z_OK) throw ArchiveError("inflate init failed");
+  struct InflateGuard {
+    z_stream &zs;
+    ~InflateGuard() { inflateEnd(&zs); }
+  } guard{zs};
+
+  for (;;) {
+    if (zs.avail_in == 0) {
+      const ssize_t n = read(in, inBuf.get(), kInBytes);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) fail_errno("read " + source);
+      if (n == 0) break;
+      zs.next_in = inBuf.get();
+      zs.avail_in = static_cast<uInt>(n);
+    }
+    zs.next_out = outBuf.get();
+    zs.avail_out = static_cast<uInt>(kOutBytes);
+    const int rc = inflate(&zs, Z_NO_FLUSH);
+    if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+      throw ArchiveError(std::string("invalid gzip data: ") + (zs.msg ? zs.msg : std::to_string(rc)));
+    }
+    const size_t produced = kOutBytes - zs.avail_out;
+    if (produced > 0 && !tar.feed(outBuf.get(), produced)) break;
+    // Concatenated gzip members form one stream.
+    if (rc == Z_STREAM_END) inflateReset(&zs);
+  }
+  tar.finish();
+
+  if (hasher) {
+    std::string expected = opts.sha256;
+    std::transform(expected.begin(), expected.end(), expected.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    const std::string actual = hasher->finish();
+    if (actual != expected) throw ArchiveError("sha256 mismatch: expected " + expected + ", got " + actual);
+  }
+  return stats;
+}
@@ -0,0 +1,377 @@
+#include "archive.h"
+#include "archive_internal.h"
+
+#include <zlib.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+// Uncompressed bytes per gzip member. Larger chunks compress slightly better (each member starts
+// with an empty window); this keeps the loss well under 1% for source trees.
+constexpr size_t kChunkBytes = 1 << 20;
+constexpr size_t kReadBytes = 1 << 20;
+constexpr size_t kBlock = 512;
+
+struct Chunk {
+  std::vector<uint8_t> raw;
+  std::vector<uint8_t> out;
+  bool ready = false;
+  std::string error;
+};
+
+void deflate_chunk(Chunk &c, int level) {
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  // 15 + 16: gzip wrapper, so every chunk is a complete member.
+  if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    c.error = "deflate init failed";
+    return;
+  }
+  c.out.resize(deflateBound(&zs, static_cast<uLong>(c.raw.size())));
+  zs.next_in = c.raw.data();
+  zs.avail_in = static_cast<uInt>(c.raw.size());
+  zs.next_out = c.out.data();
+  zs.avail_out = static_cast<uInt>(c.out.size());
+  const int rc = deflate(&zs, Z_FINISH);
+  if (rc != Z_STREAM_END) c.error = std::string("deflate failed: ") + (zs.msg ? zs.msg : std::to_string(rc));
+  c.out.resize(zs.total_out);
+  deflateEnd(&zs);
+  std::vector<uint8_t>().swap(c.raw);
+}
+
+// Compresses chunks on worker threads and writes them to `fd` in submission order, on the calling
+// thread. At most two chunks per worker are in flight; write() blocks until the oldest is done.
+class ParallelGzip {
+ public:
+  ParallelGzip(int fd, int level, unsigned threads) : fd_(fd), level_(level), maxInFlight_(threads * 2) {
+    cur_.reset(new Chunk);
+    cur_->raw.reserve(kChunkBytes);
+    for (unsigned i = 0; i < threads; i++) threads_.emplace_back([this]() { work(); });
+  }
+
+  ~ParallelGzip() {
+    {
+      std::lock_guard<std::mutex> g(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &t : threads_) t.join();
+  }
+
+  ParallelGzip(const ParallelGzip &) = delete;
+  ParallelGzip &operator=(const ParallelGzip &) = delete;
+
+  void write(const uint8_t *p, size_t n) {
+    while (n > 0) {
+      const size_t take = std::min(n, kChunkBytes - cur_->raw.size());
+      cur_->raw.insert(cur_->raw.end(), p, p + take);
+      p += take;
+      n -= take;
+      if (cur_->raw.size() == kChunkBytes) submit();
+    }
+  }
+
+  // Flushes the last chunk and waits for everything to be written.
+  void finish() {
+    if (!cur_->raw.empty()) submit();
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!order_.empty()) write_front(lock);
+  }
+
+  uint64_t written() const { return written_; }
+
+ private:
+  void submit() {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (order_.size() >= maxInFlight_) write_front(lock);
+    jobs_.push_back(cur_.get());
+    order_.push_back(std::move(cur_));
+    cv_.notify_all();
+    lock.unlock();
+    cur_.reset(new Chunk);
+    cur_->raw.reserve(kChunkBytes);
+  }
+
+  // Waits for the oldest chunk and writes it; called and returns with `lock` held.
+  void write_front(std::unique_lock<std::mutex> &lock) {
+    cv_.wait(lock, [this]() { return order_.front()->ready; });
+    std::unique_ptr<Chunk> c = std::move(order_.front());
+    order_.pop_front();
+    lock.unlock();
+    if (!c->error.empty()) throw ArchiveError(c->error);
+    write_all(fd_, c->out.data(), c->out.size(), "archive stream");
+    written_ += c->out.size();
+    lock.lock();
+  }
+
+  void work() {
+    std::unique_lock<std::mutex> lock(mu_);
+    for (;;) {
+      cv_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+      if (stop_) return;
+      Chunk *c = jobs_.front();
+      jobs_.pop_front();
+      lock.unlock();
+      deflate_chunk(*c, level_);
+      lock.lock();
+      c->ready = true;
+      cv_.notify_all();
+    }
+  }
+
+  const int fd_;
+  const int level_;
+  const size_t maxInFlight_;
+  uint64_t written_ = 0;
+  std::unique_ptr<Chunk> cur_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<std::unique_ptr<Chunk>> order_;  // submitted, oldest first
+  std::deque<Chunk *> jobs_;  // not yet picked up by a worker
+  bool stop_ = false;
+  std::vector<std::thread> threads_;  // Last, so they start after the members they use exist.
+};
+
+// Octal in `len - 1` digits plus NUL, or GNU base-256 when the value does not fit.
+void put_number(uint8_t *p, size_t len, uint64_t v) {
+  const uint64_t octalMax = (len - 1) * 3 >= 64 ? UINT64_MAX : (uint64_t(1) << ((len - 1) * 3)) - 1;
+  if (v <= octalMax) {
+    p[len - 1] = 0;
+    for (size_t i = len - 1; i-- > 0;) {
+      p[i] = static_cast<uint8_t>('0' + (v & 7));
+      v >>= 3;
+    }
+    return;
+  }
+  for (size_t i = len; i-- > 1;) {
+    p[i] = static_cast<uint8_t>(v & 0xff);
+    v >>= 8;
+  }
+  p[0] = 0x80;
+}
+
+void put_string(uint8_t *p, size_t len, const std::string &s) {
+  memcpy(p, s.data(), std::min(len, s.size()));
+}
+
+class TarWriter {
+ public:
+  TarWriter(ParallelGzip &gz, TarPackStats &stats) : gz_(gz), stats_(stats) {}
+
+  void add_dir(const std::string &rel, const struct stat &st) {
+    header(rel + "/", '5', 0, 0755, st.st_mtime, "");
+    stats_.directories++;
+  }
+
+  void add_symlink(const std::string &rel, const std::string &target, const struct stat &st) {
+    header(rel, '2', 0, 0777, st.st_mtime, target);
+    stats_.links++;
+  }
+
+  // The declared size is the one from `st`; a file that shrinks meanwhile is padded with zeros and
+  // one that grows is cut, as tar does.
+  void add_file(const std::string &rel, int fd, const struct stat &st) {
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    header(rel, '0', size, (st.st_mode & 0111) ? 0755 : 0644, st.st_mtime, "");
+    uint64_t left = size;
+    while (left > 0) {
+      ssize_t n = read(fd, buf_.get(), static_cast<size_t>(std::min<uint64_t>(left, kReadBytes)));
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) fail_errno("read " + rel);
+      if (n == 0) {
+        n = static_cast<ssize_t>(std::min<uint64_t>(left, kReadBytes));
+        memset(buf_.get(), 0, static_cast<size_t>(n));
+      }
+      gz_.write(buf_.get(), static_cast<size_t>(n));
+      left -= static_cast<uint64_t>(n);
+    }
+    pad(size);
+    stats_.files++;
+    stats_.bytes += size;
+  }
+
+  // Two zero blocks end the archive.
+  void finish() {
+    static const uint8_t zeros[kBlock * 2] = {};
+    gz_.write(zeros, sizeof zeros);
+  }
+
+ private:
+  void header(const std::string &name, char type, uint64_t size, uint32_t mode, time_t mtime, const std::string &link) {
+    if (name.size() > 100) long_name('L', name);
+    if (link.size() > 100) long_name('K', link);
+    uint8_t h[kBlock] = {};
+    put_string(h, 100, name);
+    put_number(h + 100, 8, mode);
+    put_number(h + 108, 8, 0);
+    put_number(h + 116, 8, 0);
+    put_number(h + 124, 12, size);
+    put_number(h + 136, 12, mtime > 0 ? static_cast<uint64_t>(mtime) : 0);
+    h[156] = static_cast<uint8_t>(type);
+    put_string(h + 157, 100, link);
+    memcpy(h + 257, "ustar\0" "00", 8);
+    checksum(h);
+    gz_.write(h, kBlock);
+  }
+
+  void long_name(char type, const std::string &value) {
+    uint8_t h[kBlock] = {};
+    put_string(h, 100, "././@LongLink");
+    put_number(h + 100, 8, 0644);
+    put_number(h + 108, 8, 0);
+    put_number(h + 116, 8, 0);
+    put_number(h + 124, 12, value.size() + 1);
+    put_number(h + 136, 12, 0);
+    h[156] = static_cast<uint8_t>(type);
+    memcpy(h + 257, "ustar  ", 8);
+    checksum(h);
+    gz_.write(h, kBlock);
+    gz_.write(reinterpret_cast<const uint8_t *>(value.c_str()), value.size() + 1);
+    pad(value.size() + 1);
+  }
+
+  void pad(uint64_t size) {
+    static const uint8_t zeros[kBlock] = {};
+    const size_t n = static_cast<size_t>((kBlock - size % kBlock) % kBlock);
+    if (n) gz_.write(zeros, n);
+  }
+
+  static void checksum(uint8_t *h) {
+    memset(h + 148, ' ', 8);
+    uint32_t sum = 0;
+    for (size_t i = 0; i < kBlock; i++) sum += h[i];
+    put_number(h + 148, 7, sum);
+    h[155] = ' ';
+  }
+
+  ParallelGzip &gz_;
+  TarPackStats &stats_;
+  AlignedBuffer buf_ = aligned_buffer(kReadBytes);
+};
+
+// "a/./b" and "a//b" are tidied; paths that are absolute or climb out with ".." are rejected.
+bool clean_rel(const std::string &raw, std::string &out) {
+  out.clear();
+  if (raw.empty() || raw[0] == '/') return false;
+  size_t pos = 0;
+  while (pos <= raw.size()) {
+    size_t end = raw.find('/', pos);
+    if (end == std::string::npos) end = raw.size();
+    const std::string part = raw.substr(pos, end - pos);
+    if (part == "..") return false;
+    if (!part.empty() && part != ".") {
+      if (!out.empty()) out.push_back('/');
+      out += part;
+    }
+    pos = end + 1;
+  }
+  return !out.empty();
+}
+
+class Packer {
+ public:
+  Packer(const TarPackOptions &opts, TarWriter &tar) : root_(opts.rootDir), tar_(tar) {
+    if (root_.empty() || root_.back() != '/') root_ += '/';
+    exclude_.insert(opts.excludeNames.begin(), opts.excludeNames.end());
+  }
+
+  void add_path(const std::string &rel) {
+    struct stat st;
+    if (lstat((root_ + rel).c_str(), &st) != 0) return;  // deleted since it was listed
+    add_entry(rel, st, false);
+  }
+
+  // Sorted at each level, so the same tree always packs to the same archive.
+  void walk(const std::string &dirRel) {
+    DIR *d = opendir((root_ + dirRel).c_str());
+    if (!d) fail_errno("open " + root_ + dirRel);
+    std::vector<std::string> names;
+    while (dirent *e = readdir(d)) {
+      const char *name = e->d_name;
+      if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+      if (exclude_.count(name)) continue;
+      names.emplace_back(name);
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    for (const auto &name : names) {
+      const std::string rel = dirRel.empty() ? name : dirRel + "/" + name;
+      struct stat st;
+      if (lstat((root_ + rel).c_str(), &st) != 0) continue;
+      add_entry(rel, st, true);
+    }
+  }
+
+ private:
+  void add_entry(const std::string &rel, const struct stat &st, bool recurse) {
+    const std::string abs = root_ + rel;
+    if (S_ISDIR(st.st_mode)) {
+      tar_.add_dir(rel, st);
+      if (recurse) walk(rel);
+    } else if (S_ISLNK(st.st_mode)) {
+      std::string target(static_cast<size_t>(st.st_size > 0 ? st.st_size : 256), '\0');
+      const ssize_t n = readlink(abs.c_str(), &target[0], target.size());
+      if (n <= 0) return;
+      target.resize(static_cast<size_t>(n));
+      tar_.add_symlink(rel, target, st);
+    } else if (S_ISREG(st.st_mode)) {
+      Fd fd(open(abs.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
+      if (fd.get() < 0) {
+        if (errno == ENOENT) return;
+        fail_errno("open " + abs);
+      }
+      posix_fadvise(fd.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+      struct stat now;
+      if (fstat(fd.get(), &now) != 0) fail_errno("stat " + abs);
+      tar_.add_file(rel, fd.get(), now);
+    }
+  }
+
+  std::string root_;
+  std::unordered_set<std::string> exclude_;
+  TarWriter &tar_;
+};
+}  // namespace
+
+TarPackStats tar_gz_pack(const TarPackOptions &opts) {
+  if (opts.outFd < 0) throw ArchiveError("no output descriptor");
+  struct stat rootSt;
+  if (stat(opts.rootDir.c_str(), &rootSt) != 0 || !S_ISDIR(rootSt.st_mode)) {
+    throw ArchiveError("not a directory: " + opts.rootDir);
+  }
+  unsigned threads = opts.threads;
+  if (threads == 0) threads = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+
+  TarPackStats stats;
+  ParallelGzip gz(opts.outFd, std::max(1, std::min(9, opts.level)), threads);
+  TarWriter tar(gz, stats);
+  Packer packer(opts, tar);
+  if (opts.paths.empty()) {
+    packer.walk("");
+  } else {
+    std::string rel;
+    for (const auto &p : opts.paths) {
+      if (clean_rel(p, rel)) packer.add_path(rel);
+    }
+  }
+  tar.finish();
+  gz.finish();
+  stats.written = gz.written();
+  return stats;
+}
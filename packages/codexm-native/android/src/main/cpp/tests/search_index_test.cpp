@@ -0,0 +1,123 @@
+// Host test for the trigram index behind git_search(): an indexed search must return the same
+// files as a full scan. The index may only narrow the scan to files that can match, so any pattern
+// whose required literals are extracted wrongly shows up here as missing files.
+//
+//   ctest --test-dir build-host -R search_index
+
+#include "git_internal.h"
+#include "git_ops.h"
+
+#include <git2.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+struct File {
+  const char *path;
+  const char *content;
+};
+
+// Each quantified pattern has a file that matches it without containing the quantifier's text,
+// and a decoy that contains the text but does not match.
+const File kFiles[] = {
+    {"x3.txt", "xxxyz\n"},
+    {"x3-decoy.txt", "x3}yz\n"},
+    {"bracket.txt", "bacd\n"},
+    {"bracket-decoy.txt", "2}cd\n"},
+    {"group.txt", "ababcd\n"},
+    {"range.txt", "abbbcdef\n"},
+    {"range-decoy.txt", "b{2,3}cdef\n"},
+    {"escaped.txt", "fn{body}\n"},
+    {"dir/nested.txt", "prefix quuux suffix\n"},
+    {"class.txt", "foo bar\n"},
+    {"class-decoy.txt", "foo]bar\n"},
+};
+
+const char *const kPatterns[] = {
+    "x{3}yz", "[ab]{2}cd", "(ab){2}cd", "ab{2,3}cdef", "qu{3}x", "fn\\{body\\}", "u{2,}x suffix",
+    "foo[[:space:]]bar",
+};
+
+[[noreturn]] void die(const std::string &msg) {
+  std::fprintf(stderr, "search_index_test: %s\n", msg.c_str());
+  std::exit(1);
+}
+
+void write_file(const std::string &path, const char *content) {
+  const size_t slash = path.rfind('/');
+  if (slash != std::string::npos) mkdir(path.substr(0, slash).c_str(), 0755);
+  std::ofstream out(path, std::ios::trunc);
+  out << content;
+  if (!out) die("cannot write " + path);
+}
+
+std::set<std::string> search(const std::string &dir, const std::string &pattern, bool useIndex) {
+  GitSearchOptions opts;
+  opts.localPath = dir;
+  opts.pattern = pattern;
+  opts.regex = true;
+  opts.useIndex = useIndex;
+  std::set<std::string> paths;
+  git_search(opts, [&](const std::vector<GitSearchMatch> &batch) {
+    for (const auto &m : batch) paths.insert(m.path);
+    return true;
+  });
+  return paths;
+}
+}  // namespace
+
+int main() {
+  char tmpl[] = "/tmp/codexm-search-index-XXXXXX";
+  if (!mkdtemp(tmpl)) die("mkdtemp failed");
+  const std::string dir = tmpl;
+
+  ensure_libgit2();
+  git_repository *repo = nullptr;
+  if (git_repository_init(&repo, dir.c_str(), 0) != 0) die("init: " + last_error_message(-1));
+  git_repository_free(repo);
+  for (const auto &f : kFiles) write_file(dir + "/" + f.path, f.content);
+
+  GitCommitOptions commit;
+  commit.localPath = dir;
+  commit.message = "files";
+  git_commit_paths(commit);
+  // An untracked file goes through the work-tree side of the manifest.
+  write_file(dir + "/untracked.txt", "zzxxxyz\n");
+
+  int failures = 0;
+  for (const char *pattern : kPatterns) {
+    const std::set<std::string> scanned = search(dir, pattern, false);
+    const std::set<std::string> indexed = search(dir, pattern, true);
+    if (scanned.empty()) {
+      std::fprintf(stderr, "%s: full scan found nothing (bad fixture)\n", pattern);
+      failures++;
+    }
+    for (const auto &p : scanned) {
+      if (!indexed.count(p)) {
+        std::fprintf(stderr, "%s: indexed search missed %s\n", pattern, p.c_str());
+        failures++;
+      }
+    }
+    for (const auto &p : indexed) {
+      if (!scanned.count(p)) {
+        std::fprintf(stderr, "%s: indexed search returned extra %s\n", pattern, p.c_str());
+        failures++;
+      }
+    }
+  }
+
+  git_search_index_drop(dir);
+  const std::string rm = "rm -rf '" + dir + "'";
+  if (std::system(rm.c_str()) != 0) std::fprintf(stderr, "could not remove %s\n", dir.c_str());
+  if (failures) die(std::to_string(failures) + " mismatch(es)");
+  std::puts("search_index_test: ok");
+  return 0;
+}
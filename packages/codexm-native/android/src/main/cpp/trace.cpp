@@ -0,0 +1,180 @@
+#include "trace.h"
+
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+
+#ifdef __ANDROID__
+#include <android/trace.h>
+#endif
+
+namespace {
+constexpr size_t kMaxRecords = 512;
+
+std::atomic<bool> g_recording{false};
+std::mutex g_records_mu;
+std::deque<std::string> g_records;
+
+thread_local TraceSpan *t_current = nullptr;
+
+bool atrace_enabled() {
+#ifdef __ANDROID__
+  return ATrace_isEnabled();
+#else
+  return false;
+#endif
+}
+
+void atrace_begin(const char *name) {
+#ifdef __ANDROID__
+  ATrace_beginSection(name);
+#else
+  (void)name;
+#endif
+}
+
+void atrace_end() {
+#ifdef __ANDROID__
+  ATrace_endSection();
+#endif
+}
+
+void append_json_string(std::string &out, const std::string &s) {
+  out += '"';
+  for (const unsigned char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += static_cast<char>(c);
+    } else if (c < 0x20) {
+      char buf[8];
+      std::snprintf(buf, sizeof buf, "\\u%04x", c);
+      out += buf;
+    } else {
+      out += static_cast<char>(c);
+    }
+  }
+  out += '"';
+}
+
+void append_ms(std::string &out, double ms) {
+  char buf[32];
+  std::snprintf(buf, sizeof buf, "%.3f", ms);
+  out += buf;
+}
+}  // namespace
+
+TraceSpan::TraceSpan(const char *op, const std::string &repo)
+    : record_(g_recording.load(std::memory_order_relaxed)), atrace_(atrace_enabled()) {
+  if (!record_ && !atrace_) return;
+  op_ = op;
+  parent_ = t_current;
+  t_current = this;
+  uncaught_ = std::uncaught_exceptions();
+  start_ = phaseStart_ = Clock::now();
+  if (record_) {
+    repo_ = repo;
+    startUnixMs_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+  }
+  if (atrace_) atrace_begin(op);
+}
+
+TraceSpan::~TraceSpan() {
+  if (!record_ && !atrace_) return;
+  const Clock::time_point now = Clock::now();
+  end_phase(now);
+  if (atrace_) atrace_end();
+  t_current = parent_;
+  if (!record_) return;
+
+  std::string line = "{\"op\":";
+  append_json_string(line, op_);
+  line += ",\"repo\":";
+  append_json_string(line, repo_);
+  line += ",\"ts\":" + std::to_string(startUnixMs_) + ",\"ms\":";
+  append_ms(line, std::chrono::duration<double, std::milli>(now - start_).count());
+  line += ",\"ok\":";
+  line += std::uncaught_exceptions() > uncaught_ ? "false" : "true";
+  line += ",\"phases\":{";
+  for (size_t i = 0; i < phases_.size(); i++) {
+    if (i) line += ',';
+    append_json_string(line, phases_[i].first);
+    line += ':';
+    append_ms(line, phases_[i].second);
+  }
+  line += "},\"counts\":{";
+  for (size_t i = 0; i < counts_.size(); i++) {
+    if (i) line += ',';
+    append_json_string(line, counts_[i].first);
+    line += ':' + std::to_string(counts_[i].second);
+  }
+  line += "}}";
+
+  std::lock_guard<std::mutex> g(g_records_mu);
+  g_records.push_back(std::move(line));
+  while (g_records.size() > kMaxRecords) g_records.pop_front();
+}
+
+TraceSpan *TraceSpan::current() {
+  return t_current;
+}
+
+void TraceSpan::end_phase(Clock::time_point now) {
+  if (!phase_) return;
+  if (atrace_) atrace_end();
+  const double ms = std::chrono::duration<double, std::milli>(now - phaseStart_).count();
+  // A phase entered more than once (e.g. "open" for two repositories) accumulates.
+  for (auto &p : phases_) {
+    if (std::strcmp(p.first, phase_) == 0) {
+      p.second += ms;
+      phase_ = nullptr;
+      return;
+    }
+  }
+  phases_.emplace_back(phase_, ms);
+  phase_ = nullptr;
+}
+
+void TraceSpan::phase(const char *name) {
+  if (phase_ && std::strcmp(phase_, name) == 0) return;
+  const Clock::time_point now = Clock::now();
+  end_phase(now);
+  phase_ = name;
+  phaseStart_ = now;
+  if (atrace_) atrace_begin(name);
+}
+
+void TraceSpan::count(const char *key, int64_t value) {
+  if (!record_) return;
+  for (auto &c : counts_) {
+    if (std::strcmp(c.first, key) == 0) {
+      c.second = value;
+      return;
+    }
+  }
+  counts_.emplace_back(key, value);
+}
+
+void git_trace_set_enabled(bool enabled) {
+  g_recording.store(enabled, std::memory_order_relaxed);
+  if (enabled) return;
+  std::lock_guard<std::mutex> g(g_records_mu);
+  g_records.clear();
+}
+
+std::string git_trace_drain() {
+  std::deque<std::string> records;
+  {
+    std::lock_guard<std::mutex> g(g_records_mu);
+    records.swap(g_records);
+  }
+  std::string out;
+  for (const auto &r : records) {
+    out += r;
+    out += '\n';
+  }
+  return out;
+}
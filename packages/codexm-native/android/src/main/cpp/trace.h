@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Span timing for native git calls. A span covers one entry point (usually opened in the JNI
+// wrapper, so argument/result marshaling is included) and is split into named phases; code below
+// it adds phases and counters to the innermost span on the current thread without being handed
+// anything, e.g. `trace_phase("open")` in acquire_repo().
+//
+// Spans are emitted as Android ATrace sections while systrace/Perfetto is capturing, and recorded
+// as JSON lines (drained by git_trace_drain()) while recording is enabled. With both off a span is
+// a relaxed atomic load and an ATrace_isEnabled() call; phases and counters are a thread-local
+// null check.
+
+class TraceSpan {
+ public:
+  TraceSpan(const char *op, const std::string &repo);
+  ~TraceSpan();
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+
+  // Ends the current phase and starts `name` (no-op if it is already the current phase). Names and
+  // counter keys are kept by pointer: pass string literals.
+  void phase(const char *name);
+  // Sets (not adds) a counter; the last value wins.
+  void count(const char *key, int64_t value);
+
+  // Innermost active span on this thread, or nullptr.
+  static TraceSpan *current();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  void end_phase(Clock::time_point now);
+
+  bool record_ = false;
+  bool atrace_ = false;
+  const char *op_ = nullptr;
+  std::string repo_;
+  TraceSpan *parent_ = nullptr;
+  int uncaught_ = 0;
+  int64_t startUnixMs_ = 0;
+  Clock::time_point start_;
+  const char *phase_ = nullptr;
+  Clock::time_point phaseStart_;
+  std::vector<std::pair<const char *, double>> phases_;  // name, ms
+  std::vector<std::pair<const char *, int64_t>> counts_;
+};
+
+inline void trace_phase(const char *name) {
+  if (TraceSpan *s = TraceSpan::current()) s->phase(name);
+}
+
+inline void trace_count(const char *key, int64_t value) {
+  if (TraceSpan *s = TraceSpan::current()) s->count(key, value);
+}
+
+// Recording of JSON records (ATrace does not depend on this). Off by default.
+void git_trace_set_enabled(bool enabled);
+// Completed spans since the last drain, one JSON object per line, oldest first. At most the last
+// 512 are kept.
+std::string git_trace_drain();
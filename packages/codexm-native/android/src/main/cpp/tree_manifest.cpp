@@ -0,0 +1,380 @@
+#include "git_internal.h"
+#include "git_ops.h"
+#include "operation.h"
+#include "repo_cache.h"
+#include "trace.h"
+
+#include <git2.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Content manifest for WebDAV delta sync: path -> git blob id of every file in a tree, plus the
+// stat data git uses to trust a cached id (size, mtime, inode).
+//
+// Ids come from the first of: the git index entry for the path, the manifest of the last sync, or
+// hashing the file. A cached id is used only when size, mtime and inode match and the file's mtime
+// is older than the cache itself (the index file or the manifest), which is git's racy-timestamp
+// rule: a file written in the same instant as the cache could have changed without moving its
+// mtime. Index ids are of the filtered (clean) content while hashed ids are of the raw bytes; the
+// two only differ in repositories with eol or filter attributes, where the first sync after a
+// switch between the sources reports such files as modified.
+//
+// libgit2 is only touched on the calling thread (reading the index). The walk and the hashing run
+// on worker threads; git_odb_hashfile() uses no repository state.
+
+namespace {
+constexpr char kManifestMagic[] = "codexm-tree-manifest";
+constexpr uint32_t kVersion = 1;
+constexpr const char *kNextSuffix = ".next";
+constexpr size_t kOidBytes = 20;
+
+struct StatKey {
+  uint64_t size = 0;
+  int64_t mtimeNs = 0;
+  uint64_t ino = 0;
+};
+
+struct CachedOid {
+  StatKey stat;
+  git_oid oid;
+};
+
+struct FileRec {
+  std::string path;
+  StatKey stat;
+  git_oid oid;
+  GitManifestChange change = GitManifestChange::Unchanged;
+};
+
+int64_t mtime_ns(const struct stat &st) {
+  return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+void put_u64(std::string &buf, uint64_t v) {
+  for (int i = 0; i < 8; i++) buf.push_back(static_cast<char>(v >> (8 * i)));
+}
+
+uint64_t get_u64(const unsigned char *p) {
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+  return v;
+}
+
+// Ids the last manifest recorded, and the time it was written (its mtime).
+struct Baseline {
+  std::unordered_map<std::string, CachedOid> files;
+  int64_t writtenNs = 0;
+};
+
+// Records: 20-byte OID, u64 size, u64 mtime (ns), u64 inode, then the NUL-terminated path.
+constexpr size_t kRecordFixed = kOidBytes + 3 * 8;
+
+Baseline load_baseline(const std::string &path) {
+  Baseline b;
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return b;
+  std::string header;
+  std::getline(in, header);
+  std::istringstream hs(header);
+  std::string magic;
+  uint32_t version = 0;
+  hs >> magic >> version;
+  if (magic != kManifestMagic || version != kVersion) return b;  // treated as a first sync
+
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0) b.writtenNs = mtime_ns(st);
+  unsigned char fixed[kRecordFixed];
+  std::string rel;
+  while (in.read(reinterpret_cast<char *>(fixed), sizeof fixed) && std::getline(in, rel, '\0')) {
+    CachedOid c;
+    std::memcpy(c.oid.id, fixed, kOidBytes);
+    c.stat.size = get_u64(fixed + kOidBytes);
+    c.stat.mtimeNs = static_cast<int64_t>(get_u64(fixed + kOidBytes + 8));
+    c.stat.ino = get_u64(fixed + kOidBytes + 16);
+    b.files.emplace(rel, c);
+  }
+  return b;
+}
+
+void write_manifest(const std::string &path, const std::vector<FileRec> &files) {
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out << kManifestMagic << ' ' << kVersion << '\n';
+    std::string rec;
+    for (const auto &f : files) {
+      rec.assign(reinterpret_cast<const char *>(f.oid.id), kOidBytes);
+      put_u64(rec, f.stat.size);
+      put_u64(rec, static_cast<uint64_t>(f.stat.mtimeNs));
+      put_u64(rec, f.stat.ino);
+      rec.append(f.path.c_str(), f.path.size() + 1);
+      out.write(rec.data(), static_cast<std::streamsize>(rec.size()));
+    }
+    if (!out) throw GitException("Unable to write " + tmp);
+  }
+  if (rename(tmp.c_str(), path.c_str()) != 0) throw GitException("Unable to write " + path);
+}
+
+// Stage-0 regular-file entries of the index, when `root` is the work tree of a repository.
+struct IndexCache {
+  std::unordered_map<std::string, CachedOid> files;
+  int64_t writtenNs = 0;
+};
+
+IndexCache load_index(const std::string &root) {
+  IndexCache cache;
+  std::optional<RepoLease> lease;
+  try {
+    lease.emplace(acquire_repo(root));
+  } catch (const GitException &) {
+    return cache;
+  }
+  git_repository *repo = lease->get();
+  const char *wd = git_repository_workdir(repo);
+  if (!wd || root != wd) return cache;  // a subdirectory or a bare repository
+
+  git_index *index = nullptr;
+  if (git_repository_index(&index, repo) != 0) return cache;
+  struct stat st;
+  if (git_index_read(index, 0) == 0 && git_index_path(index) && stat(git_index_path(index), &st) == 0) {
+    cache.writtenNs = mtime_ns(st);
+    const size_t n = git_index_entrycount(index);
+    cache.files.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+      const git_index_entry *e = git_index_get_byindex(index, i);
+      if (GIT_INDEX_ENTRY_STAGE(e) != 0) continue;
+      if (e->mode != GIT_FILEMODE_BLOB && e->mode != GIT_FILEMODE_BLOB_EXECUTABLE) continue;
+      CachedOid c;
+      // The index keeps 32 bits of size and inode; compared truncated below.
+      c.stat.size = e->file_size;
+      c.stat.mtimeNs = static_cast<int64_t>(e->mtime.seconds) * 1000000000 + e->mtime.nanoseconds;
+      c.stat.ino = e->ino;
+      c.oid = e->id;
+      cache.files.emplace(e->path, c);
+    }
+  }
+  git_index_free(index);
+  return cache;
+}
+
+bool index_matches(const CachedOid &c, const StatKey &s, int64_t writtenNs) {
+  return c.stat.size == static_cast<uint32_t>(s.size) && c.stat.ino == static_cast<uint32_t>(s.ino) &&
+         c.stat.mtimeNs == s.mtimeNs && s.mtimeNs < writtenNs;
+}
+
+bool baseline_matches(const CachedOid &c, const StatKey &s, int64_t writtenNs) {
+  return c.stat.size == s.size && c.stat.ino == s.ino && c.stat.mtimeNs == s.mtimeNs && s.mtimeNs < writtenNs;
+}
+
+// Directories are handed out from a shared stack; a worker that finds it empty waits until the
+// others either push more or all go idle.
+struct WalkState {
+  std::string root;  // with a trailing '/'
+  std::unordered_set<std::string> exclude;
+  const OperationContext *op = nullptr;
+  std::atomic<bool> stop{false};
+
+  std::mutex mu;
+  std::condition_variable cv;
+  std::vector<std::string> pending;
+  int busy = 0;
+  std::vector<FileRec> files;
+  std::vector<std::string> dirs;
+};
+
+void walk_worker(WalkState &st) {
+  std::vector<FileRec> files;
+  std::vector<std::string> dirs;
+  std::unique_lock<std::mutex> lock(st.mu);
+  for (;;) {
+    st.cv.wait(lock, [&]() { return !st.pending.empty() || st.busy == 0 || st.stop.load(); });
+    if (st.pending.empty() || st.stop.load()) break;
+    const std::string dirRel = std::move(st.pending.back());
+    st.pending.pop_back();
+    st.busy++;
+    lock.unlock();
+    if (st.op->cancelled()) st.stop.store(true);
+
+    files.clear();
+    dirs.clear();
+    if (DIR *d = opendir((st.root + dirRel).c_str())) {
+      const int dfd = dirfd(d);
+      while (dirent *e = readdir(d)) {
+        const char *name = e->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+        if (st.exclude.count(name)) continue;
+        struct stat est;
+        if (fstatat(dfd, name, &est, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        std::string rel = dirRel.empty() ? std::string(name) : dirRel + "/" + name;
+        if (S_ISDIR(est.st_mode)) {
+          dirs.push_back(std::move(rel));
+        } else if (S_ISREG(est.st_mode)) {
+          FileRec f;
+          f.path = std::move(rel);
+          f.stat.size = static_cast<uint64_t>(est.st_size);
+          f.stat.mtimeNs = mtime_ns(est);
+          f.stat.ino = static_cast<uint64_t>(est.st_ino);
+          files.push_back(std::move(f));
+        }
+      }
+      closedir(d);
+    }
+
+    lock.lock();
+    st.busy--;
+    for (auto &f : files) st.files.push_back(std::move(f));
+    for (const auto &dir : dirs) {
+      st.pending.push_back(dir);
+      st.dirs.push_back(dir);
+    }
+    st.cv.notify_all();
+  }
+  st.cv.notify_all();
+}
+
+unsigned worker_count() {
+  return std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+}
+}  // namespace
+
+GitTreeManifest git_tree_manifest(const GitTreeManifestOptions &opts) {
+  if (opts.manifestPath.empty()) throw GitException("manifestPath is required");
+  OperationContext op(opts.hooks.operationId, opts.hooks.onProgress);
+
+  WalkState st;
+  st.root = opts.localPath;
+  if (st.root.empty() || st.root.back() != '/') st.root += '/';
+  st.exclude.insert(opts.excludeNames.begin(), opts.excludeNames.end());
+  st.op = &op;
+  struct stat rootSt;
+  if (stat(st.root.c_str(), &rootSt) != 0 || !S_ISDIR(rootSt.st_mode)) {
+    throw GitException("Not a directory: " + opts.localPath);
+  }
+
+  const IndexCache index = load_index(st.root);
+  const Baseline baseline = load_baseline(opts.manifestPath);
+  trace_phase("walk");
+
+  const unsigned workers = worker_count();
+  {
+    st.pending.push_back("");
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < workers; i++) threads.emplace_back(walk_worker, std::ref(st));
+    for (auto &t : threads) t.join();
+  }
+  if (op.cancelled()) op.fail(GIT_EUSER);
+
+  std::vector<FileRec> &files = st.files;
+  std::sort(files.begin(), files.end(), [](const FileRec &a, const FileRec &b) { return a.path < b.path; });
+
+  // Cached ids first (cheap, on this thread); what is left is read by the workers.
+  GitTreeManifest out;
+  std::vector<size_t> toHash;
+  for (size_t i = 0; i < files.size(); i++) {
+    FileRec &f = files[i];
+    auto ii = index.files.find(f.path);
+    if (ii != index.files.end() && index_matches(ii->second, f.stat, index.writtenNs)) {
+      f.oid = ii->second.oid;
+      out.fromIndex++;
+      continue;
+    }
+    auto bi = baseline.files.find(f.path);
+    if (bi != baseline.files.end() && baseline_matches(bi->second, f.stat, baseline.writtenNs)) {
+      f.oid = bi->second.oid;
+      out.fromManifest++;
+      continue;
+    }
+    toHash.push_back(i);
+  }
+
+  trace_phase("hash");
+  std::atomic<size_t> next{0};
+  std::atomic<size_t> done{0};
+  std::atomic<uint64_t> bytes{0};
+  std::vector<char> failed(files.size(), 0);
+  auto hash_worker = [&]() {
+    for (size_t k = next++; k < toHash.size() && !st.stop.load(); k = next++) {
+      FileRec &f = files[toHash[k]];
+      if (git_odb_hashfile(&f.oid, (st.root + f.path).c_str(), GIT_OBJECT_BLOB) != 0) {
+        failed[toHash[k]] = 1;  // vanished or unreadable since the walk
+      }
+      bytes += f.stat.size;
+      done++;
+    }
+  };
+  {
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < workers && i < toHash.size(); i++) threads.emplace_back(hash_worker);
+    while (done.load() < toHash.size() && !st.stop.load()) {
+      op.report("hashing", done.load(), toHash.size(), bytes.load());
+      if (op.cancelled()) st.stop.store(true);
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    for (auto &t : threads) t.join();
+  }
+  if (op.cancelled()) op.fail(GIT_EUSER);
+  op.report("hashing", toHash.size(), toHash.size(), bytes.load());
+
+  size_t kept = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (failed[i]) continue;
+    if (kept != i) files[kept] = std::move(files[i]);
+    kept++;
+  }
+  files.resize(kept);
+
+  std::unordered_set<std::string> present;
+  present.reserve(files.size());
+  out.files.reserve(files.size());
+  char hex[GIT_OID_HEXSZ + 1];
+  for (FileRec &f : files) {
+    auto bi = baseline.files.find(f.path);
+    if (bi == baseline.files.end()) {
+      f.change = GitManifestChange::Added;
+    } else if (!git_oid_equal(&bi->second.oid, &f.oid)) {
+      f.change = GitManifestChange::Modified;
+    }
+    present.insert(f.path);
+    git_oid_tostr(hex, sizeof hex, &f.oid);
+    out.files.push_back(GitTreeManifestFile{f.path, hex, f.stat.size, f.change});
+  }
+  for (const auto &b : baseline.files) {
+    if (!present.count(b.first)) out.deleted.push_back(b.first);
+  }
+  std::sort(out.deleted.begin(), out.deleted.end());
+  out.dirs = std::move(st.dirs);
+  std::sort(out.dirs.begin(), out.dirs.end());
+  out.hashed = toHash.size();
+
+  write_manifest(opts.manifestPath + kNextSuffix, files);
+  trace_count("files", static_cast<int64_t>(out.files.size()));
+  trace_count("hashed", static_cast<int64_t>(out.hashed));
+  return out;
+}
+
+void git_tree_manifest_commit(const std::string &manifestPath) {
+  const std::string next = manifestPath + kNextSuffix;
+  if (rename(next.c_str(), manifestPath.c_str()) != 0) {
+    throw GitException("No pending manifest at " + next + ": " + std::strerror(errno));
+  }
+}
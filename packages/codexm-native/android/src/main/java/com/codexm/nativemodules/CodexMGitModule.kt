@@ -1,23 +1,199 @@
 package com.codexm.nativemodules
 
+import android.app.ActivityManager
+import android.content.BroadcastReceiver
+import android.content.ComponentCallbacks2
+import android.content.Context
+import android.content.Intent
+import android.content.IntentFilter
+import android.content.res.Configuration
+import android.net.ConnectivityManager
+import android.net.Network
+import android.net.NetworkCapabilities
 import android.net.Uri
+import android.os.BatteryManager
+import android.os.ParcelFileDescriptor
+import android.os.PowerManager
+import android.util.Base64
+import androidx.annotation.Keep
+import com.facebook.react.bridge.Arguments
+import com.facebook.react.bridge.LifecycleEventListener
 import com.facebook.react.bridge.Promise
 import com.facebook.react.bridge.ReactApplicationContext
 import com.facebook.react.bridge.ReactContextBaseJavaModule
 import com.facebook.react.bridge.ReactMethod
 import com.facebook.react.bridge.ReadableMap
+import com.facebook.react.bridge.WritableArray
 import com.facebook.react.bridge.WritableMap
-import java.util.concurrent.Executors
+import com.facebook.react.modules.core.DeviceEventManagerModule.RCTDeviceEventEmitter
+import com.facebook.react.turbomodule.core.CallInvokerHolderImpl
+import java.net.HttpURLConnection
+import java.net.URL
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.util.concurrent.CancellationException
+import java.util.concurrent.ConcurrentHashMap
+import java.util.concurrent.atomic.AtomicBoolean
+import java.util.concurrent.atomic.AtomicReference
 
 class CodexMGitModule(private val reactContext: ReactApplicationContext) :
   ReactContextBaseJavaModule(reactContext) {
 
-  private val ioExecutor = Executors.newCachedThreadPool()
+  // streamId -> cancel flag for diff streams in flight.
+  private val diffStreams = ConcurrentHashMap<String, AtomicBoolean>()
+
+  // searchId -> cancel flag for content searches in flight.
+  private val searches = ConcurrentHashMap<String, AtomicBoolean>()
 
   override fun getName(): String = "CodexMGit"
 
+  private val connectivity = reactContext.getSystemService(Context.CONNECTIVITY_SERVICE) as? ConnectivityManager
+
+  // Feeds background prefetch, which only runs on unmetered networks.
+  private val networkCallback = object : ConnectivityManager.NetworkCallback() {
+    override fun onCapabilitiesChanged(network: Network, caps: NetworkCapabilities) {
+      setNetwork(
+        caps.hasCapability(NetworkCapabilities.NET_CAPABILITY_INTERNET),
+        !caps.hasCapability(NetworkCapabilities.NET_CAPABILITY_NOT_METERED),
+      )
+    }
+
+    override fun onLost(network: Network) {
+      setNetwork(false, true)
+    }
+  }
+
+  // Kept here until the library is loaded, then pushed by onNativeLoaded().
+  @Volatile private var online = false
+  @Volatile private var metered = true
+
+  private fun setNetwork(online: Boolean, metered: Boolean) {
+    this.online = online
+    this.metered = metered
+    if (NativeLibrary.isLoaded) nativePrefetchSetNetwork(online, metered)
+  }
+
+  // Pack maintenance runs only while the device is charging with the screen off.
+  @Volatile private var charging = false
+  @Volatile private var screenOff = false
+
+  private val deviceStateReceiver = object : BroadcastReceiver() {
+    override fun onReceive(context: Context, intent: Intent) {
+      when (intent.action) {
+        Intent.ACTION_POWER_CONNECTED -> charging = true
+        Intent.ACTION_POWER_DISCONNECTED -> charging = false
+        Intent.ACTION_SCREEN_OFF -> screenOff = true
+        Intent.ACTION_SCREEN_ON -> screenOff = false
+        else -> return
+      }
+      if (NativeLibrary.isLoaded) nativeMaintenanceSetDeviceState(charging, screenOff)
+    }
+  }
+
+  private val runtimePrefs = reactContext.getSharedPreferences("codexm_git_runtime", Context.MODE_PRIVATE)
+
+  private val memoryCallbacks = object : ComponentCallbacks2 {
+    override fun onTrimMemory(level: Int) {
+      // Nothing to trim before the library is loaded.
+      if (NativeLibrary.isLoaded) nativeTrimMemory(level)
+    }
+
+    override fun onConfigurationChanged(newConfig: Configuration) {}
+
+    @Deprecated("Deprecated in Java")
+    override fun onLowMemory() {
+      if (NativeLibrary.isLoaded) nativeTrimMemory(ComponentCallbacks2.TRIM_MEMORY_COMPLETE)
+    }
+  }
+
+  // onTrimMemory has no "pressure is over" signal; coming back to the foreground is the next best.
+  private val lifecycleListener = object : LifecycleEventListener {
+    override fun onHostResume() {
+      if (NativeLibrary.isLoaded) nativeTrimMemory(0)
+    }
+
+    override fun onHostPause() {}
+
+    override fun onHostDestroy() {}
+  }
+
+  /** Stored memoryClass ("low" / "mid" / "high"), else picked from total RAM. */
+  private fun memoryClassOf(setting: String?): Int {
+    when (setting) {
+      "low" -> return MEMORY_LOW
+      "mid" -> return MEMORY_MID
+      "high" -> return MEMORY_HIGH
+    }
+    val am = reactContext.getSystemService(Context.ACTIVITY_SERVICE) as? ActivityManager ?: return MEMORY_MID
+    if (am.isLowRamDevice) return MEMORY_LOW
+    val info = ActivityManager.MemoryInfo().also { am.getMemoryInfo(it) }
+    val gib = 1024L * 1024L * 1024L
+    return when {
+      info.totalMem < 3 * gib -> MEMORY_LOW
+      info.totalMem < 6 * gib -> MEMORY_MID
+      else -> MEMORY_HIGH
+    }
+  }
+
+  private fun applyRuntimeConfig() {
+    nativeConfigureRuntime(
+      memoryClassOf(runtimePrefs.getString("memoryClass", null)),
+      runtimePrefs.getBoolean("trustLocalObjects", false),
+    )
+  }
+
+  /** Loads libcodexm_git on first use; every native call outside the callbacks goes through this. */
+  private fun ensureNative() = NativeLibrary.ensureLoaded()
+
+  private fun onNativeLoaded() {
+    // Before any repository is opened, so the first pack mappings already use these limits.
+    applyRuntimeConfig()
+    nativePrefetchSetNetwork(online, metered)
+    nativeMaintenanceSetDeviceState(charging, screenOff)
+  }
+
   init {
-    System.loadLibrary("codexm_git")
+    NativeLibrary.onLoad(::onNativeLoaded)
+    NativeLibrary.warmUpWhenIdle(::nativeWarmUp)
+    reactContext.registerComponentCallbacks(memoryCallbacks)
+    reactContext.addLifecycleEventListener(lifecycleListener)
+    try {
+      connectivity?.registerDefaultNetworkCallback(networkCallback)
+    } catch (_: Throwable) {
+      // Without network state prefetch stays off.
+    }
+    try {
+      val battery = reactContext.registerReceiver(null, IntentFilter(Intent.ACTION_BATTERY_CHANGED))
+      charging = (battery?.getIntExtra(BatteryManager.EXTRA_PLUGGED, 0) ?: 0) != 0
+      val power = reactContext.getSystemService(Context.POWER_SERVICE) as? PowerManager
+      screenOff = power?.isInteractive == false
+      val filter = IntentFilter().apply {
+        addAction(Intent.ACTION_POWER_CONNECTED)
+        addAction(Intent.ACTION_POWER_DISCONNECTED)
+        addAction(Intent.ACTION_SCREEN_OFF)
+        addAction(Intent.ACTION_SCREEN_ON)
+      }
+      reactContext.registerReceiver(deviceStateReceiver, filter)
+    } catch (_: Throwable) {
+      // Without device state maintenance only runs when requested explicitly.
+    }
+  }
+
+  override fun invalidate() {
+    try {
+      connectivity?.unregisterNetworkCallback(networkCallback)
+    } catch (_: Throwable) {
+      // best-effort
+    }
+    try {
+      reactContext.unregisterReceiver(deviceStateReceiver)
+    } catch (_: Throwable) {
+      // best-effort
+    }
+    if (NativeLibrary.isLoaded) nativeMaintenanceSetDeviceState(false, false)
+    reactContext.unregisterComponentCallbacks(memoryCallbacks)
+    reactContext.removeLifecycleEventListener(lifecycleListener)
+    super.invalidate()
   }
 
   private fun uriToFilePath(uriOrPath: String): String {
@@ -38,9 +214,14 @@ class CodexMGitModule(private val reactContext: ReactApplicationContext) :
     userName: String?,
     userEmail: String?,
     allowInsecure: Boolean,
+    depth: Int,
+    singleBranch: Boolean,
+    sparsePaths: Array<String>,
+    operationId: String?,
+    progress: ProgressSink?,
   )
 
-  private external fun nativeCheckout(localPath: String, ref: String)
+  private external fun nativeCheckout(localPath: String, ref: String, operationId: String?, progress: ProgressSink?)
 
   private external fun nativePull(
     localPath: String,
@@ -49,7 +230,20 @@ class CodexMGitModule(private val reactContext: ReactApplicationContext) :
     username: String?,
     token: String?,
     allowInsecure: Boolean,
-  )
+    depth: Int,
+    unshallow: Boolean,
+    strategy: Int,
+    operationId: String?,
+    progress: ProgressSink?,
+  ): ByteArray
+
+  private external fun nativeCommit(
+    localPath: String,
+    message: String,
+    paths: Array<String>,
+    stage: Boolean,
+    allowEmpty: Boolean,
+  ): String
 
   private external fun nativePush(
     localPath: String,
@@ -58,121 +252,1323 @@ class CodexMGitModule(private val reactContext: ReactApplicationContext) :
     username: String?,
     token: String?,
     allowInsecure: Boolean,
+    operationId: String?,
+    progress: ProgressSink?,
   )
 
-  private external fun nativeStatus(localPath: String): WritableMap
-  private external fun nativeDiff(localPath: String, maxBytes: Int): String
+  private external fun nativeStatus(localPath: String, renameThreshold: Int, renameLimit: Int, renameCopies: Boolean): ByteArray
+  private external fun nativeStatusIncremental(
+    localPath: String,
+    touchedPaths: Array<String>,
+    watch: Boolean,
+  ): ByteArray
+  private external fun nativeStatusIncrementalReset(localPath: String)
+  private external fun nativeStatusMany(localPaths: Array<String>, summaryOnly: Boolean, sink: StatusManySink)
+  private external fun nativeDiff(
+    localPath: String,
+    maxBytes: Int,
+    renameThreshold: Int,
+    renameLimit: Int,
+    renameCopies: Boolean,
+  ): String
+  private external fun nativeDiffStructured(
+    localPath: String,
+    renameThreshold: Int,
+    renameLimit: Int,
+    renameCopies: Boolean,
+  ): ByteArray
+  private external fun nativeDiffStream(
+    localPath: String,
+    chunkBytes: Int,
+    renameThreshold: Int,
+    renameLimit: Int,
+    renameCopies: Boolean,
+    sink: DiffChunkSink,
+  )
+  private external fun nativeSearch(
+    localPath: String,
+    pattern: String,
+    regex: Boolean,
+    ignoreCase: Boolean,
+    paths: Array<String>,
+    includeIgnored: Boolean,
+    useIndex: Boolean,
+    maxResults: Int,
+    operationId: String,
+    sink: SearchSink,
+  ): LongArray
+  private external fun nativeSearchIndexRefresh(localPath: String, operationId: String?, progress: ProgressSink?): LongArray
+  private external fun nativeSearchIndexDrop(localPath: String)
+  private external fun nativeTreeManifest(
+    localPath: String,
+    manifestPath: String,
+    excludeNames: Array<String>,
+    changedOnly: Boolean,
+    operationId: String?,
+    progress: ProgressSink?,
+  ): ByteArray
+  private external fun nativeTreeManifestCommit(manifestPath: String)
+  private external fun nativePackTree(rootDir: String, paths: Array<String>, excludeNames: Array<String>, outFd: Int): LongArray
+  private external fun nativeUnpackTree(inFd: Int, destDir: String): LongArray
+  private external fun nativeReleaseRepo(localPath: String)
+  private external fun nativeCancelOperation(operationId: String)
+  private external fun nativeTraceSetEnabled(enabled: Boolean)
+  private external fun nativeTraceDrain(): ByteArray
+  private external fun nativeSetRemoteIdleTimeout(ms: Long)
+  private external fun nativeConfigureRuntime(memoryClass: Int, trustLocalObjects: Boolean)
+  private external fun nativeTrimMemory(level: Int)
+  private external fun nativeWarmUp()
+  private external fun nativePrefetchTouch(
+    localPath: String,
+    remote: String?,
+    username: String?,
+    token: String?,
+    allowInsecure: Boolean,
+  )
+  private external fun nativePrefetchForget(localPath: String)
+  private external fun nativePrefetchSetNetwork(online: Boolean, metered: Boolean)
+  private external fun nativePrefetchConfigure(enabled: Boolean, intervalMs: Long, recentWindowMs: Long)
+  private external fun nativeMaintenance(
+    localPath: String,
+    force: Boolean,
+    operationId: String?,
+    progress: ProgressSink?,
+  ): LongArray
+  private external fun nativeMaintenanceRequest(localPath: String)
+  private external fun nativeMaintenanceSetDeviceState(charging: Boolean, idle: Boolean)
+  private external fun nativeSnapshot(localPath: String, message: String?): String
+  private external fun nativeRestoreSnapshot(localPath: String, oid: String)
+  private external fun nativeListSnapshots(localPath: String): ByteArray
+  private external fun nativeDropSnapshot(localPath: String, oid: String)
+  private external fun nativeLogPage(
+    localPath: String,
+    ref: String?,
+    cursor: String?,
+    paths: Array<String>,
+    limit: Int,
+    maxScan: Int,
+  ): ByteArray
+  private external fun nativeBlame(localPath: String, path: String, startLine: Int, endLine: Int, ref: String?): ByteArray
+  private external fun nativeReadRange(
+    localPath: String,
+    spec: String?,
+    path: String?,
+    lines: Boolean,
+    start: Long,
+    count: Long,
+    maxBytes: Int,
+  ): ByteArray
+  private external fun nativeGetSparsePaths(localPath: String): ByteArray
+  private external fun nativeSetSparsePaths(localPath: String, paths: Array<String>)
+  private external fun nativeInstallJsi(runtime: Long, callInvoker: CallInvokerHolderImpl): Boolean
+  private external fun nativeSubmit(repoPath: String, coalesceKey: String?, kind: Int, task: GitTask)
+
+  /** Called from native code on the calling thread; return false to stop the stream. */
+  @Keep
+  private interface DiffChunkSink {
+    fun onChunk(section: Int, path: ByteArray, fileStart: Boolean, data: ByteArray): Boolean
+  }
+
+  /** Called from native code on the calling thread with a packed batch; return false to stop. */
+  @Keep
+  private interface SearchSink {
+    fun onBatch(packed: ByteArray): Boolean
+  }
+
+  /** Called once from a native worker thread when every repository of a statusMany() call is done. */
+  @Keep
+  private interface StatusManySink {
+    fun onComplete(packed: ByteArray)
+  }
+
+  /** Called from native code on the operation's thread, already throttled. */
+  @Keep
+  private interface ProgressSink {
+    fun onProgress(phase: String, current: Long, total: Long, bytes: Long, message: ByteArray?)
+  }
+
+  /**
+   * Work queued on the native scheduler (scheduler.h). run() executes on a native worker thread,
+   * serialized with every other task for the same repository; complete() receives its result or
+   * exception. Coalesced tasks never run: they receive the result of the task they joined.
+   */
+  @Keep
+  private interface GitTask {
+    fun run(): Any?
+    fun complete(result: Any?, error: Throwable?)
+  }
+
+  /**
+   * Queues `work` for the repository named by `localRepoDirUri` and settles `promise` with
+   * `finish(result)`. Only read-only calls may pass a `coalesceKey`; it must cover every parameter
+   * that affects the result, and `finish` must build a fresh value per caller.
+   */
+  private fun submit(
+    params: ReadableMap,
+    promise: Promise,
+    errorCode: String,
+    kind: Int = JOB_READ,
+    coalesceKey: String? = null,
+    finish: (Any?) -> Any? = { it },
+    work: (localPath: String) -> Any?,
+  ) {
+    val localRepoDirUri = params.getString("localRepoDirUri")
+    if (localRepoDirUri == null) {
+      promise.reject(errorCode, "localRepoDirUri is required")
+      return
+    }
+    val localPath = uriToFilePath(localRepoDirUri)
+    ensureNative()
+    val task = object : GitTask {
+      override fun run(): Any? = work(localPath)
+
+      override fun complete(result: Any?, error: Throwable?) {
+        when (error) {
+          null ->
+            try {
+              promise.resolve(finish(result))
+            } catch (e: Throwable) {
+              promise.reject(errorCode, e.message, e)
+            }
+          is CancellationException -> promise.reject("E_GIT_CANCELLED", error.message, error)
+          else -> promise.reject(errorCode, error.message, error)
+        }
+      }
+    }
+    try {
+      nativeSubmit(localPath, coalesceKey, kind, task)
+    } catch (e: RuntimeException) {
+      // Not queued (e.g. out of memory); complete() will never be called.
+      promise.reject(errorCode, e.message, e)
+    }
+  }
+
+  private fun stringArrayOf(params: ReadableMap, key: String): Array<String> {
+    if (!params.hasKey(key) || params.isNull(key)) return emptyArray()
+    val arr = params.getArray(key)!!
+    return Array(arr.size()) { i -> arr.getString(i) ?: "" }
+  }
+
+  /** `renames` ({ threshold?, limit?, copies? }) as native arguments; a threshold of 0 leaves it off. */
+  private class RenameArgs(val threshold: Int, val limit: Int, val copies: Boolean) {
+    // Appended to coalescing keys: results differ with the rename settings.
+    val key: String
+      get() = if (threshold == 0) "" else ":M$threshold/$limit${if (copies) "C" else ""}"
+  }
+
+  private fun renameArgsOf(params: ReadableMap): RenameArgs {
+    if (!params.hasKey("renames") || params.isNull("renames")) return RenameArgs(0, 0, false)
+    val r = params.getMap("renames")!!
+    val threshold = if (r.hasKey("threshold") && !r.isNull("threshold")) r.getInt("threshold") else 50
+    val limit = if (r.hasKey("limit") && !r.isNull("limit")) r.getInt("limit") else 0
+    val copies = r.hasKey("copies") && !r.isNull("copies") && r.getBoolean("copies")
+    return RenameArgs(threshold.coerceIn(1, 100), limit, copies)
+  }
+
+  private fun operationIdOf(params: ReadableMap): String? =
+    if (params.hasKey("operationId") && !params.isNull("operationId")) params.getString("operationId") else null
+
+  /** Progress is only reported for calls that carry an operationId (JS filters events by it). */
+  private fun progressSink(op: String, operationId: String?): ProgressSink? {
+    if (operationId == null) return null
+    val emitter = reactContext.getJSModule(RCTDeviceEventEmitter::class.java)
+    return object : ProgressSink {
+      override fun onProgress(phase: String, current: Long, total: Long, bytes: Long, message: ByteArray?) {
+        val payload = Arguments.createMap().apply {
+          putString("operationId", operationId)
+          putString("op", op)
+          putString("phase", phase)
+          putDouble("current", current.toDouble())
+          putDouble("total", total.toDouble())
+          putDouble("bytes", bytes.toDouble())
+          if (message != null) putString("message", String(message, Charsets.UTF_8))
+        }
+        emitter.emit("CodexMGitProgress", payload)
+      }
+    }
+  }
+
+  /**
+   * Decodes the packed status from codexmgit_jni.cpp: u32 count (LE), one bucket byte per path
+   * (0 staged, 1 unstaged, 2 untracked), then the NUL-terminated UTF-8 paths in the same order.
+   */
+  private fun decodeStatus(buf: ByteArray): WritableMap {
+    val count = (buf[0].toInt() and 0xff) or
+      ((buf[1].toInt() and 0xff) shl 8) or
+      ((buf[2].toInt() and 0xff) shl 16) or
+      ((buf[3].toInt() and 0xff) shl 24)
+    val staged = Arguments.createArray()
+    val unstaged = Arguments.createArray()
+    val untracked = Arguments.createArray()
+
+    var pos = 4 + count
+    for (i in 0 until count) {
+      var end = pos
+      while (buf[end] != 0.toByte()) end++
+      val path = String(buf, pos, end - pos, Charsets.UTF_8)
+      when (buf[4 + i].toInt()) {
+        0 -> staged.pushString(path)
+        1 -> unstaged.pushString(path)
+        else -> untracked.pushString(path)
+      }
+      pos = end + 1
+    }
+
+    return Arguments.createMap().apply {
+      putArray("staged", staged)
+      putArray("unstaged", unstaged)
+      putArray("untracked", untracked)
+    }
+  }
 
   @ReactMethod
   fun clone(params: ReadableMap, promise: Promise) {
-    ioExecutor.execute {
-      try {
-        val remoteUrl = params.getString("remoteUrl") ?: throw IllegalArgumentException("remoteUrl is required")
-        val localRepoDirUri =
-          params.getString("localRepoDirUri") ?: throw IllegalArgumentException("localRepoDirUri is required")
-        val localPath = uriToFilePath(localRepoDirUri)
-        val branch = if (params.hasKey("branch") && !params.isNull("branch")) params.getString("branch") else null
+    submit(params, promise, "E_GIT_CLONE", kind = JOB_NETWORK) { localPath ->
+      val remoteUrl = params.getString("remoteUrl") ?: throw IllegalArgumentException("remoteUrl is required")
+      val branch = if (params.hasKey("branch") && !params.isNull("branch")) params.getString("branch") else null
 
-        val auth = if (params.hasKey("auth") && !params.isNull("auth")) params.getMap("auth") else null
-        val username = auth?.getString("username")
-        val token = auth?.getString("token")
-        val userName = if (params.hasKey("userName") && !params.isNull("userName")) params.getString("userName") else null
-        val userEmail = if (params.hasKey("userEmail") && !params.isNull("userEmail")) params.getString("userEmail") else null
-        val allowInsecure = params.hasKey("allowInsecure") && params.getBoolean("allowInsecure")
+      val auth = if (params.hasKey("auth") && !params.isNull("auth")) params.getMap("auth") else null
+      val username = auth?.getString("username")
+      val token = auth?.getString("token")
+      val userName = if (params.hasKey("userName") && !params.isNull("userName")) params.getString("userName") else null
+      val userEmail = if (params.hasKey("userEmail") && !params.isNull("userEmail")) params.getString("userEmail") else null
+      val allowInsecure = params.hasKey("allowInsecure") && params.getBoolean("allowInsecure")
+      val depth = if (params.hasKey("depth") && !params.isNull("depth")) params.getInt("depth") else 0
+      val singleBranch = params.hasKey("singleBranch") && params.getBoolean("singleBranch")
 
-        nativeClone(remoteUrl, localPath, branch, username, token, userName, userEmail, allowInsecure)
-        promise.resolve(null)
-      } catch (e: Throwable) {
-        promise.reject("E_GIT_CLONE", e.message, e)
-      }
+      val operationId = operationIdOf(params)
+      nativeClone(
+        remoteUrl,
+        localPath,
+        branch,
+        username,
+        token,
+        userName,
+        userEmail,
+        allowInsecure,
+        depth,
+        singleBranch,
+        stringArrayOf(params, "sparsePaths"),
+        operationId,
+        progressSink("clone", operationId),
+      )
+      null
     }
   }
 
   @ReactMethod
   fun checkout(params: ReadableMap, promise: Promise) {
-    ioExecutor.execute {
+    submit(params, promise, "E_GIT_CHECKOUT", kind = JOB_WRITE) { localPath ->
+      val ref = params.getString("ref") ?: throw IllegalArgumentException("ref is required")
+      val operationId = operationIdOf(params)
+      nativeCheckout(localPath, ref, operationId, progressSink("checkout", operationId))
+      null
+    }
+  }
+
+  /** Layout from nativePull: outcome, head, then path/ancestor/ours/theirs per conflict. */
+  private fun decodePullResult(flat: Array<String>): WritableMap {
+    val conflicts = Arguments.createArray()
+    var i = 2
+    while (i + 3 < flat.size) {
+      conflicts.pushMap(
+        Arguments.createMap().apply {
+          putString("path", flat[i])
+          flat[i + 1].takeIf { it.isNotEmpty() }?.let { putString("ancestor", it) }
+          flat[i + 2].takeIf { it.isNotEmpty() }?.let { putString("ours", it) }
+          flat[i + 3].takeIf { it.isNotEmpty() }?.let { putString("theirs", it) }
+        },
+      )
+      i += 4
+    }
+    return Arguments.createMap().apply {
+      putString(
+        "outcome",
+        when (flat[0].toInt()) {
+          1 -> "fast-forward"
+          2 -> "merged"
+          3 -> "rebased"
+          4 -> "conflicts"
+          else -> "up-to-date"
+        },
+      )
+      putString("head", flat[1])
+      putArray("conflicts", conflicts)
+    }
+  }
+
+  @ReactMethod
+  fun pull(params: ReadableMap, promise: Promise) {
+    submit(
+      params,
+      promise,
+      "E_GIT_PULL",
+      kind = JOB_NETWORK,
+      finish = { decodePullResult(decodeStrings(it as ByteArray)) },
+    ) { localPath ->
+      val remote = if (params.hasKey("remote") && !params.isNull("remote")) params.getString("remote") else null
+      val branch = if (params.hasKey("branch") && !params.isNull("branch")) params.getString("branch") else null
+
+      val auth = if (params.hasKey("auth") && !params.isNull("auth")) params.getMap("auth") else null
+      val username = auth?.getString("username")
+      val token = auth?.getString("token")
+      val allowInsecure = params.hasKey("allowInsecure") && params.getBoolean("allowInsecure")
+      val depth = if (params.hasKey("depth") && !params.isNull("depth")) params.getInt("depth") else 0
+      val unshallow = params.hasKey("unshallow") && params.getBoolean("unshallow")
+      val strategyName = if (params.hasKey("strategy") && !params.isNull("strategy")) params.getString("strategy") else null
+      // GitPullStrategy in git_ops.h.
+      val strategy = when (strategyName) {
+        "merge" -> 1
+        "rebase" -> 2
+        else -> 0
+      }
+
+      val operationId = operationIdOf(params)
+      nativePull(
+        localPath,
+        remote,
+        branch,
+        username,
+        token,
+        allowInsecure,
+        depth,
+        unshallow,
+        strategy,
+        operationId,
+        progressSink("pull", operationId),
+      )
+    }
+  }
+
+  @ReactMethod
+  fun commit(params: ReadableMap, promise: Promise) {
+    submit(params, promise, "E_GIT_COMMIT", kind = JOB_WRITE) { localPath ->
+      val message = params.getString("message") ?: throw IllegalArgumentException("message is required")
+      val stage = !params.hasKey("stage") || params.isNull("stage") || params.getBoolean("stage")
+      val allowEmpty = params.hasKey("allowEmpty") && params.getBoolean("allowEmpty")
+      nativeCommit(localPath, message, stringArrayOf(params, "paths"), stage, allowEmpty)
+    }
+  }
+
+  @ReactMethod
+  fun push(params: ReadableMap, promise: Promise) {
+    submit(params, promise, "E_GIT_PUSH", kind = JOB_NETWORK) { localPath ->
+      val remote = if (params.hasKey("remote") && !params.isNull("remote")) params.getString("remote") else null
+      val branch = if (params.hasKey("branch") && !params.isNull("branch")) params.getString("branch") else null
+
+      val auth = if (params.hasKey("auth") && !params.isNull("auth")) params.getMap("auth") else null
+      val username = auth?.getString("username")
+      val token = auth?.getString("token")
+      val allowInsecure = params.hasKey("allowInsecure") && params.getBoolean("allowInsecure")
+
+      val operationId = operationIdOf(params)
+      nativePush(
+        localPath,
+        remote,
+        branch,
+        username,
+        token,
+        allowInsecure,
+        operationId,
+        progressSink("push", operationId),
+      )
+      null
+    }
+  }
+
+  /**
+   * Installs `global.__CodexMGitJSI` (jsi_binding.cpp) for status/diff calls without the bridge.
+   * Runs on the JS thread; false if the runtime or its CallInvoker isn't reachable.
+   */
+  @ReactMethod(isBlockingSynchronousMethod = true)
+  fun installJsi(): Boolean {
+    val runtime = reactContext.javaScriptContextHolder?.get() ?: 0L
+    val invoker = reactContext.jsCallInvokerHolder as? CallInvokerHolderImpl
+    if (runtime == 0L || invoker == null) return false
+    ensureNative()
+    return nativeInstallJsi(runtime, invoker)
+  }
+
+  @ReactMethod
+  fun cancelOperation(operationId: String, promise: Promise) {
+    // Nothing can be running before the library is loaded.
+    if (NativeLibrary.isLoaded) nativeCancelOperation(operationId)
+    promise.resolve(null)
+  }
+
+  @ReactMethod
+  fun setTracing(enabled: Boolean, promise: Promise) {
+    ensureNative()
+    nativeTraceSetEnabled(enabled)
+    promise.resolve(null)
+  }
+
+  /** Completed spans since the last drain as JSON lines. */
+  @ReactMethod
+  fun drainTrace(promise: Promise) {
+    if (!NativeLibrary.isLoaded) {
+      promise.resolve("")
+      return
+    }
+    promise.resolve(String(nativeTraceDrain(), Charsets.UTF_8))
+  }
+
+  @ReactMethod
+  fun setRemoteIdleTimeout(ms: Double, promise: Promise) {
+    ensureNative()
+    nativeSetRemoteIdleTimeout(ms.toLong())
+    promise.resolve(null)
+  }
+
+  /** Persists and applies memory/integrity settings; omitted keys keep their stored value. */
+  @ReactMethod
+  fun configureRuntime(params: ReadableMap, promise: Promise) {
+    val edit = runtimePrefs.edit()
+    if (params.hasKey("memoryClass")) {
+      val memoryClass = if (params.isNull("memoryClass")) null else params.getString("memoryClass")
+      if (memoryClass == null || memoryClass == "auto") edit.remove("memoryClass") else edit.putString("memoryClass", memoryClass)
+    }
+    if (params.hasKey("trustLocalObjects") && !params.isNull("trustLocalObjects")) {
+      edit.putBoolean("trustLocalObjects", params.getBoolean("trustLocalObjects"))
+    }
+    edit.apply()
+    ensureNative()
+    applyRuntimeConfig()
+    promise.resolve(null)
+  }
+
+  @ReactMethod
+  fun prefetchTouch(params: ReadableMap, promise: Promise) {
+    val localRepoDirUri = params.getString("localRepoDirUri")
+    if (localRepoDirUri == null) {
+      promise.reject("E_GIT_PREFETCH", "localRepoDirUri is required")
+      return
+    }
+    val remote = if (params.hasKey("remote") && !params.isNull("remote")) params.getString("remote") else null
+    val auth = if (params.hasKey("auth") && !params.isNull("auth")) params.getMap("auth") else null
+    val allowInsecure = params.hasKey("allowInsecure") && params.getBoolean("allowInsecure")
+    ensureNative()
+    nativePrefetchTouch(
+      uriToFilePath(localRepoDirUri),
+      remote,
+      auth?.getString("username"),
+      auth?.getString("token"),
+      allowInsecure,
+    )
+    promise.resolve(null)
+  }
+
+  @ReactMethod
+  fun prefetchForget(params: ReadableMap, promise: Promise) {
+    val localRepoDirUri = params.getString("localRepoDirUri")
+    if (localRepoDirUri == null) {
+      promise.reject("E_GIT_PREFETCH", "localRepoDirUri is required")
+      return
+    }
+    ensureNative()
+    nativePrefetchForget(uriToFilePath(localRepoDirUri))
+    promise.resolve(null)
+  }
+
+  @ReactMethod
+  fun prefetchConfigure(params: ReadableMap, promise: Promise) {
+    val enabled = !params.hasKey("enabled") || params.isNull("enabled") || params.getBoolean("enabled")
+    val intervalMs =
+      if (params.hasKey("intervalMs") && !params.isNull("intervalMs")) params.getDouble("intervalMs").toLong() else 0L
+    val recentWindowMs =
+      if (params.hasKey("recentWindowMs") && !params.isNull("recentWindowMs")) {
+        params.getDouble("recentWindowMs").toLong()
+      } else {
+        0L
+      }
+    ensureNative()
+    nativePrefetchConfigure(enabled, intervalMs, recentWindowMs)
+    promise.resolve(null)
+  }
+
+  @ReactMethod
+  fun maintenance(params: ReadableMap, promise: Promise) {
+    submit(params, promise, "E_GIT_MAINTENANCE", kind = JOB_WRITE) { localPath ->
+      val force = params.hasKey("force") && params.getBoolean("force")
+      val operationId = operationIdOf(params)
+      val r = nativeMaintenance(localPath, force, operationId, progressSink("maintenance", operationId))
+      Arguments.createMap().apply {
+        putBoolean("ran", r[0] != 0L)
+        putDouble("objectsPacked", r[1].toDouble())
+        putDouble("packsRemoved", r[2].toDouble())
+        putDouble("looseRemoved", r[3].toDouble())
+        putDouble("bytesBefore", r[4].toDouble())
+        putDouble("bytesAfter", r[5].toDouble())
+        putBoolean("commitGraph", r[6] != 0L)
+      }
+    }
+  }
+
+  @ReactMethod
+  fun requestMaintenance(params: ReadableMap, promise: Promise) {
+    val localRepoDirUri = params.getString("localRepoDirUri")
+    if (localRepoDirUri == null) {
+      promise.reject("E_GIT_MAINTENANCE", "localRepoDirUri is required")
+      return
+    }
+    ensureNative()
+    nativeMaintenanceRequest(uriToFilePath(localRepoDirUri))
+    promise.resolve(null)
+  }
+
+  @ReactMethod
+  fun snapshot(params: ReadableMap, promise: Promise) {
+    submit(params, promise, "E_GIT_SNAPSHOT", kind = JOB_WRITE) { localPath ->
+      val message = if (params.hasKey("message") && !params.isNull("message")) params.getString("message") else null
+      nativeSnapshot(localPath, message)
+    }
+  }
+
+  @ReactMethod
+  fun restoreSnapshot(params: ReadableMap, promise: Promise) {
+    submit(params, promise, "E_GIT_SNAPSHOT", kind = JOB_WRITE) { localPath ->
+      val oid = params.getString("oid") ?: throw IllegalArgumentException("oid is required")
+      nativeRestoreSnapshot(localPath, oid)
+      null
+    }
+  }
+
+  @ReactMethod
+  fun listSnapshots(params: ReadableMap, promise: Promise) {
+    submit(
+      params,
+      promise,
+      "E_GIT_SNAPSHOT",
+      coalesceKey = "listSnapshots",
+      finish = { result ->
+        val flat = decodeStrings(result as ByteArray)
+        val res = Arguments.createArray()
+        for (i in 0 until flat.size / 3) {
+          res.pushMap(
+            Arguments.createMap().apply {
+              putString("oid", flat[i * 3])
+              putDouble("createdAt", (flat[i * 3 + 1].toLongOrNull() ?: 0L) * 1000.0)
+              putString("message", flat[i * 3 + 2])
+            },
+          )
+        }
+        res
+      },
+    ) { localPath -> nativeListSnapshots(localPath) }
+  }
+
+  @ReactMethod
+  fun dropSnapshot(params: ReadableMap, promise: Promise) {
+    submit(params, promise, "E_GIT_SNAPSHOT", kind = JOB_WRITE) { localPath ->
+      val oid = params.getString("oid") ?: throw IllegalArgumentException("oid is required")
+      nativeDropSnapshot(localPath, oid)
+      null
+    }
+  }
+
+  private fun optInt(params: ReadableMap, key: String): Int =
+    if (params.hasKey(key) && !params.isNull(key)) params.getInt(key) else 0
+
+  private fun optString(params: ReadableMap, key: String): String? =
+    if (params.hasKey(key) && !params.isNull(key)) params.getString(key) else null
+
+  /**
+   * Decodes a string list from codexmgit_jni.cpp (strings_to_packed): u32 count, then per item
+   * u32 length + bytes (all LE). Bytes that are not valid UTF-8 become U+FFFD.
+   */
+  private fun decodeStrings(packed: ByteArray): Array<String> {
+    val buf = ByteBuffer.wrap(packed).order(ByteOrder.LITTLE_ENDIAN)
+    return Array(buf.getInt()) {
+      val len = buf.getInt()
+      val s = String(packed, buf.position(), len, Charsets.UTF_8)
+      buf.position(buf.position() + len)
+      s
+    }
+  }
+
+  @ReactMethod
+  fun logPage(params: ReadableMap, promise: Promise) {
+    submit(
+      params,
+      promise,
+      "E_GIT_LOG",
+      finish = { result ->
+        // Layout from nativeLogPage: nextCursor, scanned, then 7 fields per commit.
+        val flat = decodeStrings(result as ByteArray)
+        val commits = Arguments.createArray()
+        var i = 2
+        while (i + 7 <= flat.size) {
+          val parents = Arguments.createArray()
+          (flat[i + 1] as String).split(' ').filter { it.isNotEmpty() }.forEach { parents.pushString(it) }
+          commits.pushMap(
+            Arguments.createMap().apply {
+              putString("oid", flat[i] as String)
+              putArray("parents", parents)
+              putString("authorName", flat[i + 2] as String)
+              putString("authorEmail", flat[i + 3] as String)
+              putDouble("authorTime", ((flat[i + 4] as String).toLongOrNull() ?: 0L) * 1000.0)
+              putDouble("commitTime", ((flat[i + 5] as String).toLongOrNull() ?: 0L) * 1000.0)
+              putString("summary", flat[i + 6] as String)
+            },
+          )
+          i += 7
+        }
+        val cursor = flat[0] as String
+        Arguments.createMap().apply {
+          putArray("commits", commits)
+          if (cursor.isEmpty()) putNull("nextCursor") else putString("nextCursor", cursor)
+          putInt("scanned", (flat[1] as String).toIntOrNull() ?: 0)
+        }
+      },
+    ) { localPath ->
+      nativeLogPage(
+        localPath,
+        optString(params, "ref"),
+        optString(params, "cursor"),
+        stringArrayOf(params, "paths"),
+        optInt(params, "limit"),
+        optInt(params, "maxScan"),
+      )
+    }
+  }
+
+  @ReactMethod
+  fun blame(params: ReadableMap, promise: Promise) {
+    submit(
+      params,
+      promise,
+      "E_GIT_BLAME",
+      finish = { result ->
+        // Layout from nativeBlame: 10 fields per hunk.
+        val flat = decodeStrings(result as ByteArray)
+        val hunks = Arguments.createArray()
+        for (i in 0 until flat.size / 10) {
+          val f = { k: Int -> flat[i * 10 + k] as String }
+          hunks.pushMap(
+            Arguments.createMap().apply {
+              putInt("startLine", f(0).toIntOrNull() ?: 0)
+              putInt("lineCount", f(1).toIntOrNull() ?: 0)
+              putString("oid", f(2))
+              putString("authorName", f(3))
+              putString("authorEmail", f(4))
+              putDouble("authorTime", (f(5).toLongOrNull() ?: 0L) * 1000.0)
+              putString("summary", f(6))
+              putString("origPath", f(7))
+              putInt("origStartLine", f(8).toIntOrNull() ?: 0)
+              putBoolean("boundary", f(9) == "1")
+            },
+          )
+        }
+        hunks
+      },
+    ) { localPath ->
+      val path = params.getString("path") ?: throw IllegalArgumentException("path is required")
+      nativeBlame(localPath, path, optInt(params, "startLine"), optInt(params, "endLine"), optString(params, "ref"))
+    }
+  }
+
+  /** Decodes a window from codexmgit_jni.cpp (nativeReadRange); binary content stays base64. */
+  private fun decodeRange(packed: ByteArray): WritableMap {
+    val buf = ByteBuffer.wrap(packed).order(ByteOrder.LITTLE_ENDIAN)
+    val byteOffset = buf.getLong()
+    val totalBytes = buf.getLong()
+    val firstLine = buf.getLong()
+    val lineCount = buf.getLong()
+    val totalLines = buf.getLong()
+    val flags = buf.getInt()
+    val oid = ByteArray(buf.getInt()).also { buf.get(it) }
+    val dataAt = buf.position()
+    val dataLen = packed.size - dataAt
+    val binary = (flags and 1) != 0
+    return Arguments.createMap().apply {
+      if (binary) {
+        putString("base64", Base64.encodeToString(packed, dataAt, dataLen, Base64.NO_WRAP))
+      } else {
+        putString("text", String(packed, dataAt, dataLen, Charsets.UTF_8))
+      }
+      putBoolean("binary", binary)
+      putBoolean("truncated", (flags and 2) != 0)
+      putDouble("byteOffset", byteOffset.toDouble())
+      putDouble("byteLength", dataLen.toDouble())
+      putDouble("totalBytes", totalBytes.toDouble())
+      putDouble("firstLine", firstLine.toDouble())
+      putDouble("lineCount", lineCount.toDouble())
+      if (totalLines < 0) putNull("totalLines") else putDouble("totalLines", totalLines.toDouble())
+      if (oid.isEmpty()) putNull("oid") else putString("oid", String(oid, Charsets.US_ASCII))
+    }
+  }
+
+  private fun readRange(params: ReadableMap, promise: Promise, spec: String?, path: String?) {
+    val lines = params.hasKey("lines") && !params.isNull("lines") && params.getBoolean("lines")
+    val start = if (params.hasKey("start") && !params.isNull("start")) params.getDouble("start").toLong() else 0L
+    val count = if (params.hasKey("count") && !params.isNull("count")) params.getDouble("count").toLong() else 0L
+    submit(params, promise, "E_GIT_READ", finish = { decodeRange(it as ByteArray) }) { localPath ->
+      nativeReadRange(localPath, spec, path, lines, start, count, optInt(params, "maxBytes"))
+    }
+  }
+
+  /** A byte or line window of a blob (`spec` like "HEAD:src/app.ts" or a blob id). */
+  @ReactMethod
+  fun readBlobRange(params: ReadableMap, promise: Promise) {
+    val spec = optString(params, "spec")
+    if (spec.isNullOrEmpty()) {
+      promise.reject("E_GIT_READ", "spec is required")
+      return
+    }
+    readRange(params, promise, spec, null)
+  }
+
+  /** The same window of a work-tree file (`path` relative to the work tree). */
+  @ReactMethod
+  fun readFileRange(params: ReadableMap, promise: Promise) {
+    val path = optString(params, "path")
+    if (path.isNullOrEmpty()) {
+      promise.reject("E_GIT_READ", "path is required")
+      return
+    }
+    readRange(params, promise, null, path)
+  }
+
+  @ReactMethod
+  fun getSparsePaths(params: ReadableMap, promise: Promise) {
+    submit(
+      params,
+      promise,
+      "E_GIT_SPARSE",
+      coalesceKey = "getSparsePaths",
+      finish = { result ->
+        val res = Arguments.createArray()
+        decodeStrings(result as ByteArray).forEach { res.pushString(it) }
+        res
+      },
+    ) { localPath -> nativeGetSparsePaths(localPath) }
+  }
+
+  @ReactMethod
+  fun setSparsePaths(params: ReadableMap, promise: Promise) {
+    submit(params, promise, "E_GIT_SPARSE", kind = JOB_WRITE) { localPath ->
+      nativeSetSparsePaths(localPath, stringArrayOf(params, "paths"))
+      null
+    }
+  }
+
+  @ReactMethod
+  fun status(params: ReadableMap, promise: Promise) {
+    val renames = renameArgsOf(params)
+    submit(params, promise, "E_GIT_STATUS", coalesceKey = "status${renames.key}", finish = { decodeStatus(it as ByteArray) }) {
+      nativeStatus(it, renames.threshold, renames.limit, renames.copies)
+    }
+  }
+
+  @ReactMethod
+  fun statusIncremental(params: ReadableMap, promise: Promise) {
+    val touched = stringArrayOf(params, "touchedPaths")
+    val watch = !params.hasKey("watch") || params.isNull("watch") || params.getBoolean("watch")
+    // Calls carrying touchedPaths each have something new to report, so only bare polls coalesce.
+    val coalesceKey = if (touched.isEmpty()) "statusIncremental:$watch" else null
+    submit(params, promise, "E_GIT_STATUS", coalesceKey = coalesceKey, finish = { decodeStatus(it as ByteArray) }) {
+      nativeStatusIncremental(it, touched, watch)
+    }
+  }
+
+  /**
+   * Decodes the summaries from codexmgit_jni.cpp (status_many_to_packed), one per entry of `uris`
+   * and in the same order: u8 flags (1 dirty, 2 hasUpstream, 4 error), u32 staged, unstaged,
+   * untracked, ahead, behind (LE), then the NUL-terminated branch and error.
+   */
+  private fun decodeStatusMany(packed: ByteArray, uris: Array<String>): WritableArray {
+    val buf = ByteBuffer.wrap(packed).order(ByteOrder.LITTLE_ENDIAN)
+    fun cString(): String {
+      val start = buf.position()
+      var end = start
+      while (packed[end] != 0.toByte()) end++
+      buf.position(end + 1)
+      return String(packed, start, end - start, Charsets.UTF_8)
+    }
+    val out = Arguments.createArray()
+    repeat(buf.getInt()) { i ->
+      val flags = buf.get().toInt()
+      val staged = buf.getInt()
+      val unstaged = buf.getInt()
+      val untracked = buf.getInt()
+      val ahead = buf.getInt()
+      val behind = buf.getInt()
+      val branch = cString()
+      val error = cString()
+      out.pushMap(
+        Arguments.createMap().apply {
+          putString("localRepoDirUri", uris[i])
+          putBoolean("dirty", flags and 1 != 0)
+          putInt("staged", staged)
+          putInt("unstaged", unstaged)
+          putInt("untracked", untracked)
+          if (branch.isEmpty()) putNull("branch") else putString("branch", branch)
+          if (flags and 2 != 0) {
+            putInt("ahead", ahead)
+            putInt("behind", behind)
+          } else {
+            putNull("ahead")
+            putNull("behind")
+          }
+          if (flags and 4 != 0) putString("error", error)
+        },
+      )
+    }
+    return out
+  }
+
+  /**
+   * Summaries for many work trees at once (the workspace list). Each repository is its own job on
+   * the native scheduler, so they run in parallel; per-repository failures are reported in the
+   * entry's `error` instead of rejecting the whole call.
+   */
+  @ReactMethod
+  fun statusMany(params: ReadableMap, promise: Promise) {
+    val uris = stringArrayOf(params, "localRepoDirUris")
+    val summaryOnly = !params.hasKey("summaryOnly") || params.isNull("summaryOnly") || params.getBoolean("summaryOnly")
+    ensureNative()
+    nativeStatusMany(Array(uris.size) { uriToFilePath(uris[it]) }, summaryOnly, object : StatusManySink {
+      override fun onComplete(packed: ByteArray) {
+        try {
+          promise.resolve(decodeStatusMany(packed, uris))
+        } catch (e: Throwable) {
+          promise.reject("E_GIT_STATUS", e.message, e)
+        }
+      }
+    })
+  }
+
+  @ReactMethod
+  fun statusIncrementalReset(params: ReadableMap, promise: Promise) {
+    submit(params, promise, "E_GIT_STATUS", kind = JOB_WRITE) { localPath ->
+      nativeStatusIncrementalReset(localPath)
+      null
+    }
+  }
+
+  @ReactMethod
+  fun diff(params: ReadableMap, promise: Promise) {
+    val maxBytes = if (params.hasKey("maxBytes") && !params.isNull("maxBytes")) params.getInt("maxBytes") else 400000
+    val renames = renameArgsOf(params)
+    submit(params, promise, "E_GIT_DIFF", coalesceKey = "diff:$maxBytes${renames.key}") { localPath ->
+      nativeDiff(localPath, maxBytes, renames.threshold, renames.limit, renames.copies)
+    }
+  }
+
+  @ReactMethod
+  fun diffStructured(params: ReadableMap, promise: Promise) {
+    val renames = renameArgsOf(params)
+    submit(
+      params,
+      promise,
+      "E_GIT_DIFF",
+      coalesceKey = "diffStructured${renames.key}",
+      // The bridge has no binary type; the layout is decoded in src/git/structuredDiff.ts.
+      finish = { Base64.encodeToString(it as ByteArray, Base64.NO_WRAP) },
+    ) { localPath -> nativeDiffStructured(localPath, renames.threshold, renames.limit, renames.copies) }
+  }
+
+  @ReactMethod
+  fun diffStream(params: ReadableMap, promise: Promise) {
+    val id = params.getString("streamId")
+    if (id == null || params.getString("localRepoDirUri") == null) {
+      promise.reject("E_GIT_DIFF", "streamId and localRepoDirUri are required")
+      return
+    }
+    val chunkBytes =
+      if (params.hasKey("chunkBytes") && !params.isNull("chunkBytes")) params.getInt("chunkBytes") else 64 * 1024
+    // Registered before queueing so a cancel issued while the stream waits its turn is honoured.
+    val cancelled = AtomicBoolean(false)
+    diffStreams[id] = cancelled
+    val renames = renameArgsOf(params)
+
+    submit(params, promise, "E_GIT_DIFF") { localPath ->
       try {
-        val localRepoDirUri =
-          params.getString("localRepoDirUri") ?: throw IllegalArgumentException("localRepoDirUri is required")
-        val ref = params.getString("ref") ?: throw IllegalArgumentException("ref is required")
-        nativeCheckout(uriToFilePath(localRepoDirUri), ref)
-        promise.resolve(null)
-      } catch (e: Throwable) {
-        promise.reject("E_GIT_CHECKOUT", e.message, e)
+        val emitter = reactContext.getJSModule(RCTDeviceEventEmitter::class.java)
+        var seq = 0
+        var bytes = 0L
+        if (!cancelled.get()) {
+          nativeDiffStream(localPath, chunkBytes, renames.threshold, renames.limit, renames.copies, object : DiffChunkSink {
+            override fun onChunk(section: Int, path: ByteArray, fileStart: Boolean, data: ByteArray): Boolean {
+              if (cancelled.get()) return false
+              val payload = Arguments.createMap().apply {
+                putString("streamId", id)
+                putInt("seq", seq)
+                putString("section", if (section == 0) "staged" else "workdir")
+                putString("path", String(path, Charsets.UTF_8))
+                putBoolean("fileStart", fileStart)
+                putString("text", String(data, Charsets.UTF_8))
+              }
+              emitter.emit("CodexMGitDiffChunk", payload)
+              seq += 1
+              bytes += data.size
+              return !cancelled.get()
+            }
+          })
+        }
+
+        Arguments.createMap().apply {
+          putInt("chunks", seq)
+          putDouble("bytes", bytes.toDouble())
+          putBoolean("cancelled", cancelled.get())
+        }
+      } finally {
+        diffStreams.remove(id)
       }
     }
   }
 
   @ReactMethod
-  fun pull(params: ReadableMap, promise: Promise) {
-    ioExecutor.execute {
+  fun cancelDiffStream(streamId: String, promise: Promise) {
+    diffStreams[streamId]?.set(true)
+    promise.resolve(null)
+  }
+
+  /**
+   * Decodes a match batch from codexmgit_jni.cpp: u32 count, then per match u32 line, u32 column,
+   * u32 length + UTF-8 path, u32 length + UTF-8 text (all LE).
+   */
+  private fun decodeSearchBatch(packed: ByteArray): WritableArray {
+    val buf = ByteBuffer.wrap(packed).order(ByteOrder.LITTLE_ENDIAN)
+    val out = Arguments.createArray()
+    repeat(buf.getInt()) {
+      val line = buf.getInt()
+      val column = buf.getInt()
+      val pathLen = buf.getInt()
+      val path = String(packed, buf.position(), pathLen, Charsets.UTF_8)
+      buf.position(buf.position() + pathLen)
+      val textLen = buf.getInt()
+      val text = String(packed, buf.position(), textLen, Charsets.UTF_8)
+      buf.position(buf.position() + textLen)
+      out.pushMap(
+        Arguments.createMap().apply {
+          putString("path", path)
+          putInt("line", line)
+          putInt("column", column)
+          putString("text", text)
+        },
+      )
+    }
+    return out
+  }
+
+  @ReactMethod
+  fun search(params: ReadableMap, promise: Promise) {
+    val id = params.getString("searchId")
+    val pattern = params.getString("pattern")
+    if (id == null || pattern == null || params.getString("localRepoDirUri") == null) {
+      promise.reject("E_GIT_SEARCH", "searchId, pattern and localRepoDirUri are required")
+      return
+    }
+    val regex = params.hasKey("regex") && params.getBoolean("regex")
+    val ignoreCase = params.hasKey("ignoreCase") && params.getBoolean("ignoreCase")
+    val includeIgnored = params.hasKey("includeIgnored") && params.getBoolean("includeIgnored")
+    val useIndex = params.hasKey("useIndex") && params.getBoolean("useIndex")
+    val maxResults =
+      if (params.hasKey("maxResults") && !params.isNull("maxResults")) params.getInt("maxResults") else 0
+    val paths = stringArrayOf(params, "paths")
+    // Same as diffStream: registered before queueing so an early cancel is honoured.
+    val cancelled = AtomicBoolean(false)
+    searches[id] = cancelled
+
+    submit(params, promise, "E_GIT_SEARCH") { localPath ->
       try {
-        val localRepoDirUri =
-          params.getString("localRepoDirUri") ?: throw IllegalArgumentException("localRepoDirUri is required")
-        val remote = if (params.hasKey("remote") && !params.isNull("remote")) params.getString("remote") else null
-        val branch = if (params.hasKey("branch") && !params.isNull("branch")) params.getString("branch") else null
+        val emitter = reactContext.getJSModule(RCTDeviceEventEmitter::class.java)
+        var seq = 0
+        var stats = LongArray(4)
+        if (!cancelled.get()) {
+          try {
+            stats = nativeSearch(
+              localPath,
+              pattern,
+              regex,
+              ignoreCase,
+              paths,
+              includeIgnored,
+              useIndex,
+              maxResults,
+              "search:$id",
+              object : SearchSink {
+                override fun onBatch(packed: ByteArray): Boolean {
+                  if (cancelled.get()) return false
+                  val payload = Arguments.createMap().apply {
+                    putString("searchId", id)
+                    putInt("seq", seq)
+                    putArray("matches", decodeSearchBatch(packed))
+                  }
+                  emitter.emit("CodexMGitSearchMatches", payload)
+                  seq += 1
+                  return !cancelled.get()
+                }
+              },
+            )
+          } catch (e: CancellationException) {
+            cancelled.set(true)
+          }
+        }
 
-        val auth = if (params.hasKey("auth") && !params.isNull("auth")) params.getMap("auth") else null
-        val username = auth?.getString("username")
-        val token = auth?.getString("token")
-        val allowInsecure = params.hasKey("allowInsecure") && params.getBoolean("allowInsecure")
+        Arguments.createMap().apply {
+          putDouble("filesScanned", stats[0].toDouble())
+          putDouble("bytesScanned", stats[1].toDouble())
+          putDouble("matches", stats[2].toDouble())
+          putBoolean("truncated", stats[3] != 0L)
+          putBoolean("cancelled", cancelled.get())
+        }
+      } finally {
+        searches.remove(id)
+      }
+    }
+  }
+
+  @ReactMethod
+  fun cancelSearch(searchId: String, promise: Promise) {
+    searches[searchId]?.set(true)
+    // Stops the walk even between batches.
+    if (NativeLibrary.isLoaded) nativeCancelOperation("search:$searchId")
+    promise.resolve(null)
+  }
 
-        nativePull(uriToFilePath(localRepoDirUri), remote, branch, username, token, allowInsecure)
-        promise.resolve(null)
-      } catch (e: Throwable) {
-        promise.reject("E_GIT_PULL", e.message, e)
+  @ReactMethod
+  fun searchIndexRefresh(params: ReadableMap, promise: Promise) {
+    submit(params, promise, "E_GIT_SEARCH") { localPath ->
+      val operationId = operationIdOf(params)
+      val r = nativeSearchIndexRefresh(localPath, operationId, progressSink("searchIndex", operationId))
+      Arguments.createMap().apply {
+        putDouble("files", r[0].toDouble())
+        putDouble("blobs", r[1].toDouble())
+        putDouble("segments", r[2].toDouble())
+        putDouble("bytes", r[3].toDouble())
+        putDouble("indexedNow", r[4].toDouble())
       }
     }
   }
 
   @ReactMethod
-  fun push(params: ReadableMap, promise: Promise) {
-    ioExecutor.execute {
-      try {
-        val localRepoDirUri =
-          params.getString("localRepoDirUri") ?: throw IllegalArgumentException("localRepoDirUri is required")
-        val remote = if (params.hasKey("remote") && !params.isNull("remote")) params.getString("remote") else null
-        val branch = if (params.hasKey("branch") && !params.isNull("branch")) params.getString("branch") else null
+  fun searchIndexDrop(params: ReadableMap, promise: Promise) {
+    submit(params, promise, "E_GIT_SEARCH", kind = JOB_WRITE) { localPath ->
+      nativeSearchIndexDrop(localPath)
+      null
+    }
+  }
+
+  @ReactMethod
+  fun treeManifest(params: ReadableMap, promise: Promise) {
+    val manifestUri = optString(params, "manifestUri")
+    if (manifestUri == null) {
+      promise.reject("E_GIT_MANIFEST", "manifestUri is required")
+      return
+    }
+    val changedOnly = params.hasKey("changedOnly") && params.getBoolean("changedOnly")
+    submit(
+      params,
+      promise,
+      "E_GIT_MANIFEST",
+      finish = { result ->
+        // Layout from nativeTreeManifest: 5 counters, the dirs, the deleted paths, then 4 fields
+        // per file.
+        val flat = decodeStrings(result as ByteArray)
+        val dirCount = (flat[0] as String).toInt()
+        val deletedCount = (flat[1] as String).toInt()
+        val dirs = Arguments.createArray()
+        val deleted = Arguments.createArray()
+        for (i in 0 until dirCount) dirs.pushString(flat[5 + i] as String)
+        for (i in 0 until deletedCount) deleted.pushString(flat[5 + dirCount + i] as String)
+        val files = Arguments.createArray()
+        var i = 5 + dirCount + deletedCount
+        while (i + 4 <= flat.size) {
+          files.pushMap(
+            Arguments.createMap().apply {
+              putString("path", flat[i] as String)
+              putString("oid", flat[i + 1] as String)
+              putDouble("size", (flat[i + 2] as String).toDouble())
+              putString(
+                "change",
+                when (flat[i + 3] as String) {
+                  "A" -> "added"
+                  "M" -> "modified"
+                  else -> "unchanged"
+                },
+              )
+            },
+          )
+          i += 4
+        }
+        Arguments.createMap().apply {
+          putArray("files", files)
+          putArray("dirs", dirs)
+          putArray("deleted", deleted)
+          putDouble("hashed", (flat[2] as String).toDouble())
+          putDouble("fromIndex", (flat[3] as String).toDouble())
+          putDouble("fromManifest", (flat[4] as String).toDouble())
+        }
+      },
+    ) { localPath ->
+      val operationId = operationIdOf(params)
+      nativeTreeManifest(
+        localPath,
+        uriToFilePath(manifestUri),
+        stringArrayOf(params, "excludeNames"),
+        changedOnly,
+        operationId,
+        progressSink("treeManifest", operationId),
+      )
+    }
+  }
 
-        val auth = if (params.hasKey("auth") && !params.isNull("auth")) params.getMap("auth") else null
-        val username = auth?.getString("username")
-        val token = auth?.getString("token")
-        val allowInsecure = params.hasKey("allowInsecure") && params.getBoolean("allowInsecure")
+  @ReactMethod
+  fun treeManifestCommit(params: ReadableMap, promise: Promise) {
+    val manifestUri = optString(params, "manifestUri")
+    if (manifestUri == null) {
+      promise.reject("E_GIT_MANIFEST", "manifestUri is required")
+      return
+    }
+    submit(params, promise, "E_GIT_MANIFEST") { _ ->
+      nativeTreeManifestCommit(uriToFilePath(manifestUri))
+      null
+    }
+  }
 
-        nativePush(uriToFilePath(localRepoDirUri), remote, branch, username, token, allowInsecure)
-        promise.resolve(null)
-      } catch (e: Throwable) {
-        promise.reject("E_GIT_PUSH", e.message, e)
+  private fun openBundleConnection(params: ReadableMap, method: String): HttpURLConnection {
+    val url = optString(params, "url") ?: throw IllegalArgumentException("url is required")
+    val conn = URL(url).openConnection() as HttpURLConnection
+    conn.requestMethod = method
+    conn.connectTimeout = 30_000
+    conn.readTimeout = 120_000
+    if (params.hasKey("headers") && !params.isNull("headers")) {
+      val headers = params.getMap("headers")!!
+      val it = headers.keySetIterator()
+      while (it.hasNextKey()) {
+        val k = it.nextKey()
+        val v = headers.getString(k)
+        if (v != null) conn.setRequestProperty(k, v)
       }
     }
+    return conn
   }
 
+  // Packs the tree natively into one end of a pipe while this thread streams the other end as a
+  // chunked PUT, so the archive never exists on disk.
   @ReactMethod
-  fun status(params: ReadableMap, promise: Promise) {
-    ioExecutor.execute {
+  fun uploadTreeBundle(params: ReadableMap, promise: Promise) {
+    submit(params, promise, "E_GIT_BUNDLE", kind = JOB_NETWORK) { localPath ->
+      val conn = openBundleConnection(params, "PUT")
+      conn.doOutput = true
+      conn.setChunkedStreamingMode(BUNDLE_BUFFER_BYTES)
+      conn.setRequestProperty("Content-Type", "application/gzip")
+
+      val (readSide, writeSide) = ParcelFileDescriptor.createPipe()
+      var stats: LongArray? = null
+      var packError: Throwable? = null
+      val packer = Thread({
+        try {
+          stats = nativePackTree(localPath, stringArrayOf(params, "paths"), stringArrayOf(params, "excludeNames"), writeSide.fd)
+        } catch (e: Throwable) {
+          packError = e
+        } finally {
+          writeSide.close()
+        }
+      }, "codexm-pack")
+      packer.start()
       try {
-        val localRepoDirUri =
-          params.getString("localRepoDirUri") ?: throw IllegalArgumentException("localRepoDirUri is required")
-        val res = nativeStatus(uriToFilePath(localRepoDirUri))
-        promise.resolve(res)
-      } catch (e: Throwable) {
-        promise.reject("E_GIT_STATUS", e.message, e)
+        ParcelFileDescriptor.AutoCloseInputStream(readSide).use { input ->
+          val output = conn.outputStream
+          input.copyTo(output, BUNDLE_BUFFER_BYTES)
+          // A failed pack also ends the stream; don't let the server take the truncated archive
+          // for a complete one.
+          packer.join()
+          packError?.let { throw it }
+          output.close()
+        }
+        val code = conn.responseCode
+        if (code !in 200..299) throw RuntimeException("WebDAV PUT failed: $code")
+        val s = stats!!
+        Arguments.createMap().apply {
+          putDouble("files", s[0].toDouble())
+          putDouble("directories", s[1].toDouble())
+          putDouble("links", s[2].toDouble())
+          putDouble("bytes", s[3].toDouble())
+          putDouble("written", s[4].toDouble())
+          val etag = conn.getHeaderField("ETag")
+          if (etag != null) putString("etag", etag)
+        }
+      } finally {
+        readSide.close()
+        packer.join()
+        conn.disconnect()
       }
     }
   }
 
+  // The response body is copied into a pipe on a helper thread and extracted natively from the
+  // other end as it arrives.
   @ReactMethod
-  fun diff(params: ReadableMap, promise: Promise) {
-    ioExecutor.execute {
+  fun downloadTreeBundle(params: ReadableMap, promise: Promise) {
+    submit(params, promise, "E_GIT_BUNDLE", kind = JOB_NETWORK) { localPath ->
+      val conn = openBundleConnection(params, "GET")
       try {
-        val localRepoDirUri =
-          params.getString("localRepoDirUri") ?: throw IllegalArgumentException("localRepoDirUri is required")
-        val maxBytes = if (params.hasKey("maxBytes") && !params.isNull("maxBytes")) params.getInt("maxBytes") else 400000
-        val res = nativeDiff(uriToFilePath(localRepoDirUri), maxBytes)
-        promise.resolve(res)
-      } catch (e: Throwable) {
-        promise.reject("E_GIT_DIFF", e.message, e)
+        val code = conn.responseCode
+        if (code !in 200..299) throw RuntimeException("WebDAV GET failed: $code")
+
+        val (readSide, writeSide) = ParcelFileDescriptor.createPipe()
+        val feedError = AtomicReference<Throwable?>()
+        val feeder = Thread({
+          try {
+            conn.inputStream.use { input ->
+              ParcelFileDescriptor.AutoCloseOutputStream(writeSide).use { output ->
+                input.copyTo(output, BUNDLE_BUFFER_BYTES)
+              }
+            }
+          } catch (e: Throwable) {
+            feedError.set(e)
+            writeSide.close()
+          }
+        }, "codexm-unpack")
+        feeder.start()
+        // The extractor stops at the end-of-archive blocks, so a copy that fails after that (on
+        // trailing bytes) doesn't matter; one that failed before the extractor did explains the
+        // truncated archive. Once the extractor fails, closing the pipe makes the copy fail too
+        // ("Broken pipe"), so the extractor's own error (e.g. a bad checksum) is the one to report.
+        var unpackError: Throwable? = null
+        val s = try {
+          nativeUnpackTree(readSide.fd, localPath)
+        } catch (e: Throwable) {
+          unpackError = feedError.get() ?: e
+          null
+        }
+        readSide.close()
+        feeder.join()
+        if (s == null) throw unpackError!!
+        Arguments.createMap().apply {
+          putDouble("files", s[0].toDouble())
+          putDouble("directories", s[1].toDouble())
+          putDouble("links", s[2].toDouble())
+          putDouble("bytes", s[3].toDouble())
+        }
+      } finally {
+        conn.disconnect()
       }
     }
   }
+
+  @ReactMethod
+  fun releaseRepo(params: ReadableMap, promise: Promise) {
+    submit(params, promise, "E_GIT_RELEASE", kind = JOB_WRITE) { localPath ->
+      nativeReleaseRepo(localPath)
+      null
+    }
+  }
+
+  private companion object {
+    // GitJobKind in scheduler.h.
+    const val JOB_READ = 0
+    const val JOB_WRITE = 1
+    const val JOB_NETWORK = 2
+
+    // GitMemoryClass in git_ops.h.
+    const val MEMORY_LOW = 0
+    const val MEMORY_MID = 1
+    const val MEMORY_HIGH = 2
+
+    const val BUNDLE_BUFFER_BYTES = 256 * 1024
+  }
 }
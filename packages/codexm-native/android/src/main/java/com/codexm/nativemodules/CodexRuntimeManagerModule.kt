@@ -2,7 +2,9 @@ package com.codexm.nativemodules
 
 import android.net.Uri
 import android.os.Build
+import android.os.ParcelFileDescriptor
 import android.system.Os
+import androidx.annotation.Keep
 import com.facebook.react.bridge.Arguments
 import com.facebook.react.bridge.Promise
 import com.facebook.react.bridge.ReactApplicationContext
@@ -10,11 +12,8 @@ import com.facebook.react.bridge.ReactContextBaseJavaModule
 import com.facebook.react.bridge.ReactMethod
 import com.facebook.react.bridge.ReadableMap
 import com.facebook.react.modules.core.DeviceEventManagerModule.RCTDeviceEventEmitter
-import java.io.BufferedInputStream
 import java.io.BufferedReader
 import java.io.File
-import java.io.FileInputStream
-import java.io.FileOutputStream
 import java.io.InputStreamReader
 import java.io.OutputStreamWriter
 import java.nio.charset.StandardCharsets
@@ -22,7 +21,6 @@ import java.util.concurrent.ConcurrentHashMap
 import java.util.concurrent.Executors
 import java.util.concurrent.TimeUnit
 import java.util.concurrent.atomic.AtomicBoolean
-import java.util.zip.GZIPInputStream
 
 class CodexRuntimeManagerModule(private val reactContext: ReactApplicationContext) :
   ReactContextBaseJavaModule(reactContext) {
@@ -43,6 +41,16 @@ class CodexRuntimeManagerModule(private val reactContext: ReactApplicationContex
   private val ioExecutor = Executors.newCachedThreadPool()
   private val runtimes = ConcurrentHashMap<String, RuntimeProc>()
 
+  @Keep
+  private interface LineBatchSink {
+    // `batch` is UTF-8, records joined by '\n'. Return false to stop reading.
+    fun onBatch(batch: ByteArray, records: Int): Boolean
+  }
+
+  private external fun nativeExtractTarGz(archivePath: String, destDir: String, sha256: String?): LongArray
+  private external fun nativeOpenFifo(path: String): Int
+  private external fun nativeReadJsonl(fd: Int, frameMs: Int, sink: LineBatchSink): LongArray?
+
   override fun getName(): String = "CodexRuntimeManager"
 
   private fun chmodExecutable(path: String) {
@@ -111,6 +119,40 @@ class CodexRuntimeManagerModule(private val reactContext: ReactApplicationContex
     reactContext.getJSModule(RCTDeviceEventEmitter::class.java).emit("CodexRuntimeLine", payload)
   }
 
+  private fun emitLines(runtimeId: String, text: String, count: Int) {
+    val payload = Arguments.createMap().apply {
+      putString("runtimeId", runtimeId)
+      putString("stream", "stdout")
+      putString("text", text)
+      putInt("count", count)
+    }
+    reactContext.getJSModule(RCTDeviceEventEmitter::class.java).emit("CodexRuntimeLines", payload)
+  }
+
+  // Stdout goes through a FIFO instead of the Process pipe so the native framer can read the fd
+  // directly (Process.getInputStream() exposes no descriptor). Returns the open read end, or null
+  // when FIFOs are unavailable and the caller should keep the regular pipe.
+  private fun openStdoutFifo(runtimeId: String): Pair<File, Int>? {
+    val fifo = File(reactContext.cacheDir, "codex-stdout-$runtimeId-${System.nanoTime()}")
+    return try {
+      NativeLibrary.ensureLoaded()
+      // 0600
+      Os.mkfifo(fifo.absolutePath, 384)
+      Pair(fifo, nativeOpenFifo(fifo.absolutePath))
+    } catch (_: Throwable) {
+      fifo.delete()
+      null
+    }
+  }
+
+  private fun closeFd(fd: Int) {
+    try {
+      ParcelFileDescriptor.adoptFd(fd).close()
+    } catch (_: Throwable) {
+      // best-effort
+    }
+  }
+
   private fun uriToFilePath(uriOrPath: String): String {
     return try {
       val uri = Uri.parse(uriOrPath)
@@ -241,9 +283,16 @@ class CodexRuntimeManagerModule(private val reactContext: ReactApplicationContex
         }
       }
 
+      val stdoutFifo = openStdoutFifo(runtimeId)
+      if (stdoutFifo != null) pb.redirectOutput(stdoutFifo.first)
+
       val proc = try {
         pb.start()
       } catch (e: Throwable) {
+        if (stdoutFifo != null) {
+          closeFd(stdoutFifo.second)
+          stdoutFifo.first.delete()
+        }
         val msg = e.message ?: ""
         if (msg.contains("error=13") || msg.contains("Permission denied", ignoreCase = true)) {
           val appData = reactContext.filesDir.absolutePath
@@ -267,16 +316,34 @@ class CodexRuntimeManagerModule(private val reactContext: ReactApplicationContex
       val runtime = RuntimeProc(runtimeId, proc, stdin, alive)
       runtimes[runtimeId] = runtime
 
-      ioExecutor.execute {
-        try {
-          BufferedReader(InputStreamReader(proc.inputStream, StandardCharsets.UTF_8)).use { br ->
-            while (alive.get()) {
-              val line = br.readLine() ?: break
-              emitLine(runtimeId, "stdout", line)
+      if (stdoutFifo != null) {
+        // The child holds its own write end now; the name is no longer needed.
+        stdoutFifo.first.delete()
+        val sink = object : LineBatchSink {
+          override fun onBatch(batch: ByteArray, records: Int): Boolean {
+            emitLines(runtimeId, String(batch, StandardCharsets.UTF_8), records)
+            return alive.get()
+          }
+        }
+        ioExecutor.execute {
+          try {
+            nativeReadJsonl(stdoutFifo.second, 16, sink)
+          } catch (e: Throwable) {
+            emitLine(runtimeId, "stderr", "stdout reader error: ${e.message}")
+          }
+        }
+      } else {
+        ioExecutor.execute {
+          try {
+            BufferedReader(InputStreamReader(proc.inputStream, StandardCharsets.UTF_8)).use { br ->
+              while (alive.get()) {
+                val line = br.readLine() ?: break
+                emitLine(runtimeId, "stdout", line)
+              }
             }
+          } catch (e: Throwable) {
+            emitLine(runtimeId, "stderr", "stdout reader error: ${e.message}")
           }
-        } catch (e: Throwable) {
-          emitLine(runtimeId, "stderr", "stdout reader error: ${e.message}")
         }
       }
 
@@ -361,51 +428,6 @@ class CodexRuntimeManagerModule(private val reactContext: ReactApplicationContex
     }
   }
 
-  private fun tarString(buf: ByteArray, offset: Int, len: Int): String {
-    var end = offset
-    val max = offset + len
-    while (end < max && buf[end].toInt() != 0) end++
-    return String(buf, offset, end - offset, StandardCharsets.UTF_8)
-  }
-
-  private fun tarOctal(buf: ByteArray, offset: Int, len: Int): Long {
-    val s = tarString(buf, offset, len).trim()
-    if (s.isBlank()) return 0
-    return try {
-      s.toLong(8)
-    } catch (_: Throwable) {
-      0
-    }
-  }
-
-  private fun readFully(input: java.io.InputStream, buf: ByteArray, len: Int): Int {
-    var total = 0
-    while (total < len) {
-      val n = input.read(buf, total, len - total)
-      if (n <= 0) break
-      total += n
-    }
-    return total
-  }
-
-  private fun skipFully(input: java.io.InputStream, bytes: Long) {
-    var remaining = bytes
-    while (remaining > 0) {
-      val skipped = try {
-        input.skip(remaining)
-      } catch (_: Throwable) {
-        0
-      }
-      if (skipped > 0) {
-        remaining -= skipped
-        continue
-      }
-      val b = input.read()
-      if (b == -1) break
-      remaining -= 1
-    }
-  }
-
   @ReactMethod
   fun chmod(params: ReadableMap, promise: Promise) {
     try {
@@ -422,90 +444,34 @@ class CodexRuntimeManagerModule(private val reactContext: ReactApplicationContex
     }
   }
 
+  /**
+   * Extracts a .tar.gz natively (tar_extract.cpp): streaming inflate and direct writes, with an
+   * optional SHA-256 of the archive checked in parallel. Resolves with entry counts.
+   */
   @ReactMethod
   fun extractTarGz(params: ReadableMap, promise: Promise) {
-    try {
-      val archive0 = params.getString("archivePath") ?: throw IllegalArgumentException("archivePath is required")
-      val destDir0 = params.getString("destDir") ?: throw IllegalArgumentException("destDir is required")
-      val archivePath = uriToFilePath(archive0)
-      val destDirPath = uriToFilePath(destDir0)
-
-      val destRoot = File(destDirPath).apply { mkdirs() }.canonicalFile
-      val destRootPrefix = destRoot.absolutePath + File.separator
-
-      val header = ByteArray(512)
-      val buf = ByteArray(32 * 1024)
-
-      FileInputStream(File(archivePath)).use { fis ->
-        GZIPInputStream(BufferedInputStream(fis)).use { input ->
-          while (true) {
-            val n = readFully(input, header, 512)
-            if (n == 0) break
-            if (n < 512) throw IllegalStateException("invalid tar header: truncated")
-
-            var allZero = true
-            for (b in header) {
-              if (b.toInt() != 0) {
-                allZero = false
-                break
-              }
-            }
-            if (allZero) break
-
-            val name = tarString(header, 0, 100).trim()
-            val prefix = tarString(header, 345, 155).trim()
-            val fullName = when {
-              prefix.isNotBlank() && name.isNotBlank() -> "$prefix/$name"
-              name.isNotBlank() -> name
-              else -> ""
-            }
-
-            val size = tarOctal(header, 124, 12)
-            val typeFlag = header[156].toInt().toChar()
-            val normalized = fullName.replace('\\', '/')
-
-            val padding = ((512 - (size % 512)) % 512)
-
-            if (normalized.isBlank()) {
-              skipFully(input, size + padding)
-              continue
-            }
-
-            // Prevent path traversal.
-            val out = File(destRoot, normalized).canonicalFile
-            val outPath = out.absolutePath
-            if (!(outPath == destRoot.absolutePath || outPath.startsWith(destRootPrefix))) {
-              skipFully(input, size + padding)
-              continue
-            }
-
-            val isDir = typeFlag == '5' || normalized.endsWith("/")
-            if (isDir) {
-              out.mkdirs()
-              skipFully(input, size + padding)
-              continue
-            }
-
-            // Regular file
-            out.parentFile?.mkdirs()
-            FileOutputStream(out).use { fos ->
-              var remaining = size
-              while (remaining > 0) {
-                val toRead = kotlin.math.min(buf.size.toLong(), remaining).toInt()
-                val r = input.read(buf, 0, toRead)
-                if (r <= 0) throw IllegalStateException("invalid tar entry: truncated")
-                fos.write(buf, 0, r)
-                remaining -= r.toLong()
-              }
-            }
-            skipFully(input, padding)
-          }
-        }
+    val archive0 = params.getString("archivePath")
+    val destDir0 = params.getString("destDir")
+    if (archive0 == null || destDir0 == null) {
+      promise.reject("E_TAR_GZ", "archivePath and destDir are required")
+      return
+    }
+    val sha256 = if (params.hasKey("sha256") && !params.isNull("sha256")) params.getString("sha256") else null
+    ioExecutor.execute {
+      try {
+        NativeLibrary.ensureLoaded()
+        val stats = nativeExtractTarGz(uriToFilePath(archive0), uriToFilePath(destDir0), sha256)
+        promise.resolve(
+          Arguments.createMap().apply {
+            putDouble("files", stats[0].toDouble())
+            putDouble("directories", stats[1].toDouble())
+            putDouble("links", stats[2].toDouble())
+            putDouble("bytes", stats[3].toDouble())
+          },
+        )
+      } catch (e: Throwable) {
+        promise.reject("E_TAR_GZ", e.message, e)
       }
-
-      promise.resolve(null)
-    } catch (e: Throwable) {
-      promise.reject("E_TAR_GZ", e.message, e)
     }
   }
 }
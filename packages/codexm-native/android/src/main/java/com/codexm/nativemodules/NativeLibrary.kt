@@ -0,0 +1,64 @@
+package com.codexm.nativemodules
+
+import android.os.Looper
+import android.os.Process
+
+/**
+ * libcodexm_git (libgit2 + OpenSSL) for both modules, loaded on first use instead of while React
+ * Native builds its modules: mapping and relocating it, then initialising libgit2, used to sit on
+ * the startup path before the first frame. [warmUpWhenIdle] moves that work to a background thread
+ * once the main thread has nothing left to do.
+ */
+internal object NativeLibrary {
+  @Volatile private var loaded = false
+  private val onLoadHooks = ArrayList<() -> Unit>()
+
+  val isLoaded: Boolean
+    get() = loaded
+
+  /**
+   * Loads the library if needed. Hooks run on the loading thread before any other caller returns,
+   * so native calls after this always see them applied.
+   */
+  fun ensureLoaded() {
+    if (loaded) return
+    synchronized(this) {
+      if (loaded) return
+      System.loadLibrary("codexm_git")
+      for (hook in onLoadHooks) hook()
+      onLoadHooks.clear()
+      loaded = true
+    }
+  }
+
+  /** Runs `hook` right after the library is loaded, or now if it already is. */
+  fun onLoad(hook: () -> Unit) {
+    synchronized(this) {
+      if (!loaded) {
+        onLoadHooks.add(hook)
+        return
+      }
+    }
+    hook()
+  }
+
+  /**
+   * When the main looper next goes idle (after the first frame has been drawn), loads the library
+   * and runs `warmUp` on a low-priority thread. A JS call that needs the library earlier just
+   * loads it itself.
+   */
+  fun warmUpWhenIdle(warmUp: () -> Unit) {
+    Looper.getMainLooper().queue.addIdleHandler {
+      Thread({
+        Process.setThreadPriority(Process.THREAD_PRIORITY_BACKGROUND)
+        try {
+          ensureLoaded()
+          warmUp()
+        } catch (_: Throwable) {
+          // best-effort: the next real call loads it again and reports the failure.
+        }
+      }, "codexm-warmup").start()
+      false
+    }
+  }
+}
@@ -69,6 +69,13 @@ export class JsonRpcClient {
     await this.sendLine(JSON.stringify(payload));
   }
 
+  /** Handle a batch of JSONL lines joined by '\n'. */
+  async handleLines(text: string) {
+    for (const line of text.split('\n')) {
+      await this.handleLine(line);
+    }
+  }
+
   /** Handle a single JSONL line from the transport. */
   async handleLine(line: string) {
     let msg: any;
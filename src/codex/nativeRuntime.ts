@@ -6,6 +6,21 @@ export type CodexRuntimeLineEvent = {
   line: string;
 };
 
+/** Stdout records framed natively: `count` JSONL records joined by '\n', one event per frame. */
+export type CodexRuntimeLinesEvent = {
+  runtimeId: string;
+  stream: 'stdout';
+  text: string;
+  count: number;
+};
+
+export type TarExtractStats = {
+  files: number;
+  directories: number;
+  links: number;
+  bytes: number;
+};
+
 type NativeCodexRuntimeManager = {
   start(params: {
     runtimeId: string;
@@ -18,7 +33,7 @@ type NativeCodexRuntimeManager = {
   stop(params?: { runtimeId: string }): Promise<void>;
   send(params: { runtimeId: string; line: string }): Promise<void>;
   chmod(params: { path: string }): Promise<void>;
-  extractTarGz(params: { archivePath: string; destDir: string }): Promise<void>;
+  extractTarGz(params: { archivePath: string; destDir: string; sha256?: string }): Promise<TarExtractStats>;
 };
 
 function getNativeRuntime(): NativeCodexRuntimeManager {
@@ -36,6 +51,11 @@ export function onCodexRuntimeLine(listener: (ev: CodexRuntimeLineEvent) => void
   return () => sub.remove();
 }
 
+export function onCodexRuntimeLines(listener: (ev: CodexRuntimeLinesEvent) => void) {
+  const sub = DeviceEventEmitter.addListener('CodexRuntimeLines', listener);
+  return () => sub.remove();
+}
+
 export async function startCodexRuntime(params: Parameters<NativeCodexRuntimeManager['start']>[0]) {
   return await getNativeRuntime().start(params);
 }
@@ -52,6 +72,14 @@ export async function chmodPath(pathOrUri: string) {
   return await getNativeRuntime().chmod({ path: pathOrUri });
 }
 
-export async function extractTarGz(archivePathOrUri: string, destDirUri: string) {
-  return await getNativeRuntime().extractTarGz({ archivePath: archivePathOrUri, destDir: destDirUri });
+/**
+ * Extracts a .tar.gz in native code. With `sha256` (hex, of the archive) the download is verified
+ * while extracting; a mismatch rejects after files were written, so extract into a scratch dir.
+ */
+export async function extractTarGz(archivePathOrUri: string, destDirUri: string, opts?: { sha256?: string }) {
+  return await getNativeRuntime().extractTarGz({
+    archivePath: archivePathOrUri,
+    destDir: destDirUri,
+    sha256: opts?.sha256,
+  });
 }
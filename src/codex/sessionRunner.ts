@@ -1,14 +1,15 @@
 import type { Workspace } from '@/src/workspaces/types';
 import { Platform } from 'react-native';
 
+import { gitDrainTrace, gitSetTracing } from '@/src/git/nativeGit';
 import { listMcpServers } from '@/src/mcp/store';
 import { getSession, setSessionCodexThreadId } from '@/src/sessions/store';
 import { ensureWorkspaceDirs, workspaceRepoPath } from '@/src/workspaces/paths';
 
 import { JsonRpcClient, JsonRpcError } from './jsonRpc';
 import type { JsonRpcNotification } from './jsonRpc';
-import type { CodexRuntimeLineEvent } from './nativeRuntime';
-import { onCodexRuntimeLine, sendCodexLine, startCodexRuntime, stopCodexRuntime } from './nativeRuntime';
+import type { CodexRuntimeLineEvent, CodexRuntimeLinesEvent } from './nativeRuntime';
+import { onCodexRuntimeLine, onCodexRuntimeLines, sendCodexLine, startCodexRuntime, stopCodexRuntime } from './nativeRuntime';
 import { getCodexApiKey, getCodexSettings, materializeCodexConfigFiles } from './settings';
 import { appendDebugLog, pruneDebugLogs } from './debugLog';
 
@@ -160,6 +161,8 @@ export async function* runCodexTurn(_params: {
   }
 
   if (debugLogEnabled) void pruneDebugLogs(workspace.id, retentionDays);
+  // Native git timings go to the same log; recording costs nothing while the log is off.
+  void gitSetTracing(debugLogEnabled).catch(() => {});
   if (!settings.enabled) {
     logEvent('blocked', 'Codex 未开启。');
     yield { type: 'error', message: 'Codex 未开启：请到「设置」中开启。' };
@@ -210,10 +213,11 @@ export async function* runCodexTurn(_params: {
 
   // One process per turn (simple + avoids cross-session event mixing).
   const runtimeId = `${workspace.id}:${sessionId}:${Date.now()}`;
-  const lineQueue = new AsyncQueue<CodexRuntimeLineEvent>();
+  const lineQueue = new AsyncQueue<CodexRuntimeLineEvent | CodexRuntimeLinesEvent>();
   const notifQueue = new AsyncQueue<JsonRpcNotification>();
 
   let unsubscribe = () => {};
+  let unsubscribeBatches = () => {};
 
   let pumpRunning = true;
   let started = false;
@@ -293,6 +297,10 @@ export async function* runCodexTurn(_params: {
       if (ev.runtimeId !== runtimeId) return;
       lineQueue.push(ev);
     });
+    unsubscribeBatches = onCodexRuntimeLines((ev) => {
+      if (ev.runtimeId !== runtimeId) return;
+      lineQueue.push(ev);
+    });
 
     await startCodexRuntime({
       runtimeId,
@@ -309,7 +317,8 @@ export async function* runCodexTurn(_params: {
         const ev = await lineQueue.shift();
         if (!ev) break;
         if (ev.stream !== 'stdout') continue;
-        await rpc.handleLine(ev.line);
+        if ('text' in ev) await rpc.handleLines(ev.text);
+        else await rpc.handleLine(ev.line);
       }
     })();
 
@@ -537,6 +546,7 @@ export async function* runCodexTurn(_params: {
     lineQueue.close();
     notifQueue.close();
     unsubscribe();
+    unsubscribeBatches();
     try {
       if (started) await stopCodexRuntime(runtimeId);
     } catch {
@@ -549,6 +559,13 @@ export async function* runCodexTurn(_params: {
     }
     const tail = takeFlush(true);
     if (tail) yield { type: 'text', text: tail };
+    if (debugLogEnabled) {
+      try {
+        for (const record of await gitDrainTrace()) logEvent('git_trace', record.op, record);
+      } catch {
+        // ignore
+      }
+    }
     logEvent('turn_end');
     yield { type: 'done' };
   }
@@ -1,19 +1,115 @@
-import { NativeModules } from 'react-native';
+import { DeviceEventEmitter, NativeModules } from 'react-native';
 
 import { loadAuth } from '@/src/auth/authStore';
 import type { GitHttpsAuth } from '@/src/auth/types';
+import { uuidV4 } from '@/src/utils/uuid';
 
-import type { GitCheckoutParams, GitCloneParams, GitPullParams, GitPushParams, GitStatus } from './types';
+import type {
+  GitBlameHunk,
+  GitBlameParams,
+  GitBlobRangeParams,
+  GitCheckoutParams,
+  GitCloneParams,
+  GitCommitParams,
+  GitDiffChunkEvent,
+  GitDiffParams,
+  GitDiffStreamResult,
+  GitFileRange,
+  GitFileRangeParams,
+  GitIncrementalStatusParams,
+  GitLogPage,
+  GitLogParams,
+  GitMaintenanceParams,
+  GitMaintenanceResult,
+  GitOperationOptions,
+  GitPrefetchConfig,
+  GitPrefetchParams,
+  GitProgressEvent,
+  GitSnapshot,
+  GitPullParams,
+  GitPullResult,
+  GitPushParams,
+  GitRenameDetection,
+  GitRepoStatusSummary,
+  GitRuntimeConfig,
+  GitSearchIndexStats,
+  GitSearchMatch,
+  GitSearchMatchesEvent,
+  GitSearchParams,
+  GitSearchResult,
+  GitStatus,
+  GitStatusManyParams,
+  GitStatusParams,
+  GitStructuredDiff,
+  GitTraceRecord,
+  GitTreeBundleDownloadParams,
+  GitTreeBundleStats,
+  GitTreeBundleUploadParams,
+  GitTreeManifest,
+  GitTreeManifestParams,
+} from './types';
+import { decodePackedStatus } from './packedStatus';
+import { decodeStructuredDiff, decodeStructuredDiffBytes } from './structuredDiff';
 
 type NativeGitAuth = { username: string; token: string } | null;
 
+type NativeOperation = { operationId?: string };
+
 type NativeGitModule = {
-  clone(params: GitCloneParams & { auth?: NativeGitAuth; allowInsecure?: boolean }): Promise<void>;
-  checkout(params: GitCheckoutParams): Promise<void>;
-  pull(params: GitPullParams & { auth?: NativeGitAuth; allowInsecure?: boolean }): Promise<void>;
-  push(params: GitPushParams & { auth?: NativeGitAuth; allowInsecure?: boolean }): Promise<void>;
-  status(params: { localRepoDirUri: string }): Promise<GitStatus>;
-  diff(params: { localRepoDirUri: string; maxBytes?: number }): Promise<string>;
+  clone(params: GitCloneParams & NativeOperation & { auth?: NativeGitAuth; allowInsecure?: boolean }): Promise<void>;
+  checkout(params: GitCheckoutParams & NativeOperation): Promise<void>;
+  pull(params: GitPullParams & NativeOperation & { auth?: NativeGitAuth; allowInsecure?: boolean }): Promise<GitPullResult>;
+  commit(params: GitCommitParams): Promise<string>;
+  push(params: GitPushParams & NativeOperation & { auth?: NativeGitAuth; allowInsecure?: boolean }): Promise<void>;
+  cancelOperation(operationId: string): Promise<void>;
+  setTracing(enabled: boolean): Promise<void>;
+  drainTrace(): Promise<string>;
+  setRemoteIdleTimeout(ms: number): Promise<void>;
+  configureRuntime(config: GitRuntimeConfig): Promise<void>;
+  prefetchTouch(params: GitPrefetchParams & { auth?: NativeGitAuth }): Promise<void>;
+  prefetchForget(params: { localRepoDirUri: string }): Promise<void>;
+  prefetchConfigure(params: GitPrefetchConfig): Promise<void>;
+  maintenance(params: GitMaintenanceParams & NativeOperation): Promise<GitMaintenanceResult>;
+  requestMaintenance(params: { localRepoDirUri: string }): Promise<void>;
+  snapshot(params: { localRepoDirUri: string; message?: string }): Promise<string>;
+  restoreSnapshot(params: { localRepoDirUri: string; oid: string }): Promise<void>;
+  listSnapshots(params: { localRepoDirUri: string }): Promise<GitSnapshot[]>;
+  dropSnapshot(params: { localRepoDirUri: string; oid: string }): Promise<void>;
+  logPage(params: GitLogParams): Promise<GitLogPage>;
+  blame(params: GitBlameParams): Promise<GitBlameHunk[]>;
+  readBlobRange(params: GitBlobRangeParams): Promise<GitFileRange>;
+  readFileRange(params: GitFileRangeParams): Promise<GitFileRange>;
+  getSparsePaths(params: { localRepoDirUri: string }): Promise<string[]>;
+  setSparsePaths(params: { localRepoDirUri: string; paths: string[] }): Promise<void>;
+  status(params: GitStatusParams): Promise<GitStatus>;
+  statusIncremental(params: GitIncrementalStatusParams): Promise<GitStatus>;
+  statusIncrementalReset(params: { localRepoDirUri: string }): Promise<void>;
+  statusMany(params: GitStatusManyParams): Promise<GitRepoStatusSummary[]>;
+  diff(params: GitDiffParams): Promise<string>;
+  diffStructured(params: Omit<GitDiffParams, 'maxBytes'>): Promise<string>;
+  diffStream(params: Omit<GitDiffParams, 'maxBytes'> & { streamId: string; chunkBytes?: number }): Promise<GitDiffStreamResult>;
+  cancelDiffStream(streamId: string): Promise<void>;
+  search(params: GitSearchParams & { searchId: string }): Promise<GitSearchResult>;
+  cancelSearch(searchId: string): Promise<void>;
+  searchIndexRefresh(params: { localRepoDirUri: string } & NativeOperation): Promise<GitSearchIndexStats>;
+  searchIndexDrop(params: { localRepoDirUri: string }): Promise<void>;
+  treeManifest(params: GitTreeManifestParams & NativeOperation): Promise<GitTreeManifest>;
+  treeManifestCommit(params: { localRepoDirUri: string; manifestUri: string }): Promise<void>;
+  uploadTreeBundle(params: GitTreeBundleUploadParams): Promise<GitTreeBundleStats>;
+  downloadTreeBundle(params: GitTreeBundleDownloadParams): Promise<GitTreeBundleStats>;
+  releaseRepo(params: { localRepoDirUri: string }): Promise<void>;
+  installJsi?(): boolean;
+};
+
+/**
+ * Direct binding installed by `installJsi()` (jsi_binding.cpp). Resolves with native buffers, so
+ * status and diff results skip the bridge and the Java string copies.
+ */
+type NativeGitJsi = {
+  status(localRepoDirUri: string, renames?: GitRenameDetection): Promise<ArrayBuffer>;
+  statusIncremental(localRepoDirUri: string, touchedPaths?: string[], watch?: boolean): Promise<ArrayBuffer>;
+  diff(localRepoDirUri: string, maxBytes?: number, renames?: GitRenameDetection): Promise<ArrayBuffer>;
+  diffStructured(localRepoDirUri: string, renames?: GitRenameDetection): Promise<ArrayBuffer>;
 };
 
 function getNativeGit(): NativeGitModule {
@@ -26,6 +122,23 @@ function getNativeGit(): NativeGitModule {
   return mod;
 }
 
+let nativeGitJsi: NativeGitJsi | null | undefined;
+
+/** The JSI binding, installed on first use; null when the runtime can't take it (e.g. remote JS debugging). */
+function getNativeGitJsi(): NativeGitJsi | null {
+  if (nativeGitJsi !== undefined) return nativeGitJsi;
+  const g = globalThis as { __CodexMGitJSI?: NativeGitJsi };
+  if (!g.__CodexMGitJSI) {
+    try {
+      getNativeGit().installJsi?.();
+    } catch {
+      // Fall back to the bridge methods.
+    }
+  }
+  nativeGitJsi = g.__CodexMGitJSI ?? null;
+  return nativeGitJsi;
+}
+
 async function resolveGitAuth(authRef?: string): Promise<{ username: string; token: string } | null> {
   if (!authRef) return null;
   const stored = await loadAuth<GitHttpsAuth>(authRef);
@@ -33,29 +146,326 @@ async function resolveGitAuth(authRef?: string): Promise<{ username: string; tok
   return { username: stored.username, token: stored.token };
 }
 
-export async function gitClone(params: GitCloneParams) {
+async function withProgress<T>(
+  options: GitOperationOptions | undefined,
+  run: (operationId: string | undefined) => Promise<T>
+): Promise<T> {
+  const onProgress = options?.onProgress;
+  const operationId = options?.operationId ?? (onProgress ? uuidV4() : undefined);
+  if (!onProgress) return await run(operationId);
+
+  const sub = DeviceEventEmitter.addListener('CodexMGitProgress', (e: GitProgressEvent) => {
+    if (e.operationId === operationId) onProgress(e);
+  });
+  try {
+    return await run(operationId);
+  } finally {
+    sub.remove();
+  }
+}
+
+export async function gitClone(params: GitCloneParams, options?: GitOperationOptions) {
   const auth = await resolveGitAuth(params.authRef);
-  return await getNativeGit().clone({ ...params, auth });
+  return await withProgress(options, (operationId) => getNativeGit().clone({ ...params, auth, operationId }));
 }
 
-export async function gitCheckout(params: GitCheckoutParams) {
-  return await getNativeGit().checkout(params);
+export async function gitCheckout(params: GitCheckoutParams, options?: GitOperationOptions) {
+  return await withProgress(options, (operationId) => getNativeGit().checkout({ ...params, operationId }));
 }
 
-export async function gitPull(params: GitPullParams) {
+export async function gitPull(params: GitPullParams, options?: GitOperationOptions): Promise<GitPullResult> {
   const auth = await resolveGitAuth(params.authRef);
-  return await getNativeGit().pull({ ...params, auth });
+  return await withProgress(options, (operationId) => getNativeGit().pull({ ...params, auth, operationId }));
+}
+
+/** Stages `paths` (or all changes) and commits on HEAD. Resolves with the new commit id. */
+export async function gitCommit(params: GitCommitParams): Promise<string> {
+  return await getNativeGit().commit(params);
+}
+
+export async function gitPush(params: GitPushParams, options?: GitOperationOptions) {
+  const auth = await resolveGitAuth(params.authRef);
+  return await withProgress(options, (operationId) => getNativeGit().push({ ...params, auth, operationId }));
+}
+
+/**
+ * Stops a clone/pull/push/checkout started with this `operationId`. The call then rejects with
+ * code `E_GIT_CANCELLED`.
+ */
+export async function gitCancelOperation(operationId: string): Promise<void> {
+  return await getNativeGit().cancelOperation(operationId);
+}
+
+/**
+ * Records per-call timings (phases, row/byte/object counts) for `gitDrainTrace`. While off only
+ * Android system tracing (Perfetto/systrace) sees the spans.
+ */
+export async function gitSetTracing(enabled: boolean): Promise<void> {
+  return await getNativeGit().setTracing(enabled);
+}
+
+/** Native git calls completed since the last drain, oldest first (at most 512 are buffered). */
+export async function gitDrainTrace(): Promise<GitTraceRecord[]> {
+  const text = await getNativeGit().drainTrace();
+  const out: GitTraceRecord[] = [];
+  for (const line of text.split('\n')) {
+    if (line) out.push(JSON.parse(line) as GitTraceRecord);
+  }
+  return out;
+}
+
+/**
+ * How long a repository keeps its remote connection open after fetch/pull/push so the next call
+ * skips the TLS handshake. `0` disables reuse. Default 30 s.
+ */
+export async function gitSetRemoteIdleTimeout(ms: number): Promise<void> {
+  return await getNativeGit().setRemoteIdleTimeout(ms);
 }
 
-export async function gitPush(params: GitPushParams) {
+/** Stored natively and applied at every start; omitted keys keep their current value. */
+export async function gitConfigureRuntime(config: GitRuntimeConfig): Promise<void> {
+  return await getNativeGit().configureRuntime(config);
+}
+
+/**
+ * Marks a workspace as recently opened so its remote is fetched in the background (unmetered
+ * networks only, never while the repo is busy). A later pull then mostly runs locally.
+ */
+export async function gitPrefetchTouch(params: GitPrefetchParams): Promise<void> {
   const auth = await resolveGitAuth(params.authRef);
-  return await getNativeGit().push({ ...params, auth });
+  return await getNativeGit().prefetchTouch({ ...params, auth });
+}
+
+export async function gitPrefetchForget(params: { localRepoDirUri: string }): Promise<void> {
+  return await getNativeGit().prefetchForget(params);
+}
+
+export async function gitPrefetchConfigure(config: GitPrefetchConfig): Promise<void> {
+  return await getNativeGit().prefetchConfigure(config);
+}
+
+/**
+ * Repacks the repository into one pack, prunes redundant and unreachable loose objects and writes
+ * a commit-graph. Does nothing below the thresholds unless `force` is set.
+ */
+export async function gitMaintenance(
+  params: GitMaintenanceParams,
+  options?: GitOperationOptions
+): Promise<GitMaintenanceResult> {
+  return await withProgress(options, (operationId) => getNativeGit().maintenance({ ...params, operationId }));
+}
+
+/** Queues maintenance for when the device is charging with the screen off (at most once a day). */
+export async function gitRequestMaintenance(params: { localRepoDirUri: string }): Promise<void> {
+  return await getNativeGit().requestMaintenance(params);
+}
+
+/**
+ * Checkpoints index + work tree (including untracked, non-ignored files) without touching HEAD,
+ * refs or the index. Returns the snapshot id for `gitRestoreSnapshot`.
+ */
+export async function gitSnapshot(params: { localRepoDirUri: string; message?: string }): Promise<string> {
+  return await getNativeGit().snapshot(params);
+}
+
+/** Rolls index and work tree back to a snapshot; files created since are removed. HEAD is unchanged. */
+export async function gitRestoreSnapshot(params: { localRepoDirUri: string; oid: string }): Promise<void> {
+  return await getNativeGit().restoreSnapshot(params);
+}
+
+export async function gitListSnapshots(params: { localRepoDirUri: string }): Promise<GitSnapshot[]> {
+  return await getNativeGit().listSnapshots(params);
+}
+
+export async function gitDropSnapshot(params: { localRepoDirUri: string; oid: string }): Promise<void> {
+  return await getNativeGit().dropSnapshot(params);
+}
+
+/**
+ * One page of history, newest first. Pass `nextCursor` back as `cursor` for the next page; the
+ * native walk stops after each page, so only what is shown is ever walked.
+ */
+export async function gitLogPage(params: GitLogParams): Promise<GitLogPage> {
+  return await getNativeGit().logPage(params);
+}
+
+/** Blame for a window of one file's lines (as of `ref`, default HEAD). */
+export async function gitBlameRange(params: GitBlameParams): Promise<GitBlameHunk[]> {
+  return await getNativeGit().blame(params);
+}
+
+/**
+ * A byte or line window of a blob, e.g. `{ spec: 'HEAD:' + path, lines: true, start, count }`.
+ * Only the window crosses into JS; line offsets are indexed natively per blob, so paging through a
+ * large file costs about one page per call.
+ */
+export async function gitReadBlobRange(params: GitBlobRangeParams): Promise<GitFileRange> {
+  return await getNativeGit().readBlobRange(params);
+}
+
+/** The same for the work-tree version of a file (memory-mapped natively). */
+export async function gitReadFileRange(params: GitFileRangeParams): Promise<GitFileRange> {
+  return await getNativeGit().readFileRange(params);
+}
+
+/** Sparse prefixes of this work tree; empty when everything is checked out. */
+export async function gitGetSparsePaths(params: { localRepoDirUri: string }): Promise<string[]> {
+  return await getNativeGit().getSparsePaths(params);
+}
+
+/**
+ * Narrows or widens the sparse checkout. Files that leave the set are deleted unless they have local
+ * changes; an empty list checks out the whole tree again.
+ */
+export async function gitSetSparsePaths(params: { localRepoDirUri: string; paths: string[] }): Promise<void> {
+  return await getNativeGit().setSparsePaths(params);
 }
 
-export async function gitStatus(params: { localRepoDirUri: string }): Promise<GitStatus> {
+export async function gitStatus(params: GitStatusParams): Promise<GitStatus> {
+  const jsi = getNativeGitJsi();
+  if (jsi) return decodePackedStatus(new Uint8Array(await jsi.status(params.localRepoDirUri, params.renames)));
   return await getNativeGit().status(params);
 }
 
-export async function gitDiff(params: { localRepoDirUri: string; maxBytes?: number }): Promise<string> {
+/**
+ * Status that only re-checks changed paths after the first call (native inotify watcher plus the
+ * optional `touchedPaths` hint). Same result shape as `gitStatus`.
+ */
+export async function gitStatusIncremental(params: GitIncrementalStatusParams): Promise<GitStatus> {
+  const jsi = getNativeGitJsi();
+  if (jsi) {
+    const buf = await jsi.statusIncremental(params.localRepoDirUri, params.touchedPaths ?? [], params.watch ?? true);
+    return decodePackedStatus(new Uint8Array(buf));
+  }
+  return await getNativeGit().statusIncremental(params);
+}
+
+export async function gitStatusIncrementalReset(params: { localRepoDirUri: string }): Promise<void> {
+  return await getNativeGit().statusIncrementalReset(params);
+}
+
+/**
+ * Dirty flag, branch and ahead/behind for many workspaces in one call (the workspace list). The
+ * repositories are scanned in parallel on the native worker pool; a failing one only sets its own
+ * `error`.
+ */
+export async function gitStatusMany(params: GitStatusManyParams): Promise<GitRepoStatusSummary[]> {
+  if (params.localRepoDirUris.length === 0) return [];
+  return await getNativeGit().statusMany(params);
+}
+
+export async function gitDiff(params: GitDiffParams): Promise<string> {
+  const jsi = getNativeGitJsi();
+  if (jsi) {
+    const buf = await jsi.diff(params.localRepoDirUri, params.maxBytes, params.renames);
+    return new TextDecoder('utf-8').decode(new Uint8Array(buf));
+  }
   return await getNativeGit().diff(params);
 }
+
+/** Files, +/- counts and hunk ranges of the `gitDiff` patch, without the patch text. */
+export async function gitDiffStructured(params: Omit<GitDiffParams, 'maxBytes'>): Promise<GitStructuredDiff> {
+  const jsi = getNativeGitJsi();
+  if (jsi) {
+    return decodeStructuredDiffBytes(new Uint8Array(await jsi.diffStructured(params.localRepoDirUri, params.renames)));
+  }
+  return decodeStructuredDiff(await getNativeGit().diffStructured(params));
+}
+
+export type GitDiffStreamHandle = {
+  streamId: string;
+  /** Resolves once every chunk has been delivered (or the stream was cancelled). */
+  done: Promise<GitDiffStreamResult>;
+  cancel(): Promise<void>;
+};
+
+/**
+ * Streams the same patch as `gitDiff` file by file (large files are split at hunk boundaries), with
+ * no size cap. Chunks arrive in `seq` order through `onChunk`.
+ */
+export function gitDiffStream(
+  params: Omit<GitDiffParams, 'maxBytes'> & { chunkBytes?: number },
+  onChunk: (chunk: GitDiffChunkEvent) => void
+): GitDiffStreamHandle {
+  const mod = getNativeGit();
+  const streamId = uuidV4();
+  const sub = DeviceEventEmitter.addListener('CodexMGitDiffChunk', (e: GitDiffChunkEvent) => {
+    if (e.streamId === streamId) onChunk(e);
+  });
+  const done = mod.diffStream({ ...params, streamId }).finally(() => sub.remove());
+  return { streamId, done, cancel: () => mod.cancelDiffStream(streamId) };
+}
+
+export type GitSearchHandle = {
+  searchId: string;
+  done: Promise<GitSearchResult>;
+  cancel: () => Promise<void>;
+};
+
+/**
+ * Searches file contents in the work tree natively (ignored files, .git and binaries are skipped).
+ * Matches arrive in batches through `onMatches`; order across files is not defined.
+ */
+export function gitSearch(
+  params: GitSearchParams,
+  onMatches: (matches: GitSearchMatch[]) => void
+): GitSearchHandle {
+  const mod = getNativeGit();
+  const searchId = uuidV4();
+  const sub = DeviceEventEmitter.addListener('CodexMGitSearchMatches', (e: GitSearchMatchesEvent) => {
+    if (e.searchId === searchId) onMatches(e.matches);
+  });
+  const done = mod.search({ ...params, searchId }).finally(() => sub.remove());
+  return { searchId, done, cancel: () => mod.cancelSearch(searchId) };
+}
+
+/**
+ * Updates the trigram index used by `gitSearch({ useIndex: true })`, reading only file contents it
+ * has not seen. Useful after a clone or checkout so the first indexed search is fast.
+ */
+export async function gitSearchIndexRefresh(
+  params: { localRepoDirUri: string },
+  options?: GitOperationOptions
+): Promise<GitSearchIndexStats> {
+  return await withProgress(options, (operationId) => getNativeGit().searchIndexRefresh({ ...params, operationId }));
+}
+
+/** Deletes the trigram index. */
+export async function gitSearchIndexDrop(params: { localRepoDirUri: string }): Promise<void> {
+  return await getNativeGit().searchIndexDrop(params);
+}
+
+/**
+ * Hashes every file of the tree (git blob ids, reusing the index's and the last manifest's stat
+ * caches) and reports what changed since the manifest at `manifestUri`. The new manifest is only
+ * staged; call `gitTreeManifestCommit` once the sync it drove has succeeded.
+ */
+export async function gitTreeManifest(
+  params: GitTreeManifestParams,
+  options?: GitOperationOptions
+): Promise<GitTreeManifest> {
+  return await withProgress(options, (operationId) => getNativeGit().treeManifest({ ...params, operationId }));
+}
+
+/** Makes the manifest staged by the last `gitTreeManifest` call the baseline for the next one. */
+export async function gitTreeManifestCommit(params: { localRepoDirUri: string; manifestUri: string }): Promise<void> {
+  return await getNativeGit().treeManifestCommit(params);
+}
+
+/**
+ * Packs the tree (or `paths` of it) into a .tar.gz, compressed on several threads, and streams it
+ * to `url` in one PUT without writing the archive to disk.
+ */
+export async function gitUploadTreeBundle(params: GitTreeBundleUploadParams): Promise<GitTreeBundleStats> {
+  return await getNativeGit().uploadTreeBundle(params);
+}
+
+/** Streams the .tar.gz at `url` straight into the extractor; files in the archive overwrite local ones. */
+export async function gitDownloadTreeBundle(params: GitTreeBundleDownloadParams): Promise<GitTreeBundleStats> {
+  return await getNativeGit().downloadTreeBundle(params);
+}
+
+/** Closes the native repository handle cached for this work tree (call before deleting it). */
+export async function gitReleaseRepo(params: { localRepoDirUri: string }): Promise<void> {
+  return await getNativeGit().releaseRepo(params);
+}
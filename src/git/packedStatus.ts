@@ -0,0 +1,25 @@
+import type { GitStatus } from './types';
+
+// Mirrors git_status_packed() in git_ops.h: u32 count (LE), one bucket byte per path (0 staged,
+// 1 unstaged, 2 untracked), then the NUL-terminated UTF-8 paths in the same order.
+export function decodePackedStatus(bytes: Uint8Array): GitStatus {
+  if (bytes.byteLength < 4) throw new Error('Unexpected status payload');
+  const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+  const count = view.getUint32(0, true);
+  if (4 + count > bytes.byteLength) throw new Error('Truncated status payload');
+
+  const decoder = new TextDecoder('utf-8');
+  const out: GitStatus = { staged: [], unstaged: [], untracked: [] };
+  let pos = 4 + count;
+  for (let i = 0; i < count; i++) {
+    const end = bytes.indexOf(0, pos);
+    if (end < 0) throw new Error('Truncated status payload');
+    const path = decoder.decode(bytes.subarray(pos, end));
+    const bucket = bytes[4 + i];
+    if (bucket === 0) out.staged.push(path);
+    else if (bucket === 1) out.unstaged.push(path);
+    else out.untracked.push(path);
+    pos = end + 1;
+  }
+  return out;
+}
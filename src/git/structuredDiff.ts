@@ -0,0 +1,83 @@
+import { toByteArray } from 'base64-js';
+
+import type { GitDiffFileSummary, GitDiffHunkRange, GitStructuredDiff } from './types';
+
+// Mirrors the layout documented at git_diff_structured() in git_ops.h.
+const MAGIC = 0x31445843; // "CXD1"
+const HEADER_BYTES = 32;
+const FILE_BYTES = 36;
+const HUNK_BYTES = 24;
+
+const DELTA_STATUS: GitDiffFileSummary['status'][] = [
+  'unmodified',
+  'added',
+  'deleted',
+  'modified',
+  'renamed',
+  'copied',
+  'ignored',
+  'untracked',
+  'typechange',
+  'unreadable',
+  'conflicted',
+];
+
+export function decodeStructuredDiff(base64: string): GitStructuredDiff {
+  return decodeStructuredDiffBytes(toByteArray(base64));
+}
+
+/** Same as `decodeStructuredDiff`, for the raw buffer (the JSI binding hands it over directly). */
+export function decodeStructuredDiffBytes(bytes: Uint8Array): GitStructuredDiff {
+  const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+  if (bytes.byteLength < HEADER_BYTES || view.getUint32(0, true) !== MAGIC) {
+    throw new Error('Unexpected structured diff payload');
+  }
+
+  const fileCount = view.getUint32(4, true);
+  const hunkCount = view.getUint32(8, true);
+  const stringBytes = view.getUint32(12, true);
+  const filesAt = HEADER_BYTES;
+  const hunksAt = filesAt + fileCount * FILE_BYTES;
+  const stringsAt = hunksAt + hunkCount * HUNK_BYTES;
+  if (stringsAt + stringBytes > bytes.byteLength) throw new Error('Truncated structured diff payload');
+
+  const decoder = new TextDecoder('utf-8');
+  const str = (off: number, len: number) =>
+    len === 0 ? '' : decoder.decode(bytes.subarray(stringsAt + off, stringsAt + off + len));
+
+  const hunks: GitDiffHunkRange[] = new Array(hunkCount);
+  for (let i = 0; i < hunkCount; i++) {
+    const at = hunksAt + i * HUNK_BYTES;
+    hunks[i] = {
+      oldStart: view.getUint32(at, true),
+      oldLines: view.getUint32(at + 4, true),
+      newStart: view.getUint32(at + 8, true),
+      newLines: view.getUint32(at + 12, true),
+      header: str(view.getUint32(at + 16, true), view.getUint32(at + 20, true)),
+    };
+  }
+
+  const files: GitDiffFileSummary[] = new Array(fileCount);
+  for (let i = 0; i < fileCount; i++) {
+    const at = filesAt + i * FILE_BYTES;
+    const firstHunk = view.getUint32(at + 28, true);
+    const fileHunks = view.getUint32(at + 32, true);
+    files[i] = {
+      section: view.getUint8(at) === 0 ? 'staged' : 'workdir',
+      status: DELTA_STATUS[view.getUint8(at + 1)] ?? 'modified',
+      binary: (view.getUint16(at + 2, true) & 1) !== 0,
+      oldPath: str(view.getUint32(at + 4, true), view.getUint32(at + 8, true)),
+      newPath: str(view.getUint32(at + 12, true), view.getUint32(at + 16, true)),
+      additions: view.getUint32(at + 20, true),
+      deletions: view.getUint32(at + 24, true),
+      hunks: hunks.slice(firstHunk, firstHunk + fileHunks),
+    };
+  }
+
+  return {
+    files,
+    filesChanged: view.getUint32(16, true),
+    insertions: view.getUint32(20, true),
+    deletions: view.getUint32(24, true),
+  };
+}
@@ -3,13 +3,26 @@ import type { WorkspaceId } from '@/src/workspaces/types';
 export type GitAuthRef = string;
 
 export type GitProgressEvent = {
-  op: 'clone' | 'fetch' | 'pull' | 'push' | 'checkout';
+  operationId?: string;
+  op: 'clone' | 'fetch' | 'pull' | 'push' | 'checkout' | 'maintenance' | 'searchIndex';
+  /**
+   * receiving / resolving / packing / uploading / checkout / writing / indexing, or remote for a
+   * server message.
+   */
   phase?: string;
   current?: number;
   total?: number;
+  /** Bytes transferred so far (receiving/resolving/uploading). */
+  bytes?: number;
   message?: string;
 };
 
+export type GitOperationOptions = {
+  /** Id passed to `gitCancelOperation`; generated when `onProgress` is set and no id is given. */
+  operationId?: string;
+  onProgress?: (e: GitProgressEvent) => void;
+};
+
 export type GitCloneParams = {
   workspaceId: WorkspaceId;
   remoteUrl: string;
@@ -19,6 +32,12 @@ export type GitCloneParams = {
   allowInsecure?: boolean;
   userName?: string;
   userEmail?: string;
+  /** Only fetch the latest `depth` commits (omit for full history). */
+  depth?: number;
+  /** Only fetch `branch` (or the remote default branch); later pulls stay on that branch. */
+  singleBranch?: boolean;
+  /** Sparse checkout: only write these repo-relative directories/files (omit for the whole tree). */
+  sparsePaths?: string[];
 };
 
 export type GitPullParams = {
@@ -28,6 +47,40 @@ export type GitPullParams = {
   branch?: string;
   authRef?: GitAuthRef;
   allowInsecure?: boolean;
+  /** Shallow repos: re-truncate/deepen history to `depth` commits. */
+  depth?: number;
+  /** Shallow repos: fetch the full history. */
+  unshallow?: boolean;
+  /** How to reconcile diverged branches. Default `ff-only` rejects instead. */
+  strategy?: GitPullStrategy;
+};
+
+export type GitPullStrategy = 'ff-only' | 'merge' | 'rebase';
+
+/** A conflicted path; blob ids are absent for a side that does not have the file. */
+export type GitConflict = {
+  path: string;
+  ancestor?: string;
+  ours?: string;
+  theirs?: string;
+};
+
+export type GitPullResult = {
+  /** `conflicts`: the merge/rebase was computed in memory only; nothing was written. */
+  outcome: 'up-to-date' | 'fast-forward' | 'merged' | 'rebased' | 'conflicts';
+  /** Branch tip after the pull. */
+  head: string;
+  conflicts: GitConflict[];
+};
+
+export type GitCommitParams = {
+  localRepoDirUri: string;
+  message: string;
+  /** Files or directories to stage first; omit to stage every change. */
+  paths?: string[];
+  /** `false` commits the index as it is. Default `true`. */
+  stage?: boolean;
+  allowEmpty?: boolean;
 };
 
 export type GitPushParams = {
@@ -50,3 +103,394 @@ export type GitStatus = {
   unstaged: string[];
   untracked: string[];
 };
+
+/**
+ * Opt-in rename/copy pairing for status and diff (git's -M / -C). Without it a moved file shows up
+ * as a full delete plus a full add.
+ */
+export type GitRenameDetection = {
+  /** Similarity percentage needed to pair two files (default 50). */
+  threshold?: number;
+  /**
+   * Beyond `limit`² deleted × added candidate pairs only identical files are paired, which bounds
+   * the cost after large moves (default 1000, like git's diff.renameLimit).
+   */
+  limit?: number;
+  /** Also pair new files with modified ones they were copied from (default false). */
+  copies?: boolean;
+};
+
+export type GitStatusParams = {
+  localRepoDirUri: string;
+  /** Renamed paths are then reported once, under the new path; untracked directories are listed file by file. */
+  renames?: GitRenameDetection;
+};
+
+export type GitDiffParams = {
+  localRepoDirUri: string;
+  maxBytes?: number;
+  renames?: GitRenameDetection;
+};
+
+export type GitIncrementalStatusParams = {
+  localRepoDirUri: string;
+  /** Work-tree-relative paths known to have changed since the last call (e.g. files the agent edited). */
+  touchedPaths?: string[];
+  /** Watch the work tree for other changes (default true). */
+  watch?: boolean;
+};
+
+export type GitStatusManyParams = {
+  localRepoDirUris: string[];
+  /** Stop each scan at its first change (default true): `dirty` is exact, each count is then 0 or 1. */
+  summaryOnly?: boolean;
+};
+
+/** One work tree in `gitStatusMany`, in the order the URIs were passed. */
+export type GitRepoStatusSummary = {
+  localRepoDirUri: string;
+  dirty: boolean;
+  staged: number;
+  unstaged: number;
+  untracked: number;
+  /** Checked-out branch; null when HEAD is detached or unborn. */
+  branch: string | null;
+  /** Commits not yet pushed / not yet pulled; null without an upstream branch. */
+  ahead: number | null;
+  behind: number | null;
+  /** Set when the repository could not be opened or scanned; the other fields are then defaults. */
+  error?: string;
+};
+
+export type GitDiffHunkRange = {
+  oldStart: number;
+  oldLines: number;
+  newStart: number;
+  newLines: number;
+  /** The `@@ … @@` line, without the trailing newline. */
+  header: string;
+};
+
+export type GitDiffFileSummary = {
+  section: 'staged' | 'workdir';
+  status:
+    | 'unmodified'
+    | 'added'
+    | 'deleted'
+    | 'modified'
+    | 'renamed'
+    | 'copied'
+    | 'ignored'
+    | 'untracked'
+    | 'typechange'
+    | 'unreadable'
+    | 'conflicted';
+  binary: boolean;
+  oldPath: string;
+  newPath: string;
+  additions: number;
+  deletions: number;
+  hunks: GitDiffHunkRange[];
+};
+
+export type GitStructuredDiff = {
+  files: GitDiffFileSummary[];
+  /** Distinct paths across both sections. */
+  filesChanged: number;
+  insertions: number;
+  deletions: number;
+};
+
+export type GitDiffChunkEvent = {
+  streamId: string;
+  /** Increases by one per chunk within a stream. */
+  seq: number;
+  section: 'staged' | 'workdir';
+  path: string;
+  /** True for the first chunk of a file (starts with its `diff --git` header). */
+  fileStart: boolean;
+  text: string;
+};
+
+export type GitDiffStreamResult = {
+  chunks: number;
+  bytes: number;
+  cancelled: boolean;
+};
+
+export type GitSearchParams = {
+  localRepoDirUri: string;
+  pattern: string;
+  /** POSIX extended regex instead of a literal. */
+  regex?: boolean;
+  ignoreCase?: boolean;
+  /** Work-tree-relative prefixes to search under (default: whole tree). */
+  paths?: string[];
+  /** Also search files excluded by .gitignore. */
+  includeIgnored?: boolean;
+  /** Default 2000. */
+  maxResults?: number;
+  /** Only scan files the trigram index says can match (built on first use). Ignored with includeIgnored. */
+  useIndex?: boolean;
+};
+
+export type GitSearchMatch = {
+  path: string;
+  line: number;
+  /** 1-based byte offset within the line. */
+  column: number;
+  /** The matching line, cut to 512 bytes. */
+  text: string;
+};
+
+export type GitSearchMatchesEvent = {
+  searchId: string;
+  /** Increases by one per batch within a search. */
+  seq: number;
+  matches: GitSearchMatch[];
+};
+
+export type GitSearchResult = {
+  filesScanned: number;
+  bytesScanned: number;
+  matches: number;
+  /** Stopped at maxResults. */
+  truncated: boolean;
+  cancelled: boolean;
+};
+
+export type GitSearchIndexStats = {
+  /** Paths covered. */
+  files: number;
+  /** Distinct file contents indexed. */
+  blobs: number;
+  segments: number;
+  /** Size on disk. */
+  bytes: number;
+  /** Contents read by this refresh. */
+  indexedNow: number;
+};
+
+export type GitTreeManifestParams = {
+  /** Tree to hash (any directory; the git index is only used as a stat cache when it is a repo). */
+  localRepoDirUri: string;
+  /** Manifest of the last sync; changes are reported against it. */
+  manifestUri: string;
+  /** Entries with these names are skipped at any depth. */
+  excludeNames?: string[];
+  /** Leave unchanged files out of `files`. */
+  changedOnly?: boolean;
+};
+
+export type GitTreeManifestFile = {
+  path: string;
+  /** Git blob id of the content. */
+  oid: string;
+  size: number;
+  change: 'added' | 'modified' | 'unchanged';
+};
+
+export type GitTreeManifest = {
+  files: GitTreeManifestFile[];
+  /** Sorted, parents first. */
+  dirs: string[];
+  /** In the last manifest but gone now. */
+  deleted: string[];
+  /** Files read to compute their id; the rest came from a stat cache. */
+  hashed: number;
+  fromIndex: number;
+  fromManifest: number;
+};
+
+export type GitTreeBundleUploadParams = {
+  localRepoDirUri: string;
+  /** Full URL the .tar.gz is PUT to. */
+  url: string;
+  headers?: Record<string, string>;
+  /** Only these files (relative paths); default is the whole tree. */
+  paths?: string[];
+  /** Entries with these names are skipped at any depth (whole-tree packs only). */
+  excludeNames?: string[];
+};
+
+export type GitTreeBundleDownloadParams = {
+  /** Directory the archive is extracted into. */
+  localRepoDirUri: string;
+  url: string;
+  headers?: Record<string, string>;
+};
+
+export type GitTreeBundleStats = {
+  files: number;
+  directories: number;
+  links: number;
+  /** File contents, uncompressed. */
+  bytes: number;
+  /** Compressed size (uploads only). */
+  written?: number;
+  etag?: string;
+};
+
+export type GitSnapshot = {
+  oid: string;
+  /** Epoch milliseconds. */
+  createdAt: number;
+  message: string;
+};
+
+export type GitLogParams = {
+  localRepoDirUri: string;
+  /** Where the first page starts (default HEAD); ignored with `cursor`. */
+  ref?: string;
+  /** `nextCursor` of the previous page. */
+  cursor?: string;
+  /** Only commits that change something at or below one of these paths. */
+  paths?: string[];
+  /** Commits per page (default 50). */
+  limit?: number;
+  /** Commits walked per page at most (default 5000); a short page with a cursor means ask again. */
+  maxScan?: number;
+};
+
+export type GitLogEntry = {
+  oid: string;
+  parents: string[];
+  authorName: string;
+  authorEmail: string;
+  /** Epoch milliseconds. */
+  authorTime: number;
+  /** Epoch milliseconds. */
+  commitTime: number;
+  summary: string;
+};
+
+export type GitLogPage = {
+  commits: GitLogEntry[];
+  /** Null once the history is exhausted. */
+  nextCursor: string | null;
+  scanned: number;
+};
+
+export type GitBlameParams = {
+  localRepoDirUri: string;
+  path: string;
+  /** 1-based, inclusive (default 1). */
+  startLine?: number;
+  /** 1-based, inclusive; omit for the end of the file. */
+  endLine?: number;
+  /** Commit whose version is blamed (default HEAD). */
+  ref?: string;
+};
+
+export type GitBlameHunk = {
+  startLine: number;
+  lineCount: number;
+  oid: string;
+  authorName: string;
+  authorEmail: string;
+  /** Epoch milliseconds. */
+  authorTime: number;
+  summary: string;
+  /** Path and line in `oid`; differ from the blamed ones across renames. */
+  origPath: string;
+  origStartLine: number;
+  /** The lines predate the oldest commit available (e.g. a shallow clone). */
+  boundary: boolean;
+};
+
+/** A byte window, or with `lines` a line window, of one file. */
+export type GitRangeWindow = {
+  /** Count lines instead of bytes. */
+  lines?: boolean;
+  /** First byte, or 0-based first line (default 0). */
+  start?: number;
+  /** Bytes or lines to read; omit for the rest of the file, within `maxBytes`. */
+  count?: number;
+  /** Cap on the returned bytes (default 256 KiB). */
+  maxBytes?: number;
+};
+
+export type GitBlobRangeParams = GitRangeWindow & {
+  localRepoDirUri: string;
+  /** Anything that resolves to a blob: "HEAD:src/app.ts", ":src/app.ts" (staged), a blob id. */
+  spec: string;
+};
+
+export type GitFileRangeParams = GitRangeWindow & {
+  localRepoDirUri: string;
+  /** Work-tree-relative path. */
+  path: string;
+};
+
+export type GitFileRange = {
+  /** UTF-8 decoded content; absent when `binary`. */
+  text?: string;
+  /** Raw content of a binary file. */
+  base64?: string;
+  binary: boolean;
+  /** `maxBytes` cut the window short (line windows still end on a whole line when one fits). */
+  truncated: boolean;
+  byteOffset: number;
+  byteLength: number;
+  totalBytes: number;
+  /** Line windows: 0-based first line and the number of whole lines returned. */
+  firstLine: number;
+  lineCount: number;
+  /** Known after the first line window over this content; null before. */
+  totalLines: number | null;
+  /** Blob id; null for work-tree files. */
+  oid: string | null;
+};
+
+export type GitPrefetchParams = {
+  localRepoDirUri: string;
+  remote?: string;
+  authRef?: GitAuthRef;
+  allowInsecure?: boolean;
+};
+
+export type GitPrefetchConfig = {
+  enabled?: boolean;
+  /** Minimum time between background fetches of one repository (>= 60 s). Default 15 min. */
+  intervalMs?: number;
+  /** Workspaces not opened for this long stop being prefetched. Default 24 h. */
+  recentWindowMs?: number;
+};
+
+export type GitMaintenanceParams = {
+  localRepoDirUri: string;
+  /** Run even when there are few loose objects and packs. */
+  force?: boolean;
+};
+
+export type GitMaintenanceResult = {
+  /** False when the repository was below the thresholds and nothing was done. */
+  ran: boolean;
+  objectsPacked: number;
+  packsRemoved: number;
+  looseRemoved: number;
+  bytesBefore: number;
+  bytesAfter: number;
+  commitGraph: boolean;
+};
+
+export type GitRuntimeConfig = {
+  /** Pack window / object cache budget. `auto` (default) picks from the device's RAM. */
+  memoryClass?: 'auto' | 'low' | 'mid' | 'high';
+  /** Skip re-hashing objects read from this device's own repositories. Fetched packs are still verified. */
+  trustLocalObjects?: boolean;
+};
+
+/** One native git call, recorded while tracing is on (see `gitSetTracing`). */
+export type GitTraceRecord = {
+  op: string;
+  repo: string;
+  /** Start time, Unix ms. */
+  ts: number;
+  ms: number;
+  ok: boolean;
+  /** Milliseconds per phase, e.g. open / index / walk / receiving / checkout / marshal. */
+  phases: Record<string, number>;
+  /** rows, bytes, objects per transfer phase, ... */
+  counts: Record<string, number>;
+};
@@ -1,5 +1,8 @@
 import * as FileSystem from 'expo-file-system/legacy';
 
+import { gitDownloadTreeBundle, gitTreeManifest, gitTreeManifestCommit, gitUploadTreeBundle } from '@/src/git/nativeGit';
+import type { GitTreeBundleStats, GitTreeManifestFile } from '@/src/git/types';
+
 import type { WebDavEntry } from './types';
 import { WebDavClient } from './webdavClient';
 
@@ -68,6 +71,47 @@ async function listLocalTree(rootDirUri: string, onProgress?: (p: WebDavSyncProg
   return { files, dirs };
 }
 
+/**
+ * Delta-sync state of one local tree: the native content manifest at `manifestUri` plus the remote
+ * ETags seen by the last sync next to it.
+ */
+type RemoteTags = Record<string, string>;
+
+function remoteTagsUri(manifestUri: string) {
+  return `${manifestUri}.remote.json`;
+}
+
+async function loadRemoteTags(manifestUri: string): Promise<RemoteTags> {
+  try {
+    return JSON.parse(await FileSystem.readAsStringAsync(remoteTagsUri(manifestUri))) as RemoteTags;
+  } catch {
+    return {};
+  }
+}
+
+async function saveRemoteTags(manifestUri: string, tags: RemoteTags) {
+  await FileSystem.writeAsStringAsync(remoteTagsUri(manifestUri), JSON.stringify(tags));
+}
+
+/** What identifies a remote file's content: its ETag, else its modification time and size. */
+function remoteTag(e: WebDavEntry) {
+  if (e.etag) return e.etag;
+  if (e.lastModified) return `${e.lastModified}|${e.contentLength ?? ''}`;
+  return undefined;
+}
+
+async function localManifest(localRootDirUri: string, manifestUri: string, onProgress?: (p: WebDavSyncProgress) => void) {
+  onProgress?.({ phase: 'list-local' });
+  const manifest = await gitTreeManifest({
+    localRepoDirUri: localRootDirUri,
+    manifestUri,
+    excludeNames: Array.from(DEFAULT_EXCLUDE_DIRS),
+  });
+  const files = new Map<string, GitTreeManifestFile>();
+  for (const f of manifest.files) files.set(f.path, f);
+  return { files, dirs: manifest.dirs, deleted: manifest.deleted };
+}
+
 async function listRemoteTree(
   client: WebDavClient,
   remoteRootDir: string,
@@ -112,13 +156,23 @@ async function listRemoteTree(
   return { files, dirs, root };
 }
 
+/**
+ * Downloads the remote tree into `localRootDirUri`. With `manifestUri` (e.g. a file in the
+ * workspace's `.meta/`), only files whose remote ETag changed since the last sync, or that are
+ * missing locally, are downloaded; without it, files of the same size are skipped.
+ */
 export async function pullWebDav(params: {
   client: WebDavClient;
   remoteRootDir: string;
   localRootDirUri: string;
+  manifestUri?: string;
   onProgress?: (p: WebDavSyncProgress) => void;
 }) {
-  const { client, localRootDirUri, onProgress } = params;
+  const { client, localRootDirUri, manifestUri, onProgress } = params;
+  if (manifestUri) {
+    await pullWebDavDelta({ ...params, manifestUri });
+    return;
+  }
   const { files: remoteFiles, dirs: remoteDirs, root } = await listRemoteTree(
     client,
     params.remoteRootDir,
@@ -154,13 +208,23 @@ export async function pullWebDav(params: {
   onProgress?.({ phase: 'done' });
 }
 
+/**
+ * Uploads `localRootDirUri` to the remote tree. With `manifestUri`, only files whose content hash
+ * changed since the last sync, or that are missing or of a different size remotely, are uploaded;
+ * without it, files of the same size are skipped.
+ */
 export async function pushWebDav(params: {
   client: WebDavClient;
   remoteRootDir: string;
   localRootDirUri: string;
+  manifestUri?: string;
   onProgress?: (p: WebDavSyncProgress) => void;
 }) {
-  const { client, localRootDirUri, onProgress } = params;
+  const { client, localRootDirUri, manifestUri, onProgress } = params;
+  if (manifestUri) {
+    await pushWebDavDelta({ ...params, manifestUri });
+    return;
+  }
 
   const { files: localFiles, dirs: localDirs } = await listLocalTree(localRootDirUri, onProgress);
   const { files: remoteFiles, root } = await listRemoteTree(client, params.remoteRootDir, onProgress);
@@ -187,3 +251,171 @@ export async function pushWebDav(params: {
 
   onProgress?.({ phase: 'done' });
 }
+
+async function pullWebDavDelta(params: {
+  client: WebDavClient;
+  remoteRootDir: string;
+  localRootDirUri: string;
+  manifestUri: string;
+  onProgress?: (p: WebDavSyncProgress) => void;
+}) {
+  const { client, localRootDirUri, manifestUri, onProgress } = params;
+  const { files: remoteFiles, dirs: remoteDirs, root } = await listRemoteTree(
+    client,
+    params.remoteRootDir,
+    onProgress
+  );
+  const { files: localFiles, dirs: localDirs } = await localManifest(localRootDirUri, manifestUri, onProgress);
+  const lastTags = await loadRemoteTags(manifestUri);
+
+  const localDirSet = new Set(localDirs);
+  const dirs = Array.from(remoteDirs)
+    .filter((d) => !localDirSet.has(d))
+    .sort((a, b) => a.localeCompare(b));
+  for (let i = 0; i < dirs.length; i++) {
+    const relDir = dirs[i];
+    onProgress?.({ phase: 'mkdir-local', current: i + 1, total: dirs.length, path: relDir });
+    await FileSystem.makeDirectoryAsync(joinUri(localRootDirUri, relDir), { intermediates: true });
+  }
+
+  const tags: RemoteTags = {};
+  const toDownload: [string, WebDavEntry][] = [];
+  for (const [rel, entry] of remoteFiles) {
+    const tag = remoteTag(entry);
+    if (tag) tags[rel] = tag;
+    const local = localFiles.get(rel);
+    if (!local) {
+      toDownload.push([rel, entry]);
+    } else if (lastTags[rel] != null) {
+      if (lastTags[rel] !== tag) toDownload.push([rel, entry]);
+    } else if (entry.contentLength == null || entry.contentLength !== local.size) {
+      toDownload.push([rel, entry]);
+    }
+  }
+
+  for (let i = 0; i < toDownload.length; i++) {
+    const [rel] = toDownload[i];
+    onProgress?.({ phase: 'download', current: i + 1, total: toDownload.length, path: rel });
+    await client.downloadToFile(`${root}${rel}`, joinUri(localRootDirUri, rel));
+  }
+
+  // The downloads changed the tree the first manifest described; hash it again (only the
+  // downloaded files are read) and make that the baseline.
+  if (toDownload.length) await localManifest(localRootDirUri, manifestUri);
+  await gitTreeManifestCommit({ localRepoDirUri: localRootDirUri, manifestUri });
+  await saveRemoteTags(manifestUri, tags);
+
+  onProgress?.({ phase: 'done' });
+}
+
+async function pushWebDavDelta(params: {
+  client: WebDavClient;
+  remoteRootDir: string;
+  localRootDirUri: string;
+  manifestUri: string;
+  onProgress?: (p: WebDavSyncProgress) => void;
+}) {
+  const { client, localRootDirUri, manifestUri, onProgress } = params;
+
+  const { files: localFiles, dirs: localDirs } = await localManifest(localRootDirUri, manifestUri, onProgress);
+  const { files: remoteFiles, dirs: remoteDirs, root } = await listRemoteTree(
+    client,
+    params.remoteRootDir,
+    onProgress
+  );
+
+  const dirs = localDirs.filter((d) => !remoteDirs.has(d));
+  for (let i = 0; i < dirs.length; i++) {
+    const relDir = dirs[i];
+    onProgress?.({ phase: 'mkdir-remote', current: i + 1, total: dirs.length, path: relDir });
+    await client.mkcol(`${root}${relDir}/`);
+  }
+
+  const tags: RemoteTags = {};
+  const toUpload: string[] = [];
+  for (const [rel, local] of localFiles) {
+    const remote = remoteFiles.get(rel);
+    const tag = remote ? remoteTag(remote) : undefined;
+    if (tag) tags[rel] = tag;
+    const sameSize = remote?.contentLength != null && remote.contentLength === local.size;
+    if (local.change !== 'unchanged' || !remote || !sameSize) toUpload.push(rel);
+  }
+
+  for (let i = 0; i < toUpload.length; i++) {
+    const rel = toUpload[i];
+    onProgress?.({ phase: 'upload', current: i + 1, total: toUpload.length, path: rel });
+    const { etag } = await client.uploadFile(`${root}${rel}`, joinUri(localRootDirUri, rel));
+    // Without an ETag in the response the next pull falls back to comparing sizes.
+    if (etag) tags[rel] = etag;
+    else delete tags[rel];
+  }
+
+  await gitTreeManifestCommit({ localRepoDirUri: localRootDirUri, manifestUri });
+  await saveRemoteTags(manifestUri, tags);
+
+  onProgress?.({ phase: 'done' });
+}
+
+/**
+ * Uploads the tree as one .tar.gz at `remotePath` (relative to the WebDAV base), packed and
+ * compressed natively while it streams, instead of one request per file. The bundle always holds
+ * the whole tree, because it replaces the previous one and a pull restores only the latest. With
+ * `manifestUri`, the manifest only decides whether anything changed since the last push; returns
+ * null when nothing did.
+ */
+export async function pushWebDavBundle(params: {
+  client: WebDavClient;
+  remotePath: string;
+  localRootDirUri: string;
+  manifestUri?: string;
+  onProgress?: (p: WebDavSyncProgress) => void;
+}): Promise<GitTreeBundleStats | null> {
+  const { client, remotePath, localRootDirUri, manifestUri, onProgress } = params;
+
+  if (manifestUri) {
+    const { files, deleted } = await localManifest(localRootDirUri, manifestUri, onProgress);
+    const changed = deleted.length > 0 || Array.from(files.values()).some((f) => f.change !== 'unchanged');
+    if (!changed) {
+      onProgress?.({ phase: 'done' });
+      return null;
+    }
+  }
+
+  onProgress?.({ phase: 'upload', current: 1, total: 1, path: remotePath });
+  const stats = await gitUploadTreeBundle({
+    localRepoDirUri: localRootDirUri,
+    ...client.request(remotePath),
+    excludeNames: Array.from(DEFAULT_EXCLUDE_DIRS),
+  });
+  if (manifestUri) await gitTreeManifestCommit({ localRepoDirUri: localRootDirUri, manifestUri });
+
+  onProgress?.({ phase: 'done' });
+  return stats;
+}
+
+/**
+ * Extracts the .tar.gz at `remotePath` into `localRootDirUri` as it downloads. With `manifestUri`,
+ * the result becomes the baseline for the next delta sync.
+ *
+ * The archive is extracted over the existing tree and nothing is removed: files deleted on the
+ * pushing side since an earlier pull stay here. Pull into an empty directory for an exact copy.
+ */
+export async function pullWebDavBundle(params: {
+  client: WebDavClient;
+  remotePath: string;
+  localRootDirUri: string;
+  manifestUri?: string;
+  onProgress?: (p: WebDavSyncProgress) => void;
+}): Promise<GitTreeBundleStats> {
+  const { client, remotePath, localRootDirUri, manifestUri, onProgress } = params;
+
+  onProgress?.({ phase: 'download', current: 1, total: 1, path: remotePath });
+  const stats = await gitDownloadTreeBundle({ localRepoDirUri: localRootDirUri, ...client.request(remotePath) });
+  if (manifestUri) {
+    await localManifest(localRootDirUri, manifestUri, onProgress);
+    await gitTreeManifestCommit({ localRepoDirUri: localRootDirUri, manifestUri });
+  }
+
+  onProgress?.({ phase: 'done' });
+  return stats;
+}
@@ -133,6 +133,11 @@ export class WebDavClient {
         return { etag };
     }
 
+    /** URL and auth headers for `path`, for transfers made natively. */
+    request(path: string): { url: string; headers: Record<string, string> } {
+        return { url: buildUrl(this.cfg, path), headers: authHeaders(this.auth) };
+    }
+
     async mkcol(path: string): Promise<void> {
         const url = buildUrl(this.cfg, path.endsWith('/') ? path : `${path}/`);
         const res = await fetch(url, {
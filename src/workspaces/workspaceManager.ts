@@ -1,8 +1,9 @@
 import * as FileSystem from 'expo-file-system/legacy';
 
-import { workspaceRoot } from './paths';
+import { workspaceRepoPath, workspaceRoot } from './paths';
 import { getActiveWorkspaceId, getWorkspace, initWorkspace, listWorkspaces, removeWorkspaceFromIndex, setActiveWorkspaceId, upsertWorkspace } from './store';
 import type { Workspace, WorkspaceId } from './types';
+import { gitPrefetchTouch, gitReleaseRepo, gitRequestMaintenance } from '@/src/git/nativeGit';
 import { uuidV4 } from '@/src/utils/uuid';
 
 export async function createWorkspace(params: {
@@ -38,6 +39,19 @@ export async function getActiveWorkspace(): Promise<Workspace | null> {
 
 export async function setActiveWorkspace(id: WorkspaceId | null) {
     await setActiveWorkspaceId(id);
+    if (!id) return;
+    const ws = await getWorkspace(id);
+    if (!ws?.git) return;
+    try {
+        await gitPrefetchTouch({
+            localRepoDirUri: workspaceRepoPath(id),
+            authRef: ws.git.authRef,
+            allowInsecure: ws.git.allowInsecure,
+        });
+        await gitRequestMaintenance({ localRepoDirUri: workspaceRepoPath(id) });
+    } catch {
+        // Prefetch and maintenance are optimizations; the native module may be unavailable (e.g. web).
+    }
 }
 
 export async function deleteWorkspace(id: WorkspaceId) {
@@ -45,6 +59,11 @@ export async function deleteWorkspace(id: WorkspaceId) {
     if (activeId === id) await setActiveWorkspaceId(null);
 
     await removeWorkspaceFromIndex(id);
+    try {
+        await gitReleaseRepo({ localRepoDirUri: workspaceRepoPath(id) });
+    } catch {
+        // Native module may be unavailable (e.g. web); nothing is cached then.
+    }
     await FileSystem.deleteAsync(workspaceRoot(id), { idempotent: true });
 }
 